@@ -0,0 +1,328 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * backoffmatch.c -- Backoff pattern matcher for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * The backoff patterns are grouped into buckets by the number of times
+ * in each pattern, because a host can only match a pattern with the
+ * same number of packets.  Each bucket holds the delta times of its
+ * patterns in one contiguous array, sorted on the delta of a single key
+ * packet.  A lookup finds the bucket, uses a binary search on the key
+ * delta to find the few patterns that could be within their fuzz of the
+ * host's times, and only compares those in full.
+ *
+ * Where several patterns match, the one whose times are closest to the
+ * host's times is chosen, with ties going to the pattern that comes
+ * first in the patterns file.  The match for a single time is the same
+ * as times_close_enough().
+ */
+
+#include "ike-scan.h"
+
+/*
+ *	pattern_close_enough -- Check a delta time against a pattern time
+ *
+ *	Inputs:
+ *
+ *	bt	The pattern time
+ *	delta	The observed delta time in microseconds
+ *	score	Incremented by the difference if the times are close enough
+ *
+ *	Returns:
+ *
+ *	Nonzero if the times are within the fuzz of each other.
+ *
+ *	This gives the same result as times_close_enough(), which truncates
+ *	the difference to whole milliseconds towards minus infinity.
+ */
+static int
+pattern_close_enough(const backoff_time *bt, IKE_INT64 delta,
+                     IKE_UINT64 *score) {
+   IKE_INT64 diff = bt->delta - delta;
+
+   if (diff < -(IKE_INT64)1000 * bt->fuzz ||
+       diff >= (IKE_INT64)1000 * (bt->fuzz + 1))
+      return 0;
+   *score += diff < 0 ? -diff : diff;
+   return 1;
+}
+
+static const backoff_bucket *sort_bucket;	/* Bucket being sorted */
+
+/*
+ *	bucket_key_cmp -- qsort comparison of patterns by key delta
+ *
+ *	The patterns are compared by the delta of the key packet in
+ *	sort_bucket, then by their order in the patterns file.
+ */
+static int
+bucket_key_cmp(const void *a, const void *b) {
+   const backoff_time *ta;
+   const backoff_time *tb;
+   unsigned pa = *(const unsigned *) a;
+   unsigned pb = *(const unsigned *) b;
+
+   ta = sort_bucket->times + pa * sort_bucket->num_times + sort_bucket->key;
+   tb = sort_bucket->times + pb * sort_bucket->num_times + sort_bucket->key;
+   if (ta->delta != tb->delta)
+      return ta->delta < tb->delta ? -1 : 1;
+   return pa < pb ? -1 : pa > pb;
+}
+
+/*
+ *	backoff_matcher_build -- Build a backoff matcher from a pattern list
+ *
+ *	Inputs:
+ *
+ *	patlist		The backoff patterns in file order
+ *
+ *	Returns:
+ *
+ *	A pointer to the new matcher.
+ *
+ *	The matcher refers to the pattern names in patlist, so patlist must
+ *	not be freed while the matcher is in use.
+ */
+backoff_matcher *
+backoff_matcher_build(const pattern_list *patlist) {
+   backoff_matcher *m;
+   backoff_bucket *bb;
+   const pattern_list *pl;
+   const pattern_entry_list *te;
+   backoff_time *times;
+   unsigned *order;
+   unsigned *pattern;
+   unsigned i;
+   unsigned j;
+   unsigned k;
+
+   m = Malloc(sizeof(backoff_matcher));
+   m->bucket = NULL;
+   m->num_buckets = 0;
+   m->num_patterns = 0;
+   for (pl=patlist; pl != NULL; pl=pl->next)
+      m->num_patterns++;
+   m->name = Malloc((m->num_patterns + 1) * sizeof(char *));
+/*
+ *	Count the patterns with each number of times, and make one bucket
+ *	for each number of times in increasing order.
+ */
+   for (pl=patlist, i=0; pl != NULL; pl=pl->next, i++) {
+      m->name[i] = pl->name;
+      if (pl->num_times == 0 || pl->recv_times == NULL)
+         continue;
+      for (j=0; j<m->num_buckets; j++) {
+         if (m->bucket[j].num_times >= pl->num_times)
+            break;
+      }
+      if (j == m->num_buckets || m->bucket[j].num_times != pl->num_times) {
+         m->bucket = Realloc(m->bucket,
+                             (m->num_buckets + 1) * sizeof(backoff_bucket));
+         memmove(m->bucket + j + 1, m->bucket + j,
+                 (m->num_buckets - j) * sizeof(backoff_bucket));
+         memset(m->bucket + j, '\0', sizeof(backoff_bucket));
+         m->bucket[j].num_times = pl->num_times;
+         m->num_buckets++;
+      }
+      m->bucket[j].num_patterns++;
+   }
+/*
+ *	Fill in each bucket with its patterns in file order, then sort them
+ *	on the key delta.  The key is the second packet, because the first
+ *	delta is always zero.
+ */
+   for (j=0; j<m->num_buckets; j++) {
+      bb = &m->bucket[j];
+      times = Malloc(bb->num_patterns * bb->num_times * sizeof(backoff_time));
+      pattern = Malloc(bb->num_patterns * sizeof(unsigned));
+      bb->key = bb->num_times > 1 ? 1 : 0;
+      bb->max_fuzz = 0;
+      k = 0;
+      for (pl=patlist, i=0; pl != NULL; pl=pl->next, i++) {
+         backoff_time *bt;
+
+         if (pl->num_times != bb->num_times || pl->recv_times == NULL)
+            continue;
+         bt = times + k * bb->num_times;
+         for (te=pl->recv_times; te != NULL; te=te->next, bt++) {
+            bt->delta = (IKE_INT64)1000000 * te->time.tv_sec +
+                        te->time.tv_usec;
+            bt->fuzz = te->fuzz;
+         }
+         if (times[k * bb->num_times + bb->key].fuzz > bb->max_fuzz)
+            bb->max_fuzz = times[k * bb->num_times + bb->key].fuzz;
+         pattern[k++] = i;
+      }
+      order = Malloc(bb->num_patterns * sizeof(unsigned));
+      for (k=0; k<bb->num_patterns; k++)
+         order[k] = k;
+      bb->times = times;
+      sort_bucket = bb;
+      qsort(order, bb->num_patterns, sizeof(unsigned), bucket_key_cmp);
+      bb->times = Malloc(bb->num_patterns * bb->num_times *
+                         sizeof(backoff_time));
+      bb->pattern = Malloc(bb->num_patterns * sizeof(unsigned));
+      for (k=0; k<bb->num_patterns; k++) {
+         memcpy(bb->times + k * bb->num_times,
+                times + order[k] * bb->num_times,
+                bb->num_times * sizeof(backoff_time));
+         bb->pattern[k] = pattern[order[k]];
+      }
+      free(order);
+      free(pattern);
+      free(times);
+   }
+
+   return m;
+}
+
+/*
+ *	backoff_matcher_match -- Find the best backoff pattern for a host
+ *
+ *	Inputs:
+ *
+ *	m		The backoff matcher
+ *	times		The host's receive times in microseconds
+ *	num_times	The number of receive times
+ *
+ *	Returns:
+ *
+ *	The name of the best matching pattern, or NULL if none match.
+ */
+const char *
+backoff_matcher_match(const backoff_matcher *m, const IKE_UINT64 *times,
+                      unsigned num_times) {
+   const backoff_bucket *bb = NULL;
+   const backoff_time *bt;
+   IKE_INT64 *delta;
+   IKE_INT64 low;
+   IKE_INT64 high;
+   IKE_UINT64 score;
+   IKE_UINT64 best_score = 0;
+   unsigned best = UINT_MAX;
+   unsigned lo;
+   unsigned hi;
+   unsigned mid;
+   unsigned i;
+   unsigned k;
+
+   if (m == NULL || num_times == 0)
+      return NULL;
+   lo = 0;
+   hi = m->num_buckets;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (m->bucket[mid].num_times < num_times) {
+         lo = mid + 1;
+      } else if (m->bucket[mid].num_times > num_times) {
+         hi = mid;
+      } else {
+         bb = &m->bucket[mid];
+         break;
+      }
+   }
+   if (bb == NULL)
+      return NULL;
+
+   delta = Malloc(num_times * sizeof(IKE_INT64));
+   delta[0] = 0;
+   for (i=1; i<num_times; i++)
+      delta[i] = (IKE_INT64) (times[i] - times[i-1]);
+/*
+ *	Only patterns whose key delta is within the largest key fuzz of the
+ *	host's key delta can match.  Find the first of them, then compare
+ *	each in full until the key delta is too large.
+ */
+   low = delta[bb->key] - (IKE_INT64)1000 * bb->max_fuzz;
+   high = delta[bb->key] + (IKE_INT64)1000 * (bb->max_fuzz + 1);
+   lo = 0;
+   hi = bb->num_patterns;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (bb->times[mid * bb->num_times + bb->key].delta < low)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   for (k=lo; k<bb->num_patterns; k++) {
+      bt = bb->times + k * bb->num_times;
+      if (bt[bb->key].delta >= high)
+         break;
+      score = 0;
+      for (i=0; i<num_times; i++) {
+         if (!pattern_close_enough(&bt[i], delta[i], &score))
+            break;
+      }
+      if (i < num_times)
+         continue;
+      if (best == UINT_MAX || score < best_score ||
+          (score == best_score && bb->pattern[k] < best)) {
+         best = bb->pattern[k];
+         best_score = score;
+      }
+   }
+   free(delta);
+
+   return best == UINT_MAX ? NULL : m->name[best];
+}
+
+/*
+ *	backoff_matcher_free -- Free a backoff matcher
+ *
+ *	Inputs:
+ *
+ *	m	The backoff matcher
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+backoff_matcher_free(backoff_matcher *m) {
+   unsigned j;
+
+   if (m == NULL)
+      return;
+   for (j=0; j<m->num_buckets; j++) {
+      free(m->bucket[j].times);
+      free(m->bucket[j].pattern);
+   }
+   free(m->bucket);
+   free(m->name);
+   free(m);
+}
@@ -0,0 +1,387 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-backoff -- Check and time the backoff pattern matcher
+ *
+ * Date:	16 October 2026
+ *
+ *	Load all of the patterns in ike-backoff-patterns in the same way as
+ *	add_pattern(), add NUM_RANDOM_PATTERNS random patterns, and build a
+ *	backoff matcher from them.  Make a set of test hosts with the exact
+ *	times of each pattern, with the times of each pattern moved by up to
+ *	one and a half times the fuzz, and with random times.  Check that the
+ *	matcher gives the same result as comparing the host with every
+ *	pattern using times_close_enough() and choosing the closest, and
+ *	compare the speed with the first match search that match_pattern()
+ *	used before the matcher.
+ */
+
+#include "ike-scan.h"
+#define NUM_RANDOM_PATTERNS 5000
+#define NUM_RANDOM_HOSTS 5000
+#define MAX_TIMES 16
+#define SPEED_PASSES 5
+
+typedef struct {
+   IKE_UINT64 times[MAX_TIMES];
+   unsigned num_times;
+} test_host;
+
+/*
+ *	add_test_pattern -- Add a pattern to the tail of a pattern list
+ */
+static void
+add_test_pattern(pattern_list ***tail, const char *name, const long *usec,
+                 const unsigned *fuzz, unsigned num_times) {
+   pattern_list *pe;
+   pattern_entry_list **tp;
+   pattern_entry_list *te;
+   unsigned i;
+
+   pe = Malloc(sizeof(pattern_list));
+   pe->name = dupstr(name);
+   pe->num_times = num_times;
+   pe->recv_times = NULL;
+   pe->next = NULL;
+   tp = &pe->recv_times;
+   for (i=0; i<num_times; i++) {
+      te = Malloc(sizeof(pattern_entry_list));
+      te->time.tv_sec = usec[i] / 1000000;
+      te->time.tv_usec = usec[i] % 1000000;
+      te->fuzz = fuzz[i];
+      te->next = NULL;
+      *tp = te;
+      tp = &te->next;
+   }
+   **tail = pe;
+   *tail = &pe->next;
+}
+
+/*
+ *	load_patterns -- Load the backoff patterns file
+ *
+ *	This parses each line in the same way as add_pattern(), using the
+ *	default fuzz where a time does not give one.
+ */
+static void
+load_patterns(const char *fn, pattern_list ***tail) {
+   char line[MAXLINE];
+   char *name;
+   char *endp;
+   long usec[MAX_TIMES];
+   unsigned fuzz[MAX_TIMES];
+   unsigned num_times;
+   unsigned scale;
+   FILE *fp;
+
+   if ((fp = fopen(fn, "r")) == NULL)
+      err_sys("fopen %s", fn);
+   while (fgets(line, MAXLINE, fp)) {
+      if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+         continue;
+      name = line;
+      if ((endp = strchr(line, '\t')) == NULL)
+         continue;
+      *endp++ = '\0';
+      num_times = 0;
+      while (*endp != '\0' && *endp != '\n' && *endp != '\r' &&
+             num_times < MAX_TIMES) {
+         while (*endp == '\t' || *endp == ' ')
+            endp++;
+         usec[num_times] = strtol(endp, &endp, 10) * 1000000;
+         if (*endp == '.') {
+            endp++;
+            for (scale=100000; isdigit((unsigned char) *endp); endp++) {
+               usec[num_times] += (*endp - '0') * scale;
+               scale /= 10;
+            }
+         }
+         if (*endp == '/') {
+            endp++;
+            fuzz[num_times] = strtol(endp, &endp, 10);
+         } else {
+            fuzz[num_times] = DEFAULT_PATTERN_FUZZ;
+         }
+         if (*endp == ',')
+            endp++;
+         num_times++;
+      }
+      if (num_times)
+         add_test_pattern(tail, name, usec, fuzz, num_times);
+   }
+   fclose(fp);
+}
+
+/*
+ *	pattern_score -- Compare a host with a pattern using times_close_enough
+ *
+ *	Returns 1 and sets *score to the total difference in microseconds if
+ *	every time is close enough, otherwise returns 0.
+ */
+static int
+pattern_score(const pattern_list *pl, const test_host *th, IKE_UINT64 *score) {
+   const pattern_entry_list *pp;
+   struct timeval recv_time;
+   struct timeval prev_time;
+   struct timeval diff;
+   IKE_INT64 d;
+   unsigned i;
+
+   if (pl->num_times != th->num_times)
+      return 0;
+   *score = 0;
+   diff.tv_sec = 0;
+   diff.tv_usec = 0;
+   for (pp=pl->recv_times, i=0; pp != NULL; pp=pp->next, i++) {
+      recv_time.tv_sec = th->times[i] / 1000000;
+      recv_time.tv_usec = th->times[i] % 1000000;
+      if (i > 0)
+         timeval_diff(&recv_time, &prev_time, &diff);
+      if (!times_close_enough((struct timeval *) &pp->time, &diff, pp->fuzz))
+         return 0;
+      d = (IKE_INT64)1000000 * (pp->time.tv_sec - diff.tv_sec) +
+          pp->time.tv_usec - diff.tv_usec;
+      *score += d < 0 ? -d : d;
+      prev_time = recv_time;
+   }
+   return 1;
+}
+
+/*
+ *	linear_best -- Find the closest matching pattern by linear search
+ */
+static const char *
+linear_best(const pattern_list *patlist, const test_host *th) {
+   const pattern_list *pl;
+   const char *best = NULL;
+   IKE_UINT64 best_score = 0;
+   IKE_UINT64 score;
+
+   for (pl=patlist; pl != NULL; pl=pl->next) {
+      if (pattern_score(pl, th, &score) && (best == NULL || score < best_score)) {
+         best = pl->name;
+         best_score = score;
+      }
+   }
+   return best;
+}
+
+/*
+ *	linear_first -- Find the first matching pattern by linear search
+ *
+ *	This is the search that match_pattern() performed before the
+ *	backoff matcher.
+ */
+static const char *
+linear_first(const pattern_list *patlist, const test_host *th) {
+   const pattern_list *pl;
+   IKE_UINT64 score;
+
+   for (pl=patlist; pl != NULL; pl=pl->next) {
+      if (pattern_score(pl, th, &score))
+         return pl->name;
+   }
+   return NULL;
+}
+
+/*
+ *	make_host -- Make a test host from a pattern
+ *
+ *	Each delta time is moved by a random amount of up to "jitter" times
+ *	the fuzz for that time.
+ */
+static void
+make_host(const pattern_list *pl, double jitter, test_host *th) {
+   const pattern_entry_list *pp;
+   IKE_INT64 t = 1000000000;
+   IKE_INT64 d;
+   unsigned i;
+
+   th->num_times = pl->num_times;
+   for (pp=pl->recv_times, i=0; pp != NULL; pp=pp->next, i++) {
+      d = (IKE_INT64)1000000 * pp->time.tv_sec + pp->time.tv_usec;
+      if (i > 0 && jitter > 0)
+         d += (IKE_INT64) ((genrand_res53() * 2 - 1) * jitter * 1000 *
+                           pp->fuzz);
+      if (d < 0)
+         d = 0;
+      t += d;
+      th->times[i] = t;
+   }
+}
+
+int
+main(void) {
+   pattern_list *patlist = NULL;
+   pattern_list **tail = &patlist;
+   pattern_list *pl;
+   backoff_matcher *m;
+   test_host *hosts;
+   long usec[MAX_TIMES];
+   unsigned fuzz[MAX_TIMES];
+   char name[MAXLINE];
+   char path[MAXLINE];
+   const char *srcdir;
+   const char *expected;
+   const char *got;
+   unsigned num_file;
+   unsigned num_patterns;
+   unsigned num_hosts;
+   unsigned max_hosts;
+   unsigned matched;
+   unsigned not_first;
+   unsigned bad;
+   unsigned pass;
+   unsigned i;
+   unsigned j;
+   IKE_UINT64 start_ns;
+   double matcher_seconds;
+   double linear_seconds;
+   int error=0;
+
+   if ((srcdir = getenv("srcdir")) == NULL)
+      srcdir = ".";
+   init_genrand(0);
+
+   snprintf(path, sizeof(path), "%s/ike-backoff-patterns", srcdir);
+   load_patterns(path, &tail);
+   num_file = 0;
+   for (pl=patlist; pl != NULL; pl=pl->next)
+      num_file++;
+   for (i=0; i<NUM_RANDOM_PATTERNS; i++) {
+      unsigned num_times = 2 + genrand_int32() % (MAX_TIMES - 2);
+
+      usec[0] = 0;
+      fuzz[0] = DEFAULT_PATTERN_FUZZ;
+      for (j=1; j<num_times; j++) {
+         usec[j] = 1000 * (genrand_int32() % 60000);
+         fuzz[j] = 50 + genrand_int32() % 1000;
+      }
+      snprintf(name, sizeof(name), "Random pattern %u", i);
+      add_test_pattern(&tail, name, usec, fuzz, num_times);
+   }
+   num_patterns = num_file + NUM_RANDOM_PATTERNS;
+   start_ns = monotonic_ns();
+   m = backoff_matcher_build(patlist);
+   printf("\nBuilt matcher for %u patterns in %.6f seconds (%u buckets)\n",
+          num_patterns, (monotonic_ns() - start_ns) / 1000000000.0,
+          m->num_buckets);
+
+   max_hosts = 3 * num_patterns + NUM_RANDOM_HOSTS;
+   hosts = Malloc(max_hosts * sizeof(test_host));
+   num_hosts = 0;
+   for (pl=patlist; pl != NULL; pl=pl->next) {
+      make_host(pl, 0, &hosts[num_hosts++]);
+      make_host(pl, 0.5, &hosts[num_hosts++]);
+      make_host(pl, 1.5, &hosts[num_hosts++]);
+   }
+   for (i=0; i<NUM_RANDOM_HOSTS; i++) {
+      hosts[num_hosts].num_times = 1 + genrand_int32() % MAX_TIMES;
+      hosts[num_hosts].times[0] = 1000000000;
+      for (j=1; j<hosts[num_hosts].num_times; j++)
+         hosts[num_hosts].times[j] = hosts[num_hosts].times[j-1] +
+                                     genrand_int32() % 60000000;
+      num_hosts++;
+   }
+
+   printf("\nChecking %u hosts...\n", num_hosts);
+   matched = 0;
+   not_first = 0;
+   bad = 0;
+   for (i=0; i<num_hosts; i++) {
+      expected = linear_best(patlist, &hosts[i]);
+      got = backoff_matcher_match(m, hosts[i].times, hosts[i].num_times);
+      if (expected) {
+         matched++;
+         if (expected != linear_first(patlist, &hosts[i]))
+            not_first++;
+      }
+      if (got != expected) {
+         if (bad++ < 10)
+            printf("host %u: expected %s, got %s\n", i,
+                   expected ? expected : "no match", got ? got : "no match");
+      }
+   }
+   printf("Same result as linear search:\t%u of %u\t", num_hosts - bad,
+          num_hosts);
+   if (bad) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Hosts matched:\t\t\t%u\t\t", matched);
+   if (matched < num_patterns) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Closer than the first match:\t%u\n", not_first);
+
+   printf("\nChecking backoff match speed...\n");
+   matched = 0;
+   start_ns = monotonic_ns();
+   for (pass=0; pass<SPEED_PASSES; pass++) {
+      for (i=0; i<num_hosts; i++) {
+         if (backoff_matcher_match(m, hosts[i].times, hosts[i].num_times))
+            matched++;
+      }
+   }
+   matcher_seconds = (monotonic_ns() - start_ns) / 1000000000.0;
+   start_ns = monotonic_ns();
+   for (i=0; i<num_hosts; i++) {
+      if (linear_first(patlist, &hosts[i]))
+         matched++;
+   }
+   linear_seconds = (monotonic_ns() - start_ns) / 1000000000.0;
+   printf("%u matcher lookups in %.6f seconds (%.0f per sec)\n",
+          SPEED_PASSES * num_hosts, matcher_seconds,
+          SPEED_PASSES * num_hosts / matcher_seconds);
+   printf("%u linear lookups in %.6f seconds (%.0f per sec)\n",
+          num_hosts, linear_seconds, num_hosts / linear_seconds);
+   if (matcher_seconds > 0)
+      printf("Matcher is %.0f times faster than linear search\n",
+             SPEED_PASSES * linear_seconds / matcher_seconds);
+
+   backoff_matcher_free(m);
+   free(hosts);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-cookie -- Check the initiator cookie index
+ *
+ * Date:	16 October 2026
+ *
+ *	Build a host list of NUM_HOSTS entries with cookies generated in the
+ *	same way as add_host(), and check that the cookie index finds every
+ *	entry and rejects cookies that are not in the list.  Remove every
+ *	other entry and check that the rest are still found.  Then compare the
+ *	lookup speed of the index with a backwards linear search through the
+ *	list, which is the baseline that the index is measured against.
+ *
+ *	Also check that stateless cookies give back the target address, and
+ *	that cookies which have been altered are rejected.
+ */
+
+#include "ike-scan.h"
+#include "hash_functions.h"
+#define NUM_HOSTS 1000000
+#define NUM_MISSES 100000
+#define INDEX_SPEED_ITERATIONS 1000000
+#define LINEAR_SPEED_ITERATIONS 200
+#define NUM_STATELESS 100000
+
+/*
+ *	linear_find -- Backwards linear search for a cookie
+ *
+ *	This is the baseline for the speed comparison, and is not used by
+ *	ike-scan.  The search starts at position "start" in the list.
+ */
+static host_entry *
+linear_find(host_entry **list, unsigned num_hosts, unsigned start,
+            const uint32_t *icookie) {
+   host_entry **he = list + start;
+   host_entry **p = he;
+
+   do {
+      if ((*p)->icookie[0] == icookie[0] && (*p)->icookie[1] == icookie[1])
+         return *p;
+      if (p == list)
+         p = list + (num_hosts-1);
+      else
+         p--;
+   } while (p != he);
+
+   return NULL;
+}
+
+int
+main(void) {
+   host_entry *helist;
+   host_entry **helistptr;
+   cookie_index ci = {NULL, 0, 0};
+   char str[MAXLINE];
+   uint32_t icookie[COOKIE_SIZE];
+   unsigned i;
+   unsigned pos;
+   unsigned found;
+   struct timeval start_time;
+   struct timeval end_time;
+   struct timeval elapsed_time;
+   double index_seconds;
+   double linear_seconds;
+   struct in_addr addr;
+   struct in_addr recovered;
+   unsigned bad;
+   int error=0;
+
+   init_genrand(0);
+   helist = Malloc(NUM_HOSTS * sizeof(host_entry));
+   helistptr = Malloc(NUM_HOSTS * sizeof(host_entry *));
+
+   printf("\nBuilding cookie index for %u hosts...\n", NUM_HOSTS);
+   Gettimeofday(&start_time);
+   for (i=0; i<NUM_HOSTS; i++) {
+      snprintf(str, sizeof(str), "0 0 %u 10.%u.%u.%u", i+1, (i>>16) & 0xff,
+               (i>>8) & 0xff, i & 0xff);
+      memcpy(helist[i].icookie, MD5((unsigned char *)str, strlen(str), NULL),
+             sizeof(helist[i].icookie));
+      helistptr[i] = &helist[i];
+      cookie_index_add(&ci, &helist[i]);
+   }
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   printf("%u entries added in %.6f seconds (%u slots)\n", NUM_HOSTS,
+          elapsed_time.tv_sec + (elapsed_time.tv_usec / 1000000.0),
+          ci.mask + 1);
+
+   printf("\nChecking cookie index lookups...\n");
+   found = 0;
+   for (i=0; i<NUM_HOSTS; i++) {
+      if (cookie_index_find(&ci, helist[i].icookie) == &helist[i])
+         found++;
+   }
+   printf("Present cookies:\t%u of %u found\t", found, NUM_HOSTS);
+   if (found != NUM_HOSTS) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   found = 0;
+   for (i=0; i<NUM_MISSES; i++) {
+      snprintf(str, sizeof(str), "miss %u", i);
+      memcpy(icookie, MD5((unsigned char *)str, strlen(str), NULL),
+             sizeof(icookie));
+      if (cookie_index_find(&ci, icookie) != NULL)
+         found++;
+   }
+   printf("Absent cookies:\t\t%u of %u found\t", found, NUM_MISSES);
+   if (found != 0) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   printf("\nChecking cookie lookup speed...\n");
+   found = 0;
+   Gettimeofday(&start_time);
+   for (i=0; i<INDEX_SPEED_ITERATIONS; i++) {
+      pos = genrand_int32() % NUM_HOSTS;
+      if (cookie_index_find(&ci, helist[pos].icookie))
+         found++;
+   }
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   index_seconds = (elapsed_time.tv_sec +
+                    (elapsed_time.tv_usec / 1000000.0)) /
+                   INDEX_SPEED_ITERATIONS;
+   printf("%u index lookups in %.6f seconds (%.2f per sec)\n",
+          INDEX_SPEED_ITERATIONS, index_seconds * INDEX_SPEED_ITERATIONS,
+          1.0 / index_seconds);
+
+   Gettimeofday(&start_time);
+   for (i=0; i<LINEAR_SPEED_ITERATIONS; i++) {
+      pos = genrand_int32() % NUM_HOSTS;
+      if (linear_find(helistptr, NUM_HOSTS, genrand_int32() % NUM_HOSTS,
+                      helist[pos].icookie))
+         found++;
+   }
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   linear_seconds = (elapsed_time.tv_sec +
+                     (elapsed_time.tv_usec / 1000000.0)) /
+                    LINEAR_SPEED_ITERATIONS;
+   printf("%u linear lookups in %.6f seconds (%.2f per sec)\n",
+          LINEAR_SPEED_ITERATIONS, linear_seconds * LINEAR_SPEED_ITERATIONS,
+          1.0 / linear_seconds);
+   if (index_seconds > 0)
+      printf("Index lookup is %.0f times faster than linear search\n",
+             linear_seconds / index_seconds);
+   if (found != INDEX_SPEED_ITERATIONS + LINEAR_SPEED_ITERATIONS) {
+      printf("FAIL (%u lookups did not find their entry)\n",
+             INDEX_SPEED_ITERATIONS + LINEAR_SPEED_ITERATIONS - found);
+      error++;
+   }
+
+   printf("\nChecking cookie index removal...\n");
+   for (i=0; i<NUM_HOSTS; i+=2)
+      cookie_index_remove(&ci, &helist[i]);
+   found = 0;
+   bad = 0;
+   for (i=0; i<NUM_HOSTS; i++) {
+      if (cookie_index_find(&ci, helist[i].icookie) == &helist[i]) {
+         if (i % 2)
+            found++;
+         else
+            bad++;
+      }
+   }
+   printf("Remaining cookies:\t%u of %u found\t", found, NUM_HOSTS / 2);
+   if (found != NUM_HOSTS / 2 || ci.count != NUM_HOSTS / 2) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Removed cookies:\t%u of %u found\t", bad, NUM_HOSTS / 2);
+   if (bad != 0) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   printf("\nChecking stateless cookies...\n");
+   stateless_cookie_init(500);
+   found = 0;
+   bad = 0;
+   for (i=0; i<NUM_STATELESS; i++) {
+      addr.s_addr = htonl(0x0a000000 + i);
+      stateless_cookie(icookie, addr);
+      if (stateless_cookie_check(icookie, &recovered) &&
+          recovered.s_addr == addr.s_addr)
+         found++;
+      icookie[0] ^= htonl(1);
+      if (stateless_cookie_check(icookie, &recovered))
+         bad++;
+      icookie[0] ^= htonl(1);
+      icookie[1] ^= htonl(1);
+      if (stateless_cookie_check(icookie, &recovered))
+         bad++;
+   }
+   printf("Valid cookies:\t\t%u of %u recovered\t", found, NUM_STATELESS);
+   if (found != NUM_STATELESS) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Altered cookies:\t%u of %u accepted\t", bad, 2*NUM_STATELESS);
+   if (bad != 0) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   free(ci.slot);
+   free(helistptr);
+   free(helist);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-format -- Check and time the formatting of decoded packets
+ *
+ * Date:	16 October 2026
+ *
+ *	Decode each of the pkt-*.dat packet files with the same steps as
+ *	display_packet() in ike-scan, appending the description of each
+ *	payload to one output buffer that is reset for each packet.  The first
+ *	pass grows the buffer to fit the longest description.  Then decode
+ *	the packets DECODE_PASSES more times, and check that every
+ *	description is the same as in the first pass and that the buffer was
+ *	not reallocated, which shows that decoding does not allocate memory
+ *	once the buffer has grown.  The number of packets decoded per second
+ *	is displayed as a benchmark.
+ *
+ *	The output of the decoders is checked against known responses by the
+ *	check-decode script.  Vendor ID patterns are not loaded, so that this
+ *	only times the decode and formatting.
+ *
+ *	Also check that the output buffer functions give the same strings as
+ *	hexstring(), printable() and make_message().
+ */
+
+#include "ike-scan.h"
+#define DECODE_PASSES 20000
+#define MAX_PACKET 4096
+
+psk_crack psk_values;	/* Referenced by isakmp.c */
+int mbz_value = 0;	/* Referenced by isakmp.c */
+extern const id_name_map payload_map[];
+
+static const char *packet_files[] = {
+   "pkt-aggr-cert-response.dat",
+   "pkt-aggr-mode-response.dat",
+   "pkt-aggressive.dat",
+   "pkt-checkpoint-notify.dat",
+   "pkt-custom-proposal.dat",
+   "pkt-default-proposal.dat",
+   "pkt-ikev2.dat",
+   "pkt-main-mode-response.dat",
+   "pkt-main-natt-response.dat",
+   "pkt-malformed.dat",
+   "pkt-notify-response.dat",
+   "pkt-single-trans.dat",
+   "pkt-v2-notify-response.dat",
+   "pkt-v2-sainit-response.dat",
+};
+#define NUM_PACKETS (sizeof(packet_files)/sizeof(packet_files[0]))
+
+/*
+ *	decode_packet -- Decode a packet in the same way as display_packet()
+ */
+static void
+decode_packet(unsigned char *packet_in, size_t n, out_buf *msg,
+              out_buf *hdr_descr) {
+   size_t bytes_left = n;
+   unsigned next;
+   unsigned type;
+   unsigned char *pkt_ptr;
+   unsigned char *payload_ptr;
+
+   out_reset(msg);
+   out_append(msg, "127.0.0.1\t");
+   pkt_ptr = process_isakmp_hdr(packet_in, &bytes_left, &next, &type,
+                                hdr_descr);
+   if (!bytes_left) {
+      out_printf(msg, "Short or malformed ISAKMP packet returned: %d bytes\n",
+                 (int) n);
+      return;
+   }
+   switch (next) {
+      case ISAKMP_NEXT_SA:
+         process_sa(pkt_ptr, bytes_left, type, 0, 0, hdr_descr->buf, msg);
+         break;
+      case ISAKMP_NEXT_V2_SA:
+         process_sa2(pkt_ptr, bytes_left, type, 0, 0, hdr_descr->buf, msg);
+         break;
+      case ISAKMP_NEXT_N:
+         process_notify(pkt_ptr, bytes_left, 0, 0, hdr_descr->buf, msg);
+         break;
+      case ISAKMP_NEXT_V2_N:
+         process_notify2(pkt_ptr, bytes_left, 0, 0, hdr_descr->buf, msg);
+         break;
+      default:
+         out_printf(msg, "Unexpected IKE payload returned: %s",
+                    id_to_name(next, payload_map));
+         break;
+   }
+   pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
+   while (bytes_left) {
+      payload_ptr = clone_payload(pkt_ptr, bytes_left);
+      out_append(msg, " ");
+      switch (next) {
+         case ISAKMP_NEXT_VID:
+         case ISAKMP_NEXT_V2_VID:
+            process_vid(payload_ptr, bytes_left, NULL, msg);
+            break;
+         case ISAKMP_NEXT_ID:
+            process_id(payload_ptr, bytes_left, msg);
+            break;
+         case ISAKMP_NEXT_CERT:
+         case ISAKMP_NEXT_CR:
+            process_cert(payload_ptr, bytes_left, next, msg);
+            break;
+         case ISAKMP_NEXT_D:
+            process_delete(payload_ptr, bytes_left, msg);
+            break;
+         case ISAKMP_NEXT_N:
+            process_notification(payload_ptr, bytes_left, msg);
+            break;
+         default:
+            process_generic(payload_ptr, bytes_left, next, msg);
+            break;
+      }
+      pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
+   }
+   out_append(msg, "\n");
+}
+
+/*
+ *	check_string -- Compare an output buffer with an expected string
+ */
+static int
+check_string(const char *label, const out_buf *ob, char *expected) {
+   int ok;
+
+   ok = strlen(ob->buf) == ob->len && strcmp(ob->buf, expected) == 0;
+   printf("%s\t%s\n", label, ok ? "ok" : "FAIL");
+   free(expected);
+   return !ok;
+}
+
+int
+main(void) {
+   unsigned char *packet[NUM_PACKETS];
+   size_t packet_len[NUM_PACKETS];
+   char *expected[NUM_PACKETS];
+   out_buf msg = {NULL, 0, 0};
+   out_buf hdr_descr = {NULL, 0, 0};
+   out_buf ob = {NULL, 0, 0};
+   unsigned char data[256];
+   char long_str[1000];
+   char path[MAXLINE];
+   const char *srcdir;
+   char *buf;
+   size_t size;
+   size_t total_len;
+   unsigned pass;
+   unsigned i;
+   unsigned bad;
+   int fd;
+   ssize_t got;
+   IKE_UINT64 start_ns;
+   double elapsed;
+   int error=0;
+
+   if ((srcdir = getenv("srcdir")) == NULL)
+      srcdir = ".";
+
+   printf("\nChecking output buffer functions...\n");
+   for (i=0; i<sizeof(data); i++)
+      data[i] = i;
+   memset(long_str, 'x', sizeof(long_str) - 1);
+   long_str[sizeof(long_str) - 1] = '\0';
+   out_reset(&ob);
+   out_hex(&ob, data, sizeof(data));
+   error += check_string("Hex string:\t", &ob, hexstring(data, sizeof(data)));
+   out_reset(&ob);
+   out_printable(&ob, data, sizeof(data));
+   error += check_string("Printable string:", &ob,
+                         printable(data, sizeof(data)));
+   out_reset(&ob);
+   for (i=0; i<100; i++)
+      out_printf(&ob, "%u %s,", i, i % 10 ? "" : long_str);
+   buf = make_message("%s", ob.buf);
+   out_reset(&ob);
+   for (i=0; i<100; i++) {
+      out_printf(&ob, "%u ", i);
+      if (i % 10 == 0)
+         out_append(&ob, long_str);
+      out_append(&ob, ",");
+   }
+   error += check_string("Formatted string:", &ob, buf);
+   free(ob.buf);
+
+   printf("\nDecoding %u packet files...\n", (unsigned) NUM_PACKETS);
+   for (i=0; i<NUM_PACKETS; i++) {
+      snprintf(path, sizeof(path), "%s/%s", srcdir, packet_files[i]);
+      if ((fd = open(path, O_RDONLY)) < 0)
+         err_sys("open %s", path);
+      packet[i] = Malloc(MAX_PACKET);
+      if ((got = read(fd, packet[i], MAX_PACKET)) < 0)
+         err_sys("read %s", path);
+      close(fd);
+      packet_len[i] = got;
+      decode_packet(packet[i], packet_len[i], &msg, &hdr_descr);
+      expected[i] = dupstr(msg.buf);
+   }
+   buf = msg.buf;
+   size = msg.size;
+
+   bad = 0;
+   total_len = 0;
+   start_ns = monotonic_ns();
+   for (pass=0; pass<DECODE_PASSES; pass++) {
+      for (i=0; i<NUM_PACKETS; i++) {
+         decode_packet(packet[i], packet_len[i], &msg, &hdr_descr);
+         total_len += msg.len;
+         if (pass == 0 && strcmp(msg.buf, expected[i]) != 0)
+            bad++;
+      }
+   }
+   elapsed = (monotonic_ns() - start_ns) / 1000000000.0;
+   printf("%u packets decoded in %.3f seconds (%.0f per sec, %.1f MB/s of text)\n",
+          DECODE_PASSES * (unsigned) NUM_PACKETS, elapsed,
+          DECODE_PASSES * NUM_PACKETS / elapsed, total_len / elapsed / 1e6);
+   printf("Descriptions match first pass:\t");
+   if (bad) {
+      printf("FAIL (%u differ)\n", bad);
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Output buffer not reallocated:\t");
+   if (msg.buf != buf || msg.size != size) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   for (i=0; i<NUM_PACKETS; i++) {
+      free(packet[i]);
+      free(expected[i]);
+   }
+   free(msg.buf);
+   free(hdr_descr.buf);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
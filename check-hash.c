@@ -53,11 +53,17 @@
  *	f) HMAC-SHA1 PSK cracking speed
  *	g) Raw MD5 hash speed using 8-byte input
  *	h) Raw SHA1 hash speed using 8-byte input
+ *	i) Multi-buffer MD5, SHA1, HMAC-MD5 and HMAC-SHA1 against the scalar
+ *	   functions for each kernel that the CPU supports, and HMAC-MD5 speed
  */
 
 #include "ike-scan.h"
 #include "hash_functions.h"
+#include "mbhash.h"
 #define NUM_HMAC_TESTS 1
+#define NUM_MB_TESTS 2000
+#define MB_KEY_MAX 100		/* Longest random key + 1 */
+#define MB_TEXT_MAX 400		/* Longest random message + 1 */
 #define HMAC_SPEED_ITERATIONS 100000
 #define HASH_SPEED_ITERATIONS 500000
 
@@ -224,6 +230,162 @@ main(void) {
       }
    }
 
+/*
+ *	Check that precomputed HMAC key state gives the same result, and can
+ *	be used for more than one message.
+ */
+   printf("\nChecking HMAC key state reuse...\n");
+   do {
+      hmac_md5_ctx md5_key;
+      hmac_sha1_ctx sha1_key;
+      unsigned char md[20];
+      const char *actual;
+
+      hmac_md5_init(&md5_key, hmac_md5_tests[0].key, hmac_md5_tests[0].key_len);
+      hmac_sha1_init(&sha1_key, hmac_sha1_tests[0].key,
+                     hmac_sha1_tests[0].key_len);
+      for (i=0; i<2; i++) {
+         printf("HMAC-MD5 pass %d\t\t", i+1);
+         actual = hexstring(hmac_md5_final(&md5_key, hmac_md5_tests[0].data,
+                                           hmac_md5_tests[0].data_len, md), 16);
+         if (strcmp(actual, hmac_md5_tests[0].digest)) {
+            error++;
+            printf("FAIL (expected %s, got %s)\n", hmac_md5_tests[0].digest,
+                   actual);
+         } else {
+            printf("ok\n");
+         }
+         printf("HMAC-SHA1 pass %d\t", i+1);
+         actual = hexstring(hmac_sha1_final(&sha1_key, hmac_sha1_tests[0].data,
+                                            hmac_sha1_tests[0].data_len, md),
+                            20);
+         if (strcmp(actual, hmac_sha1_tests[0].digest)) {
+            error++;
+            printf("FAIL (expected %s, got %s)\n", hmac_sha1_tests[0].digest,
+                   actual);
+         } else {
+            printf("ok\n");
+         }
+      }
+   } while (0);
+
+/*
+ *	Check each multi-buffer kernel that this CPU supports against the
+ *	scalar HMAC functions, using random keys and messages.  Some of the
+ *	keys are longer than the 64-byte block, and the message lengths
+ *	cover the cases where the padding needs an extra block.
+ */
+   printf("\nChecking multi-buffer HMAC kernels...\n");
+   do {
+      const mb_kernel *kernels;
+      unsigned num_kernels;
+      unsigned kn;
+      unsigned test;
+      unsigned j;
+      unsigned n;
+      unsigned char keys[MB_MAX_LANES][MB_KEY_MAX];
+      const unsigned char *key_ptr[MB_MAX_LANES];
+      size_t key_len[MB_MAX_LANES];
+      unsigned char text[MB_TEXT_MAX];
+      size_t text_len;
+      unsigned char md[MB_MAX_LANES][20];
+      unsigned char *md_ptr[MB_MAX_LANES];
+      unsigned char expected[20];
+      mb_hmac_ctx hc;
+      unsigned bad;
+      struct timeval start_time;
+      struct timeval end_time;
+      struct timeval elapsed_time;
+      double elapsed_seconds;
+
+      init_genrand(0);
+      kernels = mb_kernels(&num_kernels);
+      for (j=0; j<MB_MAX_LANES; j++) {
+         key_ptr[j] = keys[j];
+         md_ptr[j] = md[j];
+      }
+      for (kn=0; kn<num_kernels; kn++) {
+         const mb_kernel *k = &kernels[kn];
+
+         bad = 0;
+         for (test=0; test<NUM_MB_TESTS; test++) {
+            n = 1 + genrand_int32() % k->lanes;
+            for (j=0; j<n; j++) {
+               key_len[j] = genrand_int32() % MB_KEY_MAX;
+               for (i=0; i<(int)key_len[j]; i++)
+                  keys[j][i] = genrand_int32();
+            }
+            text_len = genrand_int32() % MB_TEXT_MAX;
+            for (i=0; i<(int)text_len; i++)
+               text[i] = genrand_int32();
+            mb_hmac_init(k, MB_MD5, &hc, key_ptr, key_len, n);
+            mb_hmac_final(k, MB_MD5, &hc, text, text_len, md_ptr, n);
+            for (j=0; j<n; j++) {
+               hmac_md5(text, text_len, keys[j], key_len[j], expected);
+               if (memcmp(md[j], expected, 16))
+                  bad++;
+            }
+            mb_hmac_init(k, MB_SHA1, &hc, key_ptr, key_len, n);
+            mb_hmac_final(k, MB_SHA1, &hc, text, text_len, md_ptr, n);
+            for (j=0; j<n; j++) {
+               hmac_sha1(text, text_len, keys[j], key_len[j], expected);
+               if (memcmp(md[j], expected, 20))
+                  bad++;
+            }
+            mb_hash(k, MB_MD5, key_ptr, key_len, md_ptr, n);
+            for (j=0; j<n; j++) {
+               if (memcmp(md[j], MD5(keys[j], key_len[j], expected), 16))
+                  bad++;
+            }
+            mb_hash(k, MB_SHA1, key_ptr, key_len, md_ptr, n);
+            for (j=0; j<n; j++) {
+               if (memcmp(md[j], SHA1(keys[j], key_len[j], expected), 20))
+                  bad++;
+            }
+         }
+         printf("%s (%u lanes)\t", k->name, k->lanes);
+         if (bad) {
+            error++;
+            printf("FAIL (%u wrong digests)\n", bad);
+         } else {
+            printf("ok\n");
+         }
+      }
+/*
+ *	Compare the speed of each kernel with the scalar functions, hashing
+ *	a message the size of a typical HASH_R input with a new key each time.
+ */
+      text_len = 340;
+      Gettimeofday(&start_time);
+      for (i=0; i<HMAC_SPEED_ITERATIONS; i++)
+         hmac_md5(text, text_len, keys[0], 16, md[0]);
+      Gettimeofday(&end_time);
+      timeval_diff(&end_time, &start_time, &elapsed_time);
+      elapsed_seconds = elapsed_time.tv_sec +
+                        (elapsed_time.tv_usec / 1000000.0);
+      printf("Scalar: %u HMAC-MD5 in %.6f seconds (%.2f per sec)\n",
+             HMAC_SPEED_ITERATIONS, elapsed_seconds,
+             HMAC_SPEED_ITERATIONS/elapsed_seconds);
+      for (j=0; j<MB_MAX_LANES; j++)
+         key_len[j] = 16;
+      for (kn=0; kn<num_kernels; kn++) {
+         const mb_kernel *k = &kernels[kn];
+
+         Gettimeofday(&start_time);
+         for (i=0; i<HMAC_SPEED_ITERATIONS; i+=k->lanes) {
+            mb_hmac_init(k, MB_MD5, &hc, key_ptr, key_len, k->lanes);
+            mb_hmac_final(k, MB_MD5, &hc, text, text_len, md_ptr, k->lanes);
+         }
+         Gettimeofday(&end_time);
+         timeval_diff(&end_time, &start_time, &elapsed_time);
+         elapsed_seconds = elapsed_time.tv_sec +
+                           (elapsed_time.tv_usec / 1000000.0);
+         printf("%s: %u HMAC-MD5 in %.6f seconds (%.2f per sec)\n",
+                k->name, HMAC_SPEED_ITERATIONS, elapsed_seconds,
+                HMAC_SPEED_ITERATIONS/elapsed_seconds);
+      }
+   } while (0);
+
    printf("\nChecking HMAC-MD5 PSK cracking speed...\n");
    do {
 /*
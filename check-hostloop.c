@@ -0,0 +1,267 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-hostloop -- Check and time the send loop over a large host list
+ *
+ * Date:	16 October 2026
+ *
+ *	Allocate NUM_HOSTS host entries from a pool, add them to a send
+ *	schedule and a cookie index, and then run the same steps on them as
+ *	the send loop in ike-scan: take the host that is due first, send to it
+ *	and schedule its next retry with the timeout backed off, until every
+ *	host has been sent RETRY packets.  One host in RESPONSE_RATE responds
+ *	after each send, which is a cookie lookup followed by the removal of
+ *	the host.
+ *
+ *	Check that the hosts are taken in order of due time, that every
+ *	cookie lookup finds its host, and that every host is either sent RETRY
+ *	packets or responds.  The number of loop iterations per second is
+ *	displayed as a benchmark of the host entry layout.
+ *
+ *	Then add RECV_PER_HOST receive times to each of NUM_RECV_HOSTS hosts
+ *	in turn, as happens when many hosts are being fingerprinted with
+ *	--showbackoff, and check that every host gives back its own times in
+ *	order, and that the receive time blocks are reused after the hosts
+ *	are freed.
+ */
+
+#include "ike-scan.h"
+
+#define NUM_HOSTS 1000000
+#define RETRY 3
+#define TIMEOUT 500000			/* Initial timeout in us */
+#define BACKOFF 1.5
+#define RESPONSE_RATE 7			/* One host in this many responds */
+#define NUM_RECV_HOSTS 10000
+#define RECV_PER_HOST 40
+
+/*
+ *	count_free_times -- Return the number of unused receive time blocks
+ */
+static unsigned
+count_free_times(const host_pool *pool) {
+   const time_block *tb;
+   unsigned count = 0;
+
+   for (tb = pool->free_times; tb != NULL; tb = tb->next)
+      count++;
+   return count;
+}
+
+/*
+ *	add_recv_times -- Add RECV_PER_HOST receive times to each host
+ *
+ *	Returns the number of hosts that do not give back the right times.
+ */
+static unsigned
+add_recv_times(host_pool *pool, host_entry **host) {
+   IKE_UINT64 times[RECV_PER_HOST];
+   unsigned i;
+   unsigned j;
+   unsigned bad = 0;
+
+   for (i=0; i<NUM_RECV_HOSTS; i++)
+      host[i] = host_alloc(pool);
+   for (j=0; j<RECV_PER_HOST; j++) {
+      for (i=0; i<NUM_RECV_HOSTS; i++)
+         host_add_recv_time(pool, host[i], (IKE_UINT64)i * 1000 + j);
+   }
+   for (i=0; i<NUM_RECV_HOSTS; i++) {
+      if (host[i]->info->num_recv != RECV_PER_HOST) {
+         bad++;
+         continue;
+      }
+      host_recv_times(host[i], times);
+      for (j=0; j<RECV_PER_HOST; j++) {
+         if (times[j] != (IKE_UINT64)i * 1000 + j) {
+            bad++;
+            break;
+         }
+      }
+   }
+   for (i=0; i<NUM_RECV_HOSTS; i++)
+      host_free(pool, host[i]);
+
+   return bad;
+}
+
+int
+main(void) {
+   host_pool pool;
+   host_schedule sched;
+   cookie_index ci;
+   host_entry **host;
+   host_entry *he;
+   host_entry *found;
+   IKE_UINT64 due;
+   IKE_UINT64 last_due = 0;
+   unsigned i;
+   unsigned iterations = 0;
+   unsigned responses = 0;
+   unsigned timeouts = 0;
+   unsigned out_of_order = 0;
+   unsigned not_found = 0;
+   unsigned bad;
+   unsigned free_blocks;
+   struct timeval start_time;
+   struct timeval end_time;
+   struct timeval elapsed_time;
+   double seconds;
+   int error=0;
+
+   init_genrand(0);
+   memset(&pool, '\0', sizeof(pool));
+   memset(&sched, '\0', sizeof(sched));
+   memset(&ci, '\0', sizeof(ci));
+   host = Malloc(NUM_HOSTS * sizeof(host_entry *));
+
+   printf("\nAdding %u hosts...\n", NUM_HOSTS);
+   for (i=0; i<NUM_HOSTS; i++) {
+      he = host_alloc(&pool);
+      he->addr.s_addr = htonl(0x0a000000 + i);
+      he->icookie[0] = genrand_int32();
+      he->icookie[1] = genrand_int32();
+      he->timeout = TIMEOUT;
+      he->num_sent = 0;
+      he->sched_pos = 0;
+      he->live = 1;
+      he->info->n = i + 1;
+      cookie_index_add(&ci, he);
+      sched_add(&sched, he, i);
+      host[i] = he;
+   }
+   printf("host_entry is %u bytes, host_info is %u bytes\n",
+          (unsigned) sizeof(host_entry), (unsigned) sizeof(host_info));
+
+   printf("\nRunning the send loop...\n");
+   Gettimeofday(&start_time);
+   while ((he = sched_first(&sched, &due)) != NULL) {
+      iterations++;
+      if (due < last_due)
+         out_of_order++;
+      last_due = due;
+      sched_remove(&sched, he);
+      if (he->num_sent >= RETRY) {
+         he->live = 0;
+         timeouts++;
+         cookie_index_remove(&ci, he);
+         host_free(&pool, he);
+         continue;
+      }
+      if (he->num_sent)
+         he->timeout *= BACKOFF;
+      he->num_sent++;
+      he->last_send_us = due;
+      sched_add(&sched, he, he->last_send_us + he->timeout);
+/*
+ *	Simulate a response from a host that has been sent to.  The host is
+ *	chosen from the cookie, as it is when a packet is received.
+ */
+      if (genrand_int32() % RESPONSE_RATE == 0) {
+         found = cookie_index_find(&ci, he->icookie);
+         if (found != he) {
+            not_found++;
+            continue;
+         }
+         found->live = 0;
+         responses++;
+         sched_remove(&sched, found);
+         cookie_index_remove(&ci, found);
+         host_free(&pool, found);
+      }
+   }
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   seconds = elapsed_time.tv_sec + (elapsed_time.tv_usec / 1000000.0);
+   printf("%u loop iterations in %.6f seconds (%.0f per sec)\n",
+          iterations, seconds, seconds > 0 ? iterations / seconds : 0.0);
+
+   printf("Hosts in order of due time:\t%u out of order\t", out_of_order);
+   if (out_of_order) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Cookie lookups:\t\t\t%u not found\t", not_found);
+   if (not_found) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Hosts finished:\t\t\t%u of %u\t", responses + timeouts, NUM_HOSTS);
+   if (responses + timeouts != NUM_HOSTS || ci.count != 0 ||
+       pool.num_free != pool.num_chunks * REALLOC_COUNT) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   printf("\nChecking receive times...\n");
+   Gettimeofday(&start_time);
+   bad = add_recv_times(&pool, host);
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   seconds = elapsed_time.tv_sec + (elapsed_time.tv_usec / 1000000.0);
+   printf("%u receive times added in %.6f seconds\n",
+          NUM_RECV_HOSTS * RECV_PER_HOST, seconds);
+   printf("Times for each host:\t\t%u hosts wrong\t", bad);
+   if (bad) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   free_blocks = count_free_times(&pool);
+   bad = add_recv_times(&pool, host);
+   printf("Blocks reused:\t\t\t%u of %u free\t", count_free_times(&pool),
+          free_blocks);
+   if (bad || count_free_times(&pool) != free_blocks) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   free(host);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-output -- Check the result output stage
+ *
+ * Date:	16 October 2026
+ *
+ *	Start the output stage writing to a pipe, and queue NUM_RESULTS
+ *	results while the reader of the pipe is stalled for STALL_MS, as
+ *	happens when ike-scan's output is piped to a slow program.  Check that
+ *	no call to output_write() waited for the reader, that is none took as
+ *	long as MAX_WRITE_MS, and that the reader gets every result once and
+ *	in order after output_finish().
+ */
+
+#include "ike-scan.h"
+#define NUM_RESULTS 300000
+#define STALL_MS 500
+#define MAX_WRITE_MS 100
+#define RESULT_FORMAT "10.%u.%u.%u\tMain Mode Handshake returned %u\n"
+
+#if defined(HAVE_THREADS) && defined(HAVE_ATOMIC_BUILTINS)
+static int pipe_fd[2];
+static unsigned results_read;
+static unsigned results_bad;
+
+/*
+ *	reader -- Read the results from the pipe after a delay
+ */
+static void *
+reader(void *arg) {
+   char buf[65536];
+   char line[MAXLINE];
+   char expected[MAXLINE];
+   size_t line_len = 0;
+   ssize_t n;
+   ssize_t i;
+   unsigned r;
+
+   event_sleep(monotonic_ns() + (IKE_UINT64)STALL_MS * 1000000);
+   while ((n = read(pipe_fd[0], buf, sizeof(buf))) != 0) {
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         err_sys("read");
+      }
+      for (i=0; i<n; i++) {
+         if (line_len < sizeof(line) - 1)
+            line[line_len++] = buf[i];
+         if (buf[i] != '\n')
+            continue;
+         line[line_len] = '\0';
+         r = results_read++;
+         snprintf(expected, sizeof(expected), RESULT_FORMAT, (r >> 16) & 0xff,
+                  (r >> 8) & 0xff, r & 0xff, r);
+         if (strcmp(line, expected) != 0)
+            results_bad++;
+         line_len = 0;
+      }
+   }
+   if (line_len)
+      results_bad++;
+   return arg;
+}
+
+int
+main(void) {
+   pthread_t reader_thread;
+   out_buf result = {NULL, 0, 0};
+   IKE_UINT64 start_ns;
+   IKE_UINT64 write_ns;
+   IKE_UINT64 max_write_ns = 0;
+   double elapsed;
+   unsigned i;
+   int error=0;
+
+   if ((pipe(pipe_fd)) != 0)
+      err_sys("pipe");
+   if ((pthread_create(&reader_thread, NULL, reader, NULL)) != 0)
+      err_msg("ERROR: pthread_create failed");
+
+   printf("\nQueueing %u results with the reader stalled for %u ms...\n",
+          NUM_RESULTS, STALL_MS);
+   output_init(pipe_fd[1]);
+   start_ns = monotonic_ns();
+   for (i=0; i<NUM_RESULTS; i++) {
+      out_reset(&result);
+      out_printf(&result, RESULT_FORMAT, (i >> 16) & 0xff, (i >> 8) & 0xff,
+                 i & 0xff, i);
+      write_ns = monotonic_ns();
+      output_write(result.buf, result.len);
+      write_ns = monotonic_ns() - write_ns;
+      if (write_ns > max_write_ns)
+         max_write_ns = write_ns;
+      if (i % 64 == 0)
+         output_poll();
+   }
+   elapsed = (monotonic_ns() - start_ns) / 1000000000.0;
+   printf("%u results queued in %.3f seconds (%.0f per sec)\n", NUM_RESULTS,
+          elapsed, NUM_RESULTS / elapsed);
+   printf("Longest output_write():\t%.3f ms\t", max_write_ns / 1000000.0);
+   if (max_write_ns >= (IKE_UINT64)MAX_WRITE_MS * 1000000) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   output_finish();
+   close(pipe_fd[1]);
+   pthread_join(reader_thread, NULL);
+   printf("Results read:\t\t%u of %u, %u wrong\t", results_read, NUM_RESULTS,
+          results_bad);
+   if (results_read != NUM_RESULTS || results_bad) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   free(result.buf);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
+#else
+int
+main(void) {
+   printf("Output thread not supported on this system\n");
+   return 77;	/* Tell automake that this test was skipped */
+}
+#endif
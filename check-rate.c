@@ -0,0 +1,269 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-rate -- Check the ike-scan outgoing packet rate
+ *
+ * Date:	16 October 2026
+ *
+ *	Run ike-scan with --writepkttofile set to a FIFO, and record the
+ *	time that each packet arrives on the FIFO.  Then check that the
+ *	average rate is close to the rate requested with --pps or --bandwidth,
+ *	and that no window of WINDOW_NS contains more packets than the token
+ *	bucket allows: the burst size plus one packet per interval.
+ *
+ *	Packets can only arrive later than they were sent, so reader delays
+ *	make the packets appear more bunched than they really were.  We allow
+ *	for this with a small tolerance on the window check.
+ *
+ *	The average rate can also fall short if ike-scan does not get enough
+ *	CPU time, for example when other tests are running in parallel.  In
+ *	that case we wait and repeat the test, up to RATE_ATTEMPTS times, and
+ *	only warn if the rate is still too low.  Sending too fast is always
+ *	an error.
+ */
+
+#include "ike-scan.h"
+#include <sys/wait.h>
+
+#define MAX_PACKETS 8192
+#define WINDOW_NS 20000000		/* 20 ms */
+#define WINDOW_TOLERANCE 4		/* Extra packets allowed per window */
+#define RATE_LOW 0.80			/* Lowest acceptable average rate */
+#define RATE_HIGH 1.05			/* Highest acceptable average rate */
+#define RATE_ATTEMPTS 5			/* Attempts if the rate is too low */
+#define ISAKMP_HDR_LEN 28
+
+typedef struct {
+   const char *desc;		/* Description of this test */
+   const char *rate_opt;	/* Rate option to pass to ike-scan */
+   const char *burst_opt;	/* Burst option, or NULL for default */
+   const char *targets;		/* Target network */
+   double pps;			/* Expected rate in packets per second */
+   unsigned burst;		/* Expected burst size */
+} rate_test;
+
+static const rate_test tests[] = {
+   {"--pps=2000 with default burst", "--pps=2000", NULL,
+    "127.0.4.0/23", 2000.0, 2},
+   {"--pps=10000 --burst=16", "--pps=10000", "--burst=16",
+    "127.0.8.0/22", 10000.0, 16},
+/* The default packet is 336 bytes, plus 28 bytes of IP and UDP headers */
+   {"--bandwidth=2912000 with default burst", "--bandwidth=2912000", NULL,
+    "127.0.16.0/23", 1000.0, 1},
+};
+
+/*
+ *	read_full -- Read exactly n bytes unless end of file is reached
+ */
+static int
+read_full(int fd, unsigned char *buf, size_t n) {
+   size_t got = 0;
+   ssize_t r;
+
+   while (got < n) {
+      if ((r = read(fd, buf + got, n - got)) < 0) {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      if (r == 0)
+         break;
+      got += r;
+   }
+   return got;
+}
+
+/*
+ *	run_rate_test -- Run ike-scan and check the packet timings
+ *
+ *	Returns 0 if the timings conform to the rate, 1 if they do not, or
+ *	2 if they conform except that the average rate is too low.
+ */
+static int
+run_rate_test(const rate_test *t, const char *fifo, const char *ike_scan,
+              const char *vidfile) {
+   static IKE_UINT64 stamp[MAX_PACKETS];
+   unsigned char buf[MAXUDP];
+   unsigned count = 0;
+   unsigned max_window = 0;
+   unsigned allowed;
+   unsigned first;
+   unsigned i;
+   uint32_t len;
+   double elapsed;
+   double rate;
+   int fd;
+   int status;
+   pid_t pid;
+   char wpkt[MAXLINE];
+   int error = 0;
+   int slow = 0;
+
+   printf("\nChecking %s ...\n", t->desc);
+   snprintf(wpkt, sizeof(wpkt), "--writepkttofile=%s", fifo);
+   if ((pid = fork()) < 0)
+      err_sys("fork");
+   if (pid == 0) {
+      int null_fd;
+
+      if ((null_fd = open("/dev/null", O_WRONLY)) >= 0) {
+         dup2(null_fd, STDOUT_FILENO);
+         close(null_fd);
+      }
+      if (t->burst_opt)
+         execl(ike_scan, ike_scan, "-N", "--sport=0", "--retry=1",
+               "--timeout=1", vidfile, wpkt, t->rate_opt, t->burst_opt, t->targets,
+               (char *) NULL);
+      else
+         execl(ike_scan, ike_scan, "-N", "--sport=0", "--retry=1",
+               "--timeout=1", vidfile, wpkt, t->rate_opt, t->targets, (char *) NULL);
+      err_sys("exec %s", ike_scan);
+   }
+   if ((fd = open(fifo, O_RDONLY)) < 0)
+      err_sys("open %s", fifo);
+/*
+ *	Each packet starts with the ISAKMP header, which contains the total
+ *	packet length.  Record the time that each header arrives.
+ */
+   while (count < MAX_PACKETS &&
+          read_full(fd, buf, ISAKMP_HDR_LEN) == ISAKMP_HDR_LEN) {
+      stamp[count++] = monotonic_ns();
+      memcpy(&len, buf + 24, sizeof(len));
+      len = ntohl(len);
+      if (len < ISAKMP_HDR_LEN || len > sizeof(buf) ||
+          read_full(fd, buf, len - ISAKMP_HDR_LEN) !=
+          (int)(len - ISAKMP_HDR_LEN)) {
+         printf("Bad packet length %u\tFAIL\n", len);
+         error++;
+         break;
+      }
+   }
+   close(fd);
+   if ((waitpid(pid, &status, 0)) < 0)
+      err_sys("waitpid");
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("ike-scan did not exit normally\tFAIL\n");
+      return 1;
+   }
+   if (count < 2) {
+      printf("Only %u packets received\tFAIL\n", count);
+      return 1;
+   }
+/*
+ *	Check the average rate.
+ */
+   elapsed = (stamp[count-1] - stamp[0]) / 1000000000.0;
+   rate = (count - 1) / elapsed;
+   printf("%u packets in %.3f seconds (%.0f per sec, expected %.0f)\t",
+          count, elapsed, rate, t->pps);
+   if (rate < t->pps * RATE_LOW) {
+      printf("TOO SLOW\n");
+      slow++;
+   } else if (rate > t->pps * RATE_HIGH) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+/*
+ *	Check the largest number of packets in any window.
+ */
+   first = 0;
+   for (i=0; i<count; i++) {
+      while (stamp[i] - stamp[first] >= WINDOW_NS)
+         first++;
+      if (i - first + 1 > max_window)
+         max_window = i - first + 1;
+   }
+   allowed = t->burst + (unsigned)(t->pps * WINDOW_NS / 1000000000.0) +
+             WINDOW_TOLERANCE;
+   printf("Max %u packets in %u ms window (allowed %u)\t", max_window,
+          WINDOW_NS / 1000000, allowed);
+   if (max_window > allowed) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   if (error)
+      return 1;
+   else if (slow)
+      return 2;
+   else
+      return 0;
+}
+
+int
+main(void) {
+   char fifo[MAXLINE];
+   char ike_scan[MAXLINE];
+   char vidfile[MAXLINE];
+   const char *srcdir;
+   unsigned i;
+   unsigned attempt;
+   int result;
+   int error=0;
+
+   if ((srcdir = getenv("srcdir")) == NULL)
+      srcdir = ".";
+   snprintf(ike_scan, sizeof(ike_scan), "%s/ike-scan", srcdir);
+   snprintf(vidfile, sizeof(vidfile), "--vidpatterns=%s/ike-vendor-ids",
+            srcdir);
+   snprintf(fifo, sizeof(fifo), "/tmp/ike-scan-rate.%d.fifo", (int) getpid());
+
+   for (i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+      for (attempt=1; attempt<=RATE_ATTEMPTS; attempt++) {
+         if ((mkfifo(fifo, 0600)) != 0)
+            err_sys("mkfifo %s", fifo);
+         result = run_rate_test(&tests[i], fifo, ike_scan, vidfile);
+         unlink(fifo);
+         if (result != 2)
+            break;
+         sleep(1);
+      }
+      if (result == 2)
+         printf("WARNING: Average rate too low after %u attempts; is the system busy?\n",
+                RATE_ATTEMPTS);
+      else if (result != 0)
+         error++;
+   }
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-records -- Check the structured record output formats
+ *
+ * Date:	16 October 2026
+ *
+ *	Decode each of the packet files used by the check-decode script into
+ *	a JSON Lines record and a binary record, as ike-scan does with
+ *	--format=jsonl and --format=binary.  Check that each JSON record is
+ *	valid JSON, that converting the binary record with record_read() gives
+ *	the same JSON, and that record_read() gives back the same binary
+ *	record and rejects it when it is truncated.  Also check that the
+ *	records contain some of the expected field values, and do the same
+ *	round trip for the backoff and summary records.
+ */
+
+#include "ike-scan.h"
+#define MAX_PACKET 4096
+
+psk_crack psk_values;	/* Referenced by isakmp.c */
+int mbz_value = 0;	/* Referenced by isakmp.c */
+
+static const struct {
+   const char *file;
+   const char *expected;	/* A string that must be in the JSON */
+} samples[] = {
+   {"pkt-main-mode-response.dat",
+    "\"vendor\":\"Firewall-1 NGX or later\""},
+   {"pkt-aggr-mode-response.dat", "\"mode\":\"Aggressive Mode\""},
+   {"pkt-notify-response.dat", "\"result\":\"notify\",\"exchange\":5"},
+   {"pkt-v2-sainit-response.dat", "\"mode\":\"IKEv2 SA_INIT\""},
+   {"pkt-v2-notify-response.dat", "\"result\":\"notify\""},
+   {"pkt-aggr-cert-response.dat", "\"payload_name\":\"Certificate\""},
+   {"pkt-main-natt-response.dat", "\"value_name\":\"3DES\""},	/* NAT-T */
+   {"pkt-checkpoint-notify.dat", "\"notify_type\":9101"},
+};
+#define NUM_SAMPLES (sizeof(samples)/sizeof(samples[0]))
+
+/*
+ *	json_value -- Check that a JSON value starts at *cp and skip over it
+ *
+ *	Returns nonzero if the value is valid.  This only accepts the subset of
+ *	JSON that record.c writes: objects, arrays, strings and unsigned
+ *	integers.
+ */
+static int
+json_value(const char **cp, unsigned depth) {
+   const char *p = *cp;
+
+   if (depth > REC_MAX_DEPTH)
+      return 0;
+   if (*p == '"') {
+      for (p++; *p != '"'; p++) {
+         if ((unsigned char) *p < 0x20 || (unsigned char) *p > 0x7e)
+            return 0;
+         if (*p == '\\') {
+            p++;
+            if (*p == 'u') {
+               if (strspn(p + 1, "0123456789abcdef") < 4)
+                  return 0;
+               p += 4;
+            } else if (*p != '"' && *p != '\\') {
+               return 0;
+            }
+         }
+      }
+      p++;
+   } else if (isdigit((unsigned char) *p)) {
+      if (*p == '0' && isdigit((unsigned char) p[1]))
+         return 0;
+      while (isdigit((unsigned char) *p))
+         p++;
+   } else if (*p == '{' || *p == '[') {
+      char close = *p == '{' ? '}' : ']';
+
+      p++;
+      if (*p != close) {
+         while (1) {
+            if (close == '}') {
+               if (*p != '"' || !json_value(&p, depth + 1) || *p++ != ':')
+                  return 0;
+            }
+            if (!json_value(&p, depth + 1))
+               return 0;
+            if (*p != ',')
+               break;
+            p++;
+         }
+      }
+      if (*p++ != close)
+         return 0;
+   } else {
+      return 0;
+   }
+   *cp = p;
+   return 1;
+}
+
+/*
+ *	check_record -- Check the JSON and binary forms of one record
+ *
+ *	Returns the number of failures.
+ */
+static int
+check_record(const char *label, const out_buf *json, const out_buf *bin,
+             const char *expected) {
+   out_buf conv = {NULL, 0, 0};
+   const char *p = json->buf;
+   size_t len;
+   int error = 0;
+
+   printf("%s\t", label);
+   if (!json_value(&p, 0) || strcmp(p, "\n") != 0) {
+      printf("FAIL (invalid JSON)\n");
+      error++;
+   } else if (expected && strstr(json->buf, expected) == NULL) {
+      printf("FAIL (no %s)\n", expected);
+      error++;
+   } else if ((len = record_read((unsigned char *) bin->buf, bin->len, &conv,
+                                 FORMAT_JSONL)) != bin->len ||
+              strcmp(conv.buf, json->buf) != 0) {
+      printf("FAIL (binary to JSON)\n");
+      error++;
+   } else {
+      out_reset(&conv);
+      if (record_read((unsigned char *) bin->buf, bin->len, &conv,
+                      FORMAT_BINARY) != bin->len || conv.len != bin->len ||
+          memcmp(conv.buf, bin->buf, bin->len) != 0) {
+         printf("FAIL (binary round trip)\n");
+         error++;
+      } else if (record_read((unsigned char *) bin->buf, bin->len - 1, &conv,
+                             FORMAT_JSONL) != 0) {
+         printf("FAIL (truncated record accepted)\n");
+         error++;
+      } else {
+         printf("ok\n");
+      }
+   }
+   free(conv.buf);
+   return error;
+}
+
+int
+main(void) {
+   unsigned char packet[MAX_PACKET];
+   unsigned char *start;
+   out_buf json = {NULL, 0, 0};
+   out_buf bin = {NULL, 0, 0};
+   out_buf *ob;
+   record r;
+   vid_pattern_list vid;
+   char vid_name[] = "Firewall-1 NGX or later";
+   char vid_pattern[] = "^f4ed19e0c114eb516faaac0ee37daf2807b4381f";
+   vid_matcher *vidmatch;
+   regex_t vid_regex;
+   char path[MAXLINE];
+   const char *srcdir;
+   int fd;
+   ssize_t n;
+   unsigned i;
+   int format;
+   int error=0;
+
+   if ((srcdir = getenv("srcdir")) == NULL)
+      srcdir = ".";
+
+   vid.name = vid_name;
+   vid.pattern = vid_pattern;
+   if (regcomp(&vid_regex, vid.pattern, REG_EXTENDED|REG_ICASE|REG_NOSUB) != 0)
+      err_msg("regcomp failed");
+   vid.regex = &vid_regex;
+   vid.next = NULL;
+   vidmatch = vid_matcher_build(&vid);
+
+   printf("\nChecking response records...\n");
+   for (i=0; i<NUM_SAMPLES; i++) {
+      snprintf(path, sizeof(path), "%s/%s", srcdir, samples[i].file);
+      if ((fd = open(path, O_RDONLY)) < 0)
+         err_sys("open %s", path);
+      if ((n = read(fd, packet, sizeof(packet))) < 0)
+         err_sys("read %s", path);
+      close(fd);
+      start = packet;
+      if (n > 4 && memcmp(packet, "\0\0\0\0", 4) == 0) {	/* Non-ESP marker */
+         start += 4;
+         n -= 4;
+      }
+      for (format=FORMAT_JSONL; format<=FORMAT_BINARY; format++) {
+         ob = format == FORMAT_JSONL ? &json : &bin;
+         out_reset(ob);
+         record_begin(&r, ob, format, "response");
+         record_str(&r, REC_ADDR, "127.0.0.1");
+         record_isakmp_packet(&r, start, n, 0, vidmatch, 0);
+         record_end(&r);
+      }
+      error += check_record(samples[i].file, &json, &bin, samples[i].expected);
+   }
+
+   printf("\nChecking backoff and summary records...\n");
+   for (format=FORMAT_JSONL; format<=FORMAT_BINARY; format++) {
+      ob = format == FORMAT_JSONL ? &json : &bin;
+      out_reset(ob);
+      record_begin(&r, ob, format, "backoff");
+      record_str(&r, REC_ADDR, "10.0.0.1");
+      record_list_begin(&r, REC_TIMES);
+      record_uint(&r, 0, 1000000000000ULL);
+      record_uint(&r, 0, 1000002000000ULL);
+      record_uint(&r, 0, 0);
+      record_list_end(&r);
+      record_str(&r, REC_GUESS, "Test \"quoted\"\tname");
+      record_end(&r);
+   }
+   error += check_record("Backoff record:", &json, &bin,
+                         "\"times\":[1000000000000,1000002000000,0],"
+                         "\"guess\":\"Test \\\"quoted\\\"\\u0009name\"");
+   for (format=FORMAT_JSONL; format<=FORMAT_BINARY; format++) {
+      ob = format == FORMAT_JSONL ? &json : &bin;
+      out_reset(ob);
+      record_begin(&r, ob, format, "summary");
+      record_uint(&r, REC_HOSTS, 65536);
+      record_uint(&r, REC_HANDSHAKES, 0);
+      record_end(&r);
+   }
+   error += check_record("Summary record:", &json, &bin,
+                         "{\"record\":\"summary\",\"hosts\":65536,"
+                         "\"handshakes\":0}");
+
+   vid_matcher_free(vidmatch);
+   regfree(&vid_regex);
+   free(json.buf);
+   free(bin.buf);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
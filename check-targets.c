@@ -0,0 +1,310 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-targets -- Check the target list functions
+ *
+ * Date:	16 October 2026
+ *
+ *	Check that host patterns give the expected addresses in list order,
+ *	both from the command line and from a file read on demand.  Then
+ *	check that random order visits every target exactly once for a range
+ *	of list sizes, that different seeds give different orders, and time
+ *	random order over a /8 network.
+ *
+ *	Also check that host names looked up by the lookup threads are added
+ *	to the list, in both list and random order.  The names are all
+ *	"localhost" so that the check does not depend on the DNS.
+ */
+
+#include "ike-scan.h"
+
+#define LARGE_BITS 24			/* Size of the timed network */
+#define NUM_NAMES 200			/* Host names to look up */
+#define DNS_THREADS 8			/* Lookup threads to use */
+
+static const char *patterns[] = {
+   "10.0.0.0/30",
+   "10.0.1.5-10.0.1.7",
+   "10.0.2.0:255.255.255.254",
+   "192.168.0.1",
+   "10.0.3.9-10.0.3.8",		/* Empty range */
+   "not-an-address",		/* Ignored with no_dns */
+   NULL
+};
+
+static const char *expected[] = {
+   "10.0.0.0", "10.0.0.1", "10.0.0.2", "10.0.0.3",
+   "10.0.1.5", "10.0.1.6", "10.0.1.7",
+   "10.0.2.0", "10.0.2.1",
+   "192.168.0.1",
+   NULL
+};
+
+static const unsigned random_sizes[] = {
+   1, 2, 3, 10, 255, 256, 1000, 65536, 65537, 1000000
+};
+
+/*
+ *	check_list_order -- Check that a target list gives the expected list
+ *
+ *	Returns 0 if it does, or 1 if not.
+ */
+static int
+check_list_order(target_list *tl, const char *desc) {
+   struct in_addr addr;
+   unsigned n;
+   unsigned i;
+
+   printf("%s:\t", desc);
+   for (i=0; expected[i] != NULL; i++) {
+      if (!target_next(tl, &addr, &n) ||
+          strcmp(inet_ntoa(addr), expected[i]) != 0 || n != i + 1) {
+         printf("target %u wrong\tFAIL\n", i + 1);
+         return 1;
+      }
+   }
+   if (target_next(tl, &addr, &n) || target_pending(tl)) {
+      printf("extra target %s\tFAIL\n", inet_ntoa(addr));
+      return 1;
+   }
+   printf("%u targets\tok\n", i);
+   return 0;
+}
+
+/*
+ *	check_random -- Check that random order visits every target once
+ *
+ *	Returns 0 if it does, or 1 if not.
+ */
+static int
+check_random(unsigned size) {
+   target_list tl;
+   unsigned char *seen;
+   struct in_addr addr;
+   unsigned n;
+   unsigned count = 0;
+   unsigned index;
+   int error = 0;
+
+   target_init(&tl);
+   target_add_range(&tl, 0x0a000000, 0x0a000000 + size - 1);
+   target_randomise(&tl);
+   seen = Malloc(size);
+   memset(seen, '\0', size);
+   while (target_next(&tl, &addr, &n)) {
+      index = ntohl(addr.s_addr) - 0x0a000000;
+      if (index >= size || n != index + 1 || seen[index]) {
+         error++;
+         break;
+      }
+      seen[index] = 1;
+      count++;
+   }
+   printf("%u targets (p=" IKE_UINT64_FORMAT "):\t%u visited\t", size,
+          tl.prime, count);
+   if (error || count != size) {
+      printf("FAIL\n");
+      error = 1;
+   } else {
+      printf("ok\n");
+   }
+   free(seen);
+   free(tl.range);
+
+   return error;
+}
+
+/*
+ *	first_targets -- Return a checksum of the first targets in random order
+ */
+static uint32_t
+first_targets(unsigned seed) {
+   target_list tl;
+   struct in_addr addr;
+   unsigned n;
+   unsigned i;
+   uint32_t sum = 0;
+
+   init_genrand(seed);
+   target_init(&tl);
+   target_add_range(&tl, 0x0a000000, 0x0a0003e7);	/* 1000 targets */
+   target_randomise(&tl);
+   for (i=0; i<10 && target_next(&tl, &addr, &n); i++)
+      sum = sum * 31 + n;
+   free(tl.range);
+
+   return sum;
+}
+
+/*
+ *	check_lookup -- Check host names looked up by the lookup threads
+ *
+ *	Returns 0 if every name gives a target, or 1 if not.
+ */
+static int
+check_lookup(int random_order) {
+   target_list tl;
+   struct in_addr addr;
+   unsigned n;
+   unsigned i;
+   unsigned count = 0;
+   unsigned local = 0;
+   int error = 0;
+
+   target_init(&tl);
+   tl.dns_threads = DNS_THREADS;
+   add_host_pattern(&tl, "10.0.4.0/30");
+   for (i=0; i<NUM_NAMES; i++)
+      add_host_pattern(&tl, "localhost");
+   add_host_pattern(&tl, "10.0.5.1");
+   if (random_order) {
+      target_resolve_wait(&tl);
+      target_randomise(&tl);
+   }
+   while (target_pending(&tl)) {
+      if (!target_next(&tl, &addr, &n)) {
+         usleep(1000);	/* Wait for more names to be looked up */
+         continue;
+      }
+      count++;
+      if (addr.s_addr == htonl(INADDR_LOOPBACK))
+         local++;
+   }
+   printf("%s order:\t\t%u of %u names, %u targets\t",
+          random_order ? "Random" : "List", local, NUM_NAMES, count);
+   if (local != NUM_NAMES || count != NUM_NAMES + 5 || tl.count != count) {
+      printf("FAIL\n");
+      error = 1;
+   } else {
+      printf("ok\n");
+   }
+   free(tl.range);
+   free(tl.name);
+
+   return error;
+}
+
+int
+main(void) {
+   target_list tl;
+   char filename[MAXLINE];
+   FILE *fp;
+   struct in_addr addr;
+   unsigned n;
+   unsigned i;
+   unsigned count;
+   struct timeval start_time;
+   struct timeval end_time;
+   struct timeval elapsed_time;
+   double seconds;
+   int error=0;
+
+   init_genrand(0);
+
+   printf("\nChecking list order...\n");
+   target_init(&tl);
+   tl.no_dns = 1;
+   for (i=0; patterns[i] != NULL; i++)
+      add_host_pattern(&tl, patterns[i]);
+   error += check_list_order(&tl, "Command line");
+   free(tl.range);
+
+   snprintf(filename, sizeof(filename), "/tmp/ike-scan-targets.%d.tmp",
+            (int) getpid());
+   if ((fp = fopen(filename, "w")) == NULL)
+      err_sys("fopen %s", filename);
+   for (i=0; patterns[i] != NULL; i++)
+      fprintf(fp, "%s\n", patterns[i]);
+   fclose(fp);
+   if ((fp = fopen(filename, "r")) == NULL)
+      err_sys("fopen %s", filename);
+   target_init(&tl);
+   tl.no_dns = 1;
+   target_open_file(&tl, fp);	/* Closes fp at end of file */
+   unlink(filename);
+   printf("File count:\t\t%u targets\t", tl.count);
+   if (tl.count != 11) {	/* Host names are counted before lookup */
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   error += check_list_order(&tl, "File on demand");
+   free(tl.range);
+
+   printf("\nChecking random order...\n");
+   for (i=0; i<sizeof(random_sizes)/sizeof(random_sizes[0]); i++)
+      error += check_random(random_sizes[i]);
+   printf("Different seeds:\t");
+   if (first_targets(1) == first_targets(2)) {
+      printf("same order\tFAIL\n");
+      error++;
+   } else {
+      printf("different order\tok\n");
+   }
+
+#ifdef HAVE_THREADS
+   printf("\nChecking host name lookup threads...\n");
+   error += check_lookup(0);
+   error += check_lookup(1);
+#endif
+
+   printf("\nChecking random order speed...\n");
+   target_init(&tl);
+   target_add_range(&tl, 0x0a000000, 0x0a000000 + (1U << LARGE_BITS) - 1);
+   Gettimeofday(&start_time);
+   target_randomise(&tl);
+   count = 0;
+   while (target_next(&tl, &addr, &n))
+      count++;
+   Gettimeofday(&end_time);
+   timeval_diff(&end_time, &start_time, &elapsed_time);
+   seconds = elapsed_time.tv_sec + (elapsed_time.tv_usec / 1000000.0);
+   printf("%u targets in %.6f seconds (%.0f per sec)\t", count, seconds,
+          seconds > 0 ? count / seconds : 0.0);
+   if (count != 1U << LARGE_BITS) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   free(tl.range);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
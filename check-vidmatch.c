@@ -0,0 +1,302 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * check-vidmatch -- Check and time the Vendor ID pattern matcher
+ *
+ * Date:	16 October 2026
+ *
+ *	Load all of the patterns in ike-vendor-ids in the same way as
+ *	add_vid_pattern(), and build a Vendor ID matcher from them.  Make a
+ *	set of test Vendor IDs that should match each pattern that has a
+ *	fixed prefix, together with the same Vendor IDs with the last byte
+ *	changed, with one byte removed and with one byte added, and some
+ *	random Vendor IDs.  Check that the matcher gives the same result as
+ *	trying each pattern in turn with regexec() for all of them, and
+ *	compare the speed of the two methods.
+ */
+
+#include "ike-scan.h"
+#define MAX_VIDS 8192
+#define MAX_VID_LEN 128
+#define NUM_RANDOM 1000
+#define SPEED_PASSES 20
+
+typedef struct {
+   unsigned char data[MAX_VID_LEN];
+   size_t len;
+   char hex[2*MAX_VID_LEN+1];
+} test_vid;
+
+/*
+ *	load_patterns -- Load the Vendor ID patterns file
+ *
+ *	This splits each line into name and pattern in the same way as
+ *	add_vid_pattern(), and returns the patterns in file order.
+ */
+static vid_pattern_list *
+load_patterns(const char *fn) {
+   static const char *vid_pat_str = "([^\t]+)\t[\t ]*([^\t\n\r]+)";
+   regex_t vid_pat;
+   regmatch_t pmatch[3];
+   vid_pattern_list *head = NULL;
+   vid_pattern_list **tail = &head;
+   vid_pattern_list *pe;
+   regex_t *rep;
+   char line[MAXLINE];
+   FILE *fp;
+
+   if (regcomp(&vid_pat, vid_pat_str, REG_EXTENDED) != 0)
+      err_msg("regcomp failed");
+   if ((fp = fopen(fn, "r")) == NULL)
+      err_sys("fopen %s", fn);
+   while (fgets(line, MAXLINE, fp)) {
+      if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+         continue;
+      if (regexec(&vid_pat, line, 3, pmatch, 0) != 0)
+         continue;
+      line[pmatch[1].rm_eo] = '\0';
+      line[pmatch[2].rm_eo] = '\0';
+      rep = Malloc(sizeof(regex_t));
+      if (regcomp(rep, line+pmatch[2].rm_so,
+                  REG_EXTENDED|REG_ICASE|REG_NOSUB) != 0) {
+         free(rep);
+         continue;
+      }
+      pe = Malloc(sizeof(vid_pattern_list));
+      pe->name = dupstr(line+pmatch[1].rm_so);
+      pe->pattern = dupstr(line+pmatch[2].rm_so);
+      pe->regex = rep;
+      pe->next = NULL;
+      *tail = pe;
+      tail = &pe->next;
+   }
+   fclose(fp);
+   regfree(&vid_pat);
+
+   return head;
+}
+
+/*
+ *	linear_match -- Try each Vendor ID pattern in turn
+ *
+ *	This is how Vendor IDs were matched before the matcher was added.
+ */
+static const char *
+linear_match(vid_pattern_list *vidlist, const char *hexvid) {
+   vid_pattern_list *ve;
+
+   for (ve=vidlist; ve != NULL; ve=ve->next) {
+      if (!(regexec(ve->regex, hexvid, 0, NULL, 0)))
+         return ve->name;
+   }
+   return NULL;
+}
+
+/*
+ *	add_test_vid -- Add a test Vendor ID
+ */
+static void
+add_test_vid(test_vid *vids, unsigned *num_vids, const unsigned char *data,
+        size_t len) {
+   test_vid *tv;
+   out_buf ob = {NULL, 0, 0};
+
+   if (*num_vids >= MAX_VIDS || len > MAX_VID_LEN)
+      return;
+   tv = &vids[(*num_vids)++];
+   memcpy(tv->data, data, len);
+   tv->len = len;
+   out_hex(&ob, data, len);
+   memcpy(tv->hex, ob.buf, ob.len + 1);
+   free(ob.buf);
+}
+
+/*
+ *	add_pattern_vids -- Add test Vendor IDs made from a pattern
+ *
+ *	If the pattern is "^" followed by hex digits, "." characters and
+ *	an optional "$", make a Vendor ID with the hex digits and zeros
+ *	for the rest, then versions with the last byte changed, with one
+ *	byte removed and with one byte added.
+ */
+static void
+add_pattern_vids(test_vid *vids, unsigned *num_vids, const char *pattern) {
+   unsigned char data[MAX_VID_LEN+1];
+   const char *p;
+   size_t hex_len;
+   size_t len;
+   size_t i;
+   unsigned value;
+
+   if (*pattern != '^')
+      return;
+   for (p=pattern+1; isxdigit((unsigned char) *p) || *p == '.'; p++)
+      ;
+   if (*p == '$')
+      p++;
+   if (*p != '\0')
+      return;
+   hex_len = strspn(pattern+1, "0123456789abcdefABCDEF.");
+   len = (hex_len + 1) / 2;
+   if (len == 0 || len > MAX_VID_LEN)
+      return;
+   memset(data, '\0', sizeof(data));
+   for (i=0; i<hex_len && isxdigit((unsigned char) pattern[1+i]); i++) {
+      sscanf(pattern+1+i, "%1x", &value);
+      data[i/2] |= (i % 2) ? value : value << 4;
+   }
+   add_test_vid(vids, num_vids, data, len);
+   data[len-1] ^= 0x5a;
+   add_test_vid(vids, num_vids, data, len);
+   data[len-1] ^= 0x5a;
+   add_test_vid(vids, num_vids, data, len-1);
+   add_test_vid(vids, num_vids, data, len+1);
+}
+
+int
+main(void) {
+   vid_pattern_list *vidlist;
+   vid_pattern_list *pe;
+   vid_matcher *vidmatch;
+   test_vid *vids;
+   unsigned num_vids = 0;
+   unsigned num_patterns = 0;
+   unsigned char data[MAX_VID_LEN];
+   char path[MAXLINE];
+   const char *srcdir;
+   const char *expected;
+   const char *got;
+   unsigned matched;
+   unsigned bad;
+   unsigned pass;
+   unsigned i;
+   unsigned j;
+   IKE_UINT64 start_ns;
+   double matcher_seconds;
+   double linear_seconds;
+   int error=0;
+
+   if ((srcdir = getenv("srcdir")) == NULL)
+      srcdir = ".";
+   init_genrand(0);
+
+   snprintf(path, sizeof(path), "%s/ike-vendor-ids", srcdir);
+   vidlist = load_patterns(path);
+   for (pe=vidlist; pe != NULL; pe=pe->next)
+      num_patterns++;
+   start_ns = monotonic_ns();
+   vidmatch = vid_matcher_build(vidlist);
+   printf("\nBuilt matcher for %u patterns in %.6f seconds "
+          "(%u trie nodes, %u fallback patterns)\n", num_patterns,
+          (monotonic_ns() - start_ns) / 1000000000.0, vidmatch->num_nodes,
+          vidmatch->num_fallback);
+
+   vids = Malloc(MAX_VIDS * sizeof(test_vid));
+   for (pe=vidlist; pe != NULL; pe=pe->next)
+      add_pattern_vids(vids, &num_vids, pe->pattern);
+   for (i=0; i<NUM_RANDOM; i++) {
+      for (j=0; j<16; j++)
+         data[j] = genrand_int32() & 0xff;
+      add_test_vid(vids, &num_vids, data, 8 + i % 9);
+   }
+
+   printf("\nChecking %u Vendor IDs...\n", num_vids);
+   matched = 0;
+   bad = 0;
+   for (i=0; i<num_vids; i++) {
+      expected = linear_match(vidlist, vids[i].hex);
+      got = vid_matcher_match(vidmatch, vids[i].data, vids[i].len,
+                              i % 2 ? vids[i].hex : NULL);
+      if (expected)
+         matched++;
+      if ((got == NULL) != (expected == NULL) ||
+          (got && strcmp(got, expected) != 0)) {
+         if (bad++ < 10)
+            printf("%s: expected %s, got %s\n", vids[i].hex,
+                   expected ? expected : "no match", got ? got : "no match");
+      }
+   }
+   printf("Same result as regexec:\t%u of %u\t", num_vids - bad, num_vids);
+   if (bad) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+   printf("Vendor IDs matched:\t%u\t\t", matched);
+   if (matched < num_patterns) {
+      printf("FAIL\n");
+      error++;
+   } else {
+      printf("ok\n");
+   }
+
+   printf("\nChecking Vendor ID match speed...\n");
+   matched = 0;
+   start_ns = monotonic_ns();
+   for (pass=0; pass<SPEED_PASSES; pass++) {
+      for (i=0; i<num_vids; i++) {
+         if (vid_matcher_match(vidmatch, vids[i].data, vids[i].len, NULL))
+            matched++;
+      }
+   }
+   matcher_seconds = (monotonic_ns() - start_ns) / 1000000000.0;
+   start_ns = monotonic_ns();
+   for (pass=0; pass<SPEED_PASSES; pass++) {
+      for (i=0; i<num_vids; i++) {
+         if (linear_match(vidlist, vids[i].hex))
+            matched++;
+      }
+   }
+   linear_seconds = (monotonic_ns() - start_ns) / 1000000000.0;
+   printf("%u matcher lookups in %.6f seconds (%.0f per sec)\n",
+          SPEED_PASSES * num_vids, matcher_seconds,
+          SPEED_PASSES * num_vids / matcher_seconds);
+   printf("%u regexec lookups in %.6f seconds (%.0f per sec)\n",
+          SPEED_PASSES * num_vids, linear_seconds,
+          SPEED_PASSES * num_vids / linear_seconds);
+   if (matcher_seconds > 0)
+      printf("Matcher is %.0f times faster than regexec\n",
+             linear_seconds / matcher_seconds);
+
+   vid_matcher_free(vidmatch);
+   free(vids);
+
+   if (error)
+      return EXIT_FAILURE;
+   else
+      return EXIT_SUCCESS;
+}
@@ -0,0 +1,404 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * cookie.c -- Initiator cookie functions for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * This file contains the functions that map the initiator cookie in a
+ * received packet back to the host entry that it was sent to, and the
+ * functions that generate and check stateless cookies.
+ *
+ * The cookie index is an open addressing hash table with linear probing.
+ * Each slot holds a pointer to a host entry, or NULL if it is empty, and a
+ * copy of the entry's cookie.  The copy means that probing, resizing and
+ * removal only touch the table, and a lookup only reads the host entry
+ * that it returns.  Host entries are removed from the index when they are
+ * returned to their pool, and the entries after a removed one are moved
+ * back to fill the gap, so that no tombstones are needed and lookups stay
+ * short.
+ *
+ * Stateless cookies allow the target to be recovered from the initiator
+ * cookie alone, without any per-host state.  The second cookie word is a
+ * MAC of the target address and destination port, and the first word is
+ * the target address masked with a pad derived from the MAC:
+ *
+ *	icookie[1] = HMAC-MD5(key, addr || port)
+ *	icookie[0] = addr XOR HMAC-MD5(key, icookie[1])
+ *
+ * Both HMAC values are truncated to 32 bits.  A responder that has not
+ * seen our packet has a one in 2^32 chance of guessing a valid cookie.
+ */
+
+#include "ike-scan.h"
+#include "hash_functions.h"
+
+#define COOKIE_INDEX_MIN_SIZE 1024	/* Initial number of slots */
+#define STATELESS_KEY_LEN 16		/* Stateless cookie key length */
+#define STATELESS_SEEN_SIZE 65536	/* Recently seen responders */
+
+static unsigned char stateless_key[STATELESS_KEY_LEN];
+static uint16_t stateless_port;		/* Destination port, network order */
+static uint32_t *stateless_seen = NULL;	/* Recent responder addresses */
+
+/*
+ *	cookie_hash -- Calculate the hash table slot for a cookie
+ *
+ *	Inputs:
+ *
+ *	icookie	The initiator cookie (COOKIE_SIZE 32-bit words)
+ *
+ *	Returns:
+ *
+ *	The 32-bit hash value.
+ *
+ *	The automatically generated cookies are already random, but cookies
+ *	specified with --cookie need not be, so we mix both words with the
+ *	64-bit finaliser from MurmurHash3 to spread them over the table.
+ */
+static uint32_t
+cookie_hash(const uint32_t *icookie) {
+   IKE_UINT64 h;
+
+   h = ((IKE_UINT64) icookie[0] << 32) | icookie[1];
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+
+   return (uint32_t) h;
+}
+
+/*
+ *	cookie_index_insert -- Insert a slot into the table
+ *
+ *	Inputs:
+ *
+ *	ci	The cookie index
+ *	cs	The host entry and its cookie
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The caller must ensure that there is at least one free slot.
+ */
+static void
+cookie_index_insert(cookie_index *ci, const cookie_slot *cs) {
+   unsigned slot;
+
+   slot = cookie_hash(cs->icookie) & ci->mask;
+   while (ci->slot[slot].he != NULL)
+      slot = (slot + 1) & ci->mask;
+   ci->slot[slot] = *cs;
+   ci->count++;
+}
+
+/*
+ *	cookie_index_add -- Add a host entry to the cookie index
+ *
+ *	Inputs:
+ *
+ *	ci	The cookie index
+ *	he	The host entry, which must not move while it is in the index
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The table is allocated on first use, and is doubled in size whenever
+ *	it becomes half full, which keeps the expected probe length below two
+ *	for both hits and misses.
+ */
+void
+cookie_index_add(cookie_index *ci, host_entry *he) {
+   cookie_slot cs;
+
+   if (ci->slot == NULL) {
+      ci->slot = Malloc(COOKIE_INDEX_MIN_SIZE * sizeof(cookie_slot));
+      memset(ci->slot, '\0', COOKIE_INDEX_MIN_SIZE * sizeof(cookie_slot));
+      ci->mask = COOKIE_INDEX_MIN_SIZE - 1;
+      ci->count = 0;
+   } else if (2 * (ci->count + 1) > ci->mask + 1) {
+      cookie_slot *old_slot = ci->slot;
+      unsigned old_size = ci->mask + 1;
+      unsigned i;
+
+      ci->mask = 2 * old_size - 1;
+      ci->slot = Malloc(2 * old_size * sizeof(cookie_slot));
+      memset(ci->slot, '\0', 2 * old_size * sizeof(cookie_slot));
+      ci->count = 0;
+      for (i=0; i<old_size; i++) {
+         if (old_slot[i].he != NULL)
+            cookie_index_insert(ci, &old_slot[i]);
+      }
+      free(old_slot);
+   }
+   cs.icookie[0] = he->icookie[0];
+   cs.icookie[1] = he->icookie[1];
+   cs.he = he;
+   cookie_index_insert(ci, &cs);
+}
+
+/*
+ *	cookie_index_remove -- Remove a host entry from the cookie index
+ *
+ *	Inputs:
+ *
+ *	ci	The cookie index
+ *	he	The host entry
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Does nothing if the entry is not in the index.  After removing the
+ *	entry, any following entries in the same probe run that could have
+ *	been stored in the empty slot are moved back into it, so that every
+ *	entry can still be reached from its home slot without a gap.
+ */
+void
+cookie_index_remove(cookie_index *ci, const host_entry *he) {
+   unsigned slot;
+   unsigned next;
+   unsigned home;
+
+   if (ci->slot == NULL)
+      return;
+
+   slot = cookie_hash(he->icookie) & ci->mask;
+   while (ci->slot[slot].he != he) {
+      if (ci->slot[slot].he == NULL)
+         return;
+      slot = (slot + 1) & ci->mask;
+   }
+   ci->slot[slot].he = NULL;
+   ci->count--;
+/*
+ *	An entry at "next" may be moved back to "slot" unless its home slot
+ *	is cyclically in the range (slot, next].
+ */
+   next = slot;
+   for (;;) {
+      next = (next + 1) & ci->mask;
+      if (ci->slot[next].he == NULL)
+         break;
+      home = cookie_hash(ci->slot[next].icookie) & ci->mask;
+      if (((next - home) & ci->mask) >= ((next - slot) & ci->mask)) {
+         ci->slot[slot] = ci->slot[next];
+         ci->slot[next].he = NULL;
+         slot = next;
+      }
+   }
+}
+
+/*
+ *	cookie_index_find -- Find a host entry by initiator cookie
+ *
+ *	Inputs:
+ *
+ *	ci	The cookie index
+ *	icookie	The initiator cookie to look for
+ *
+ *	Returns:
+ *
+ *	Pointer to the matching host entry, or NULL if there is no match.
+ */
+host_entry *
+cookie_index_find(const cookie_index *ci, const uint32_t *icookie) {
+   unsigned slot;
+   const cookie_slot *cs;
+
+   if (ci->slot == NULL)
+      return NULL;
+
+   slot = cookie_hash(icookie) & ci->mask;
+   while ((cs = &ci->slot[slot])->he != NULL) {
+      if (cs->icookie[0] == icookie[0] && cs->icookie[1] == icookie[1])
+         return cs->he;
+      slot = (slot + 1) & ci->mask;
+   }
+   return NULL;
+}
+
+/*
+ *	stateless_cookie_init -- Initialise stateless cookie generation
+ *
+ *	Inputs:
+ *
+ *	dest_port	The destination UDP port for this scan.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This chooses a random key for the cookie MAC.  Anyone who knows the
+ *	key can forge cookies, so it is read from /dev/urandom rather than
+ *	taken from the scan's random number generator, which may have a
+ *	known seed.  If /dev/urandom cannot be read, the key comes from the
+ *	random number generator with a warning, so this must be called
+ *	after that has been seeded.
+ */
+void
+stateless_cookie_init(unsigned dest_port) {
+   unsigned i;
+   size_t got = 0;
+   ssize_t n;
+   int fd;
+
+   if ((fd = open("/dev/urandom", O_RDONLY)) >= 0) {
+      while (got < STATELESS_KEY_LEN &&
+             (n = read(fd, stateless_key + got,
+                       STATELESS_KEY_LEN - got)) > 0)
+         got += n;
+      close(fd);
+   }
+   if (got < STATELESS_KEY_LEN) {
+      warn_msg("WARNING: Could not read /dev/urandom, so the stateless "
+               "cookie key is not secret");
+      for (i=0; i<STATELESS_KEY_LEN; i++)
+         stateless_key[i] = random_byte();
+   }
+   stateless_port = htons(dest_port);
+   stateless_seen = Malloc(STATELESS_SEEN_SIZE * sizeof(uint32_t));
+   memset(stateless_seen, '\0', STATELESS_SEEN_SIZE * sizeof(uint32_t));
+}
+
+/*
+ *	stateless_mac -- Calculate the 32-bit MAC of an address and port
+ */
+static uint32_t
+stateless_mac(uint32_t addr) {
+   unsigned char text[sizeof(addr) + sizeof(stateless_port)];
+   unsigned char md[16];
+   uint32_t mac;
+
+   memcpy(text, &addr, sizeof(addr));
+   memcpy(text + sizeof(addr), &stateless_port, sizeof(stateless_port));
+   hmac_md5(text, sizeof(text), stateless_key, sizeof(stateless_key), md);
+   memcpy(&mac, md, sizeof(mac));
+
+   return mac;
+}
+
+/*
+ *	stateless_pad -- Calculate the 32-bit address pad for a MAC
+ */
+static uint32_t
+stateless_pad(uint32_t mac) {
+   unsigned char md[16];
+   uint32_t pad;
+
+   hmac_md5((unsigned char *) &mac, sizeof(mac), stateless_key,
+            sizeof(stateless_key), md);
+   memcpy(&pad, md, sizeof(pad));
+
+   return pad;
+}
+
+/*
+ *	stateless_cookie -- Generate the stateless cookie for a target
+ *
+ *	Inputs:
+ *
+ *	icookie	The initiator cookie to fill in
+ *	addr	The target address
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+stateless_cookie(uint32_t *icookie, struct in_addr addr) {
+   icookie[1] = stateless_mac(addr.s_addr);
+   icookie[0] = addr.s_addr ^ stateless_pad(icookie[1]);
+}
+
+/*
+ *	stateless_cookie_check -- Check a stateless cookie and recover target
+ *
+ *	Inputs:
+ *
+ *	icookie	The initiator cookie from a received packet
+ *	addr	The recovered target address
+ *
+ *	Returns:
+ *
+ *	1 if the cookie is valid, or 0 if it is not.
+ *
+ *	The target address is only stored in addr if the cookie is valid.
+ */
+int
+stateless_cookie_check(const uint32_t *icookie, struct in_addr *addr) {
+   uint32_t target;
+
+   target = icookie[0] ^ stateless_pad(icookie[1]);
+   if (stateless_mac(target) != icookie[1])
+      return 0;
+   addr->s_addr = target;
+
+   return 1;
+}
+
+/*
+ *	stateless_seen_before -- Check if a responder has been seen recently
+ *
+ *	Inputs:
+ *
+ *	addr	The target address recovered from the cookie
+ *
+ *	Returns:
+ *
+ *	1 if the address has been seen recently, or 0 if not.
+ *
+ *	IKE responders retransmit their response, so without per-host state
+ *	we would display each responder several times.  We keep a fixed size
+ *	direct mapped table of recent responders to suppress these.  A busy
+ *	scan can evict an entry before its retransmissions arrive, so this
+ *	reduces duplicates rather than eliminating them.
+ */
+int
+stateless_seen_before(struct in_addr addr) {
+   uint32_t slot;
+
+   slot = (uint32_t) (addr.s_addr * 0x9e3779b1U) >> 16;
+   if (stateless_seen[slot] == addr.s_addr)
+      return 1;
+   stateless_seen[slot] = addr.s_addr;
+
+   return 0;
+}
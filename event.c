@@ -0,0 +1,358 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * event.c -- Event wait and send rate functions for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * The main loop waits until either the socket becomes readable or the
+ * next send deadline is reached.  Deadlines are absolute times in
+ * nanoseconds on the monotonic clock, so that the send schedule does not
+ * drift with the time spent processing each loop.
+ *
+ * On systems with epoll and timerfd, the deadline is set on a timerfd as
+ * an absolute time and a single epoll_wait() covers both the timer and
+ * the socket.  The timerfd has nanosecond resolution and is not subject
+ * to the timer slack that the kernel adds to select() timeouts, which
+ * allows packet intervals of a few microseconds.  Other systems use
+ * select() with a relative timeout.
+ *
+ * The send rate is limited with a token bucket.  One token is earned per
+ * packet interval up to the bucket size, and each packet sent uses one
+ * token.  The bucket size sets how many packets can be sent back to back
+ * when the main loop has been delayed, for example by timer slack or by
+ * processing a burst of responses.
+ */
+
+#include "ike-scan.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H) && \
+    defined(HAVE_TIMERFD_CREATE) && defined(HAVE_CLOCK_GETTIME)
+#define USE_EPOLL 1
+#endif
+
+static int event_sock = -1;	/* Socket to wait on, or -1 for none */
+#ifdef USE_EPOLL
+static int epoll_fd = -1;	/* epoll instance */
+static int timer_fd = -1;	/* Deadline timer */
+#endif
+
+/*
+ *	monotonic_ns -- Return the current monotonic time in nanoseconds
+ *
+ *	Inputs:
+ *
+ *	None.
+ *
+ *	Returns:
+ *
+ *	The current time in nanoseconds from an arbitrary starting point.
+ *
+ *	If clock_gettime() is not available, we use gettimeofday() instead,
+ *	which is not monotonic and only has microsecond resolution.
+ */
+IKE_UINT64
+monotonic_ns(void) {
+#ifdef HAVE_CLOCK_GETTIME
+   struct timespec ts;
+
+   if ((clock_gettime(CLOCK_MONOTONIC, &ts)) != 0)
+      err_sys("clock_gettime");
+   return (IKE_UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+   struct timeval tv;
+
+   Gettimeofday(&tv);
+   return (IKE_UINT64)tv.tv_sec * 1000000000 + (IKE_UINT64)tv.tv_usec * 1000;
+#endif
+}
+
+/*
+ *	event_init -- Initialise the event wait functions
+ *
+ *	Inputs:
+ *
+ *	s	The socket to wait on, or -1 to wait for deadlines only.
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+event_init(int s) {
+#ifdef USE_EPOLL
+   struct epoll_event ev;
+#endif
+
+   event_sock = s;
+#ifdef USE_EPOLL
+   if ((epoll_fd = epoll_create(2)) < 0)
+      err_sys("epoll_create");
+   if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0)
+      err_sys("timerfd_create");
+
+   memset(&ev, '\0', sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.fd = timer_fd;
+   if ((epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev)) != 0)
+      err_sys("epoll_ctl");
+   if (s >= 0) {
+      ev.data.fd = s;
+      if ((epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &ev)) != 0)
+         err_sys("epoll_ctl");
+   }
+#endif
+}
+
+/*
+ *	event_wait -- Wait for the socket to become readable or a deadline
+ *
+ *	Inputs:
+ *
+ *	deadline	Absolute deadline from monotonic_ns().
+ *
+ *	Returns:
+ *
+ *	1 if the socket is readable, or 0 if the deadline was reached first.
+ *
+ *	If the deadline has already passed, this checks whether the socket
+ *	is readable without waiting.
+ */
+int
+event_wait(IKE_UINT64 deadline) {
+#ifdef USE_EPOLL
+   struct epoll_event ev[2];
+   struct itimerspec its;
+   uint64_t expirations;
+   int readable = 0;
+   int n;
+   int i;
+/*
+ *	Arm the timer at the absolute deadline.  A zero it_value would
+ *	disarm the timer, so a deadline of zero is rounded up to 1ns, which
+ *	has passed and so expires immediately.
+ */
+   memset(&its, '\0', sizeof(its));
+   if (deadline == 0)
+      deadline = 1;
+   its.it_value.tv_sec = deadline / 1000000000;
+   its.it_value.tv_nsec = deadline % 1000000000;
+   if ((timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL)) != 0)
+      err_sys("timerfd_settime");
+
+   if ((n = epoll_wait(epoll_fd, ev, 2, -1)) < 0) {
+      if (errno == EINTR)
+         return 0;	/* Handle "Interrupted System call" as timeout */
+      else
+         err_sys("epoll_wait");
+   }
+   for (i=0; i<n; i++) {
+      if (ev[i].data.fd == timer_fd) {
+         if ((read(timer_fd, &expirations, sizeof(expirations))) < 0 &&
+             errno != EAGAIN)
+            err_sys("read timerfd");
+      } else {
+         readable = 1;
+      }
+   }
+
+   return readable;
+#else
+   fd_set readset;
+   struct timeval to;
+   IKE_UINT64 now;
+   IKE_UINT64 tmo;
+   int n;
+
+   now = monotonic_ns();
+   tmo = deadline > now ? (deadline - now) / 1000 : 0;	/* us */
+   to.tv_sec  = tmo/1000000;
+   to.tv_usec = (tmo - 1000000*to.tv_sec);
+   if (event_sock < 0) {
+      n = select(0, NULL, NULL, NULL, &to);
+   } else {
+      FD_ZERO(&readset);
+      FD_SET(event_sock, &readset);
+      n = select(event_sock+1, &readset, NULL, NULL, &to);
+   }
+   if (n < 0) {
+      if (errno == EINTR)
+         return 0;	/* Handle "Interrupted System call" as timeout */
+      else
+         err_sys("ERROR: select");
+   }
+
+   return n > 0 && event_sock >= 0;
+#endif
+}
+
+/*
+ *	event_sleep -- Sleep until a deadline
+ *
+ *	Inputs:
+ *
+ *	deadline	Absolute deadline from monotonic_ns().
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Unlike event_wait(), this does not use any shared state, so it can be
+ *	called from several threads at once.  It may return early if it is
+ *	interrupted by a signal.
+ */
+void
+event_sleep(IKE_UINT64 deadline) {
+#if defined(HAVE_CLOCK_NANOSLEEP) && defined(HAVE_CLOCK_GETTIME)
+   struct timespec ts;
+
+   ts.tv_sec = deadline / 1000000000;
+   ts.tv_nsec = deadline % 1000000000;
+   clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#else
+   struct timeval to;
+   IKE_UINT64 now;
+   IKE_UINT64 tmo;
+
+   now = monotonic_ns();
+   if (deadline <= now)
+      return;
+   tmo = (deadline - now) / 1000;	/* us */
+   to.tv_sec  = tmo/1000000;
+   to.tv_usec = (tmo - 1000000*to.tv_sec);
+   select(0, NULL, NULL, NULL, &to);
+#endif
+}
+
+/*
+ *	token_bucket_init -- Initialise a token bucket
+ *
+ *	Inputs:
+ *
+ *	tb		The token bucket to initialise
+ *	interval_ns	Time to earn one token in ns, or 0 for no limit
+ *	burst		Maximum number of tokens in the bucket
+ *	now		The current time from monotonic_ns()
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The bucket starts with one token, so that the first packet can be
+ *	sent immediately but the scan does not start with a burst.
+ */
+void
+token_bucket_init(token_bucket *tb, IKE_UINT64 interval_ns, unsigned burst,
+                  IKE_UINT64 now) {
+   tb->interval_ns = interval_ns;
+   tb->burst = burst ? burst : 1;
+   tb->tokens = 1;
+   tb->last_ns = now;
+}
+
+/*
+ *	token_bucket_available -- Return the number of tokens available now
+ *
+ *	Inputs:
+ *
+ *	tb	The token bucket
+ *	now	The current time from monotonic_ns()
+ *
+ *	Returns:
+ *
+ *	The number of tokens in the bucket after adding those earned since
+ *	the last call.
+ *
+ *	The time of the last token earned advances in whole intervals so
+ *	that part intervals are not lost, even when the bucket is full.
+ *	Otherwise a bucket of one token would lose the time by which each
+ *	wakeup is late, and the average rate would fall short.
+ */
+unsigned
+token_bucket_available(token_bucket *tb, IKE_UINT64 now) {
+   IKE_UINT64 earned;
+
+   if (!tb->interval_ns)
+      return tb->burst;
+   if (now > tb->last_ns) {
+      earned = (now - tb->last_ns) / tb->interval_ns;
+      if (tb->tokens + earned >= tb->burst) {
+         tb->tokens = tb->burst;
+         tb->last_ns = now - (now - tb->last_ns) % tb->interval_ns;
+      } else {
+         tb->tokens += earned;
+         tb->last_ns += earned * tb->interval_ns;
+      }
+   }
+   return tb->tokens;
+}
+
+/*
+ *	token_bucket_consume -- Remove tokens from the bucket
+ *
+ *	Inputs:
+ *
+ *	tb	The token bucket
+ *	n	The number of tokens to remove
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The caller must not remove more tokens than token_bucket_available()
+ *	returned.
+ */
+void
+token_bucket_consume(token_bucket *tb, unsigned n) {
+   if (tb->interval_ns)
+      tb->tokens -= n;
+}
+
+/*
+ *	token_bucket_next -- Return the time when the next token is earned
+ *
+ *	Inputs:
+ *
+ *	tb	The token bucket
+ *
+ *	Returns:
+ *
+ *	The time from monotonic_ns() when the next token will be earned.
+ */
+IKE_UINT64
+token_bucket_next(const token_bucket *tb) {
+   return tb->last_ns + tb->interval_ns;
+}
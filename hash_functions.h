@@ -117,42 +117,88 @@ SHA1(const unsigned char *d, size_t n, unsigned char *md) {
 #endif
 
 /*
- *	hmac_md5 -- Calculate HMAC-MD5 keyed hash
+ *	HMAC key state.  This holds the hash state after the inner and outer
+ *	padded key blocks, so that several messages can be hashed with the
+ *	same key without hashing the key blocks again each time.
+ */
+typedef struct {
+#ifdef HAVE_OPENSSL
+   MD5_CTX inner;
+   MD5_CTX outer;
+#else
+   md5_state_t inner;
+   md5_state_t outer;
+#endif
+} hmac_md5_ctx;
+
+typedef struct {
+#ifdef HAVE_OPENSSL
+   SHA_CTX inner;
+   SHA_CTX outer;
+#else
+   SHA1_CTX inner;
+   SHA1_CTX outer;
+#endif
+} hmac_sha1_ctx;
+
+/*
+ *	hmac_pads -- Build the HMAC inner and outer padded key blocks
  *
  *	Inputs:
  *
- *	text		The data to hash
- *	text_len	Length of the data in bytes
- *	key		The key
+ *	key		The key, no more than 64 bytes
  *	key_len		Length of the key in bytes
- *	digest		The resulting HMAC-MD5 digest
+ *	k_ipad		The resulting inner pad, 64 bytes
+ *	k_opad		The resulting outer pad, 64 bytes
  *
  *	Returns:
  *
- *	The HMAC-MD5 hash.
+ *	None.
+ */
+static inline void
+hmac_pads(const unsigned char *key, size_t key_len, unsigned char *k_ipad,
+          unsigned char *k_opad) {
+   size_t i;
+
+   /*
+    * the HMAC transform looks like:
+    *
+    * H(K XOR opad, H(K XOR ipad, text))
+    *
+    * where K is an n byte key
+    * ipad is the byte 0x36 repeated 64 times
+    * opad is the byte 0x5c repeated 64 times
+    * and text is the data being protected
+    */
+   for (i=0; i<key_len; i++) {
+      k_ipad[i] = key[i] ^ 0x36;
+      k_opad[i] = key[i] ^ 0x5c;
+   }
+   memset(k_ipad + key_len, 0x36, 64 - key_len);
+   memset(k_opad + key_len, 0x5c, 64 - key_len);
+}
+
+/*
+ *	hmac_md5_init -- Set up HMAC-MD5 key state
  *
- *	This function is based on the code from the RFC 2104 appendix.
+ *	Inputs:
  *
- *	We use #ifdef to select either the OpenSSL MD5 functions or the
- *	built-in MD5 functions depending on whether HAVE_OPENSSL is defined.
- *	This is faster that calling OpenSSL "HMAC" directly.
+ *	hc		The key state to set up
+ *	key		The key
+ *	key_len		Length of the key in bytes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This hashes the inner and outer padded key blocks, which are the
+ *	only part of the HMAC that depends on the key alone.
  */
-static inline unsigned char *
-hmac_md5(const unsigned char *text, size_t text_len, const unsigned char *key,
-         size_t key_len, unsigned char *md) {
-   static unsigned char m[16];
-#ifdef HAVE_OPENSSL
-   MD5_CTX context;
-#else
-   md5_state_t context;
-#endif
-   unsigned char k_ipad[65];	/* inner padding -  key XORd with ipad */
-   unsigned char k_opad[65];    /* outer padding -  key XORd with opad */
+static inline void
+hmac_md5_init(hmac_md5_ctx *hc, const unsigned char *key, size_t key_len) {
+   unsigned char k_ipad[64];	/* inner padding -  key XORd with ipad */
+   unsigned char k_opad[64];    /* outer padding -  key XORd with opad */
    unsigned char tk[16];
-   int i;
-
-   if (md == NULL)	/* Use static storage if no buffer specified */
-      md=m;
 
    /* if key is longer than 64 bytes reset it to key=MD5(key) */
    if (key_len > 64) {
@@ -173,56 +219,55 @@ hmac_md5(const unsigned char *text, size_t text_len, const unsigned char *key,
       key = tk;
       key_len = 16;
    }
-   /*
-    * the HMAC_MD5 transform looks like:
-    *
-    * MD5(K XOR opad, MD5(K XOR ipad, text))
-    *
-    * where K is an n byte key
-    * ipad is the byte 0x36 repeated 64 times
-    * opad is the byte 0x5c repeated 64 times
-    * and text is the data being protected
-    */
-
-   /* start out by storing key in pads */
-   memset(k_ipad, '\0', sizeof k_ipad);
-   memset(k_opad, '\0', sizeof k_opad);
-   memcpy(k_ipad, key, key_len);
-   memcpy(k_opad, key, key_len);
+   hmac_pads(key, key_len, k_ipad, k_opad);
+#ifdef HAVE_OPENSSL
+   MD5_Init(&hc->inner);
+   MD5_Update(&hc->inner, k_ipad, 64);
+   MD5_Init(&hc->outer);
+   MD5_Update(&hc->outer, k_opad, 64);
+#else
+   md5_init(&hc->inner);
+   md5_append(&hc->inner, k_ipad, 64);
+   md5_init(&hc->outer);
+   md5_append(&hc->outer, k_opad, 64);
+#endif
+}
 
-   /* XOR key with ipad and opad values */
-   for (i=0; i<64; i++) {
-      k_ipad[i] ^= 0x36;
-      k_opad[i] ^= 0x5c;
-   }
+/*
+ *	hmac_md5_final -- Calculate HMAC-MD5 using precomputed key state
+ *
+ *	Inputs:
+ *
+ *	hc		The key state from hmac_md5_init()
+ *	text		The data to hash
+ *	text_len	Length of the data in bytes
+ *	md		The resulting HMAC-MD5 digest
+ *
+ *	Returns:
+ *
+ *	The HMAC-MD5 hash.
+ *
+ *	The key state is not changed, so it can be used again.
+ */
+static inline unsigned char *
+hmac_md5_final(const hmac_md5_ctx *hc, const unsigned char *text,
+               size_t text_len, unsigned char *md) {
 #ifdef HAVE_OPENSSL
-   /*
-    * perform inner MD5
-    */
-   MD5_Init(&context);			/* init context for 1st pass */
-   MD5_Update(&context, k_ipad, 64);	/* start with inner pad */
+   MD5_CTX context;
+
+   context = hc->inner;
    MD5_Update(&context, text, text_len); /* then text of datagram */
    MD5_Final(md, &context);		/* finish up 1st pass */
-   /*
-    * perform outer MD5
-    */
-   MD5_Init(&context);			/* init context for 2nd pass */
-   MD5_Update(&context, k_opad, 64);	/* start with outer pad */
+   context = hc->outer;
    MD5_Update(&context, md, 16);	/* then results of 1st hash */
    MD5_Final(md, &context);		/* finish up 2nd pass */
 #else
-   /*
-    * perform inner MD5
-    */
-   md5_init(&context);			/* init context for 1st pass */
-   md5_append(&context, k_ipad, 64);	/* start with inner pad */
+   md5_state_t context;
+
+   context = hc->inner;
    md5_append(&context, text, text_len); /* then text of datagram */
    md5_finish(&context, md);		/* finish up 1st pass */
-   /*
-    * perform outer MD5
-    */
-   md5_init(&context);			/* init context for 2nd pass */
-   md5_append(&context, k_opad, 64);	/* start with outer pad */
+   context = hc->outer;
    md5_append(&context, md, 16);	/* then results of 1st hash */
    md5_finish(&context, md);		/* finish up 2nd pass */
 #endif
@@ -231,7 +276,7 @@ hmac_md5(const unsigned char *text, size_t text_len, const unsigned char *key,
 }
 
 /*
- *	hmac_sha1 -- Calculate HMAC-SHA1 keyed hash
+ *	hmac_md5 -- Calculate HMAC-MD5 keyed hash
  *
  *	Inputs:
  *
@@ -239,35 +284,53 @@ hmac_md5(const unsigned char *text, size_t text_len, const unsigned char *key,
  *	text_len	Length of the data in bytes
  *	key		The key
  *	key_len		Length of the key in bytes
- *	digest		The resulting HMAC-SHA1 digest
+ *	digest		The resulting HMAC-MD5 digest
  *
  *	Returns:
  *
- *	The HMAC-SHA1 hash.
+ *	The HMAC-MD5 hash.
  *
  *	This function is based on the code from the RFC 2104 appendix.
  *
- *	We use #ifdef to select either the OpenSSL SHA1 functions or the
- *	built-in SHA1 functions depending on whether HAVE_OPENSSL is defined.
+ *	We use #ifdef to select either the OpenSSL MD5 functions or the
+ *	built-in MD5 functions depending on whether HAVE_OPENSSL is defined.
  *	This is faster that calling OpenSSL "HMAC" directly.
  */
 static inline unsigned char *
-hmac_sha1(const unsigned char *text, size_t text_len, const unsigned char *key,
-          size_t key_len, unsigned char *md) {
-   static unsigned char m[20];
-#ifdef HAVE_OPENSSL
-   SHA_CTX context;
-#else
-   SHA1_CTX context;
-#endif
-   unsigned char k_ipad[65];	/* inner padding -  key XORd with ipad */
-   unsigned char k_opad[65];    /* outer padding -  key XORd with opad */
-   unsigned char tk[20];
-   int i;
+hmac_md5(const unsigned char *text, size_t text_len, const unsigned char *key,
+         size_t key_len, unsigned char *md) {
+   static unsigned char m[16];
+   hmac_md5_ctx hc;
 
    if (md == NULL)	/* Use static storage if no buffer specified */
       md=m;
 
+   hmac_md5_init(&hc, key, key_len);
+   return hmac_md5_final(&hc, text, text_len, md);
+}
+
+/*
+ *	hmac_sha1_init -- Set up HMAC-SHA1 key state
+ *
+ *	Inputs:
+ *
+ *	hc		The key state to set up
+ *	key		The key
+ *	key_len		Length of the key in bytes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This hashes the inner and outer padded key blocks, which are the
+ *	only part of the HMAC that depends on the key alone.
+ */
+static inline void
+hmac_sha1_init(hmac_sha1_ctx *hc, const unsigned char *key, size_t key_len) {
+   unsigned char k_ipad[64];	/* inner padding -  key XORd with ipad */
+   unsigned char k_opad[64];    /* outer padding -  key XORd with opad */
+   unsigned char tk[20];
+
    /* if key is longer than 64 bytes reset it to key=SHA1(key) */
    if (key_len > 64) {
 #ifdef HAVE_OPENSSL
@@ -287,56 +350,55 @@ hmac_sha1(const unsigned char *text, size_t text_len, const unsigned char *key,
       key = tk;
       key_len = 20;
    }
-   /*
-    * the HMAC_SHA1 transform looks like:
-    *
-    * SHA1(K XOR opad, SHA1(K XOR ipad, text))
-    *
-    * where K is an n byte key
-    * ipad is the byte 0x36 repeated 64 times
-    * opad is the byte 0x5c repeated 64 times
-    * and text is the data being protected
-    */
-
-   /* start out by storing key in pads */
-   memset(k_ipad, '\0', sizeof k_ipad);
-   memset(k_opad, '\0', sizeof k_opad);
-   memcpy(k_ipad, key, key_len);
-   memcpy(k_opad, key, key_len);
+   hmac_pads(key, key_len, k_ipad, k_opad);
+#ifdef HAVE_OPENSSL
+   SHA1_Init(&hc->inner);
+   SHA1_Update(&hc->inner, k_ipad, 64);
+   SHA1_Init(&hc->outer);
+   SHA1_Update(&hc->outer, k_opad, 64);
+#else
+   SHA1Init(&hc->inner);
+   SHA1Update(&hc->inner, k_ipad, 64);
+   SHA1Init(&hc->outer);
+   SHA1Update(&hc->outer, k_opad, 64);
+#endif
+}
 
-   /* XOR key with ipad and opad values */
-   for (i=0; i<64; i++) {
-      k_ipad[i] ^= 0x36;
-      k_opad[i] ^= 0x5c;
-   }
+/*
+ *	hmac_sha1_final -- Calculate HMAC-SHA1 using precomputed key state
+ *
+ *	Inputs:
+ *
+ *	hc		The key state from hmac_sha1_init()
+ *	text		The data to hash
+ *	text_len	Length of the data in bytes
+ *	md		The resulting HMAC-SHA1 digest
+ *
+ *	Returns:
+ *
+ *	The HMAC-SHA1 hash.
+ *
+ *	The key state is not changed, so it can be used again.
+ */
+static inline unsigned char *
+hmac_sha1_final(const hmac_sha1_ctx *hc, const unsigned char *text,
+                size_t text_len, unsigned char *md) {
 #ifdef HAVE_OPENSSL
-   /*
-    * perform inner SHA1
-    */
-   SHA1_Init(&context);			/* init context for 1st pass */
-   SHA1_Update(&context, k_ipad, 64);	/* start with inner pad */
+   SHA_CTX context;
+
+   context = hc->inner;
    SHA1_Update(&context, text, text_len); /* then text of datagram */
    SHA1_Final(md, &context);		/* finish up 1st pass */
-   /*
-    * perform outer SHA1
-    */
-   SHA1_Init(&context);			/* init context for 2nd pass */
-   SHA1_Update(&context, k_opad, 64);	/* start with outer pad */
+   context = hc->outer;
    SHA1_Update(&context, md, 20);	/* then results of 1st hash */
    SHA1_Final(md, &context);		/* finish up 2nd pass */
 #else
-   /*
-    * perform inner SHA1
-    */
-   SHA1Init(&context);			/* init context for 1st pass */
-   SHA1Update(&context, k_ipad, 64);	/* start with inner pad */
+   SHA1_CTX context;
+
+   context = hc->inner;
    SHA1Update(&context, (unsigned char *)text, text_len); /* then text of datagram */
    SHA1Final(md, &context);		/* finish up 1st pass */
-   /*
-    * perform outer SHA1
-    */
-   SHA1Init(&context);			/* init context for 2nd pass */
-   SHA1Update(&context, k_opad, 64);	/* start with outer pad */
+   context = hc->outer;
    SHA1Update(&context, md, 20);	/* then results of 1st hash */
    SHA1Final(md, &context);		/* finish up 2nd pass */
 #endif
@@ -344,4 +406,38 @@ hmac_sha1(const unsigned char *text, size_t text_len, const unsigned char *key,
    return md;
 }
 
+/*
+ *	hmac_sha1 -- Calculate HMAC-SHA1 keyed hash
+ *
+ *	Inputs:
+ *
+ *	text		The data to hash
+ *	text_len	Length of the data in bytes
+ *	key		The key
+ *	key_len		Length of the key in bytes
+ *	digest		The resulting HMAC-SHA1 digest
+ *
+ *	Returns:
+ *
+ *	The HMAC-SHA1 hash.
+ *
+ *	This function is based on the code from the RFC 2104 appendix.
+ *
+ *	We use #ifdef to select either the OpenSSL SHA1 functions or the
+ *	built-in SHA1 functions depending on whether HAVE_OPENSSL is defined.
+ *	This is faster that calling OpenSSL "HMAC" directly.
+ */
+static inline unsigned char *
+hmac_sha1(const unsigned char *text, size_t text_len, const unsigned char *key,
+          size_t key_len, unsigned char *md) {
+   static unsigned char m[20];
+   hmac_sha1_ctx hc;
+
+   if (md == NULL)	/* Use static storage if no buffer specified */
+      md=m;
+
+   hmac_sha1_init(&hc, key, key_len);
+   return hmac_sha1_final(&hc, text, text_len, md);
+}
+
 #endif  /* IKE_SCAN_HASH_H */
@@ -59,11 +59,14 @@
 #include "hash_functions.h"
 
 /* Global variables */
-host_entry *helist = NULL;	/* Dynamic array of host entries */
-host_entry **helistptr;		/* Array of pointers to host entries */
-host_entry **cursor;		/* Pointer to current list entry */
+target_list targets;		/* Target addresses to scan */
+scan_shard *shards;		/* Host list shards */
+unsigned num_shards = 1;	/* Number of shards, one per thread */
+static host_pool stateless_pool;	/* Entries for stateless responses */
 pattern_list *patlist = NULL;	/* Backoff pattern list */
 vid_pattern_list *vidlist = NULL;	/* Vendor ID pattern list */
+vid_matcher *vidmatch = NULL;	/* Compiled Vendor ID patterns */
+backoff_matcher *backoffmatch = NULL;	/* Indexed backoff patterns */
 char **idlist = NULL;		/* Array of pointers to ID strings */
 static int verbose=0;			/* Verbose level */
 unsigned experimental_value=0;		/* Experimental value */
@@ -87,6 +90,8 @@ int shownum_flag=0;		/* Display packet number */
 int nat_t_flag=0;		/* RFC 3947 NAT Traversal */
 int bindip_flag=0;             /* Set bind IP address flag */
 uint32_t bind_ip_val;		/* IP address to bind to */
+int stateless_flag=0;		/* Use stateless cookies */
+int output_format=FORMAT_TEXT;	/* --format output format */
 
 extern const id_name_map notification_map[];
 extern const id_name_map attr_map[];
@@ -167,6 +172,15 @@ main(int argc, char *argv[]) {
       {"nat-t", no_argument, 0, OPT_NAT_T},
       {"rcookie", required_argument, 0, OPT_RCOOKIE},
       {"readpktfromfile", required_argument, 0, OPT_READPKTFROMFILE},
+      {"stateless", no_argument, 0, OPT_STATELESS},
+      {"rcvbuf", required_argument, 0, OPT_RCVBUF},
+      {"pps", required_argument, 0, OPT_PPS},
+      {"burst", required_argument, 0, OPT_BURST},
+      {"threads", required_argument, 0, OPT_THREADS},
+      {"dnsthreads", required_argument, 0, OPT_DNSTHREADS},
+      {"format", required_argument, 0, OPT_FORMAT},
+      {"patterndb", required_argument, 0, OPT_PATTERNDB},
+      {"compiledb", no_argument, 0, OPT_COMPILEDB},
       {"experimental", required_argument, 0, 'X'},
       {0, 0, 0, 0}
    };
@@ -235,17 +249,26 @@ main(int argc, char *argv[]) {
    struct sockaddr_in sa_local;
    struct sockaddr_in sa_peer;
    struct timeval now;
-   unsigned char packet_in[MAXUDP];	/* Received packet */
+   unsigned char *packet_in;	/* Received packet */
+   recv_slot *recv_ring;	/* Ring of receive buffers */
+   unsigned num_recv;		/* Number of packets in receive ring */
+   unsigned recv_no;		/* Current packet in receive ring */
+   int rcvbuf=0;		/* Socket receive buffer size, or 0 */
    int n;
    host_entry *temp_cursor;
    struct timeval diff;		/* Difference between two timevals */
-   IKE_UINT64 loop_timediff;	/* Time since last packet sent in us */
-   IKE_UINT64 host_timediff;	/* Time since last packet sent to this host */
    unsigned long end_timediff=0; /* Time since last packet received in ms */
-   int req_interval;		/* Requested per-packet interval */
-   int select_timeout;		/* Select timeout */
-   int cum_err=0;		/* Cumulative timing error */
-   static int reset_cum_err;
+   unsigned long send_timediff=0; /* Time since last packet sent in ms */
+   IKE_UINT64 interval_ns;	/* Interval between packets in ns */
+   IKE_UINT64 now_ns;		/* Current monotonic time in ns */
+   IKE_UINT64 deadline_ns;	/* Deadline for this wait */
+   send_params params;		/* Send parameters for all shards */
+   scan_shard *sh;		/* Shard for received packet */
+   unsigned shard_no;
+   unsigned pps=0;		/* Packets per second, or 0 */
+   unsigned burst=0;		/* Token bucket size, or 0 for automatic */
+   unsigned dns_threads=DEFAULT_DNS_THREADS;	/* Max name lookup threads */
+   unsigned packets_sent=0;	/* Total number of packets sent */
    struct timeval start_time;	/* Program start time */
    struct timeval end_time;	/* Program end time */
    struct timeval last_packet_time; /* Time last packet was sent */
@@ -253,10 +276,11 @@ main(int argc, char *argv[]) {
    double elapsed_seconds;	/* Elapsed time in seconds */
    char patfile[MAXLINE];	/* IKE Backoff pattern file name */
    char vidfile[MAXLINE];	/* IKE Vendor ID pattern file name */
+   char patterndb[MAXLINE];	/* Compiled pattern database file name */
+   int compiledb_flag = 0;	/* Compile the pattern database and exit */
+   pattern_db *db;		/* Compiled pattern database */
    char idfile[MAXLINE];	/* Aggressive Mode ID list */
    char psk_crack_file[MAXLINE];/* PSK crack data output file name */
-   unsigned pass_no=0;
-   int first_timeout=1;
    unsigned char *vid_data;	/* Binary Vendor ID data */
    size_t vid_data_len;		/* Vendor ID data length */
    int showbackoff_flag = 0;	/* Display backoff table? */
@@ -265,11 +289,11 @@ main(int argc, char *argv[]) {
    size_t packet_out_len;	/* Length of IKE packet to send */
    unsigned sa_responders = 0;	/* Number of hosts giving handshake */
    unsigned notify_responders = 0;	/* Number of hosts giving notify msg */
-   unsigned num_hosts = 0;	/* Number of entries in the list */
+   unsigned num_hosts;		/* Number of target hosts */
    unsigned live_count;		/* Number of entries awaiting reply */
+   int pending;			/* Set if there are targets left */
    int quiet=0;			/* Only print the basic info if nonzero */
    int multiline=0;		/* Split decodes across lines if nonzero */
-   unsigned hostno;
    unsigned bandwidth=DEFAULT_BANDWIDTH; /* Bandwidth in bits per sec */
    unsigned char *cookie_data=NULL;
    size_t cookie_data_len;
@@ -284,6 +308,7 @@ main(int argc, char *argv[]) {
  */
    patfile[0] = '\0';
    vidfile[0] = '\0';
+   patterndb[0] = '\0';
    idfile[0]  = '\0';
 /*
  *	Set lifetime and lifesize parameters to the default.
@@ -580,6 +605,56 @@ main(int argc, char *argv[]) {
             strlcpy(pkt_filename, optarg, sizeof(pkt_filename));
             pkt_read_filename_flag=1;
             break;
+         case OPT_STATELESS:	/* --stateless */
+            stateless_flag=1;
+            break;
+         case OPT_RCVBUF:	/* --rcvbuf */
+            rcvbuf=Strtoul(optarg, 10);
+            break;
+         case OPT_PPS:		/* --pps */
+            pps=Strtoul(optarg, 10);
+            if (pps == 0)
+               err_msg("ERROR: The --pps value must be greater than zero");
+            break;
+         case OPT_BURST:	/* --burst */
+            burst=Strtoul(optarg, 10);
+            if (burst == 0)
+               err_msg("ERROR: The --burst value must be greater than zero");
+            break;
+         case OPT_THREADS:	/* --threads */
+            num_shards=Strtoul(optarg, 10);
+            if (num_shards < 1 || num_shards > MAX_THREADS)
+               err_msg("ERROR: The --threads value must be between 1 and %d",
+                       MAX_THREADS);
+#ifndef HAVE_THREADS
+            if (num_shards > 1)
+               err_msg("ERROR: This build of ike-scan does not support --threads");
+#endif
+            break;
+         case OPT_DNSTHREADS:	/* --dnsthreads */
+            dns_threads=Strtoul(optarg, 10);
+            if (dns_threads > MAX_DNS_THREADS)
+               err_msg("ERROR: The --dnsthreads value must be between 0 and %d",
+                       MAX_DNS_THREADS);
+            break;
+         case OPT_FORMAT:	/* --format */
+            if (!strcmp(optarg, "text")) {
+               output_format = FORMAT_TEXT;
+            } else if (!strcmp(optarg, "jsonl")) {
+               output_format = FORMAT_JSONL;
+            } else if (!strcmp(optarg, "binary")) {
+               output_format = FORMAT_BINARY;
+            } else {
+               err_msg("ERROR: Unknown output format \"%s\", should be text, "
+                       "jsonl or binary", optarg);
+            }
+            break;
+         case OPT_PATTERNDB:	/* --patterndb */
+            strlcpy(patterndb, optarg, sizeof(patterndb));
+            break;
+         case OPT_COMPILEDB:	/* --compiledb */
+            compiledb_flag=1;
+            break;
          case 'X':	/* --experimental */
             experimental_value = Strtoul(optarg, 0);
             break;
@@ -587,6 +662,14 @@ main(int argc, char *argv[]) {
             usage(EXIT_FAILURE, 0);	/* Doesn't return */
       }
    }
+/*
+ *	If --compiledb was specified, compile the patterns files into the
+ *	pattern database and exit.
+ */
+   if (compiledb_flag) {
+      compile_pattern_db(patterndb, vidfile, patfile);
+      exit(EXIT_SUCCESS);
+   }
 /*
  *	Seed random number generator.
  *	If the random seed has been specified (is non-zero), then use that.
@@ -599,6 +682,11 @@ main(int argc, char *argv[]) {
       random_seed = ((unsigned) tv.tv_usec ^ (unsigned) getpid());
    }
    init_genrand(random_seed);
+/*
+ *	Choose the stateless cookie key before any hosts are added.
+ */
+   if (stateless_flag)
+      stateless_cookie_init(dest_port);
 /*
  *	Create network socket and bind to local source port.
  */
@@ -629,6 +717,24 @@ main(int argc, char *argv[]) {
          err_sys("setsockopt");
    }
 
+/*
+ *	Enlarge the socket receive buffer if required, so that large bursts
+ *	of responses are not dropped by the kernel.  The kernel may limit
+ *	the size, so report the actual size if verbose is on.
+ */
+   if (rcvbuf) {
+      int actual;
+      NET_SIZE_T actual_len = sizeof(actual);
+
+      if ((setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                      sizeof(rcvbuf))) != 0)
+         err_sys("setsockopt");
+      if (verbose &&
+          getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &actual, &actual_len) == 0)
+         warn_msg("DEBUG: requested rcvbuf=%d bytes, actual rcvbuf=%d bytes",
+                  rcvbuf, actual);
+   }
+
    memset(&sa_local, '\0', sizeof(sa_local));
    sa_local.sin_family = AF_INET;
    if (bindip_flag)
@@ -666,13 +772,17 @@ main(int argc, char *argv[]) {
       idstrings=load_id_strings(idfile);
    }
 /*
- *	Populate the list from the specified file if --file was specified, or
- *	otherwise from the remaining command line arguments.
+ *	Populate the target list from the specified file if --file was
+ *	specified, or otherwise from the remaining command line arguments.
+ *	The hosts are not expanded here: each pattern is stored as a range of
+ *	addresses, and host entries are only created when they are sent to.
+ *	A file is read on demand unless it is stdin or we are randomising.
  */
+   target_init(&targets);
+   targets.no_dns = no_dns_flag;
+   targets.dns_threads = dns_threads;
    if (filename_flag) {	/* Populate list from file */
       FILE *fp;
-      char line[MAXLINE];
-      char *cp;
 
       if ((strcmp(filename, "-")) == 0) {	/* Filename "-" means stdin */
          fp = stdin;
@@ -682,23 +792,33 @@ main(int argc, char *argv[]) {
          }
       }
 
-      while (fgets(line, MAXLINE, fp)) {
-         for (cp = line; !isspace((unsigned char)*cp) && *cp != '\0'; cp++)
-            ;
-         *cp = '\0';
-         add_host_pattern(line, timeout, &num_hosts,
-                          cookie_data, cookie_data_len);
+      if (fp == stdin || random_flag) {
+         target_load_file(&targets, fp);
+         if (fp != stdin)
+            fclose(fp);
+      } else {
+         target_open_file(&targets, fp);
       }
-      if (fp != stdin)
-         fclose(fp);
    } else {		/* Populate list from command line arguments */
       argv = &argv[optind];
       while (*argv) {
-         add_host_pattern(*argv, timeout, &num_hosts,
-                          cookie_data, cookie_data_len);
+         add_host_pattern(&targets, *argv);
          argv++;
       }
    }
+/*
+ *	Host names are looked up in the background while the scan runs.  We
+ *	must wait for the lookups to finish before putting the targets in
+ *	random order, or before connecting to the target with TCP.
+ */
+   if (random_flag || tcp_flag)
+      target_resolve_wait(&targets);
+   num_hosts = targets.count;
+/*
+ *	Check that we have at least one entry in the list.
+ */
+   if (!target_pending(&targets))
+      err_msg("ERROR: No hosts to process.");
 /*
  *	If we are using TCP transport, then connect the socket to the peer.
  *	We know that there is only one entry in the host list if we're using
@@ -725,7 +845,7 @@ main(int argc, char *argv[]) {
  */
       memset(&sa_tcp, '\0', sizeof(sa_tcp));
       sa_tcp.sin_family = AF_INET;
-      sa_tcp.sin_addr.s_addr = helist->addr.s_addr;
+      sa_tcp.sin_addr.s_addr = htonl(targets.range[0].first);
       sa_tcp.sin_port = htons(dest_port);
       sa_tcp_len = sizeof(sa_tcp);
       if ((connect(sockfd, (struct sockaddr *) &sa_tcp, sa_tcp_len)) != 0) {
@@ -739,21 +859,22 @@ main(int argc, char *argv[]) {
       alarm(0);
    }
 /*
- *	If we are displaying the backoff table, load known backoff
- *	patterns from the backoff patterns file.
+ *	Load the known Vendor ID patterns, and the known backoff patterns if
+ *	we are displaying the backoff table.  Use the compiled pattern
+ *	database if it is up to date, otherwise read the patterns files.
  */
+   db = open_pattern_db(patterndb, vidfile, patfile);
    if (showbackoff_flag) {
-      load_backoff_patterns(patfile, pattern_fuzz);
+      if (db)
+         patlist = pattern_db_backoff(db, pattern_fuzz);
+      else
+         load_backoff_patterns(patfile, pattern_fuzz);
+      backoffmatch = backoff_matcher_build(patlist);
    }
-/*
- *	Load known Vendor ID patterns from the Vendor ID file.
- */
-   load_vid_patterns(vidfile);
-/*
- *	Check that we have at least one entry in the list.
- */
-   if (!num_hosts)
-      err_msg("ERROR: No hosts to process.");
+   if (db)
+      vidmatch = pattern_db_vid_matcher(db);
+   if (vidmatch == NULL)
+      load_vid_patterns(vidfile);
 /*
  *	If --writepkttofile was specified, open the specified output file.
  */
@@ -778,6 +899,9 @@ main(int argc, char *argv[]) {
       err_msg("ERROR: You can only specify one target host with the --cookie option.");
    if (tcp_flag && num_hosts > 1)
       err_msg("ERROR: You can only specify one target host with the --tcp option.");
+   if (stateless_flag && (cookie_data || showbackoff_flag || shownum_flag))
+      err_msg("ERROR: The --stateless option cannot be used with --cookie,\n"
+              "       --showbackoff or --shownum.");
    if (*patfile != '\0' && !showbackoff_flag)
       warn_msg("WARNING: Specifying a backoff pattern file with --patterns or -p does not\n"
                "         have any effect unless you also specify --showbackoff or -o\n");
@@ -807,8 +931,22 @@ main(int argc, char *argv[]) {
    }
    if (psk_crack_flag && num_hosts > 1)
       err_msg("ERROR: You can only specify one target host with the --pskcrack (-P) option.");
+   if (psk_crack_flag && psk_crack_file[0] == '\0' &&
+       output_format != FORMAT_TEXT)
+      err_msg("ERROR: The --pskcrack (-P) option needs an output file with --format=jsonl\n"
+              "       or --format=binary.");
    if (interval && bandwidth != DEFAULT_BANDWIDTH)
       err_msg("ERROR: You cannot specify both --bandwidth and --interval.");
+   if (pps && (interval || bandwidth != DEFAULT_BANDWIDTH))
+      err_msg("ERROR: You cannot specify --pps with --bandwidth or --interval.");
+   if (num_shards > 1 && (tcp_flag || sourceip_flag || pkt_filename_flag ||
+                          pkt_read_filename_flag))
+      err_msg("ERROR: The --threads option cannot be used with --tcp, "
+              "--sourceip,\n       --writepkttofile or --readpktfromfile.");
+   if (num_shards > 1 && filename_flag && dns_threads == 0 && !no_dns_flag)
+      err_msg("ERROR: The --threads option cannot be used with --dnsthreads=0 "
+              "and --file,\n       because a slow name lookup would hold up "
+              "the receive loop.");
    if (ike_params.trans_flag != 0 && ike_params.ike_version == 2)
       warn_msg("WARNING: IKEv2 does not support custom proposals.");
    if (ike_params.ike_version == 2 &&
@@ -816,54 +954,103 @@ main(int argc, char *argv[]) {
       err_msg("ERROR: You can not specify both aggressive mode and IKEv2.\n"
               "       Aggressive mode is only applicable to IKEv1.");
 /*
- *      Create and initialise array of pointers to host entries.
- */
-   helistptr = Malloc(num_hosts * sizeof(host_entry *));
-   for (hostno=0; hostno<num_hosts; hostno++)
-      helistptr[hostno] = &helist[hostno];
-/*
- *      Randomise the list if required.
- *	Uses Knuth's shuffle algorithm.
+ *      Randomise the target order if required.
  */
-   if (random_flag) {
-      int i;
-      int r;
-      host_entry *temp;
-
-      for (i=num_hosts-1; i>0; i--) {
-         r = (int)(genrand_real2() * i);  /* 0<=r<i */
-         temp = helistptr[i];
-         helistptr[i] = helistptr[r];
-         helistptr[r] = temp;
-      }
-   }
+   if (random_flag)
+      target_randomise(&targets);
 /*
- *	Set current host pointer (cursor) to start of list, zero
- *	last packet sent time, set last receive time to now and
+ *	Zero last packet sent time, set last receive time to now and
  *	initialise static IKE header fields.
  */
-   live_count = num_hosts;
-   cursor = helistptr;
+   live_count = 0;
+   recv_ring = Malloc(RECV_BATCH_MAX * sizeof(recv_slot));
+   for (recv_no=0; recv_no<RECV_BATCH_MAX; recv_no++)
+      recv_ring[recv_no].buf = Malloc(MAXUDP);
    last_packet_time.tv_sec=0;
    last_packet_time.tv_usec=0;
    Gettimeofday(&last_recv_time);
    packet_out=initialise_ike_packet(&packet_out_len, &ike_params);
 /*
- *	Calculate the appropriate interval to achieve the required outgoing
- *	bandwidth unless an interval was specified.
+ *	Calculate the appropriate interval to achieve the required packet
+ *	rate or outgoing bandwidth unless an interval was specified.
  */
-   if (!interval) {
-      interval = ((IKE_UINT64)(packet_out_len+PACKET_OVERHEAD) * 8 * 1000000) /
-                 bandwidth;
+   if (interval) {
+      interval_ns = (IKE_UINT64)interval * 1000;
+   } else if (pps) {
+      interval_ns = 1000000000 / pps;
+   } else {
+      interval_ns = ((IKE_UINT64)(packet_out_len+PACKET_OVERHEAD) * 8 *
+                     1000000000) / bandwidth;
       if (verbose) {
-         warn_msg("DEBUG: pkt len=%u bytes, bandwidth=%u bps, int=%u us",
-                  packet_out_len, bandwidth, interval);
+         warn_msg("DEBUG: pkt len=%u bytes, bandwidth=%u bps, int=" IKE_UINT64_FORMAT " ns",
+                  packet_out_len, bandwidth, interval_ns);
       }
    }
+/*
+ *	Each shard sends at an equal share of the total rate.
+ */
+   interval_ns *= num_shards;
+/*
+ *	Initialise the token buckets.  Unless the burst size was specified,
+ *	allow enough tokens to cover DEFAULT_BURST_TIME, so that a late
+ *	wakeup of up to that time does not reduce the average rate.
+ */
+   if (!burst) {
+      if (!interval_ns || DEFAULT_BURST_TIME / interval_ns > SEND_BATCH_MAX)
+         burst = SEND_BATCH_MAX;
+      else if (DEFAULT_BURST_TIME / interval_ns < 1)
+         burst = 1;
+      else
+         burst = DEFAULT_BURST_TIME / interval_ns;
+   }
+   if (verbose) {
+      warn_msg("DEBUG: int=" IKE_UINT64_FORMAT " ns, burst=%u packets, threads=%u",
+               interval_ns, burst, num_shards);
+   }
+/*
+ *	Set up the shards.  Each shard takes targets from the shared target
+ *	list as it needs them, and has its own host entries and cookie index.
+ *	Every shard except the first has its own copy of the packet, because
+ *	sending writes the cookie into it.
+ */
+   params.sockfd = sockfd;
+   params.packet_out_len = packet_out_len;
+   params.source_port = source_port;
+   params.dest_port = dest_port;
+   params.retry = retry;
+   params.backoff_factor = backoff_factor;
+   params.timeout = timeout;
+   params.cookie_data = cookie_data;
+   params.cookie_data_len = cookie_data_len;
+   params.keep_responders = showbackoff_flag;
+   shards = Malloc(num_shards * sizeof(scan_shard));
+   memset(shards, '\0', num_shards * sizeof(scan_shard));
+   for (shard_no=0; shard_no<num_shards; shard_no++) {
+      sh = &shards[shard_no];
+      sh->id = shard_no;
+      sh->params = &params;
+      if (shard_no == 0) {
+         sh->packet_out = packet_out;
+      } else {
+         sh->packet_out = Malloc(packet_out_len);
+         memcpy(sh->packet_out, packet_out, packet_out_len);
+      }
+      token_bucket_init(&sh->bucket, interval_ns, burst, monotonic_ns());
+#ifdef HAVE_THREADS
+      if (num_shards > 1)
+         pthread_mutex_init(&sh->lock, NULL);
+#endif
+   }
+/*
+ *	Initialise the event wait functions.  There is nothing to receive
+ *	when spoofing the source address with --sourceip.
+ */
+   event_init(sourceip_flag ? -1 : sockfd);
 /*
  *	Display initial message.
  */
-   printf("Starting %s with %u hosts (http://www.nta-monitor.com/tools/ike-scan/)\n", PACKAGE_STRING, num_hosts);
+   if (output_format == FORMAT_TEXT)
+      printf("Starting %s with %u hosts (http://www.nta-monitor.com/tools/ike-scan/)\n", PACKAGE_STRING, num_hosts);
 /*
  *	Display the lists if verbose setting is 3 or more.
  */
@@ -873,138 +1060,99 @@ main(int argc, char *argv[]) {
          dump_backoff(pattern_fuzz);
       dump_vid();
    }
+/*
+ *	Start the output stage.  From here until output_finish(), results are
+ *	written by the output thread so that a slow stdout can't hold up the
+ *	main loop.
+ */
+   output_init(STDOUT_FILENO);
 /*
  *	Main loop: send packets to all hosts in order until a response
  *	has been received or the host has exhausted its retry limit.
+ *	After the first packet, each host is kept in the send schedule
+ *	until it is next due.
  *
- *	The loop exits when all hosts have either responded or timed out
- *	and, if showbackoff_flag is set, at least end_wait ms have elapsed
+ *	The loop exits when all targets have been sent to, all hosts have
+ *	either responded or timed out and, if showbackoff_flag is set, at
+ *	least end_wait ms have elapsed
  *	since the last packet was received and we have received at least one
  *	transform response.
- */
-   reset_cum_err = 1;
-   req_interval = interval;
-   while (live_count ||
-          (showbackoff_flag && sa_responders && (end_timediff < end_wait))) {
+ *
+ *	In stateless mode, each host is removed from the list as soon as its
+ *	single packet has been sent, so we also wait until the per-host
+ *	timeout has elapsed since the last packet was sent.
+ */
+#ifdef HAVE_THREADS
+   if (num_shards > 1) {
+      for (shard_no=0; shard_no<num_shards; shard_no++) {
+         if ((pthread_create(&shards[shard_no].thread, NULL, shard_thread,
+                             &shards[shard_no])) != 0)
+            err_msg("ERROR: pthread_create failed");
+      }
+   }
+#endif
+   pending = 1;
+   while (live_count || pending ||
+          (showbackoff_flag && sa_responders && (end_timediff < end_wait)) ||
+          (stateless_flag && (send_timediff < timeout))) {
 /*
  *	Obtain current time and calculate deltas since last packet and
  *	last packet to this host.
  */
       Gettimeofday(&now);
+      now_ns = monotonic_ns();
       timeval_diff(&now, &last_recv_time, &diff);
       end_timediff = 1000*diff.tv_sec + diff.tv_usec/1000;
-/*
- *	If the last packet was sent more than interval us ago, then we can
- *	potentially send a packet to the current host.
- */
+      shard_totals(&live_count, &packets_sent, &last_packet_time);
       timeval_diff(&now, &last_packet_time, &diff);
-      loop_timediff = (IKE_UINT64)1000000*diff.tv_sec + diff.tv_usec;
-      if (loop_timediff >= (unsigned)req_interval) {
-/*
- *	If the last packet to this host was sent more than the current
- *	timeout for this host us ago, then we can potentially send a packet
- *	to it.
- */
-         timeval_diff(&now, &((*cursor)->last_send_time), &diff);
-         host_timediff = (IKE_UINT64)1000000*diff.tv_sec + diff.tv_usec;
-         if (host_timediff >= (*cursor)->timeout && (*cursor)->live) {
-            if (reset_cum_err) {
-               cum_err = 0;
-               req_interval = interval;
-               reset_cum_err = 0;
-            } else {
-               cum_err += loop_timediff - interval;
-               if (req_interval > cum_err) {
-                  req_interval = req_interval - cum_err;
-               } else {
-                  req_interval = 0;
-               }
-            }
-            select_timeout = req_interval;
+      send_timediff = 1000*diff.tv_sec + diff.tv_usec/1000;
 /*
- *	If we've exceeded our retry limit, then this host has timed out so
- *	remove it from the list.  Otherwise, increase the timeout by the
- *	backoff factor if this is not the first packet sent to this host
- *	and send a packet.
- */
-
-/* This message only works if the list is not empty */
-            if (verbose && (*cursor)->num_sent > pass_no)
-               warn_msg("---\tPass %d of %u completed", ++pass_no, retry);
-            if ((*cursor)->num_sent >= retry) {
-               if (verbose > 1)
-                  warn_msg("---\tRemoving host entry %u (%s) - Timeout", (*cursor)->n, inet_ntoa((*cursor)->addr));
-               remove_host(cursor, &live_count, num_hosts);	/* Automatically calls advance_cursor() */
-               if (first_timeout) {
-                  timeval_diff(&now, &((*cursor)->last_send_time), &diff);
-                  host_timediff = (IKE_UINT64)1000000*diff.tv_sec +
-                                  diff.tv_usec;
-                  while (host_timediff >= (*cursor)->timeout && live_count) {
-                     if ((*cursor)->live) {
-                        if (verbose > 1)
-                           warn_msg("---\tRemoving host %u (%s) - Timeout",
-                                    (*cursor)->n, inet_ntoa((*cursor)->addr));
-                        remove_host(cursor, &live_count, num_hosts);
-                     } else {
-                        advance_cursor(live_count, num_hosts);
-                     }
-                     timeval_diff(&now, &((*cursor)->last_send_time), &diff);
-                     host_timediff = (IKE_UINT64)1000000*diff.tv_sec +
-                                     diff.tv_usec;
-                  }
-                  first_timeout=0;
-               }
-               Gettimeofday(&last_packet_time);
-            } else {	/* Retry limit not reached for this host */
-               if ((*cursor)->num_sent)
-                  (*cursor)->timeout *= backoff_factor;
-               send_packet(sockfd, packet_out, packet_out_len, *cursor,
-                           source_port, dest_port, &last_packet_time);
-               advance_cursor(live_count, num_hosts);
-            }
-         } else {	/* We can't send a packet to this host yet */
-/*
- *	Note that there is no point calling advance_cursor() here because if
- *	host n is not ready to send, then host n+1 will not be ready either.
- */
-            if (live_count)
-               select_timeout = (*cursor)->timeout - host_timediff;
-            else
-               select_timeout = interval;
-            reset_cum_err = 1;	/* Zero cumulative error */
-         } /* End If */
-      } else {		/* We can't send a packet yet */
-         select_timeout = req_interval - loop_timediff;
-      } /* End If */
+ *	Send to any hosts that are due.  When using more than one thread, the
+ *	shard threads do the sending, and this loop only receives.
+ */
+      if (num_shards > 1)
+         deadline_ns = now_ns + (IKE_UINT64)DEFAULT_SELECT_TIMEOUT * 1000000;
+      else
+         deadline_ns = send_due_hosts(&shards[0], &now, now_ns);
 #ifdef DEBUG_TIMINGS
-      printf("int=%d, loop_t=%llu, req_int=%d, sel=%d, cum_err=%d\n",
-             interval, loop_timediff, req_interval, select_timeout, cum_err);
+      printf("now=" IKE_UINT64_FORMAT ", wait=" IKE_UINT64_FORMAT "\n",
+             now_ns, deadline_ns > now_ns ? deadline_ns - now_ns : 0);
 #endif
-      n=recvfrom_wto(sockfd, packet_in, MAXUDP, (struct sockaddr *)&sa_peer,
-                     select_timeout);
-      if (n != -1) {
+      num_recv = recv_batch_wto(sockfd, recv_ring, RECV_BATCH_MAX, MAXUDP,
+                                deadline_ns);
+      for (recv_no=0; recv_no<num_recv; recv_no++) {
+         packet_in = recv_ring[recv_no].buf;
+         n = recv_ring[recv_no].n;
+         sa_peer = recv_ring[recv_no].sa_peer;
 /*
  *	We've received a response try to match up the packet by cookie
- *
- *	Note: We start at cursor->prev because we call advance_cursor() after
- *	      each send_packet().
  */
-         temp_cursor=find_host_by_cookie(cursor, packet_in, n, num_hosts);
+         sh = NULL;
+         if (stateless_flag)
+            temp_cursor=find_host_by_stateless_cookie(packet_in, n);
+         else
+            temp_cursor=find_host_by_cookie(packet_in, n, &sh);
          if (temp_cursor) {
 /*
- *	We found a cookie match for the returned packet.
+ *	We found a cookie match for the returned packet.  The shard is left
+ *	locked, which stops the shard thread from sending to the host or
+ *	removing it while we update it.
  */
-            add_recv_time(temp_cursor, &last_recv_time);
+            add_recv_time(temp_cursor, sh ? &sh->pool : &stateless_pool,
+                          &last_recv_time);
             if (verbose > 1)
-               warn_msg("---\tReceived packet #%u from %s",temp_cursor->num_recv ,inet_ntoa(sa_peer.sin_addr));
+               warn_msg("---\tReceived packet #%u from %s",temp_cursor->info->num_recv ,inet_ntoa(sa_peer.sin_addr));
             if (temp_cursor->live) {
                display_packet(n, packet_in, temp_cursor, &(sa_peer.sin_addr),
                               &sa_responders, &notify_responders, quiet,
                               multiline);
-               if (verbose > 1)
-                  warn_msg("---\tRemoving host entry %u (%s) - Received %d bytes", temp_cursor->n, inet_ntoa(sa_peer.sin_addr), n);
-               remove_host(&temp_cursor, &live_count, num_hosts);
+               if (!stateless_flag) {
+                  if (verbose > 1)
+                     warn_msg("---\tRemoving host entry %u (%s) - Received %d bytes", temp_cursor->info->n, inet_ntoa(sa_peer.sin_addr), n);
+                  remove_host(&temp_cursor, sh);
+               }
             }
+            shard_unlock(sh);
          } else {
             struct isakmp_hdr hdr_in;
 /*
@@ -1021,8 +1169,27 @@ main(int argc, char *argv[]) {
                free(cp);
             }
          }
-      } /* End If */
+      } /* End For */
+/*
+ *	Check for targets left before counting the live hosts.  A shard
+ *	thread adds a host to its live count while it holds the shard lock
+ *	that it took the target under, so no target can be missed by both.
+ */
+      pending = target_pending(&targets);
+      shard_totals(&live_count, &packets_sent, &last_packet_time);
+      output_poll();
    } /* End While */
+#ifdef HAVE_THREADS
+   if (num_shards > 1) {
+      for (shard_no=0; shard_no<num_shards; shard_no++)
+         pthread_join(shards[shard_no].thread, NULL);
+      shard_totals(&live_count, &packets_sent, &last_packet_time);
+   }
+#endif
+/*
+ *	Wait for the output thread to write all of the results.
+ */
+   output_finish();
    close(sockfd);
    if (write_pkt_to_file)
       close(write_pkt_to_file);
@@ -1032,9 +1199,10 @@ main(int argc, char *argv[]) {
  *	Display the backoff times if --showbackoff option was specified
  *	and we have at least one system returning a handshake.
  */
-   printf("\n");	/* Ensure we have a blank line */
+   if (output_format == FORMAT_TEXT)
+      printf("\n");	/* Ensure we have a blank line */
    if (showbackoff_flag && sa_responders) {
-      dump_times(num_hosts);
+      dump_times();
    }
 /*
  *	Display PSK crack values if applicable
@@ -1050,297 +1218,70 @@ main(int argc, char *argv[]) {
    elapsed_seconds = (elapsed_time.tv_sec*1000 +
                       elapsed_time.tv_usec/1000.0) / 1000.0;
 
-   printf("Ending %s: %u hosts scanned in %.3f seconds (%.2f hosts/sec).  %u returned handshake; %u returned notify\n",
+   num_hosts = targets.next;
+   if (output_format != FORMAT_TEXT) {
+      static out_buf ob;
+      record r;
+
+      record_begin(&r, &ob, output_format, "summary");
+      record_uint(&r, REC_HOSTS, num_hosts);
+      record_uint(&r, REC_ELAPSED_US, (IKE_UINT64)elapsed_time.tv_sec*1000000 +
+                  elapsed_time.tv_usec);
+      record_uint(&r, REC_PACKETS, packets_sent);
+      record_uint(&r, REC_HANDSHAKES, sa_responders);
+      record_uint(&r, REC_NOTIFIES, notify_responders);
+      record_end(&r);
+      fwrite(ob.buf, 1, ob.len, stdout);
+      return 0;
+   }
+   printf("Ending %s: %u hosts scanned in %.3f seconds (%.2f hosts/sec, %.2f packets/sec).  %u returned handshake; %u returned notify\n",
           PACKAGE_STRING, num_hosts, elapsed_seconds,
-          num_hosts/elapsed_seconds,sa_responders, notify_responders);
+          num_hosts/elapsed_seconds, packets_sent/elapsed_seconds,
+          sa_responders, notify_responders);
 
    return 0;
 }
 
 /*
- *	add_host_pattern -- Add one or more new host to the list.
+ *	add_host -- Create a host entry for a target.
  *
  *	Inputs:
  *
- *	pattern	= The host pattern to add.
- *	timeout	= Per-host timeout in ms.
- *	num_hosts = The number of entries in the host list.
- *	cookie_data = Data for static cookie value, or NULL
- *	cookie_data_len = Length of cookie_data value;
- *
- *	Returns: None
- *
- *	This adds one or more new hosts to the list.  The pattern argument
- *	can either be a single host or IP address, in which case one host
- *	will be added to the list, or it can specify a number of hosts with
- *	the IPnet/bits, IPnet:mask or IPstart-IPend formats.
+ *	sh	= The shard that will send to the host.
+ *	addr	= The IP address of the host.
+ *	n	= The position of the target in the target list.
  *
- *	The timeout, num_hosts, cookie_data and cookie_data_len arguments
- *	are passed unchanged to add_host().
- */
-void
-add_host_pattern(const char *pattern, unsigned timeout, unsigned *num_hosts,
-                 unsigned char *cookie_data, size_t cookie_data_len) {
-   char *patcopy;
-   struct in_addr in_val;
-   struct in_addr mask_val;
-   unsigned numbits;
-   char *cp;
-   uint32_t ipnet_val;
-   uint32_t network;
-   uint32_t mask;
-   unsigned long hoststart;
-   unsigned long hostend;
-   unsigned i;
-   uint32_t x;
-   static int first_call=1;
-   static regex_t iprange_pat;
-   static regex_t ipslash_pat;
-   static regex_t ipmask_pat;
-   static const char *iprange_pat_str =
-      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+-[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+";
-   static const char *ipslash_pat_str =
-      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+/[0-9]+";
-   static const char *ipmask_pat_str =
-      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+:[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+";
-/*
- *	Compile regex patterns if this is the first time we've been called.
- */
-   if (first_call) {
-      int result;
-
-      first_call = 0;
-      if ((result=regcomp(&iprange_pat, iprange_pat_str,
-                          REG_EXTENDED|REG_NOSUB))) {
-         char errbuf[MAXLINE];
-         regerror(result, &iprange_pat, errbuf, MAXLINE);
-         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
-                 iprange_pat_str, errbuf);
-      }
-      if ((result=regcomp(&ipslash_pat, ipslash_pat_str,
-                          REG_EXTENDED|REG_NOSUB))) {
-         char errbuf[MAXLINE];
-         regerror(result, &ipslash_pat, errbuf, MAXLINE);
-         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
-                 ipslash_pat_str, errbuf);
-      }
-      if ((result=regcomp(&ipmask_pat, ipmask_pat_str,
-                          REG_EXTENDED|REG_NOSUB))) {
-         char errbuf[MAXLINE];
-         regerror(result, &ipmask_pat, errbuf, MAXLINE);
-         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
-                 ipmask_pat_str, errbuf);
-      }
-   }
-/*
- *	Make a copy of pattern because we don't want to modify our argument.
- */
-   patcopy = dupstr(pattern);
-
-   if (!(regexec(&ipslash_pat, patcopy, 0, NULL, 0))) { /* IPnet/bits */
-/*
- *	Get IPnet and bits as integers. Perform basic error checking.
- */
-      cp=strchr(patcopy, '/');
-      *(cp++)='\0';	/* patcopy points to IPnet, cp points to bits */
-      if (!(inet_aton(patcopy, &in_val)))
-         err_msg("ERROR: %s is not a valid IP address", patcopy);
-      ipnet_val=ntohl(in_val.s_addr);	/* We need host byte order */
-      numbits=Strtoul(cp, 10);
-      if (numbits<3 || numbits>32)
-         err_msg("ERROR: Number of bits in %s must be between 3 and 32",
-                 pattern);
-/*
- *	Construct 32-bit network bitmask from number of bits.
- */
-      mask=0;
-      for (i=0; i<numbits; i++)
-         mask += 1 << i;
-      mask = mask << (32-i);
-/*
- *	Mask off the network. Warn if the host bits were non-zero.
- */
-      network=ipnet_val & mask;
-      if (network != ipnet_val)
-         warn_msg("WARNING: host part of %s is non-zero", pattern);
-/*
- *	Determine maximum and minimum host values. We include the host
- *	and broadcast.
- */
-      hoststart=0;
-      hostend=(1<<(32-numbits))-1;
-/*
- *	Calculate all host addresses in the range and feed to add_host()
- *	in dotted-quad format.
- */
-      for (i=hoststart; i<=hostend; i++) {
-         uint32_t hostip;
-         int b1, b2, b3, b4;
-         char ipstr[16];
-
-         hostip = network+i;
-         b1 = (hostip & 0xff000000) >> 24;
-         b2 = (hostip & 0x00ff0000) >> 16;
-         b3 = (hostip & 0x0000ff00) >> 8;
-         b4 = (hostip & 0x000000ff);
-         snprintf(ipstr, sizeof(ipstr), "%d.%d.%d.%d", b1,b2,b3,b4);
-         add_host(ipstr, timeout, num_hosts, cookie_data, cookie_data_len, 1);
-      }
-   } else if (!(regexec(&ipmask_pat, patcopy, 0, NULL, 0))) { /* IPnet:netmask */
-/*
- *	Get IPnet and bits as integers. Perform basic error checking.
- */
-      cp=strchr(patcopy, ':');
-      *(cp++)='\0';	/* patcopy points to IPnet, cp points to netmask */
-      if (!(inet_aton(patcopy, &in_val)))
-         err_msg("ERROR: %s is not a valid IP address", patcopy);
-      ipnet_val=ntohl(in_val.s_addr);	/* We need host byte order */
-      if (!(inet_aton(cp, &mask_val)))
-         err_msg("ERROR: %s is not a valid netmask", patcopy);
-      mask=ntohl(mask_val.s_addr);	/* We need host byte order */
-/*
- *	Calculate the number of bits in the network.
- */
-      x = mask;
-      for (numbits=0; x != 0; x>>=1) {
-         if (x & 0x01) {
-            numbits++;
-         }
-      }
-/*
- *	Mask off the network. Warn if the host bits were non-zero.
- */
-      network=ipnet_val & mask;
-      if (network != ipnet_val)
-         warn_msg("WARNING: host part of %s is non-zero", pattern);
-/*
- *	Determine maximum and minimum host values. We include the host
- *	and broadcast.
- */
-      hoststart=0;
-      hostend=(1<<(32-numbits))-1;
-/*
- *	Calculate all host addresses in the range and feed to add_host()
- *	in dotted-quad format.
- */
-      for (i=hoststart; i<=hostend; i++) {
-         uint32_t hostip;
-         int b1, b2, b3, b4;
-         char ipstr[16];
-
-         hostip = network+i;
-         b1 = (hostip & 0xff000000) >> 24;
-         b2 = (hostip & 0x00ff0000) >> 16;
-         b3 = (hostip & 0x0000ff00) >> 8;
-         b4 = (hostip & 0x000000ff);
-         snprintf(ipstr, sizeof(ipstr), "%d.%d.%d.%d", b1,b2,b3,b4);
-         add_host(ipstr, timeout, num_hosts, cookie_data, cookie_data_len, 1);
-      }
-   } else if (!(regexec(&iprange_pat, patcopy, 0, NULL, 0))) { /* IPstart-IPend */
-/*
- *	Get IPstart and IPend as integers.
- */
-      cp=strchr(patcopy, '-');
-      *(cp++)='\0';	/* patcopy points to IPstart, cp points to IPend */
-      if (!(inet_aton(patcopy, &in_val)))
-         err_msg("ERROR: %s is not a valid IP address", patcopy);
-      hoststart=ntohl(in_val.s_addr);	/* We need host byte order */
-      if (!(inet_aton(cp, &in_val)))
-         err_msg("ERROR: %s is not a valid IP address", cp);
-      hostend=ntohl(in_val.s_addr);	/* We need host byte order */
-/*
- *	Calculate all host addresses in the range and feed to add_host()
- *	in dotted-quad format.
- */
-      for (i=hoststart; i<=hostend; i++) {
-         int b1, b2, b3, b4;
-         char ipstr[16];
-
-         b1 = (i & 0xff000000) >> 24;
-         b2 = (i & 0x00ff0000) >> 16;
-         b3 = (i & 0x0000ff00) >> 8;
-         b4 = (i & 0x000000ff);
-         snprintf(ipstr, sizeof(ipstr), "%d.%d.%d.%d", b1,b2,b3,b4);
-         add_host(ipstr, timeout, num_hosts, cookie_data, cookie_data_len, 1);
-      }
-   } else {	/* Single host or IP address */
-      add_host(patcopy, timeout, num_hosts, cookie_data, cookie_data_len,
-               no_dns_flag);
-   }
-   free(patcopy);
-}
-
-/*
- *	add_host -- Add a new host to the list.
- *
- *	Inputs:
- *
- *	name	= The Name or IP address of the host.
- *	timeout	= Per-host timeout in ms.
- *	num_hosts = The number of entries in the host list.
- *	cookie_data = Data for static cookie value, or NULL
- *	cookie_data_len = Length of cookie_data value;
+ *	Returns:
  *
- *	Returns: None
+ *	The new host entry, which is live but not yet in the send schedule.
  */
-void
-add_host(const char *name, unsigned timeout, unsigned *num_hosts,
-         unsigned char *cookie_data, size_t cookie_data_len,
-         int numeric_only) {
-   struct hostent *hp = NULL;
+host_entry *
+add_host(scan_shard *sh, struct in_addr addr, unsigned n) {
+   const send_params *sp = sh->params;
    host_entry *he;
-   struct in_addr inp;
    char str[MAXLINE];
    struct timeval now;
-   static int num_left=0;       /* Number of free entries left */
 
-   if (numeric_only) {
-      if (!(inet_aton(name, &inp))) {
-         warn_msg("WARNING: inet_aton failed for \"%s\" - target ignored",
-                  name);
-         return;
-      }
-   } else {
-      if ((hp = gethostbyname(name)) == NULL) {
-         warn_sys("WARNING: gethostbyname failed for \"%s\" - target ignored",
-                  name);
-         return;
-      }
-   }
-
-   if (!num_left) {     /* No entries left, allocate some more */
-      if (helist)
-         helist=Realloc(helist, ((*num_hosts) * sizeof(host_entry)) +
-                        REALLOC_COUNT*sizeof(host_entry));
-      else
-         helist=Malloc(REALLOC_COUNT*sizeof(host_entry));
-      num_left = REALLOC_COUNT;
-   }
-
-   he = helist + (*num_hosts);	/* Would array notation be better? */
-
-   (*num_hosts)++;
-   num_left--;
+   he = host_alloc(&sh->pool);
+   sh->live_count++;
 
    Gettimeofday(&now);
 
-   he->n = *num_hosts;
-   if (no_dns_flag)
-      memcpy(&(he->addr), &inp, sizeof(struct in_addr));
-   else
-      memcpy(&(he->addr), hp->h_addr_list[0], sizeof(struct in_addr));
+   he->addr = addr;
    he->live = 1;
-   he->timeout = timeout * 1000;	/* Convert from ms to us */
+   he->timeout = sp->timeout * 1000;	/* Convert from ms to us */
    he->num_sent = 0;
-   he->num_recv = 0;
-   he->last_send_time.tv_sec=0;
-   he->last_send_time.tv_usec=0;
-   he->recv_times = NULL;
-   he->extra = NULL;
+   he->last_send_us = 0;
+   he->sched_pos = 0;
+   he->info->n = n;
+   he->info->extra = NULL;
 
-   if (cookie_data) {
+   if (sp->cookie_data) {
       memset(he->icookie, '\0', sizeof(he->icookie));
-      memcpy(he->icookie, cookie_data, cookie_data_len);
+      memcpy(he->icookie, sp->cookie_data, sp->cookie_data_len);
+      cookie_index_add(&sh->cookies, he);
+   } else if (stateless_flag) {
+      stateless_cookie(he->icookie, he->addr);
    } else {
 /*
  * We cast the timeval elements to unsigned long because different vendors
@@ -1349,10 +1290,13 @@ add_host(const char *name, unsigned timeout, unsigned *num_hosts,
  * safe to cast to unsigned long.
  */
       snprintf(str, sizeof(str), "%lu %lu %u %s", (unsigned long) now.tv_sec,
-              (unsigned long) now.tv_usec, *num_hosts, inet_ntoa(he->addr));
+              (unsigned long) now.tv_usec, n, inet_ntoa(he->addr));
       memcpy(he->icookie, MD5((unsigned char *)str, strlen(str), NULL),
              sizeof(he->icookie));
+      cookie_index_add(&sh->cookies, he);
    }
+
+   return he;
 }
 
 /*
@@ -1361,79 +1305,291 @@ add_host(const char *name, unsigned timeout, unsigned *num_hosts,
  *	Inputs:
  *
  *	he		Pointer to host entry to remove.
- *	live_count	Number of hosts awaiting response.
- *	num_hosts	The number of hosts in the list.
+ *	sh		The shard that the host belongs to.
  *
  *	Returns:
  *
  *	None.
  *
- *	If the host being removed is the one pointed to by the cursor, this
- *	function updates cursor so that it points to the next entry.
+ *	The host is also removed from the send schedule if it is in it.
+ *	The host entry is then returned to the shard's pool and *he is set
+ *	to NULL, unless the host has responded and we are keeping responders
+ *	for --showbackoff, in which case it stays in the cookie index so that
+ *	any further responses are recorded, and is added to the shard's list
+ *	of kept responders for dump_times().  The caller must hold the shard
+ *	lock.
  */
 void
-remove_host(host_entry **he, unsigned *live_count, unsigned num_hosts) {
+remove_host(host_entry **he, scan_shard *sh) {
    (*he)->live = 0;
-   (*live_count)--;
-   if (*he == *cursor)
-      advance_cursor(*live_count, num_hosts);
+   sh->live_count--;
+   sched_remove(&sh->sched, *he);
+   if (!sh->params->keep_responders || (*he)->info->num_recv == 0) {
+      cookie_index_remove(&sh->cookies, *he);
+      host_free(&sh->pool, *he);
+      *he = NULL;
+   } else {
+      if (sh->num_kept >= sh->max_kept) {
+         sh->max_kept += REALLOC_COUNT;
+         sh->kept = Realloc(sh->kept, sh->max_kept * sizeof(host_entry *));
+      }
+      sh->kept[sh->num_kept++] = *he;
+   }
 }
 
 /*
- *	advance_cursor -- Advance the cursor to point at next live entry
+ *	next_host -- Return the next host in a shard that is due
  *
  *	Inputs:
  *
- *	live_count	Number of hosts awaiting reply.
- *	num_hosts	The number of hosts in the list.
+ *	sh	The shard.
+ *	now	The current time in microseconds.
+ *	due	Set to the time that the first scheduled host is due if
+ *		no host is due now.
  *
  *	Returns:
  *
- *	None.
+ *	The host entry that is due, or NULL if no host is due now.
  *
- *	Does nothing if there are no live entries in the list.
+ *	Hosts in the send schedule that are due are taken first, in order of
+ *	the time that they are due.  If none are due, the next target is
+ *	taken from the target list and given a new host entry.  Sending
+ *	retries before new targets keeps the number of hosts awaiting a
+ *	response, and so the number of host entries, bounded by the send
+ *	rate multiplied by the time that each host takes to respond or time
+ *	out.  The host is not removed from the schedule.
  */
-void
-advance_cursor(unsigned live_count, unsigned num_hosts) {
-   if (live_count) {
-      do {
-         if (cursor == (helistptr+(num_hosts-1)))
-            cursor = helistptr; /* Wrap round to beginning */
+host_entry *
+next_host(scan_shard *sh, IKE_UINT64 now, IKE_UINT64 *due) {
+   host_entry *he;
+   IKE_UINT64 first_due;
+   struct in_addr addr;
+   unsigned n;
+
+   he = sched_first(&sh->sched, &first_due);
+   if (he != NULL && first_due <= now)
+      return he;
+   if (target_next(&targets, &addr, &n))
+      return add_host(sh, addr, n);
+   if (he != NULL)
+      *due = first_due;
+   return NULL;
+}
+
+/*
+ *	send_due_hosts -- Send packets to the hosts in a shard that are due
+ *
+ *	Inputs:
+ *
+ *	sh	The shard.
+ *	now	The current time.
+ *	now_ns	The current time from monotonic_ns().
+ *
+ *	Returns:
+ *
+ *	The time from monotonic_ns() when this should next be called.
+ *
+ *	If there is a token in the bucket and a host is due, then we can
+ *	send a packet.  Hosts are due when the current timeout for the host
+ *	has passed since the last packet was sent to it.  The caller must
+ *	hold the shard lock.
+ */
+IKE_UINT64
+send_due_hosts(scan_shard *sh, const struct timeval *now, IKE_UINT64 now_ns) {
+   const send_params *sp = sh->params;
+   host_entry *batch[SEND_BATCH_MAX];	/* Hosts to send to in this batch */
+   host_entry *he;		/* Host to send to or remove */
+   IKE_UINT64 now_us;		/* Current time in us */
+   IKE_UINT64 due_us;		/* Time when next host is due in us */
+   IKE_UINT64 deadline_ns;	/* Time to call again */
+   unsigned tokens;		/* Number of packets we may send now */
+   unsigned batch_size;		/* Number of packets in the next batch */
+   unsigned num_batch;		/* Number of hosts in this batch */
+   unsigned batch_no;		/* Current host in batch */
+   unsigned num_removed;	/* Number of timed out hosts removed */
+
+   tokens = token_bucket_available(&sh->bucket, now_ns);
+   if (!tokens)		/* We can't send a packet yet */
+      return token_bucket_next(&sh->bucket);
+   now_us = (IKE_UINT64)1000000*now->tv_sec + now->tv_usec;
+   due_us = now_us + (IKE_UINT64)DEFAULT_SELECT_TIMEOUT * 1000;
+   if ((he = next_host(sh, now_us, &due_us)) == NULL)	/* None due yet */
+      return now_ns + (due_us - now_us) * 1000;
+/*
+ *	Send one packet for each token in the bucket as a single batch.
+ *	There is more than one token when the interval is shorter than the
+ *	time taken round the main loop, or when the wakeup was late.
+ *
+ *	If a due host has reached the retry limit, then it has timed out so
+ *	remove it from the list.  Otherwise, increase the timeout by the
+ *	backoff factor if this is not the first packet sent to this host
+ *	and add it to the batch.  Removing a host does not use a token.
+ */
+   batch_size = tokens < SEND_BATCH_MAX ? tokens : SEND_BATCH_MAX;
+   deadline_ns = now_ns;
+   num_batch = 0;
+   num_removed = 0;
+   do {
+      if (he->num_sent >= sp->retry) {
+         if (verbose > 1)
+            warn_msg("---\tRemoving host entry %u (%s) - Timeout", he->info->n, inet_ntoa(he->addr));
+         remove_host(&he, sh);
+         num_removed++;
+      } else {
+         if (he->num_sent)
+            he->timeout *= sp->backoff_factor;
+         sched_remove(&sh->sched, he);
+         batch[num_batch++] = he;
+      }
+   } while (num_batch < batch_size && num_removed < SEND_BATCH_MAX &&
+            (he = next_host(sh, now_us, &due_us)) != NULL);
+/*
+ *	Send the batch, and schedule each host for its next retry.  In
+ *	stateless mode, each host is only sent one packet.
+ */
+   if (num_batch) {
+      send_packet_batch(sp->sockfd, sh->packet_out, sp->packet_out_len, batch,
+                        num_batch, sp->source_port, sp->dest_port,
+                        &sh->last_packet_time);
+      sh->packets_sent += num_batch;
+      token_bucket_consume(&sh->bucket, num_batch);
+      for (batch_no=0; batch_no<num_batch; batch_no++) {
+         he = batch[batch_no];
+         if (stateless_flag)
+            remove_host(&he, sh);
          else
-            cursor++;
-      } while (!(*cursor)->live);
-   } /* End If */
+            sched_add(&sh->sched, he,
+                      he->last_send_us + he->timeout);
+      }
+      if (num_batch >= tokens)
+         deadline_ns = token_bucket_next(&sh->bucket);
+   }
+
+   return deadline_ns;
 }
 
 /*
- *	find_host_by_cookie	-- Find a host in the list by cookie
+ *	shard_lock -- Lock a shard if the shards have their own threads
+ *
+ *	Does nothing if sh is NULL, which is the case for the temporary host
+ *	entries used in stateless mode.
+ */
+void
+shard_lock(scan_shard *sh) {
+#ifdef HAVE_THREADS
+   if (sh != NULL && num_shards > 1)
+      pthread_mutex_lock(&sh->lock);
+#endif
+}
+
+/*
+ *	shard_unlock -- Unlock a shard locked with shard_lock()
+ */
+void
+shard_unlock(scan_shard *sh) {
+#ifdef HAVE_THREADS
+   if (sh != NULL && num_shards > 1)
+      pthread_mutex_unlock(&sh->lock);
+#endif
+}
+
+/*
+ *	shard_totals -- Add up the counters for all shards
+ *
+ *	Inputs:
+ *
+ *	live_count		Set to the number of hosts awaiting response
+ *	packets_sent		Set to the number of packets sent
+ *	last_packet_time	Set to the time the last packet was sent
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+shard_totals(unsigned *live_count, unsigned *packets_sent,
+             struct timeval *last_packet_time) {
+   scan_shard *sh;
+
+   *live_count = 0;
+   *packets_sent = 0;
+   last_packet_time->tv_sec = 0;
+   last_packet_time->tv_usec = 0;
+   for (sh=shards; sh<shards+num_shards; sh++) {
+      shard_lock(sh);
+      *live_count += sh->live_count;
+      *packets_sent += sh->packets_sent;
+      if (sh->last_packet_time.tv_sec > last_packet_time->tv_sec ||
+          (sh->last_packet_time.tv_sec == last_packet_time->tv_sec &&
+           sh->last_packet_time.tv_usec > last_packet_time->tv_usec))
+         *last_packet_time = sh->last_packet_time;
+      shard_unlock(sh);
+   }
+}
+
+#ifdef HAVE_THREADS
+/*
+ *	shard_thread -- Send packets to the hosts in a shard
  *
  *	Inputs:
  *
- *	he 		Pointer to current position in list.  Search runs
- *			backwards starting from this point.
+ *	arg	The shard.
+ *
+ *	Returns:
+ *
+ *	NULL.
+ *
+ *	This is the start routine for the threads used with --threads.  It
+ *	sends to the hosts in the shard until there are no targets left and
+ *	no hosts awaiting response, sleeping between batches.  Received packets are handled by
+ *	the main thread, which removes hosts from the shard as they respond.
+ */
+void *
+shard_thread(void *arg) {
+   scan_shard *sh = arg;
+   struct timeval now;
+   IKE_UINT64 deadline_ns;
+
+   for (;;) {
+      shard_lock(sh);
+      if (!sh->live_count && !target_pending(&targets)) {
+         shard_unlock(sh);
+         break;
+      }
+      Gettimeofday(&now);
+      deadline_ns = send_due_hosts(sh, &now, monotonic_ns());
+      shard_unlock(sh);
+      event_sleep(deadline_ns);
+   }
+
+   return NULL;
+}
+#endif
+
+/*
+ *	find_host_by_cookie	-- Find a host in the list by cookie
+ *
+ *	Inputs:
  *
  *	packet_in	points to the received packet containing the cookie.
  *
  *	n 		Size of the received packet in bytes.
- *	num_hosts	The number of hosts in the list.
+ *	shp		Set to the shard that the host belongs to.
  *
  *	Returns a pointer to the host entry associated with the specified IP
  *	or NULL if no match found.
+ *
+ *	Each shard has its own cookie index, which is built by add_host(), so
+ *	we look in each of them in turn.  If a host is found, its shard is
+ *	left locked so that the shard thread can not remove the host before
+ *	the caller has finished with it, and the caller must unlock it with
+ *	shard_unlock().
  */
 host_entry *
-find_host_by_cookie(host_entry **he, unsigned char *packet_in, int n,
-                    unsigned num_hosts) {
-   host_entry **p;
-   int found = 0;
+find_host_by_cookie(unsigned char *packet_in, int n, scan_shard **shp) {
+   host_entry *he;
+   scan_shard *sh;
    struct isakmp_hdr hdr_in;
-/*
- *	Check that the current list position is not null.  Return NULL if it
- *	is.  It's possible for "he" to be NULL if a packet is received just
- *	after the last entry in the list is removed.
- */
-   if (*he == NULL)
-      return NULL;
 /*
  *	Check that the received packet is at least as big as the ISAKMP
  *	header.  Return NULL if not.
@@ -1445,26 +1601,114 @@ find_host_by_cookie(host_entry **he, unsigned char *packet_in, int n,
  */
    memcpy(&hdr_in, packet_in, sizeof(hdr_in));
 
-   p = he;
-
-   do {
-      if ((*p)->icookie[0] == hdr_in.isa_icookie[0] &&
-          (*p)->icookie[1] == hdr_in.isa_icookie[1]) {
-         found = 1;
-      } else {
-         if (p == helistptr) {
-            p = helistptr + (num_hosts-1);      /* Wrap round to end */
-         } else {
-            p--;
-         }
+   for (sh=shards; sh<shards+num_shards; sh++) {
+      shard_lock(sh);
+      if ((he = cookie_index_find(&sh->cookies, hdr_in.isa_icookie))) {
+         *shp = sh;
+         return he;
       }
-   } while (!found && p != he);
+      shard_unlock(sh);
+   }
 
-   if (found) {
-      return *p;
-   } else {
+   return NULL;
+}
+
+/*
+ *	find_host_by_stateless_cookie -- Find a host by stateless cookie
+ *
+ *	Inputs:
+ *
+ *	packet_in	points to the received packet containing the cookie.
+ *	n 		Size of the received packet in bytes.
+ *
+ *	Returns a pointer to a host entry for the target that the cookie was
+ *	generated for, or NULL if the cookie is not valid.
+ *
+ *	This does not use the host list.  The target address is recovered from
+ *	the cookie itself, and the returned entry is a temporary from
+ *	stateless_pool that is freed by the next call.  The entry is marked as not live if
+ *	we have recently seen a response from the same target, so that
+ *	retransmitted responses are not displayed.
+ */
+host_entry *
+find_host_by_stateless_cookie(unsigned char *packet_in, int n) {
+   static host_entry *he = NULL;
+   struct isakmp_hdr hdr_in;
+   struct in_addr addr;
+
+   if ((unsigned)n < sizeof(hdr_in))
       return NULL;
+   memcpy(&hdr_in, packet_in, sizeof(hdr_in));
+
+   if (he != NULL) {
+      host_free(&stateless_pool, he);
+      he = NULL;
    }
+   if (!stateless_cookie_check(hdr_in.isa_icookie, &addr))
+      return NULL;
+   he = host_alloc(&stateless_pool);
+   he->addr = addr;
+   memcpy(he->icookie, hdr_in.isa_icookie, sizeof(he->icookie));
+   he->timeout = 0;
+   he->last_send_us = 0;
+   he->sched_pos = 0;
+   he->num_sent = 0;
+   he->live = !stateless_seen_before(he->addr);
+   he->info->n = 0;
+   he->info->extra = NULL;
+
+   return he;
+}
+
+/*
+ *	display_record -- Write a record for a received IKE packet
+ *
+ *	Inputs:
+ *
+ *	The same as display_packet().
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is used instead of display_packet() with --format=jsonl or
+ *	--format=binary, and writes the same details as a single record.
+ */
+static void
+display_record(int n, unsigned char *packet_in, host_entry *he,
+               struct in_addr *recv_addr, unsigned *sa_responders,
+               unsigned *notify_responders, int quiet) {
+   static out_buf ob;	/* Record to write */
+   record r;
+   struct timeval time_tv;
+   char addr[16];
+
+   out_reset(&ob);
+   record_begin(&r, &ob, output_format, "response");
+   if (shownum_flag)
+      record_uint(&r, REC_NUM, he->info->n);
+   if (timestamp_flag) {
+      Gettimeofday(&time_tv);
+      record_uint(&r, REC_TIME,
+                  (IKE_UINT64)time_tv.tv_sec*1000000 + time_tv.tv_usec);
+   }
+   strlcpy(addr, inet_ntoa(he->addr), sizeof(addr));
+   record_str(&r, REC_ADDR, addr);
+   if (((he->addr).s_addr != recv_addr->s_addr) && !tcp_flag)
+      record_str(&r, REC_RECV_ADDR, inet_ntoa(*recv_addr));
+   switch (record_isakmp_packet(&r, packet_in, n, quiet, vidmatch,
+                                psk_crack_flag)) {
+      case ISAKMP_NEXT_SA:
+      case ISAKMP_NEXT_V2_SA:
+         (*sa_responders)++;
+         break;
+      case ISAKMP_NEXT_N:
+      case ISAKMP_NEXT_V2_N:
+         (*notify_responders)++;
+         break;
+   }
+   record_end(&r);
+   output_write(ob.buf, ob.len);
 }
 
 /*
@@ -1487,31 +1731,36 @@ find_host_by_cookie(host_entry **he, unsigned char *packet_in, int n,
  *	
  *	This should check the received packet and display details of what
  *	was received in the format: <IP-Address><TAB><Details>.
+ *
+ *	The details are built up in a static output buffer which is reused
+ *	for each packet, and written with a single call once complete, so
+ *	the decode does not normally need to allocate any memory.
  */
 void
 display_packet(int n, unsigned char *packet_in, host_entry *he,
                struct in_addr *recv_addr, unsigned *sa_responders,
                unsigned *notify_responders, int quiet, int multiline) {
-   char *cp;			/* Temp pointer */
+   static out_buf msg;		/* Message to display */
+   static out_buf hdr_descr;	/* ISAKMP header description */
    size_t bytes_left;		/* Remaining buffer size */
    unsigned next;		/* Next Payload */
    unsigned type;		/* Exchange Type */
-   char *msg;			/* Message to display */
-   char *msg2;
    unsigned char *pkt_ptr;
-   char *hdr_descr;		/* ISAKMP header description */
+
+   if (output_format != FORMAT_TEXT) {
+      display_record(n, packet_in, he, recv_addr, sa_responders,
+                     notify_responders, quiet);
+      return;
+   }
 /*
  *	Set message to the empty string.
  */
-   msg = make_message("");
+   out_reset(&msg);
 /*
  *	Display the packet number if required.
  */
-   if (shownum_flag) {
-      cp = msg;
-      msg = make_message("%s%u ", cp, he->n);
-      free(cp);
-   }
+   if (shownum_flag)
+      out_printf(&msg, "%u ", he->info->n);
 /*
  *	Display the time when this packet was received if required.
  */
@@ -1523,24 +1772,18 @@ display_packet(int n, unsigned char *packet_in, host_entry *he,
       Gettimeofday(&time_tv);
       clock_seconds = time_tv.tv_sec;
       time_tm = localtime(&clock_seconds);
-      cp = msg;
-      msg = make_message("%s%02d:%02d:%02d.%06u ", cp,
-                         time_tm->tm_hour, time_tm->tm_min, time_tm->tm_sec,
-                         time_tv.tv_usec);
-      free(cp);
+      out_printf(&msg, "%02d:%02d:%02d.%06u ",
+                 time_tm->tm_hour, time_tm->tm_min, time_tm->tm_sec,
+                 time_tv.tv_usec);
    }
 /*
  *	Set msg to the IP address of the host entry, plus the address of the
  *	responder if different, and a tab.
  */
-   cp = msg;
-   msg = make_message("%s%s\t", cp, inet_ntoa(he->addr));
-   free(cp);
-   if (((he->addr).s_addr != recv_addr->s_addr) && !tcp_flag) {
-      cp = msg;
-      msg = make_message("%s(%s) ", cp, inet_ntoa(*recv_addr));
-      free(cp);
-   }
+   out_append(&msg, inet_ntoa(he->addr));
+   out_append(&msg, "\t");
+   if (((he->addr).s_addr != recv_addr->s_addr) && !tcp_flag)
+      out_printf(&msg, "(%s) ", inet_ntoa(*recv_addr));
 /*
  *	Process ISAKMP header.
  *	If this returns zero length left, indicating some sort of problem, then
@@ -1553,9 +1796,9 @@ display_packet(int n, unsigned char *packet_in, host_entry *he,
    pkt_ptr = process_isakmp_hdr(packet_in, &bytes_left, &next, &type,
                                 &hdr_descr);
    if (!bytes_left) {
-      printf("%sShort or malformed ISAKMP packet returned: %d bytes\n",
-             msg, n);
-      free(msg);
+      out_printf(&msg, "Short or malformed ISAKMP packet returned: %d bytes\n",
+                 n);
+      output_write(msg.buf, msg.len);
       return;
    }
 /*
@@ -1568,35 +1811,30 @@ display_packet(int n, unsigned char *packet_in, host_entry *he,
          if (psk_crack_flag)
             add_psk_crack_payload(pkt_ptr, next, 'R');
          (*sa_responders)++;
-         cp = process_sa(pkt_ptr, bytes_left, type, quiet, multiline,
-                         hdr_descr);
+         process_sa(pkt_ptr, bytes_left, type, quiet, multiline,
+                    hdr_descr.buf, &msg);
          break;
       case ISAKMP_NEXT_V2_SA:	/* IKEv2 SA */
          (*sa_responders)++;
-         cp = process_sa2(pkt_ptr, bytes_left, type, quiet, multiline,
-                          hdr_descr);
+         process_sa2(pkt_ptr, bytes_left, type, quiet, multiline,
+                     hdr_descr.buf, &msg);
          break;
       case ISAKMP_NEXT_N:	/* Notify */
          (*notify_responders)++;
-         cp = process_notify(pkt_ptr, bytes_left, quiet, multiline,
-                             hdr_descr);
+         process_notify(pkt_ptr, bytes_left, quiet, multiline,
+                        hdr_descr.buf, &msg);
          break;
       case ISAKMP_NEXT_V2_N:	/* IKEv2 Notify */
          (*notify_responders)++;
-         cp = process_notify2(pkt_ptr, bytes_left, quiet, multiline,
-                              hdr_descr);
+         process_notify2(pkt_ptr, bytes_left, quiet, multiline,
+                         hdr_descr.buf, &msg);
          break;
       default:			/* Something else */
-         cp=make_message("Unexpected IKE payload returned: %s",
-                         id_to_name(next, payload_map));
+         out_printf(&msg, "Unexpected IKE payload returned: %s",
+                    id_to_name(next, payload_map));
          break;
    }
-   free(hdr_descr);	/* Don't need the ISAKMP header descr string now */
    pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
-   msg2=msg;
-   msg=make_message("%s%s", msg, cp);
-   free(msg2);	/* Free old message (IP address) */
-   free(cp);	/* Free 1st payload message */
 /*
  *	Process any other interesting payloads if quiet is not in effect.
  */
@@ -1605,45 +1843,41 @@ display_packet(int n, unsigned char *packet_in, host_entry *he,
 
       while (bytes_left) {
          payload_ptr = clone_payload(pkt_ptr, bytes_left);
-         msg2=msg;
+         out_append(&msg, multiline?"\n\t":" ");
          switch (next) {
             case ISAKMP_NEXT_VID:	/* Vendor ID */
             case ISAKMP_NEXT_V2_VID:	/* IKEv2 Vendor ID */
-               cp = process_vid(payload_ptr, bytes_left, vidlist);
+               process_vid(payload_ptr, bytes_left, vidmatch, &msg);
                break;
             case ISAKMP_NEXT_ID:	/* ID */
                if (psk_crack_flag)
                   add_psk_crack_payload(payload_ptr, next, 'R');
-               cp = process_id(payload_ptr, bytes_left);
+               process_id(payload_ptr, bytes_left, &msg);
                break;
             case ISAKMP_NEXT_CERT:	/* Certificate */
             case ISAKMP_NEXT_CR:	/* Certificate Request */
-               cp = process_cert(payload_ptr, bytes_left, next);
+               process_cert(payload_ptr, bytes_left, next, &msg);
                break;
             case ISAKMP_NEXT_D:		/* Delete */
-               cp = process_delete(payload_ptr, bytes_left);
+               process_delete(payload_ptr, bytes_left, &msg);
                break;
             case ISAKMP_NEXT_N:		/* Notification */
-               cp = process_notification(payload_ptr, bytes_left);
+               process_notification(payload_ptr, bytes_left, &msg);
                break;
             default:			/* Something else */
                if (psk_crack_flag)
                   add_psk_crack_payload(payload_ptr, next, 'R');
-               cp = process_generic(payload_ptr, bytes_left, next);
+               process_generic(payload_ptr, bytes_left, next, &msg);
                break;
          } /* End Switch */
-         free(payload_ptr);
-         msg=make_message("%s%s%s", msg2, multiline?"\n\t":" ", cp);
-         free(msg2);	/* Free old message */
-         free(cp);	/* Free payload message */
          pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
       } /* End While */
    } /* End if (!quiet) */
 /*
  *	Print the message.
  */
-   printf("%s\n", msg);
-   free(msg);
+   out_append(&msg, "\n");
+   output_write(msg.buf, msg.len);
 }
 
 /*
@@ -1665,7 +1899,7 @@ display_packet(int n, unsigned char *packet_in, host_entry *he,
  *	
  *	This must construct an appropriate packet and send it to the host
  *	identified by "he" and UDP port "dest_port" using the socket "s".
- *	It must also update the "last_send_time" field for this host entry.
+ *	It must also update the "last_send_us" field for this host entry.
  */
 void
 send_packet(int s, unsigned char *packet_out, size_t packet_out_len,
@@ -1692,8 +1926,8 @@ send_packet(int s, unsigned char *packet_out, size_t packet_out_len,
  *	Update the last send times for this host.
  */
    Gettimeofday(last_packet_time);
-   he->last_send_time.tv_sec  = last_packet_time->tv_sec;
-   he->last_send_time.tv_usec = last_packet_time->tv_usec;
+   he->last_send_us = (IKE_UINT64)1000000*last_packet_time->tv_sec +
+                      last_packet_time->tv_usec;
    he->num_sent++;
 /*
  *	Cisco TCP encapsulation.
@@ -1812,14 +2046,15 @@ send_packet(int s, unsigned char *packet_out, size_t packet_out_len,
       cp += 4;
       memcpy(cp, orig_packet_out, packet_out_len);
       packet_out_len += 4;
-      free(orig_packet_out);
+      if (tcp_flag == TCP_PROTO_ENCAP || sourceip_flag != 0)
+         free(orig_packet_out);	/* Only free our own copy */
    }
 /*
  *	Send the packet.
  */
    if (verbose > 1)
       warn_msg("---\tSending packet #%u to host entry %u (%s) tmo %d us",
-               he->num_sent, he->n, inet_ntoa(he->addr), he->timeout);
+               he->num_sent, he->info->n, inet_ntoa(he->addr), he->timeout);
    if (write_pkt_to_file) {
       nsent = write(write_pkt_to_file, packet_out, packet_out_len);
    } else {
@@ -1840,6 +2075,131 @@ send_packet(int s, unsigned char *packet_out, size_t packet_out_len,
    }
 }
 
+#ifdef HAVE_SENDMMSG
+/*
+ *	send_packet_mmsg -- Send packets to a batch of hosts with sendmmsg()
+ *
+ *	Inputs:
+ *
+ *	As for send_packet_batch().
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Each packet is sent from a gather list of up to three parts: the
+ *	non-ESP marker if NAT-Traversal is used, a copy of the ISAKMP header
+ *	with the cookie for the host, and the rest of the packet, which is
+ *	the same for all hosts.  The packet itself is not modified, so this
+ *	can be called from several threads at once.  It is only used for
+ *	plain UDP, with or without NAT-Traversal encapsulation.
+ */
+static void
+send_packet_mmsg(int s, unsigned char *packet_out, size_t packet_out_len,
+                 host_entry **batch, unsigned num_batch, unsigned dest_port,
+                 struct timeval *last_packet_time) {
+   static unsigned char non_esp_marker[4];	/* All zero */
+   struct isakmp_hdr hdr[SEND_BATCH_MAX];
+   struct mmsghdr msg[SEND_BATCH_MAX];
+   struct iovec iov[SEND_BATCH_MAX][3];
+   struct sockaddr_in sa_peer[SEND_BATCH_MAX];
+   size_t buf_slot_len;		/* Total length of each packet */
+   unsigned niov;
+   unsigned i;
+   int nsent;
+
+   buf_slot_len = packet_out_len + (nat_t_flag ? sizeof(non_esp_marker) : 0);
+   Gettimeofday(last_packet_time);
+   memset(msg, '\0', num_batch * sizeof(struct mmsghdr));
+   for (i=0; i<num_batch; i++) {
+      memcpy(&hdr[i], packet_out, sizeof(hdr[i]));
+      hdr[i].isa_icookie[0] = batch[i]->icookie[0];
+      hdr[i].isa_icookie[1] = batch[i]->icookie[1];
+      niov = 0;
+      if (nat_t_flag) {
+         iov[i][niov].iov_base = non_esp_marker;
+         iov[i][niov++].iov_len = sizeof(non_esp_marker);
+      }
+      iov[i][niov].iov_base = &hdr[i];
+      iov[i][niov++].iov_len = sizeof(hdr[i]);
+      iov[i][niov].iov_base = packet_out + sizeof(hdr[i]);
+      iov[i][niov++].iov_len = packet_out_len - sizeof(hdr[i]);
+
+      memset(&sa_peer[i], '\0', sizeof(struct sockaddr_in));
+      sa_peer[i].sin_family = AF_INET;
+      sa_peer[i].sin_addr.s_addr = batch[i]->addr.s_addr;
+      sa_peer[i].sin_port = htons(dest_port);
+
+      msg[i].msg_hdr.msg_name = &sa_peer[i];
+      msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      msg[i].msg_hdr.msg_iov = iov[i];
+      msg[i].msg_hdr.msg_iovlen = niov;
+
+      batch[i]->last_send_us =
+         (IKE_UINT64)1000000*last_packet_time->tv_sec +
+         last_packet_time->tv_usec;
+      batch[i]->num_sent++;
+      if (verbose > 1)
+         warn_msg("---\tSending packet #%u to host entry %u (%s) tmo %d us",
+                  batch[i]->num_sent, batch[i]->info->n, inet_ntoa(batch[i]->addr),
+                  batch[i]->timeout);
+   }
+/*
+ *	sendmmsg() may send fewer messages than requested, so keep calling
+ *	it until the whole batch has gone.
+ */
+   for (i=0; i<num_batch; i+=nsent) {
+      if ((nsent = sendmmsg(s, &msg[i], num_batch-i, 0)) < 0)
+         err_sys("ERROR: sendmmsg");
+   }
+   for (i=0; i<num_batch; i++) {
+      if (msg[i].msg_len != buf_slot_len)
+         warn_msg("WARNING: sendmmsg: only %u bytes sent, but %u requested",
+                  msg[i].msg_len, (unsigned) buf_slot_len);
+   }
+}
+#endif
+
+/*
+ *	send_packet_batch -- Send packets to a batch of hosts
+ *
+ *	Inputs:
+ *
+ *	s               network socket file descriptor
+ *	packet_out	IKE packet to send
+ *	packet_out_len	Length of IKE packet to send
+ *	batch           Array of host entries to send to
+ *	num_batch       Number of host entries in batch
+ *	source_port     Source UDP port
+ *	dest_port       Destination UDP port
+ *	last_packet_time        Time when last packet was sent
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Plain UDP batches are sent with a single sendmmsg() call if it is
+ *	available.  Otherwise, including for TCP, --sourceip and
+ *	--writepkttofile, we call send_packet() for each host in turn.
+ */
+void
+send_packet_batch(int s, unsigned char *packet_out, size_t packet_out_len,
+                  host_entry **batch, unsigned num_batch, unsigned source_port,
+                  unsigned dest_port, struct timeval *last_packet_time) {
+   unsigned i;
+
+#ifdef HAVE_SENDMMSG
+   if (num_batch > 1 && !tcp_flag && !sourceip_flag && !write_pkt_to_file) {
+      send_packet_mmsg(s, packet_out, packet_out_len, batch, num_batch,
+                       dest_port, last_packet_time);
+      return;
+   }
+#endif
+   for (i=0; i<num_batch; i++)
+      send_packet(s, packet_out, packet_out_len, batch[i], source_port,
+                  dest_port, last_packet_time);
+}
+
 /*
  *	recvfrom_wto -- Receive packet with timeout
  *
@@ -1943,6 +2303,86 @@ recvfrom_wto(int s, unsigned char *buf, size_t len, struct sockaddr *saddr,
    return n;
 }
 
+/*
+ *	recv_batch_wto -- Receive a batch of packets with timeout
+ *
+ *      Inputs:
+ *
+ *      s       = Socket file descriptor.
+ *      ring    = Array of receive slots, each with a buffer of len bytes.
+ *      num_slots = Number of slots in ring.
+ *      len     = Size of each slot's buffer.
+ *      deadline = Absolute deadline from monotonic_ns().
+ *
+ *	Returns the number of packets received, or 0 for timeout.
+ *
+ *	This waits until the socket becomes readable or the deadline is
+ *	reached, and then drains up to num_slots packets that are waiting
+ *	with a single recvmmsg() call.  TCP, --sourceip, --readpktfromfile,
+ *	and systems without recvmmsg() use recvfrom_wto() to receive one
+ *	packet.
+ */
+unsigned
+recv_batch_wto(int s, recv_slot *ring, unsigned num_slots, size_t len,
+               IKE_UINT64 deadline) {
+   int n;
+#ifdef HAVE_RECVMMSG
+   struct mmsghdr msg[RECV_BATCH_MAX];
+   struct iovec iov[RECV_BATCH_MAX];
+   unsigned i;
+#endif
+
+   if (!event_wait(deadline) && !read_pkt_from_file)
+      return 0;		/* Timeout */
+#ifdef HAVE_RECVMMSG
+   if (!tcp_flag && !sourceip_flag && !read_pkt_from_file) {
+      if (num_slots > RECV_BATCH_MAX)
+         num_slots = RECV_BATCH_MAX;
+      memset(msg, '\0', num_slots * sizeof(struct mmsghdr));
+      for (i=0; i<num_slots; i++) {
+         iov[i].iov_base = ring[i].buf;
+         iov[i].iov_len = len;
+         msg[i].msg_hdr.msg_name = &ring[i].sa_peer;
+         msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+         msg[i].msg_hdr.msg_iov = &iov[i];
+         msg[i].msg_hdr.msg_iovlen = 1;
+      }
+      if ((n = recvmmsg(s, msg, num_slots, MSG_DONTWAIT, NULL)) < 0) {
+/*
+ *	Treat connection refused and connection reset as timeout, as for
+ *	recvfrom_wto().  EAGAIN can occur if the packet was discarded after
+ *	the socket became readable.
+ */
+         if (errno == ECONNREFUSED || errno == ECONNRESET || errno == EAGAIN)
+            return 0;
+         else
+            err_sys("ERROR: recvmmsg");
+      }
+      for (i=0; i<(unsigned)n; i++) {
+         ring[i].n = msg[i].msg_len;
+/*
+ *	RFC 3947 NAT Traversal.
+ *	Remove Non ESP marker from NAT-T packet leaving IKE data.
+ */
+         if (nat_t_flag && ring[i].n > 4) {
+            memmove(ring[i].buf, ring[i].buf+4, ring[i].n-4);
+         }
+      }
+      return n;
+   }
+#endif
+/*
+ *	We have already waited, so recvfrom_wto() does not need to.
+ */
+   n = recvfrom_wto(s, ring[0].buf, len, (struct sockaddr *)&ring[0].sa_peer,
+                    0);
+   if (n == -1)
+      return 0;
+   ring[0].n = n;
+
+   return 1;
+}
+
 /*
  *	initialise_ike_packet	-- Initialise IKE packet structures
  *
@@ -2323,29 +2763,35 @@ initialise_ike_packet(size_t *packet_out_len, ike_packet_params *params) {
 }
 
 /*
- *	dump_list -- Display contents of host list for debugging
+ *	dump_list -- Display contents of target list for debugging
  *
  *      Inputs:
  *
- *      num_hosts	The number of entries in the host list.
+ *      num_hosts	The number of hosts in the target list.
  *
  *	Returns:
  *
  *	None.
+ *
+ *	Each range is shown with the position of its first host in the list.
+ *	The cookies are not shown because they are not generated until the
+ *	hosts are sent to.  When reading from a file on demand, only the
+ *	ranges that have been read so far are shown.
  */
 void
 dump_list(unsigned num_hosts) {
-   char *cp;
+   char first[16];
+   struct in_addr addr;
    unsigned i;
 
    printf("Host List:\n\n");
-   printf("Entry\tIP Address\tCookie\n");
-   for (i=0; i<num_hosts; i++) {
-      cp = hexstring((unsigned char *)helistptr[i]->icookie,
-                     sizeof(helistptr[i]->icookie));
-      printf("%u\t%s\t%s\n", helistptr[i]->n, inet_ntoa(helistptr[i]->addr),
-             cp);
-      free(cp);
+   printf("Entry\tFirst Address\tLast Address\n");
+   for (i=0; i<targets.num_ranges; i++) {
+      addr.s_addr = htonl(targets.range[i].first);
+      strlcpy(first, inet_ntoa(addr), sizeof(first));
+      addr.s_addr = htonl(targets.range[i].last);
+      printf("%u\t%s\t%s\n", targets.range[i].start + 1, first,
+             inet_ntoa(addr));
    }
    printf("\nTotal of %u host entries.\n\n", num_hosts);
 }
@@ -2425,22 +2871,32 @@ dump_backoff(unsigned pattern_fuzz) {
  *
  *	This displays the contents of the Vendor ID pattern list.  It is useful
  *	when debugging to check that the patterns have been loaded correctly
- *	from the Vendor ID patterns file.
+ *	from the Vendor ID patterns file or the compiled pattern database.
  */
 void
 dump_vid(void) {
-   vid_pattern_list *pl;
-   int i;
+   unsigned i;
 
    printf("Vendor ID Pattern List:\n\n");
    printf("Entry\tName\tVendor ID Pattern\n");
-   pl = vidlist;
-   i=1;
-   while (pl != NULL) {
-      printf("%d\t%s\t%s\n", i++, pl->name, pl->pattern);
-      pl = pl->next;
-   } /* End While */
-   printf("\nTotal of %d Vendor ID pattern entries.\n\n", i-1);
+   for (i=0; vidmatch && i<vidmatch->num_patterns; i++) {
+      printf("%u\t%s\t%s\n", i+1, vidmatch->strings + vidmatch->name[i],
+             vidmatch->strings + vidmatch->pattern[i]);
+   }
+   printf("\nTotal of %u Vendor ID pattern entries.\n\n", i);
+}
+
+/*
+ *	host_cmp -- Compare host entries by position in the target list
+ *
+ *	This is the comparison function for qsort() in dump_times().
+ */
+static int
+host_cmp(const void *a, const void *b) {
+   const host_entry *ha = *(const host_entry * const *) a;
+   const host_entry *hb = *(const host_entry * const *) b;
+
+   return (ha->info->n > hb->info->n) - (ha->info->n < hb->info->n);
 }
 
 /*
@@ -2448,42 +2904,91 @@ dump_vid(void) {
  *
  *	Inputs:
  *
- *	num_hosts	The number of hosts in the list.
+ *	None.
  *
  *	Returns:
  *
  *	None.
+ *
+ *	The hosts that responded are kept on the shard lists of responders
+ *	until the end of the scan, and are displayed in target list order.
  */
 void
-dump_times(unsigned num_hosts) {
-   time_list *te;
+dump_times(void) {
+   host_entry **helistptr;
+   unsigned num_hosts;
+   scan_shard *sh;
+   IKE_UINT64 *times;
+   struct timeval recv_time;
    unsigned i;
-   int time_no;
+   unsigned time_no;
    struct timeval prev_time;
    struct timeval diff;
-   char *patname;
+   const char *patname;
    int unknown_patterns = 0;
 
+   num_hosts = 0;
+   for (sh=shards; sh<shards+num_shards; sh++)
+      num_hosts += sh->num_kept;
+   helistptr = Malloc((num_hosts ? num_hosts : 1) * sizeof(host_entry *));
+   num_hosts = 0;
+   for (sh=shards; sh<shards+num_shards; sh++) {
+      memcpy(helistptr + num_hosts, sh->kept,
+             sh->num_kept * sizeof(host_entry *));
+      num_hosts += sh->num_kept;
+   }
+   qsort(helistptr, num_hosts, sizeof(host_entry *), host_cmp);
+/*
+ *	With --format=jsonl or --format=binary, write one backoff record for
+ *	each host giving the receive times in microseconds.
+ */
+   if (output_format != FORMAT_TEXT) {
+      static out_buf ob;
+      record r;
+
+      for (i=0; i<num_hosts; i++) {
+         if (helistptr[i]->info->num_recv == 0)
+            continue;
+         times = Malloc(helistptr[i]->info->num_recv * sizeof(IKE_UINT64));
+         host_recv_times(helistptr[i], times);
+         out_reset(&ob);
+         record_begin(&r, &ob, output_format, "backoff");
+         record_str(&r, REC_ADDR, inet_ntoa(helistptr[i]->addr));
+         record_list_begin(&r, REC_TIMES);
+         for (time_no=0; time_no<helistptr[i]->info->num_recv; time_no++)
+            record_uint(&r, 0, times[time_no]);
+         record_list_end(&r);
+         free(times);
+         if ((patname=match_pattern(helistptr[i])) != NULL)
+            record_str(&r, REC_GUESS, patname);
+         record_end(&r);
+         fwrite(ob.buf, 1, ob.len, stdout);
+      }
+      free(helistptr);
+      return;
+   }
+
    printf("IKE Backoff Patterns:\n");
    printf("\nIP Address\tNo.\tRecv time\t\tDelta Time\n");
    for (i=0; i<num_hosts; i++) {
-      if (helistptr[i]->recv_times != NULL && helistptr[i]->num_recv > 0) {
-         te = helistptr[i]->recv_times;
-         time_no = 1;
+      if (helistptr[i]->info->num_recv > 0) {
+         times = Malloc(helistptr[i]->info->num_recv * sizeof(IKE_UINT64));
+         host_recv_times(helistptr[i], times);
          diff.tv_sec = 0;
          diff.tv_usec = 0;
-         while (te != NULL) {
+         for (time_no=1; time_no<=helistptr[i]->info->num_recv; time_no++) {
+            recv_time.tv_sec = times[time_no-1] / 1000000;
+            recv_time.tv_usec = times[time_no-1] % 1000000;
             if (time_no > 1)
-               timeval_diff(&(te->time), &prev_time, &diff);
-            printf("%s\t%d\t%lu.%.6lu\t%lu.%.6lu\n",
+               timeval_diff(&recv_time, &prev_time, &diff);
+            printf("%s\t%u\t%lu.%.6lu\t%lu.%.6lu\n",
                    inet_ntoa(helistptr[i]->addr),
-                   time_no, (unsigned long)te->time.tv_sec,
-                   (unsigned long)te->time.tv_usec,
+                   time_no, (unsigned long)recv_time.tv_sec,
+                   (unsigned long)recv_time.tv_usec,
                    (unsigned long)diff.tv_sec, (unsigned long)diff.tv_usec);
-            prev_time = te->time;
-            te = te->next;
-            time_no++;
-         } /* End While te != NULL */
+            prev_time = recv_time;
+         } /* End For */
+         free(times);
          if ((patname=match_pattern(helistptr[i])) != NULL) {
             printf("%s\tImplementation guess: %s\n",
                    inet_ntoa(helistptr[i]->addr), patname);
@@ -2501,6 +3006,7 @@ dump_times(unsigned num_hosts) {
          printf("\n");
       } /* End If */
    } /* End For */
+   free(helistptr);
    if (unknown_patterns && patlist) {
       printf("Some IKE implementations found have unknown backoff fingerprints\n");
       printf("If you know the implementation name, and the pattern is reproducible, you\n");
@@ -2520,66 +3026,35 @@ dump_times(unsigned num_hosts) {
  *
  *	Pointer to the implementation name, or NULL if no match.
  *
- *	Finds the first match for the backoff pattern of the host entry *he.
+ *	Finds the best match for the backoff pattern of the host entry *he,
+ *	which is the matching pattern with the times closest to the host's.
  */
-char *
+const char *
 match_pattern(host_entry *he) {
-   pattern_list *pl;
+   IKE_UINT64 *times;
+   const char *name;
 /*
  *	Return NULL immediately if there is no chance of matching.
  */
-   if (he == NULL || patlist == NULL)
+   if (he == NULL || backoffmatch == NULL)
       return NULL;
-   if (he->recv_times == NULL || he->num_recv < 1)
+   if (he->info->num_recv < 1)
       return NULL;
-/*
- *	Try to find a match in the pattern list.
- */
-   pl = patlist;
-   while (pl != NULL) {
-      if (he->num_recv == pl->num_times && pl->recv_times != NULL) {
-         time_list *hp;
-         pattern_entry_list *pp;
-         struct timeval diff;
-         struct timeval prev_time;
-         int match;
-         int i;
-
-         hp = he->recv_times;
-         pp = pl->recv_times;
-         match = 1;
-         i = 1;
-         diff.tv_sec = 0;
-         diff.tv_usec = 0;
-         while (pp != NULL && hp != NULL) {
-            if (i > 1)
-               timeval_diff(&(hp->time), &prev_time, &diff);
-            if (!times_close_enough(&(pp->time), &diff, pp->fuzz)) {
-               match = 0;
-               break;
-            }
-            prev_time = hp->time;
-            pp = pp->next;
-            hp = hp->next;
-            i++;
-         } /* End While */
-         if (match)
-            return pl->name;
-      } /* End If */
-      pl = pl->next;
-   } /* End While */
-/*
- *	If we reach here, then we haven't matched the pattern so return NULL.
- */
-   return NULL;
+   times = Malloc(he->info->num_recv * sizeof(IKE_UINT64));
+   host_recv_times(he, times);
+   name = backoff_matcher_match(backoffmatch, times, he->info->num_recv);
+   free(times);
+
+   return name;
 }
 
 /*
- *	add_recv_time -- Add current time to the recv_times list
+ *	add_recv_time -- Add current time to the receive times for a host
  *
  *	Inputs:
  *
  *	he	Pointer to host entry to add time to
+ *	hp	The host entry pool that the entry was allocated from
  *	last_recv_time	Time packet was received
  *
  *	Returns:
@@ -2587,32 +3062,128 @@ match_pattern(host_entry *he) {
  *	None.
  */
 void
-add_recv_time(host_entry *he, struct timeval *last_recv_time) {
-   time_list *p;		/* Temp pointer */
-   time_list *te;	/* New timeentry pointer */
-/*
- *	Allocate and initialise new time structure
- */   
-   te = Malloc(sizeof(time_list));
-   Gettimeofday(&(te->time));
-   last_recv_time->tv_sec = te->time.tv_sec;
-   last_recv_time->tv_usec = te->time.tv_usec;
-   te->next = NULL;
+add_recv_time(host_entry *he, host_pool *hp, struct timeval *last_recv_time) {
+   Gettimeofday(last_recv_time);
+   host_add_recv_time(hp, he, (IKE_UINT64)1000000*last_recv_time->tv_sec +
+                      last_recv_time->tv_usec);
+}
+
 /*
- *	Insert new time structure on the tail of the recv_times list.
+ *	data_file_name -- Get the name of a data file
+ *
+ *	Inputs:
+ *
+ *	given	The file name given on the command line, or empty for default
+ *	name	The name of the default file in the data directory
+ *
+ *	Returns:
+ *
+ *	The file name, in malloc'ed storage.
  */
-   p = he->recv_times;
-   if (p == NULL) {
-      he->recv_times = te;
-   } else {
-      while (p->next != NULL)
-         p = p->next;
-      p->next = te;
+char *
+data_file_name(const char *given, const char *name) {
+#ifdef __CYGWIN__
+   char fnbuf[MAXLINE];
+   int fnbuf_siz;
+   int i;
+#endif
+
+   if (*given != '\0')	/* If file name specified */
+      return make_message("%s", given);
+#ifdef __CYGWIN__
+   if ((fnbuf_siz=GetModuleFileName(GetModuleHandle(0), fnbuf, MAXLINE)) == 0) {
+      err_msg("ERROR: Call to GetModuleFileName failed");
+   }
+   for (i=fnbuf_siz-1; i>=0 && fnbuf[i] != '/' && fnbuf[i] != '\\'; i--)
+      ;
+   if (i >= 0) {
+      fnbuf[i] = '\0';
    }
+   return make_message("%s\\%s", fnbuf, name);
+#else
+   return make_message("%s/%s", IKEDATADIR, name);
+#endif
+}
+
 /*
- *	Increment num_received for this host
+ *	open_pattern_db -- Open the compiled pattern database if it is current
+ *
+ *	Inputs:
+ *
+ *	dbfile		The database file name, or empty for the default
+ *	vidfile		The Vendor ID patterns file name, or empty
+ *	patfile		The backoff patterns file name, or empty
+ *
+ *	Returns:
+ *
+ *	A pointer to the database, or NULL if the patterns files should be
+ *	read instead.
+ */
+pattern_db *
+open_pattern_db(const char *dbfile, const char *vidfile, const char *patfile) {
+   pattern_db *db;
+   char *db_fn;
+   char *vid_fn;
+   char *pat_fn;
+
+   db_fn = data_file_name(dbfile, PATTERN_DB_FILE);
+   vid_fn = data_file_name(vidfile, VID_FILE);
+   pat_fn = data_file_name(patfile, PATTERNS_FILE);
+   db = pattern_db_open(db_fn, vid_fn, pat_fn);
+   if (verbose) {
+      if (db)
+         warn_msg("DEBUG: Using compiled pattern database %s", db_fn);
+      else
+         warn_msg("DEBUG: Compiled pattern database %s is missing or out of date",
+                  db_fn);
+   }
+   free(db_fn);
+   free(vid_fn);
+   free(pat_fn);
+
+   return db;
+}
+
+/*
+ *	compile_pattern_db -- Compile the patterns files into a database
+ *
+ *	Inputs:
+ *
+ *	dbfile		The database file name, or empty for the default
+ *	vidfile		The Vendor ID patterns file name, or empty
+ *	patfile		The backoff patterns file name, or empty
+ *
+ *	Returns:
+ *
+ *	None.
  */
-   he->num_recv++;
+void
+compile_pattern_db(const char *dbfile, const char *vidfile,
+                   const char *patfile) {
+   char *db_fn;
+   char *vid_fn;
+   char *pat_fn;
+   vid_pattern_list *vp;
+   pattern_list *pp;
+   unsigned num_vid = 0;
+   unsigned num_backoff = 0;
+
+   db_fn = data_file_name(dbfile, PATTERN_DB_FILE);
+   vid_fn = data_file_name(vidfile, VID_FILE);
+   pat_fn = data_file_name(patfile, PATTERNS_FILE);
+   load_backoff_patterns(patfile, PATTERN_FUZZ_UNSET);
+   load_vid_patterns(vidfile);
+   if (pattern_db_write(db_fn, vidlist, vid_fn, patlist, pat_fn) != 0)
+      err_sys("ERROR: Cannot write compiled pattern database %s", db_fn);
+   for (vp=vidlist; vp != NULL; vp=vp->next)
+      num_vid++;
+   for (pp=patlist; pp != NULL; pp=pp->next)
+      num_backoff++;
+   printf("Compiled %u Vendor ID patterns and %u backoff patterns into %s\n",
+          num_vid, num_backoff, db_fn);
+   free(db_fn);
+   free(vid_fn);
+   free(pat_fn);
 }
 
 /*
@@ -2633,29 +3204,8 @@ load_backoff_patterns(const char *patfile, unsigned pattern_fuzz) {
    char line[MAXLINE];
    int line_no;
    char *fn;
-#ifdef __CYGWIN__
-   char fnbuf[MAXLINE];
-   int fnbuf_siz;
-   int i;
-#endif
 
-   if (*patfile == '\0') {	/* If patterns file not specified */
-#ifdef __CYGWIN__
-      if ((fnbuf_siz=GetModuleFileName(GetModuleHandle(0), fnbuf, MAXLINE)) == 0) {
-         err_msg("ERROR: Call to GetModuleFileName failed");
-      }
-      for (i=fnbuf_siz-1; i>=0 && fnbuf[i] != '/' && fnbuf[i] != '\\'; i--)
-         ;
-      if (i >= 0) {
-         fnbuf[i] = '\0';
-      }
-      fn = make_message("%s\\%s", fnbuf, PATTERNS_FILE);
-#else
-      fn = make_message("%s/%s", IKEDATADIR, PATTERNS_FILE);
-#endif
-   } else {
-      fn = make_message("%s", patfile);
-   }
+   fn = data_file_name(patfile, PATTERNS_FILE);
 
    if ((fp = fopen(fn, "r")) == NULL) {
       warn_msg("WARNING: Cannot open IKE backoff patterns file.  ike-scan will still display");
@@ -2853,29 +3403,8 @@ load_vid_patterns(const char *vidfile) {
    char line[MAXLINE];
    int line_no;
    char *fn;
-#ifdef __CYGWIN__
-   char fnbuf[MAXLINE];
-   int fnbuf_siz;
-   int i;
-#endif
 
-   if (*vidfile == '\0') {	/* If patterns file not specified */
-#ifdef __CYGWIN__
-      if ((fnbuf_siz=GetModuleFileName(GetModuleHandle(0), fnbuf, MAXLINE)) == 0) {
-         err_msg("ERROR: Call to GetModuleFileName failed");
-      }
-      for (i=fnbuf_siz-1; i>=0 && fnbuf[i] != '/' && fnbuf[i] != '\\'; i--)
-         ;
-      if (i >= 0) {
-         fnbuf[i] = '\0';
-      }
-      fn = make_message("%s\\%s", fnbuf, VID_FILE);
-#else
-      fn = make_message("%s/%s", IKEDATADIR, VID_FILE);
-#endif
-   } else {
-      fn = make_message("%s", vidfile);
-   }
+   fn = data_file_name(vidfile, VID_FILE);
 
    if ((fp = fopen(fn, "r")) == NULL) {
       warn_msg("WARNING: Cannot open Vendor ID patterns file.  ike-scan will still display");
@@ -2892,6 +3421,11 @@ load_vid_patterns(const char *vidfile) {
       fclose(fp);
    }
    free(fn);
+/*
+ *	Compile the patterns into a single matcher, so that each Vendor ID
+ *	does not need to be matched against every pattern in turn.
+ */
+   vidmatch = vid_matcher_build(vidlist);
 }
 
 /*
@@ -3244,6 +3778,8 @@ usage(int status, int detailed) {
       fprintf(stderr, "\n--file=<fn> or -f <fn>\tRead hostnames or addresses from the specified file\n");
       fprintf(stderr, "\t\t\tinstead of from the command line. One name or IP\n");
       fprintf(stderr, "\t\t\taddress per line.  Use \"-\" for standard input.\n");
+      fprintf(stderr, "\t\t\tThe file is read as the scan proceeds unless it is\n");
+      fprintf(stderr, "\t\t\tstandard input or --random is used.\n");
       fprintf(stderr, "\n--sport=<p> or -s <p>\tSet UDP source port to <p>, default=%u, 0=random.\n", DEFAULT_SOURCE_PORT);
       fprintf(stderr, "\t\t\tSome IKE implementations require the client to use\n");
       fprintf(stderr, "\t\t\tUDP source port 500 and will not talk to other ports.\n");
@@ -3289,8 +3825,8 @@ usage(int status, int detailed) {
       fprintf(stderr, "\t\t\t500ms, the second 750ms and the third 1125ms.\n");
       fprintf(stderr, "\n--verbose or -v\t\tDisplay verbose progress messages.\n");
       fprintf(stderr, "\t\t\tUse more than once for greater effect:\n");
-      fprintf(stderr, "\t\t\t1 - Show when each pass is completed and when\n");
-      fprintf(stderr, "\t\t\t    packets with invalid cookies are received.\n");
+      fprintf(stderr, "\t\t\t1 - Show when packets with invalid cookies are\n");
+      fprintf(stderr, "\t\t\t    received.\n");
       fprintf(stderr, "\t\t\t2 - Show each packet sent and received and when\n");
       fprintf(stderr, "\t\t\t    hosts are removed from the list.\n");
       fprintf(stderr, "\t\t\t3 - Display the host, Vendor ID and backoff lists\n");
@@ -3410,6 +3946,24 @@ usage(int status, int detailed) {
       fprintf(stderr, "\t\t\tThis specifies the name of the file containing\n");
       fprintf(stderr, "\t\t\tVendor ID patterns.  These patterns are used for\n");
       fprintf(stderr, "\t\t\tVendor ID fingerprinting.\n");
+   #ifdef __CYGWIN__
+      fprintf(stderr, "\n--patterndb=<f>\t\tUse compiled pattern database <f>,\n");
+      fprintf(stderr, "\t\t\tdefault=%s in ike-scan.exe dir.\n", PATTERN_DB_FILE);
+   #else
+      fprintf(stderr, "\n--patterndb=<f>\t\tUse compiled pattern database <f>,\n");
+      fprintf(stderr, "\t\t\tdefault=%s/%s.\n", IKEDATADIR, PATTERN_DB_FILE);
+   #endif
+      fprintf(stderr, "\t\t\tIf this file was compiled from the Vendor ID and\n");
+      fprintf(stderr, "\t\t\tbackoff patterns files in use, and they have not\n");
+      fprintf(stderr, "\t\t\tchanged since, the patterns are loaded from it\n");
+      fprintf(stderr, "\t\t\tinstead, which is much faster. Otherwise the\n");
+      fprintf(stderr, "\t\t\tpatterns files are read as usual.\n");
+      fprintf(stderr, "\n--compiledb\t\tCompile the pattern database and exit.\n");
+      fprintf(stderr, "\t\t\tThis reads the Vendor ID and backoff patterns files\n");
+      fprintf(stderr, "\t\t\tgiven by --vidpatterns and --patterns, or the\n");
+      fprintf(stderr, "\t\t\tdefaults, and writes the database given by\n");
+      fprintf(stderr, "\t\t\t--patterndb. Run it again after changing either\n");
+      fprintf(stderr, "\t\t\tpatterns file. No targets are needed.\n");
       fprintf(stderr, "\n--aggressive or -A\tUse IKE Aggressive Mode (The default is Main Mode)\n");
       fprintf(stderr, "\t\t\tIf you specify --aggressive, then you may also\n");
       fprintf(stderr, "\t\t\tspecify --dhgroup, --id and --idtype.  If you use\n");
@@ -3441,7 +3995,9 @@ usage(int status, int detailed) {
       fprintf(stderr, "\n--random or -R\t\tRandomise the host list.\n");
       fprintf(stderr, "\t\t\tThis option randomises the order of the hosts in the\n");
       fprintf(stderr, "\t\t\thost list, so the IKE probes are sent to the hosts in\n");
-      fprintf(stderr, "\t\t\ta random order.  It uses the Knuth shuffle algorithm.\n");
+      fprintf(stderr, "\t\t\ta random order.  It steps through a cyclic group\n");
+      fprintf(stderr, "\t\t\tmodulo a prime, so it uses very little memory even\n");
+      fprintf(stderr, "\t\t\tfor large networks.\n");
       fprintf(stderr, "\n--tcp[=<n>] or -T[<n>]\tUse TCP transport instead of UDP.\n");
       fprintf(stderr, "\t\t\tThis allows you to test a host running IKE over TCP.\n");
       fprintf(stderr, "\t\t\tYou won't normally need this option because the vast\n");
@@ -3581,7 +4137,8 @@ usage(int status, int detailed) {
       fprintf(stderr, "\t\t\tpacket data is exactly repeatable when it includes\n");
       fprintf(stderr, "\t\t\tpayloads with random data such as key exchange or nonce.\n");
       fprintf(stderr, "\t\t\tBy default, the PRNG is seeded with an unpredictable\n");
-      fprintf(stderr, "\t\t\tvalue.\n");
+      fprintf(stderr, "\t\t\tvalue.  The stateless cookie key is not taken from\n");
+      fprintf(stderr, "\t\t\tthe PRNG, so it is not repeatable.\n");
       fprintf(stderr, "\n--timestamp\t\tDisplay timestamps for received packets.\n");
       fprintf(stderr, "\t\t\tThis option causes a timestamp to be displayed for\n");
       fprintf(stderr, "\t\t\teach received packet.\n");
@@ -3627,6 +4184,55 @@ usage(int status, int detailed) {
       fprintf(stderr, "\t\t\tThe --ikev2 option is currently experimental. It has not\n");
       fprintf(stderr, "\t\t\tbeen extensively tested, and it only supports sending\n");
       fprintf(stderr, "\t\t\tthe default proposal.\n");
+      fprintf(stderr, "\n--stateless\t\tUse stateless cookies.\n");
+      fprintf(stderr, "\t\t\tThis sets the initiator cookie to a keyed MAC of the\n");
+      fprintf(stderr, "\t\t\ttarget address and port, so responses are matched by\n");
+      fprintf(stderr, "\t\t\trecovering the target from the cookie rather than by\n");
+      fprintf(stderr, "\t\t\tsearching the host list. Each host is sent one packet\n");
+      fprintf(stderr, "\t\t\twith no retries, and ike-scan waits for the --timeout\n");
+      fprintf(stderr, "\t\t\tperiod after the last packet before exiting.\n");
+      fprintf(stderr, "\t\t\tThis option cannot be used with --cookie, --showbackoff\n");
+      fprintf(stderr, "\t\t\tor --shownum.\n");
+      fprintf(stderr, "\n--rcvbuf=<n>\t\tSet the socket receive buffer size to <n> bytes.\n");
+      fprintf(stderr, "\t\t\tA larger receive buffer reduces the number of responses\n");
+      fprintf(stderr, "\t\t\tthat are dropped by the kernel when many hosts respond\n");
+      fprintf(stderr, "\t\t\tat once during a large scan. The operating system may\n");
+      fprintf(stderr, "\t\t\tlimit the size; use --verbose to display the actual size.\n");
+      fprintf(stderr, "\n--pps=<n>\t\tSet the outgoing packet rate to <n> packets per second.\n");
+      fprintf(stderr, "\t\t\tThis is an alternative to --bandwidth and --interval\n");
+      fprintf(stderr, "\t\t\tthat does not depend on the packet size, and cannot be\n");
+      fprintf(stderr, "\t\t\tused with either of them.\n");
+      fprintf(stderr, "\n--burst=<n>\t\tAllow bursts of up to <n> packets.\n");
+      fprintf(stderr, "\t\t\tThe send rate is limited with a token bucket that holds\n");
+      fprintf(stderr, "\t\t\tup to <n> packets. If ike-scan falls behind the rate set\n");
+      fprintf(stderr, "\t\t\tby --bandwidth, --interval or --pps, it can send up to\n");
+      fprintf(stderr, "\t\t\t<n> packets back to back to catch up, but the average\n");
+      fprintf(stderr, "\t\t\trate is never exceeded. The default is enough packets\n");
+      fprintf(stderr, "\t\t\tfor 1 ms at the configured rate, between 1 and %d.\n", SEND_BATCH_MAX);
+      fprintf(stderr, "\n--threads=<n>\t\tSend packets using <n> threads, default=1.\n");
+      fprintf(stderr, "\t\t\tThe hosts are divided between the threads, and each\n");
+      fprintf(stderr, "\t\t\tthread sends to its own hosts at an equal share of the\n");
+      fprintf(stderr, "\t\t\trate set by --bandwidth, --interval or --pps. Received\n");
+      fprintf(stderr, "\t\t\tpackets are handled by the main thread, so the output\n");
+      fprintf(stderr, "\t\t\tis the same as with one thread, although responses may\n");
+      fprintf(stderr, "\t\t\tbe displayed in a different order. This option cannot\n");
+      fprintf(stderr, "\t\t\tbe used with --tcp, --sourceip, --writepkttofile or\n");
+      fprintf(stderr, "\t\t\t--readpktfromfile, or with --dnsthreads=0 and --file.\n");
+      fprintf(stderr, "\n--dnsthreads=<n>\tLook up host names using up to <n> threads,\n");
+      fprintf(stderr, "\t\t\tdefault=%d.\n", DEFAULT_DNS_THREADS);
+      fprintf(stderr, "\t\t\tThe names are looked up while the scan runs, and each\n");
+      fprintf(stderr, "\t\t\thost is scanned as soon as its address is known, so\n");
+      fprintf(stderr, "\t\t\thosts given by name may be scanned out of order. A\n");
+      fprintf(stderr, "\t\t\tvalue of 0 looks up each name in turn before the scan\n");
+      fprintf(stderr, "\t\t\tstarts, as in earlier versions. With --random or --tcp,\n");
+      fprintf(stderr, "\t\t\tthe scan waits until all of the names are looked up.\n");
+      fprintf(stderr, "\n--format=<f>\t\tWrite the results in format <f>, default=text.\n");
+      fprintf(stderr, "\t\t\t<f> can be text for the normal output, jsonl for one\n");
+      fprintf(stderr, "\t\t\tJSON object per line, or binary for length-prefixed\n");
+      fprintf(stderr, "\t\t\tbinary records. The structured formats write a record\n");
+      fprintf(stderr, "\t\t\tfor each response with the decoded fields, a record\n");
+      fprintf(stderr, "\t\t\tfor each host with --showbackoff, and a summary record\n");
+      fprintf(stderr, "\t\t\tat the end instead of the Starting and Ending lines.\n");
    } else {
       fprintf(stderr, "use \"ike-scan --help\" for detailed information on the available options.\n");
    }
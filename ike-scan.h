@@ -137,6 +137,23 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define HAVE_THREADS 1
+#endif
+
 #ifdef HAVE_OPENSSL
 #include <openssl/md5.h>
 #include <openssl/sha.h>
@@ -180,11 +197,88 @@
 #define DEFAULT_IKE_VERSION 1		/* Default IKE version */
 #define PATTERNS_FILE "ike-backoff-patterns" /* Backoff patterns filename */
 #define VID_FILE "ike-vendor-ids"	/* Vendor ID patterns filename */
+#define PATTERN_DB_FILE "ike-patterns.db" /* Compiled pattern database */
+#define PATTERN_FUZZ_UNSET UINT_MAX	/* Fuzz not given in patterns file */
 #define REALLOC_COUNT	1000		/* Entries to realloc at once */
 #define DEFAULT_TCP_CONNECT_TIMEOUT 10	/* TCP connect timeout in seconds */
 #define TCP_PROTO_RAW 1			/* Raw IKE over TCP (Checkpoint) */
 #define TCP_PROTO_ENCAP 2		/* Encapsulated IKE over TCP (cisco) */
 #define PACKET_OVERHEAD 28		/* 20 bytes for IP hdr + 8 for UDP */
+#define SEND_BATCH_MAX 64		/* Max packets to send in one batch */
+#define RECV_BATCH_MAX 16		/* Max packets to receive in one batch */
+#define DEFAULT_BURST_TIME 1000000	/* Default burst length in ns */
+#define MAX_THREADS 64			/* Max value for --threads */
+#define DEFAULT_DNS_THREADS 16		/* Default value for --dnsthreads */
+#define MAX_DNS_THREADS 256		/* Max value for --dnsthreads */
+#define DNS_BACKLOG 1024		/* Max names queued when reading a file */
+#define RECV_TIMES_INLINE 4		/* Receive times held in each host */
+#define RECV_TIMES_BLOCK 15		/* Receive times in each extra block */
+#define TIME_BLOCK_SLAB 256		/* Receive time blocks to alloc at once */
+#define OUT_BUF_SIZE 256		/* Initial size of an output buffer */
+#define OUTPUT_RING_SIZE 1048576	/* Result queue size, a power of two */
+#define FORMAT_TEXT 0			/* --format=text */
+#define FORMAT_JSONL 1			/* --format=jsonl */
+#define FORMAT_BINARY 2			/* --format=binary */
+#define REC_MAX_DEPTH 8			/* Max nesting depth of output records */
+/* Output record field types */
+#define REC_T_UINT 1
+#define REC_T_STR 2
+#define REC_T_BYTES 3
+#define REC_T_LIST 4
+#define REC_T_OBJECT 5
+/* Output record field tags.  The names are in rec_tag_names[] in record.c */
+#define REC_RECORD 1
+#define REC_ADDR 2
+#define REC_RECV_ADDR 3
+#define REC_NUM 4
+#define REC_TIME 5
+#define REC_RESULT 6
+#define REC_LENGTH 7
+#define REC_EXCHANGE 8
+#define REC_MODE 9
+#define REC_RCOOKIE 10
+#define REC_VERSION 11
+#define REC_FLAGS 12
+#define REC_MSGID 13
+#define REC_TRANSFORMS 14
+#define REC_MULTIPLE_PROPOSALS 15
+#define REC_SPI 16
+#define REC_ATTRIBUTES 17
+#define REC_CLASS 18
+#define REC_CLASS_NAME 19
+#define REC_VALUE 20
+#define REC_VALUE_NAME 21
+#define REC_DATA 22
+#define REC_IKEV2_TRANSFORMS 23
+#define REC_TYPE 24
+#define REC_TYPE_NAME 25
+#define REC_ID 26
+#define REC_ID_NAME 27
+#define REC_NOTIFY_TYPE 28
+#define REC_NOTIFY_NAME 29
+#define REC_MESSAGE 30
+#define REC_PAYLOADS 31
+#define REC_PAYLOAD 32
+#define REC_PAYLOAD_NAME 33
+#define REC_VENDOR 34
+#define REC_ID_TYPE 35
+#define REC_ID_TYPE_NAME 36
+#define REC_ID_VALUE 37
+#define REC_CERT_TYPE 38
+#define REC_CERT_TYPE_NAME 39
+#define REC_SPI_SIZE 40
+#define REC_SPI_COUNT 41
+#define REC_DOI 42
+#define REC_PROTO_ID 43
+#define REC_ERROR 44
+#define REC_TIMES 45
+#define REC_GUESS 46
+#define REC_HOSTS 47
+#define REC_ELAPSED_US 48
+#define REC_PACKETS 49
+#define REC_HANDSHAKES 50
+#define REC_NOTIFIES 51
+#define REC_TAG_MAX 52
 #define OPT_SPISIZE 256
 #define OPT_HDRFLAGS 257
 #define OPT_HDRMSGID 258
@@ -200,14 +294,23 @@
 #define OPT_RCOOKIE 268
 #define OPT_READPKTFROMFILE 269
 #define OPT_BINDIP 270
+#define OPT_STATELESS 271
+#define OPT_RCVBUF 272
+#define OPT_PPS 273
+#define OPT_BURST 274
+#define OPT_THREADS 275
+#define OPT_DNSTHREADS 276
+#define OPT_FORMAT 277
+#define OPT_PATTERNDB 278
+#define OPT_COMPILEDB 279
 #undef DEBUG_TIMINGS			/* Define to 1 to debug timing code */
 /* #define WRITE_RECEIVED_IKE_PACKET "received-ike-packet.dat" */
 
 /* Structures */
-typedef struct time_list_ {
-   struct timeval time;
-   struct time_list_ *next;
-} time_list;
+typedef struct time_block_ {
+   IKE_UINT64 time[RECV_TIMES_BLOCK];	/* Receive times in us */
+   struct time_block_ *next;	/* Next block, or NULL */
+} time_block;
 
 typedef struct {
    int id;
@@ -217,19 +320,143 @@ typedef struct {
    } un;
 } misc_data;
 
+/*
+ *	The host entry holds the fields that the send loop and the cookie
+ *	match use, packed together so that more entries share each cache
+ *	line.  The fields that are only used when a response is received or
+ *	displayed are kept separately in a host_info.
+ */
 typedef struct {
-   time_list *recv_times; 	/* List of receive times */
+   IKE_UINT64 recv_time[RECV_TIMES_INLINE];	/* First receive times in us */
+   time_block *recv_more;	/* Later receive times, or NULL */
+   time_block *recv_last;	/* Last block in recv_more */
    misc_data *extra;		/* Extra data for this entry */ 
    unsigned n;			/* Ordinal number for this entry */
-   unsigned timeout;		/* Timeout for this host */
+   unsigned short num_recv;	/* Number of packets received */
+} host_info;
+
+typedef struct {
    uint32_t icookie[COOKIE_SIZE];	/* IKE Initiator cookie */
    struct in_addr addr;		/* Host IP address */
-   struct timeval last_send_time; /* Time when last packet sent to this addr */
+   unsigned timeout;		/* Timeout for this host in us */
+   IKE_UINT64 last_send_us;	/* Time when last packet sent in us */
+   host_info *info;		/* Fields not used by the send loop */
+   unsigned sched_pos;		/* Position in send schedule + 1, or 0 */
    unsigned short num_sent;	/* Number of packets sent */
-   unsigned short num_recv;	/* Number of packets received */
    unsigned char live;		/* Set when awaiting response */
 } host_entry;
 
+typedef struct {
+   unsigned char *buf;		/* Received packet data */
+   int n;			/* Received packet length */
+   struct sockaddr_in sa_peer;	/* Address packet was received from */
+} recv_slot;
+
+typedef struct {
+   IKE_UINT64 interval_ns;	/* Time to earn one token, or 0 for no limit */
+   IKE_UINT64 last_ns;		/* Time when the last token was earned */
+   unsigned burst;		/* Maximum number of tokens */
+   unsigned tokens;		/* Number of tokens in the bucket */
+} token_bucket;
+
+typedef struct {
+   IKE_UINT64 due;		/* Time when host is next due in us */
+   unsigned seq;		/* Order in which entries were added */
+   host_entry *he;		/* The host entry */
+} sched_node;
+
+typedef struct {
+   sched_node *heap;		/* Binary heap ordered by due time */
+   unsigned size;		/* Number of allocated entries */
+   unsigned count;		/* Number of entries in use */
+   unsigned seq;		/* Sequence number for next entry */
+} host_schedule;
+
+typedef struct {
+   uint32_t first;		/* First address in host byte order */
+   uint32_t last;		/* Last address in host byte order */
+   unsigned start;		/* Index of first address in target list */
+} target_range;
+
+typedef struct {
+   target_range *range;		/* Target address ranges */
+   unsigned num_ranges;		/* Number of ranges in use */
+   unsigned max_ranges;		/* Number of ranges allocated */
+   unsigned count;		/* Total number of target addresses */
+   unsigned next;		/* Number of targets returned so far */
+   unsigned cur_range;		/* Range containing next target */
+   uint32_t cur_offset;		/* Offset of next address in range */
+   IKE_UINT64 prime;		/* Prime modulus for random order, or 0 */
+   IKE_UINT64 root;		/* Primitive root modulo prime */
+   IKE_UINT64 elem;		/* Next element of the cyclic group */
+   FILE *fp;			/* File to read more patterns from, or NULL */
+   int no_dns;			/* Don't look up host names if nonzero */
+   char **name;			/* Queue of host names to look up */
+   unsigned num_names;		/* Number of names in the queue */
+   unsigned next_name;		/* Index of next name to look up */
+   unsigned max_names;		/* Number of queue entries allocated */
+   unsigned resolving;		/* Names queued or being looked up */
+   unsigned dns_threads;	/* Max lookup threads, or 0 for no threads */
+   unsigned dns_running;	/* Number of lookup threads running */
+#ifdef HAVE_THREADS
+   pthread_mutex_t lock;	/* Protects all of the above */
+   pthread_cond_t resolved;	/* Signalled when a name has been looked up */
+#endif
+} target_list;
+
+typedef struct {
+   host_entry **chunk;		/* Blocks of REALLOC_COUNT host entries */
+   host_info **info_chunk;	/* host_info blocks for the above */
+   unsigned num_chunks;		/* Number of blocks allocated */
+   host_entry **free_list;	/* Stack of unused host entries */
+   unsigned num_free;		/* Number of unused host entries */
+   time_block *free_times;	/* List of unused receive time blocks */
+} host_pool;
+
+typedef struct {
+   uint32_t icookie[COOKIE_SIZE];	/* Copy of the host entry cookie */
+   host_entry *he;		/* Host entry, or NULL if empty */
+} cookie_slot;
+
+typedef struct {
+   cookie_slot *slot;		/* Hash table slots */
+   unsigned mask;		/* Number of slots - 1 */
+   unsigned count;		/* Number of slots in use */
+} cookie_index;
+
+typedef struct {
+   int sockfd;			/* Socket to send on */
+   size_t packet_out_len;	/* Length of IKE packet to send */
+   unsigned source_port;	/* Source UDP port */
+   unsigned dest_port;		/* Destination UDP port */
+   unsigned retry;		/* Number of packets to send to each host */
+   double backoff_factor;	/* Timeout backoff factor */
+   unsigned timeout;		/* Initial per-host timeout in ms */
+   unsigned char *cookie_data;	/* Data for static cookie value, or NULL */
+   size_t cookie_data_len;	/* Length of cookie_data */
+   int keep_responders;		/* Keep hosts that respond until the end */
+} send_params;
+
+typedef struct {
+   unsigned id;			/* Shard number, starting from zero */
+   const send_params *params;	/* Send parameters shared by all shards */
+   unsigned char *packet_out;	/* IKE packet to send */
+   host_pool pool;		/* Host entries for this shard */
+   cookie_index cookies;	/* Hash index of host entries by icookie */
+   host_schedule sched;		/* Hosts awaiting retry */
+   host_entry **kept;		/* Responders kept for --showbackoff */
+   unsigned num_kept;		/* Number of kept responders */
+   unsigned max_kept;		/* Number of kept entries allocated */
+   token_bucket bucket;		/* Send rate limiter */
+   unsigned live_count;		/* Number of hosts awaiting response */
+   unsigned packets_sent;	/* Number of packets sent */
+   struct timeval last_packet_time; /* Time last packet was sent */
+#ifdef HAVE_THREADS
+   pthread_mutex_t lock;	/* Protects all of the above */
+   pthread_t thread;		/* Sending thread */
+#endif
+} scan_shard;
+
 typedef struct pattern_entry_list_ {
    struct timeval time;
    unsigned fuzz;
@@ -250,6 +477,72 @@ typedef struct vid_pattern_list_ {
    struct vid_pattern_list_ *next;
 } vid_pattern_list;
 
+typedef struct {
+   uint32_t first_child;	/* Index of first child in keys and child */
+   uint32_t num_child;
+   uint32_t first_term;		/* Index of first pattern ending here */
+   uint32_t num_term;
+} vid_trie_node;
+
+typedef struct {
+   uint32_t pattern;		/* Pattern number in file order */
+   int32_t nibble;		/* Final odd hex digit, or -1 for none */
+   uint32_t hex_len;		/* Minimum length of hex Vendor ID */
+   uint32_t exact;		/* Nonzero if hex_len must match exactly */
+} vid_trie_term;
+
+typedef struct {
+   uint32_t pattern;		/* Pattern number in file order */
+   uint32_t prefix;		/* Hex digits that matches must start with */
+   uint32_t prefix_len;
+} vid_fallback;
+
+typedef struct {
+   const vid_trie_node *node;	/* Trie nodes, node 0 is the root */
+   uint32_t num_nodes;
+   const unsigned char *keys;	/* Vendor ID byte for each child, sorted */
+   const uint32_t *child;	/* Node number of each child */
+   uint32_t num_edges;
+   const vid_trie_term *term;	/* Patterns that end at each node */
+   uint32_t num_terms;
+   const uint32_t *name;	/* Name of each pattern */
+   const uint32_t *pattern;	/* Text regular expression of each pattern */
+   uint32_t num_patterns;
+   const vid_fallback *fallback;	/* Patterns that need regexec(), in order */
+   uint32_t num_fallback;
+   const char *strings;		/* Strings that the offsets above refer to */
+   uint32_t strings_len;
+   regex_t *regex;		/* Compiled fallback patterns */
+   void *mem;			/* Image to free with the matcher, or NULL */
+} vid_matcher;
+
+typedef struct {
+   IKE_INT64 delta;		/* Delta time in microseconds */
+   unsigned fuzz;		/* Fuzz in ms */
+} backoff_time;
+
+typedef struct {
+   unsigned num_times;		/* Number of times in each pattern */
+   unsigned num_patterns;
+   unsigned key;		/* Packet that the patterns are sorted on */
+   unsigned max_fuzz;		/* Largest fuzz of the key packet */
+   backoff_time *times;		/* num_times for each pattern, sorted */
+   unsigned *pattern;		/* Pattern number of each in file order */
+} backoff_bucket;
+
+typedef struct {
+   backoff_bucket *bucket;	/* Buckets in order of num_times */
+   unsigned num_buckets;
+   char **name;			/* Name of each pattern in file order */
+   unsigned num_patterns;
+} backoff_matcher;
+
+typedef struct {
+   const unsigned char *data;	/* Database contents */
+   size_t len;
+   int mapped;			/* Nonzero if data is mapped with mmap() */
+} pattern_db;
+
 typedef struct {
    unsigned char *g_xr;		/* Responder DH public value */
    unsigned char *g_xi;		/* Initiator DH public value */
@@ -276,6 +569,21 @@ typedef struct {
    const char *name;
 } id_name_map;
 
+typedef struct {		/* Growable output string */
+   char *buf;			/* Null-terminated string */
+   size_t len;			/* Length of string, excluding the NULL */
+   size_t size;			/* Size of buf */
+} out_buf;
+
+typedef struct {		/* Output record being written */
+   out_buf *ob;			/* Buffer the record is appended to */
+   int format;			/* FORMAT_JSONL or FORMAT_BINARY */
+   unsigned depth;		/* Current list or object nesting depth */
+   size_t start[REC_MAX_DEPTH];	/* Binary: offset of length at each depth */
+   int first[REC_MAX_DEPTH];	/* JSON: no field yet at each depth */
+   int in_list[REC_MAX_DEPTH];	/* JSON: depth is a list, not an object */
+} record;
+
 typedef struct {		/* Used for encapsulated IKE */
   uint16_t     source;
   uint16_t     dest;
@@ -338,31 +646,105 @@ void err_msg(const char *, ...);
 void warn_msg(const char *, ...);
 void err_print(int, const char *, va_list);
 void usage(int, int);
-void add_host_pattern(const char *, unsigned, unsigned *, unsigned char *,
-                      size_t);
-void add_host(const char *, unsigned, unsigned *, unsigned char *,
-              size_t, int);
+int parse_host_pattern(const char *, uint32_t *, uint32_t *, int);
+void add_host_pattern(target_list *, const char *);
+host_entry *add_host(scan_shard *, struct in_addr, unsigned);
 void send_packet(int, unsigned char *, size_t, host_entry *, unsigned, unsigned,
                  struct timeval *);
+void send_packet_batch(int, unsigned char *, size_t, host_entry **, unsigned,
+                       unsigned, unsigned, struct timeval *);
 int recvfrom_wto(int, unsigned char *, size_t, struct sockaddr *, int);
-void remove_host(host_entry **, unsigned *, unsigned);
+unsigned recv_batch_wto(int, recv_slot *, unsigned, size_t, IKE_UINT64);
+IKE_UINT64 monotonic_ns(void);
+void event_init(int);
+int event_wait(IKE_UINT64);
+void event_sleep(IKE_UINT64);
+void token_bucket_init(token_bucket *, IKE_UINT64, unsigned, IKE_UINT64);
+unsigned token_bucket_available(token_bucket *, IKE_UINT64);
+void token_bucket_consume(token_bucket *, unsigned);
+IKE_UINT64 token_bucket_next(const token_bucket *);
+void output_init(int);
+void output_write(const char *, size_t);
+void output_poll(void);
+void output_finish(void);
+void record_begin(record *, out_buf *, int, const char *);
+void record_end(record *);
+void record_uint(record *, unsigned, IKE_UINT64);
+void record_strn(record *, unsigned, const unsigned char *, size_t);
+void record_str(record *, unsigned, const char *);
+void record_bytes(record *, unsigned, const unsigned char *, size_t);
+void record_list_begin(record *, unsigned);
+void record_list_end(record *);
+void record_object_begin(record *, unsigned);
+void record_object_end(record *);
+size_t record_read(const unsigned char *, size_t, out_buf *, int);
+void vid_matcher_image(vid_pattern_list *, out_buf *);
+vid_matcher *vid_matcher_attach(const void *, size_t, void *);
+vid_matcher *vid_matcher_build(vid_pattern_list *);
+const char *vid_matcher_match(const vid_matcher *, const unsigned char *,
+                              size_t, const char *);
+void vid_matcher_free(vid_matcher *);
+backoff_matcher *backoff_matcher_build(const pattern_list *);
+const char *backoff_matcher_match(const backoff_matcher *, const IKE_UINT64 *,
+                                  unsigned);
+void backoff_matcher_free(backoff_matcher *);
+int pattern_db_write(const char *, vid_pattern_list *, const char *,
+                     pattern_list *, const char *);
+pattern_db *pattern_db_open(const char *, const char *, const char *);
+vid_matcher *pattern_db_vid_matcher(const pattern_db *);
+pattern_list *pattern_db_backoff(const pattern_db *, unsigned);
+void pattern_db_close(pattern_db *);
+void remove_host(host_entry **, scan_shard *);
+host_entry *next_host(scan_shard *, IKE_UINT64, IKE_UINT64 *);
+IKE_UINT64 send_due_hosts(scan_shard *, const struct timeval *, IKE_UINT64);
+void shard_lock(scan_shard *);
+void shard_unlock(scan_shard *);
+void shard_totals(unsigned *, unsigned *, struct timeval *);
+#ifdef HAVE_THREADS
+void *shard_thread(void *);
+#endif
 void timeval_diff(const struct timeval *, const struct timeval *,
                   struct timeval *);
 unsigned char *initialise_ike_packet(size_t *, ike_packet_params *);
-host_entry *find_host_by_cookie(host_entry **, unsigned char *,
-                                       int, unsigned);
+host_entry *find_host_by_cookie(unsigned char *, int, scan_shard **);
+host_entry *find_host_by_stateless_cookie(unsigned char *, int);
 void display_packet(int, unsigned char *, host_entry *,
                     struct in_addr *, unsigned *, unsigned *, int, int);
-void advance_cursor(unsigned, unsigned);
+void sched_add(host_schedule *, host_entry *, IKE_UINT64);
+void sched_remove(host_schedule *, host_entry *);
+host_entry *sched_first(const host_schedule *, IKE_UINT64 *);
+void cookie_index_add(cookie_index *, host_entry *);
+void cookie_index_remove(cookie_index *, const host_entry *);
+host_entry *cookie_index_find(const cookie_index *, const uint32_t *);
+void target_init(target_list *);
+void target_add_range(target_list *, uint32_t, uint32_t);
+unsigned target_count_file(FILE *);
+void target_open_file(target_list *, FILE *);
+void target_load_file(target_list *, FILE *);
+void target_resolve_wait(target_list *);
+void target_randomise(target_list *);
+int target_next(target_list *, struct in_addr *, unsigned *);
+int target_pending(target_list *);
+host_entry *host_alloc(host_pool *);
+void host_free(host_pool *, host_entry *);
+void host_add_recv_time(host_pool *, host_entry *, IKE_UINT64);
+void host_recv_times(const host_entry *, IKE_UINT64 *);
+void stateless_cookie_init(unsigned);
+void stateless_cookie(uint32_t *, struct in_addr);
+int stateless_cookie_check(const uint32_t *, struct in_addr *);
+int stateless_seen_before(struct in_addr);
 void dump_list(unsigned);
-void dump_times(unsigned);
-void add_recv_time(host_entry *, struct timeval *);
+void dump_times(void);
+void add_recv_time(host_entry *, host_pool *, struct timeval *);
 void load_backoff_patterns(const char *, unsigned);
+char *data_file_name(const char *, const char *);
+pattern_db *open_pattern_db(const char *, const char *, const char *);
+void compile_pattern_db(const char *, const char *, const char *);
 void add_pattern(char *, unsigned);
 void load_vid_patterns(const char *);
 void add_vid_pattern(char *);
 char **load_id_strings(char *);
-char *match_pattern(host_entry *);
+const char *match_pattern(host_entry *);
 int times_close_enough(struct timeval *, struct timeval *, unsigned);
 void dump_backoff(unsigned);
 void dump_vid(void);
@@ -409,19 +791,25 @@ void decode_trans_simple(const char *, unsigned *, unsigned *, unsigned *,
 unsigned char *decode_transform(const char *, size_t *);
 unsigned char *skip_payload(unsigned char *, size_t *, unsigned *);
 unsigned char *process_isakmp_hdr(unsigned char *, size_t *, unsigned *,
-                                  unsigned *, char **);
-char *process_sa(unsigned char *, size_t, unsigned, int, int, char *);
-char *process_sa2(unsigned char *, size_t, unsigned, int, int, char *);
-char *process_attr(unsigned char **, size_t *);
-char *process_transform2(unsigned char **, size_t *);
-char *process_vid(unsigned char *, size_t, vid_pattern_list *);
-char *process_notify(unsigned char *, size_t, int, int, char *);
-char *process_notify2(unsigned char *, size_t, int, int, char *);
-char *process_id(unsigned char *, size_t);
-char *process_cert(unsigned char *, size_t, unsigned);
-char *process_delete(unsigned char *, size_t);
-char *process_notification(unsigned char *, size_t);
-char *process_generic(unsigned char *, size_t, unsigned);
+                                  unsigned *, out_buf *);
+void process_sa(unsigned char *, size_t, unsigned, int, int, const char *,
+                out_buf *);
+void process_sa2(unsigned char *, size_t, unsigned, int, int, const char *,
+                 out_buf *);
+void process_attr(unsigned char **, size_t *, out_buf *);
+void process_transform2(unsigned char **, size_t *, out_buf *);
+void process_vid(unsigned char *, size_t, const vid_matcher *, out_buf *);
+void process_notify(unsigned char *, size_t, int, int, const char *,
+                    out_buf *);
+void process_notify2(unsigned char *, size_t, int, int, const char *,
+                     out_buf *);
+void process_id(unsigned char *, size_t, out_buf *);
+void process_cert(unsigned char *, size_t, unsigned, out_buf *);
+void process_delete(unsigned char *, size_t, out_buf *);
+void process_notification(unsigned char *, size_t, out_buf *);
+void process_generic(unsigned char *, size_t, unsigned, out_buf *);
+unsigned record_isakmp_packet(record *, unsigned char *, size_t, int,
+                              const vid_matcher *, int);
 unsigned char *make_transform(size_t *, unsigned, unsigned, unsigned,
                               unsigned char *, size_t);
 unsigned char* add_transform(int, size_t *, unsigned, unsigned char *, size_t);
@@ -438,6 +826,12 @@ char *make_message(const char *, ...);
 char *numstr(unsigned);
 char *printable(const unsigned char*, size_t);
 char *hexstring(const unsigned char*, size_t);
+void out_reset(out_buf *);
+void out_append(out_buf *, const char *);
+void out_append_len(out_buf *, const char *, size_t);
+void out_printf(out_buf *, const char *, ...);
+void out_printable(out_buf *, const unsigned char *, size_t);
+void out_hex(out_buf *, const unsigned char *, size_t);
 void print_times(void);
 void sig_alarm(int);
 const char *id_to_name(unsigned, const id_name_map[]);
@@ -1557,18 +1557,21 @@ skip_payload(unsigned char *cp, size_t *len, unsigned *next) {
  *	len	Packet length remaining
  *	next	Next payload type.
  *	type	Exchange type
- *	hdr_descr	ISAKMP Header description string
+ *	hdr_descr	Output buffer for ISAKMP Header description string
  *
  *	Returns:
  *
  *	Pointer to start of next payload, or NULL if no next payload.
+ *
+ *	hdr_descr is reset before the description is written to it, and is
+ *	left empty if there is no next payload.
  */
 unsigned char *
 process_isakmp_hdr(unsigned char *cp, size_t *len, unsigned *next,
-                   unsigned *type, char **hdr_descr) {
+                   unsigned *type, out_buf *hdr_descr) {
    struct isakmp_hdr *hdr = (struct isakmp_hdr *) cp;
-   char *msg;
-   char *msg2;
+
+   out_reset(hdr_descr);
 /*
  *	Signal no more payloads by setting length to zero if:
  *
@@ -1581,7 +1584,6 @@ process_isakmp_hdr(unsigned char *cp, size_t *len, unsigned *next,
    if (*len < sizeof(struct isakmp_hdr) ||
        ntohl(hdr->isa_length) < sizeof(struct isakmp_hdr) ||
        hdr->isa_np == ISAKMP_NEXT_NONE) {
-      *hdr_descr = NULL;
       *len=0;
       *next=ISAKMP_NEXT_NONE;
       *type=ISAKMP_XCHG_NONE;
@@ -1590,38 +1592,27 @@ process_isakmp_hdr(unsigned char *cp, size_t *len, unsigned *next,
 /*
  *	Create ISAKMP header description string.
  */
-   msg2 = hexstring((unsigned char *)hdr->isa_rcookie, 8);
-   msg = make_message("HDR=(CKY-R=%s", msg2);
-   free(msg2);
+   out_append(hdr_descr, "HDR=(CKY-R=");
+   out_hex(hdr_descr, (unsigned char *)hdr->isa_rcookie, 8);
    if (hdr->isa_version != 0x10) {	/* Version not 1.0 */
-      msg2 = msg;
       if (hdr->isa_version == 0x20) {
-         msg = make_message("%s, IKEv2", msg2);
+         out_append(hdr_descr, ", IKEv2");
       } else {
-         msg = make_message("%s, version=0x%.2x", msg2,
-                            hdr->isa_version);
+         out_printf(hdr_descr, ", version=0x%.2x", hdr->isa_version);
       }
-      free(msg2);
    }
    if ((hdr->isa_version==0x10 && hdr->isa_flags != 0) ||
        (hdr->isa_version==0x20 && hdr->isa_flags != 0x20)) {
-      msg2 = msg;
-      msg = make_message("%s, flags=0x%.2x", msg2, hdr->isa_flags);
-      free(msg2);
+      out_printf(hdr_descr, ", flags=0x%.2x", hdr->isa_flags);
    }
    if (hdr->isa_msgid != 0) {	/* Non-Zero msgid - shouldn't happen */
-      msg2 = msg;
-      msg = make_message("%s, msgid=%.8x", msg2, ntohl(hdr->isa_msgid));
-      free(msg2);
+      out_printf(hdr_descr, ", msgid=%.8x", ntohl(hdr->isa_msgid));
    }
-   msg2 = msg;
-   msg = make_message("%s)", msg2);
-   free(msg2);
+   out_append(hdr_descr, ")");
 /*
  *	There is another payload after this one, so adjust length and
  *	return pointer to next payload.
  */
-   *hdr_descr = msg;
    *len = *len - sizeof(struct isakmp_hdr);
    *next = hdr->isa_np;
    *type = hdr->isa_xchg;
@@ -1639,23 +1630,18 @@ process_isakmp_hdr(unsigned char *cp, size_t *len, unsigned *next,
  *	quiet	Only print the basic info if nonzero
  *	multiline	Split decodes across lines if nonzero
  *	hdr_descr	ISAKMP Header description string
+ *	ob	Output buffer to append the SA description to
  *
  *	Returns:
  *
- *	Pointer to SA description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
+void
 process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
-           int multiline, char *hdr_descr) {
+           int multiline, const char *hdr_descr, out_buf *ob) {
    struct isakmp_sa *sa_hdr = (struct isakmp_sa *) cp;
    struct isakmp_proposal *prop_hdr =
       (struct isakmp_proposal *) (cp + sizeof(struct isakmp_sa));
-   char *msg;
-   char *msg2;
-   char *msg3;
    unsigned char *attr_ptr;
    size_t safelen;	/* Shorter of actual and claimed length */
 
@@ -1666,25 +1652,26 @@ process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
  *	size of the SA, Proposal, and transform headers.
  */
    if (safelen < sizeof(struct isakmp_sa) + sizeof(struct isakmp_proposal) +
-       sizeof(struct isakmp_transform))
-      return make_message("IKE Handshake returned (packet too short to decode)");
+       sizeof(struct isakmp_transform)) {
+      out_append(ob, "IKE Handshake returned (packet too short to decode)");
+      return;
+   }
 /*
  *	Build the first part of the message based on the exchange type.
  */
    if (type == ISAKMP_XCHG_IDPROT) {		/* Main Mode */
-      msg = make_message("Main Mode Handshake returned");
+      out_append(ob, "Main Mode Handshake returned");
    } else if (type == ISAKMP_XCHG_AGGR) {	/* Aggressive Mode */
-      msg = make_message("Aggressive Mode Handshake returned");
+      out_append(ob, "Aggressive Mode Handshake returned");
    } else {
-      msg = make_message("UNKNOWN Mode Handshake returned (%u)", type);
+      out_printf(ob, "UNKNOWN Mode Handshake returned (%u)", type);
    }
 /*
  *	If quiet is not in effect, add the ISAKMP header details to the message.
  */
    if (!quiet) {
-      msg2 = msg;
-      msg = make_message("%s%s%s", msg2, multiline?"\n\t":" ", hdr_descr);
-      free(msg2);
+      out_append(ob, multiline?"\n\t":" ");
+      out_append(ob, hdr_descr);
    }
 /*
  *	We should have exactly one transform in the server's response.
@@ -1692,9 +1679,7 @@ process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
  *	message.  This normally means that we've received our own output.
  */
    if (prop_hdr->isap_notrans != 1) {
-      msg2 = msg;
-      msg = make_message("%s (%d transforms)", msg2, prop_hdr->isap_notrans);
-      free(msg2);
+      out_printf(ob, " (%d transforms)", prop_hdr->isap_notrans);
    }
 /*
  *	If quiet is not in effect, and we have exactly one transform, add the
@@ -1703,17 +1688,12 @@ process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
    if (!quiet && prop_hdr->isap_notrans==1) {
       int firstloop=1;
 
-      msg2 = msg;
-      msg = make_message("%s%sSA=(", msg2, multiline?"\n\t":" ");
-      free(msg2);
+      out_append(ob, multiline?"\n\tSA=(":" SA=(");
       if (prop_hdr->isap_spisize != 0) {	/* Non-Zero SPI */
-         msg2 = msg;
-         msg3 = hexstring(cp + sizeof(struct isakmp_sa) +
-                          sizeof(struct isakmp_proposal),
-                          prop_hdr->isap_spisize);
-         msg = make_message("%sSPI=%s ", msg2, msg3);
-         free(msg2);
-         free(msg3);
+         out_append(ob, "SPI=");
+         out_hex(ob, cp + sizeof(struct isakmp_sa) +
+                 sizeof(struct isakmp_proposal), prop_hdr->isap_spisize);
+         out_append(ob, " ");
       }
       attr_ptr = (cp + sizeof(struct isakmp_sa) +
                   sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize +
@@ -1723,23 +1703,14 @@ process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
                  sizeof(struct isakmp_transform);
 
       while (safelen) {
-         msg2 = msg;
-         msg3 = process_attr(&attr_ptr, &safelen);
-         if (firstloop) {	/* Don't need leading space for 1st attr */
-            msg = make_message("%s%s", msg2, msg3);
+         if (firstloop)	/* Don't need leading space for 1st attr */
             firstloop=0;
-         } else {
-            msg = make_message("%s %s", msg2, msg3);
-         }
-         free(msg2);
-         free(msg3);
+         else
+            out_append(ob, " ");
+         process_attr(&attr_ptr, &safelen, ob);
       }
-      msg2 = msg;
-      msg = make_message("%s)", msg2);
-      free(msg2);
+      out_append(ob, ")");
    }
-
-   return msg;
 }
 
 /*
@@ -1753,23 +1724,18 @@ process_sa(unsigned char *cp, size_t len, unsigned type, int quiet,
  *	quiet	Only print the basic info if nonzero
  *	multiline	Split decodes across lines if nonzero
  *	hdr_descr	ISAKMP Header description string
+ *	ob	Output buffer to append the SA description to
  *
  *	Returns:
  *
- *	Pointer to SA description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
+void
 process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
-            int multiline, char *hdr_descr) {
+            int multiline, const char *hdr_descr, out_buf *ob) {
    struct isakmp_sa2 *sa_hdr = (struct isakmp_sa2 *) cp;
    struct isakmp_proposal *prop_hdr =
       (struct isakmp_proposal *) (cp + sizeof(struct isakmp_sa2));
-   char *msg;
-   char *msg2;
-   char *msg3;
    unsigned char *trans_ptr;
    size_t safelen;	/* Shorter of actual and claimed length */
 
@@ -1780,23 +1746,24 @@ process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
  *	size of the SA, Proposal, and transform headers.
  */
    if (safelen < sizeof(struct isakmp_sa2) + sizeof(struct isakmp_proposal) +
-       sizeof(struct isakmp_transform2))
-      return make_message("IKEv2 Handshake returned (packet too short to decode)");
+       sizeof(struct isakmp_transform2)) {
+      out_append(ob, "IKEv2 Handshake returned (packet too short to decode)");
+      return;
+   }
 /*
  *	Build the first part of the message based on the exchange type.
  */
    if (type == ISAKMP_XCHG_IKE_SA_INIT) {
-      msg = make_message("IKEv2 SA_INIT Handshake returned");
+      out_append(ob, "IKEv2 SA_INIT Handshake returned");
    } else {
-      msg = make_message("UNKNOWN Mode Handshake returned (%u)", type);
+      out_printf(ob, "UNKNOWN Mode Handshake returned (%u)", type);
    }
 /*
  *	If quiet is not in effect, add the ISAKMP header details to the message.
  */
    if (!quiet) {
-      msg2 = msg;
-      msg = make_message("%s%s%s", msg2, multiline?"\n\t":" ", hdr_descr);
-      free(msg2);
+      out_append(ob, multiline?"\n\t":" ");
+      out_append(ob, hdr_descr);
    }
 /*
  *	We should have exactly one proposal in the server's response.
@@ -1804,9 +1771,7 @@ process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
  *	message.  This normally means that we've received our own output.
  */
    if (prop_hdr->isap_np != ISAKMP_NEXT_NONE) {
-      msg2 = msg;
-      msg = make_message("%s (multiple proposals)", msg2);
-      free(msg2);
+      out_append(ob, " (multiple proposals)");
    }
 /*
  *	If quiet is not in effect, and we have exactly one proposal, add the
@@ -1815,17 +1780,12 @@ process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
    if (!quiet && prop_hdr->isap_np == ISAKMP_NEXT_NONE) {
       int firstloop=1;
 
-      msg2 = msg;
-      msg = make_message("%s%sSA=(", msg2, multiline?"\n\t":" ");
-      free(msg2);
+      out_append(ob, multiline?"\n\tSA=(":" SA=(");
       if (prop_hdr->isap_spisize != 0) {	/* Non-Zero SPI */
-         msg2 = msg;
-         msg3 = hexstring(cp + sizeof(struct isakmp_sa2) +
-                          sizeof(struct isakmp_proposal),
-                          prop_hdr->isap_spisize);
-         msg = make_message("%sSPI=%s ", msg2, msg3);
-         free(msg2);
-         free(msg3);
+         out_append(ob, "SPI=");
+         out_hex(ob, cp + sizeof(struct isakmp_sa2) +
+                 sizeof(struct isakmp_proposal), prop_hdr->isap_spisize);
+         out_append(ob, " ");
       }
       trans_ptr = cp + sizeof(struct isakmp_sa2) +
                   sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize;
@@ -1833,23 +1793,14 @@ process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
                  sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize;
 
       while (safelen) {
-         msg2 = msg;
-         msg3 = process_transform2(&trans_ptr, &safelen);
-         if (firstloop) {	/* Don't need leading space for 1st attr */
-            msg = make_message("%s%s", msg2, msg3);
+         if (firstloop)	/* Don't need leading space for 1st attr */
             firstloop=0;
-         } else {
-            msg = make_message("%s %s", msg2, msg3);
-         }
-         free(msg2);
-         free(msg3);
+         else
+            out_append(ob, " ");
+         process_transform2(&trans_ptr, &safelen, ob);
       }
-      msg2 = msg;
-      msg = make_message("%s)", msg2);
-      free(msg2);
+      out_append(ob, ")");
    }
-
-   return msg;
 }
 
 /*
@@ -1859,23 +1810,18 @@ process_sa2(unsigned char *cp, size_t len, unsigned type, int quiet,
  *
  *	cp	Pointer to start of attribute
  *	len	Packet length remaining
+ *	ob	Output buffer to append the attribute description to
  *
  *	Returns:
  *
- *	Pointer to attribute description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_attr(unsigned char **cp, size_t *len) {
-   char *msg;
+void
+process_attr(unsigned char **cp, size_t *len, out_buf *ob) {
    struct isakmp_attribute *attr_hdr = (struct isakmp_attribute *) *cp;
    char attr_type;	/* B=Basic, V=Variable */
    unsigned attr_class;
    unsigned attr_value=0;
-   char *attr_class_str;
-   char *attr_value_str;
    size_t value_len;
    size_t size;
 
@@ -1890,43 +1836,35 @@ process_attr(unsigned char **cp, size_t *len) {
       value_len = ntohs (attr_hdr->isaat_lv);
    }
 
-   attr_class_str = make_message("%s", id_to_name(attr_class, attr_map));
+   out_append(ob, id_to_name(attr_class, attr_map));
 
    if (attr_type == 'B') {
+      out_append(ob, "=");
       switch (attr_class) {
       case 1:		/* Encryption Algorithm */
-         attr_value_str = make_message("%s", id_to_name(attr_value, enc_map));
+         out_append(ob, id_to_name(attr_value, enc_map));
          break;
       case 2:		/* Hash Algorithm */
-         attr_value_str = make_message("%s", id_to_name(attr_value, hash_map));
+         out_append(ob, id_to_name(attr_value, hash_map));
          break;
       case 3:		/* Authentication Method */
-         attr_value_str = make_message("%s", id_to_name(attr_value, auth_map));
+         out_append(ob, id_to_name(attr_value, auth_map));
          break;
       case 4:		/* Group Description */
-         attr_value_str = make_message("%s", id_to_name(attr_value, dh_map));
+         out_append(ob, id_to_name(attr_value, dh_map));
          break;
       case 11:		/* Life Type */
-         attr_value_str = make_message("%s", id_to_name(attr_value, life_map));
+         out_append(ob, id_to_name(attr_value, life_map));
          break;
       default:
-         attr_value_str = make_message("%u", attr_value);
+         out_printf(ob, "%u", attr_value);
          break;
       }
    } else {
-      attr_value_str = hexstring((*cp) + sizeof (struct isakmp_attribute),
-                                 value_len);
+      out_printf(ob, "(%u)=0x", value_len);
+      out_hex(ob, (*cp) + sizeof (struct isakmp_attribute), value_len);
    }
 
-   if (attr_type == 'B')
-      msg = make_message("%s=%s", attr_class_str, attr_value_str);
-   else
-      msg = make_message("%s(%u)=0x%s", attr_class_str, value_len,
-                         attr_value_str);
-
-   free(attr_class_str);
-   free(attr_value_str);
-
    size=sizeof (struct isakmp_attribute) + value_len;
    if (size >= *len) {
       *len=0;
@@ -1934,8 +1872,6 @@ process_attr(unsigned char **cp, size_t *len) {
       *len -= size;
       (*cp) += size;
    }
-
-   return msg;
 }
 
 /*
@@ -1945,44 +1881,40 @@ process_attr(unsigned char **cp, size_t *len) {
  *
  *	cp	Pointer to start of transform
  *	len	Packet length remaining
+ *	ob	Output buffer to append the transform description to
  *
  *	Returns:
  *
- *	Pointer to transform description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_transform2(unsigned char **cp, size_t *len) {
-   char *msg;
+void
+process_transform2(unsigned char **cp, size_t *len, out_buf *ob) {
    struct isakmp_transform2 *trans_hdr = (struct isakmp_transform2 *) *cp;
    unsigned trans_type;
    unsigned trans_id;
-   char *trans_type_str;
-   char *trans_id_str;
    size_t size;
 
    trans_type = trans_hdr->isat2_transtype;
    trans_id = ntohs(trans_hdr->isat2_transid);
 
-   trans_type_str = make_message("%s", id_to_name(trans_type, trans_type_map));
+   out_append(ob, id_to_name(trans_type, trans_type_map));
+   out_append(ob, "=");
 
    switch (trans_type) {
    case 1:		/* Encryption Algorithm */
-      trans_id_str = make_message("%s", id_to_name(trans_id, encr_map));
+      out_append(ob, id_to_name(trans_id, encr_map));
       break;
    case 2:		/* Pseudo-random Function */
-      trans_id_str = make_message("%s", id_to_name(trans_id, prf_map));
+      out_append(ob, id_to_name(trans_id, prf_map));
       break;
    case 3:		/* Integrity Algorithm */
-      trans_id_str = make_message("%s", id_to_name(trans_id, integ_map));
+      out_append(ob, id_to_name(trans_id, integ_map));
       break;
    case 4:		/* Diffie-Hellman Group */
-      trans_id_str = make_message("%s", id_to_name(trans_id, dh_map));
+      out_append(ob, id_to_name(trans_id, dh_map));
       break;
    default:
-      trans_id_str = make_message("%u", trans_id);
+      out_printf(ob, "%u", trans_id);
       break;
    }
 
@@ -1999,23 +1931,15 @@ process_transform2(unsigned char **cp, size_t *len) {
       } else {					/* Variable attribute */
          warn_msg("WARNING: Ignoring IKEv2 variable length transform attribute");
       }
-      msg = make_message("%s=%s,%s=%u", trans_type_str, trans_id_str,
-                         id_to_name(attr_class, attr_map), attr_value);
-   } else {	/* No attributes */
-      msg = make_message("%s=%s", trans_type_str, trans_id_str);
+      out_printf(ob, ",%s=%u", id_to_name(attr_class, attr_map), attr_value);
    }
 
-   free(trans_type_str);
-   free(trans_id_str);
-
    if (size >= *len) {
       *len=0;
    } else {
       *len -= size;
       (*cp) += size;
    }
-
-   return msg;
 }
 
 /*
@@ -2025,50 +1949,41 @@ process_transform2(unsigned char **cp, size_t *len) {
  *
  *	cp	Pointer to start of Vendor ID payload
  *	len	Packet length remaining
- *	vidlist	List of Vendor ID patterns.
+ *	vidmatch	Vendor ID pattern matcher.
+ *	ob	Output buffer to append the Vendor ID description to
  *
  *	Returns:
  *
- *	Pointer to Vendor ID description string.
+ *	None.
  *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	The hex Vendor ID in the output buffer is passed to the matcher in
+ *	case any patterns need it, so it does not need to be built separately.
  */
-char *
-process_vid(unsigned char *cp, size_t len, vid_pattern_list *vidlist) {
+void
+process_vid(unsigned char *cp, size_t len, const vid_matcher *vidmatch,
+            out_buf *ob) {
    struct isakmp_vid *hdr = (struct isakmp_vid *) cp;
-   char *msg;
-   char *hexvid;
-   char *p;
+   size_t hexvid;	/* Offset of the hex Vendor ID in the buffer */
    unsigned char *vid_data;
    size_t data_len;
-   vid_pattern_list *ve;
+   const char *name;
 
    if (len < sizeof(struct isakmp_vid) ||
-        ntohs(hdr->isavid_length) < sizeof(struct isakmp_vid))
-      return make_message("VID (packet too short to decode)");
+        ntohs(hdr->isavid_length) < sizeof(struct isakmp_vid)) {
+      out_append(ob, "VID (packet too short to decode)");
+      return;
+   }
 
    vid_data = cp + sizeof(struct isakmp_vid);  /* Points to start of VID data */
    data_len = ntohs(hdr->isavid_length) < len ? ntohs(hdr->isavid_length) : len;
    data_len -= sizeof(struct isakmp_vid);
 
-   hexvid = hexstring(vid_data, data_len);
-   msg=make_message("VID=%s", hexvid);
-/*
- *	Try to find a match in the Vendor ID pattern list.
- */
-   ve = vidlist;
-   while(ve != NULL) {
-      if (!(regexec(ve->regex, hexvid, 0, NULL, 0))) {
-         p=msg;
-         msg=make_message("%s (%s)", p, ve->name);
-         free(p);
-         break;	/* Stop looking after first match */
-      }
-      ve=ve->next;
-   }
-   free(hexvid);
-   return msg;
+   out_append(ob, "VID=");
+   hexvid = ob->len;
+   out_hex(ob, vid_data, data_len);
+   if ((name = vid_matcher_match(vidmatch, vid_data, data_len,
+                                 ob->buf + hexvid)) != NULL)
+      out_printf(ob, " (%s)", name);
 }
 
 /*
@@ -2081,57 +1996,50 @@ process_vid(unsigned char *cp, size_t len, vid_pattern_list *vidlist) {
  *	quiet		Only print the basic info if nonzero
  *	multiline	Split decodes across lines if nonzero
  *	hdr_descr	ISAKMP Header description string
+ *	ob		Output buffer to append the notify description to
  *
  *	Returns:
  *
- *	Pointer to notify description string.
+ *	None.
  *
  *	This function is only used for notification messages that are part
  *	of an informational exchange.  Notification messages that are part
  *	of another exchange type are handled with process_notification()
  *	instead.  This is an ugly hack.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
  */
-char *
+void
 process_notify(unsigned char *cp, size_t len, int quiet, int multiline,
-               char *hdr_descr) {
+               const char *hdr_descr, out_buf *ob) {
    struct isakmp_notification *hdr = (struct isakmp_notification *) cp;
-   char *msg;
-   char *msg2;
    unsigned msg_type;
    size_t msg_len;
    unsigned char *msg_data;
-   char *notify_msg;
 
    if (len < sizeof(struct isakmp_notification) ||
-        ntohs(hdr->isan_length) < sizeof(struct isakmp_notification))
-      return make_message("Notify message (packet too short to decode)");
+        ntohs(hdr->isan_length) < sizeof(struct isakmp_notification)) {
+      out_append(ob, "Notify message (packet too short to decode)");
+      return;
+   }
 
    msg_type = ntohs(hdr->isan_type);
    msg_len = ntohs(hdr->isan_length) - sizeof(struct isakmp_notification);
    msg_data = cp + sizeof(struct isakmp_notification);
 
    if (msg_type == 9101 || msg_type == 9110) {	/* Firewall-1 message types */
-      notify_msg = printable(msg_data, msg_len);
-      msg=make_message("Notify message %u (Firewall-1) Message=\"%s\"",
-                       msg_type, notify_msg);
-      free(notify_msg);
+      out_printf(ob, "Notify message %u (Firewall-1) Message=\"", msg_type);
+      out_printable(ob, msg_data, msg_len);
+      out_append(ob, "\"");
    } else {			/* All other Message Types */
-      msg=make_message("Notify message %u (%s)", msg_type,
-                       id_to_name(msg_type, notification_map));
+      out_printf(ob, "Notify message %u (%s)", msg_type,
+                 id_to_name(msg_type, notification_map));
    }
 /*
  *	If quiet is not in effect, add the ISAKMP header details to the message.
  */
    if (!quiet) {
-      msg2 = msg;
-      msg = make_message("%s%s%s", msg2, multiline?"\n\t":" ", hdr_descr);
-      free(msg2);
+      out_append(ob, multiline?"\n\t":" ");
+      out_append(ob, hdr_descr);
    }
-
-   return msg;
 }
 
 /*
@@ -2144,57 +2052,50 @@ process_notify(unsigned char *cp, size_t len, int quiet, int multiline,
  *	quiet		Only print the basic info if nonzero
  *	multiline	Split decodes across lines if nonzero
  *	hdr_descr	ISAKMP Header description string
+ *	ob		Output buffer to append the notify description to
  *
  *	Returns:
  *
- *	Pointer to notify description string.
+ *	None.
  *
  *	This function is only used for notification messages that are part
  *	of an informational exchange.  Notification messages that are part
  *	of another exchange type are handled with process_notification()
  *	instead.  This is an ugly hack.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
  */
-char *
+void
 process_notify2(unsigned char *cp, size_t len, int quiet, int multiline,
-                char *hdr_descr) {
+                const char *hdr_descr, out_buf *ob) {
    struct isakmp_notification2 *hdr = (struct isakmp_notification2 *) cp;
-   char *msg;
-   char *msg2;
    unsigned msg_type;
    size_t msg_len;
    unsigned char *msg_data;
-   char *notify_msg;
 
    if (len < sizeof(struct isakmp_notification2) ||
-        ntohs(hdr->isan2_length) < sizeof(struct isakmp_notification2))
-      return make_message("Notify message (packet too short to decode)");
+        ntohs(hdr->isan2_length) < sizeof(struct isakmp_notification2)) {
+      out_append(ob, "Notify message (packet too short to decode)");
+      return;
+   }
 
    msg_type = ntohs(hdr->isan2_type);
    msg_len = ntohs(hdr->isan2_length) - sizeof(struct isakmp_notification2);
    msg_data = cp + sizeof(struct isakmp_notification2);
 
    if (msg_type == 9101 || msg_type == 9110) {	/* Firewall-1 message types */
-      notify_msg = printable(msg_data, msg_len);
-      msg=make_message("Notify message %u (Firewall-1) Message=\"%s\"",
-                       msg_type, notify_msg);
-      free(notify_msg);
+      out_printf(ob, "Notify message %u (Firewall-1) Message=\"", msg_type);
+      out_printable(ob, msg_data, msg_len);
+      out_append(ob, "\"");
    } else {			/* All other Message Types */
-      msg=make_message("Notify message %u (%s)", msg_type,
-                       id_to_name(msg_type, notification_map2));
+      out_printf(ob, "Notify message %u (%s)", msg_type,
+                 id_to_name(msg_type, notification_map2));
    }
 /*
  *	If quiet is not in effect, add the ISAKMP header details to the message.
  */
    if (!quiet) {
-      msg2 = msg;
-      msg = make_message("%s%s%s", msg2, multiline?"\n\t":" ", hdr_descr);
-      free(msg2);
+      out_append(ob, multiline?"\n\t":" ");
+      out_append(ob, hdr_descr);
    }
-
-   return msg;
 }
 
 /*
@@ -2204,65 +2105,50 @@ process_notify2(unsigned char *cp, size_t len, int quiet, int multiline,
  *
  *	cp	Pointer to start of notify payload
  *	len	Packet length remaining
+ *	ob	Output buffer to append the notification description to
  *
  *	Returns:
  *
- *	Pointer to notify description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_notification(unsigned char *cp, size_t len) {
+void
+process_notification(unsigned char *cp, size_t len, out_buf *ob) {
    struct isakmp_notification *hdr = (struct isakmp_notification *) cp;
-   char *msg;
-   char *msg2;
    unsigned msg_type;
    size_t msg_len;
    unsigned char *msg_data;
-   char *hex_spi;
    unsigned char *notification_spi;
-   char *hex_data;
    size_t spi_len;
    uint32_t doi;
    unsigned proto_id;
 
    if (len < sizeof(struct isakmp_notification) ||
-        ntohs(hdr->isan_length) < sizeof(struct isakmp_notification))
-      return make_message("Notification (packet too short to decode)");
+        ntohs(hdr->isan_length) < sizeof(struct isakmp_notification)) {
+      out_append(ob, "Notification (packet too short to decode)");
+      return;
+   }
 
    doi = ntohl(hdr->isan_doi);
    proto_id = hdr->isan_protoid;
    msg_type = ntohs(hdr->isan_type);
    notification_spi = cp + sizeof(struct isakmp_notification);
    spi_len = hdr->isan_spisize;
-   hex_spi = hexstring(notification_spi, spi_len);
    msg_len = ntohs(hdr->isan_length) - sizeof(struct isakmp_notification) -
              spi_len;
    msg_data = cp + sizeof(struct isakmp_notification) + spi_len;
-   hex_data = hexstring(msg_data, msg_len);
 
-   msg=make_message("Notification=(");
+   out_append(ob, "Notification=(");
    if (doi != 1) {	/* DOI not IPsec */
-      msg2 = msg;
-      msg = make_message("%sDOI=%s, ", msg2, id_to_name(doi, doi_map));
-      free(msg2);
+      out_printf(ob, "DOI=%s, ", id_to_name(doi, doi_map));
    }
    if (proto_id != 1) {	/* Protocol ID not ISAKMP */
-      msg2 = msg;
-      msg = make_message("%sProto_ID=%s, ", msg2,
-                         id_to_name(proto_id, protocol_map));
-      free(msg2);
-   }
-   msg2 = msg;
-   msg=make_message("%sType=%s, SPI=%s, Data=%s)", msg2,
-                    id_to_name(msg_type, notification_map),
-                    hex_spi, hex_data);
-   free(msg2);
-   free(hex_spi);
-   free(hex_data);
-
-   return msg;
+      out_printf(ob, "Proto_ID=%s, ", id_to_name(proto_id, protocol_map));
+   }
+   out_printf(ob, "Type=%s, SPI=", id_to_name(msg_type, notification_map));
+   out_hex(ob, notification_spi, spi_len);
+   out_append(ob, ", Data=");
+   out_hex(ob, msg_data, msg_len);
+   out_append(ob, ")");
 }
 
 /*
@@ -2272,34 +2158,32 @@ process_notification(unsigned char *cp, size_t len) {
  *
  *	cp	Pointer to start of identification payload
  *	len	Packet length remaining
+ *	ob	Output buffer to append the identification description to
  *
  *	Returns:
  *
- *	Pointer to identification description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_id(unsigned char *cp, size_t len) {
+void
+process_id(unsigned char *cp, size_t len, out_buf *ob) {
    struct isakmp_id *hdr = (struct isakmp_id *) cp;
    unsigned idtype;
-   char *msg;
-   char *msg2;
    unsigned char *id_data;
    size_t data_len;
 
    if (len < sizeof(struct isakmp_id) ||
-        ntohs(hdr->isaid_length) < sizeof(struct isakmp_id))
-      return make_message("ID (packet too short to decode)");
+        ntohs(hdr->isaid_length) < sizeof(struct isakmp_id)) {
+      out_append(ob, "ID (packet too short to decode)");
+      return;
+   }
 
    id_data = cp + sizeof(struct isakmp_id);  /* Points to start of ID data */
    data_len = ntohs(hdr->isaid_length) < len ? ntohs(hdr->isaid_length) : len;
    data_len -= sizeof(struct isakmp_id);
    idtype = hdr->isaid_idtype;
 
+   out_printf(ob, "ID(Type=%s, ", id_to_name(idtype,id_map));
    switch(idtype) {
-      char *id;			/* Printable ID */
       struct in_addr in;	/* IPv4 Address */
       struct in_addr in2;	/* IPv4 Address */
       unsigned char *mask;	/* Netmask */
@@ -2307,19 +2191,19 @@ process_id(unsigned char *cp, size_t len) {
       case ID_IPV4_ADDR:
          if (data_len >= sizeof(struct in_addr)) {
             memcpy(&in, id_data, sizeof(struct in_addr));
-            msg=make_message("Value=%s", inet_ntoa(in));
+            out_printf(ob, "Value=%s", inet_ntoa(in));
          } else {
-            msg=make_message("Value too short to decode");
+            out_append(ob, "Value too short to decode");
          }
          break;
       case ID_IPV4_ADDR_SUBNET:
          if (data_len >= sizeof(struct in_addr) + 4) {
             memcpy(&in, id_data, sizeof(struct in_addr));
             mask = id_data + sizeof(struct in_addr);
-            msg=make_message("Value=%s/%u.%u.%u.%u", inet_ntoa(in),
-                             mask[0], mask[1], mask[2], mask[3]);
+            out_printf(ob, "Value=%s/%u.%u.%u.%u", inet_ntoa(in),
+                       mask[0], mask[1], mask[2], mask[3]);
          } else {
-            msg=make_message("Value too short to decode");
+            out_append(ob, "Value too short to decode");
          }
          break;
       case ID_IPV4_ADDR_RANGE:
@@ -2327,39 +2211,32 @@ process_id(unsigned char *cp, size_t len) {
             memcpy(&in, id_data, sizeof(struct in_addr));
             memcpy(&in2, id_data+sizeof(struct in_addr),
                    sizeof(struct in_addr));
-            msg=make_message("Value=%s-%s", inet_ntoa(in), inet_ntoa(in2));
+            out_printf(ob, "Value=%s-%s", inet_ntoa(in), inet_ntoa(in2));
          } else {
-            msg=make_message("Value too short to decode");
+            out_append(ob, "Value too short to decode");
          }
          break;
       case ID_FQDN:
       case ID_USER_FQDN:
-         id = printable(id_data, data_len);
-         msg=make_message("Value=%s", id);
-         free(id);
+         out_append(ob, "Value=");
+         out_printable(ob, id_data, data_len);
          break;
       case ID_KEY_ID:
-         id = hexstring(id_data, data_len);
-         msg = make_message("Value=%s", id);
-         free(id);
+         out_append(ob, "Value=");
+         out_hex(ob, id_data, data_len);
          break;
       case ID_IPV6_ADDR:
       case ID_IPV6_ADDR_SUBNET:
       case ID_IPV6_ADDR_RANGE:
       case ID_DER_ASN1_DN:
       case ID_DER_ASN1_GN:
-         msg=make_message("Decode not supported for this type");
+         out_append(ob, "Decode not supported for this type");
          break;
       default:
-         msg = make_message("Unknown ID Type");
+         out_append(ob, "Unknown ID Type");
          break;
    }
-
-   msg2=msg;
-   msg=make_message("ID(Type=%s, %s)", id_to_name(idtype,id_map), msg2);
-   free(msg2);
-
-   return msg;
+   out_append(ob, ")");
 }
 
 /*
@@ -2370,36 +2247,33 @@ process_id(unsigned char *cp, size_t len) {
  *	cp	Pointer to start of certificate payload
  *	len	Packet length remaining
  *	next	The previous next payload type
+ *	ob	Output buffer to append the certificate description to
  *
  *	Returns:
  *
- *	Pointer to certificate description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_cert(unsigned char *cp, size_t len, unsigned next) {
+void
+process_cert(unsigned char *cp, size_t len, unsigned next, out_buf *ob) {
    struct isakmp_generic *hdr = (struct isakmp_generic *) cp;
-   char *msg;
    unsigned char cert_type;
    unsigned char *cert_data;
    size_t data_len;
 
    if (len < sizeof(struct isakmp_generic) + 1 ||
-        ntohs(hdr->isag_length) < sizeof(struct isakmp_generic) + 1)
-      return make_message("Certificate (packet too short to decode)");
+        ntohs(hdr->isag_length) < sizeof(struct isakmp_generic) + 1) {
+      out_append(ob, "Certificate (packet too short to decode)");
+      return;
+   }
 
    cert_data = cp + sizeof(struct isakmp_generic);
    cert_type = *cert_data++;
    data_len = ntohs(hdr->isag_length) < len ? ntohs(hdr->isag_length) : len;
    data_len -= sizeof(struct isakmp_generic) + 1;
 
-   msg=make_message("%s(Type=%s, Length=%u bytes)",
-                    id_to_name(next, payload_map),
-                    id_to_name(cert_type, cert_map), data_len);
-
-   return msg;
+   out_printf(ob, "%s(Type=%s, Length=%u bytes)",
+              id_to_name(next, payload_map),
+              id_to_name(cert_type, cert_map), data_len);
 }
 
 /*
@@ -2409,36 +2283,32 @@ process_cert(unsigned char *cp, size_t len, unsigned next) {
  *
  *	cp	Pointer to start of Delete payload
  *	len	Packet length remaining
+ *	ob	Output buffer to append the Delete description to
  *
  *	Returns:
  *
- *	Pointer to Delete description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_delete(unsigned char *cp, size_t len) {
+void
+process_delete(unsigned char *cp, size_t len, out_buf *ob) {
    struct isakmp_delete *hdr = (struct isakmp_delete *) cp;
-   char *msg;
-   char *hex_spi;
    unsigned char *delete_spi;
    size_t spi_len;
 
    if (len < sizeof(struct isakmp_delete) ||
-        ntohs(hdr->isad_length) < sizeof(struct isakmp_delete))
-      return make_message("Delete (packet too short to decode)");
+        ntohs(hdr->isad_length) < sizeof(struct isakmp_delete)) {
+      out_append(ob, "Delete (packet too short to decode)");
+      return;
+   }
 
    delete_spi = cp + sizeof(struct isakmp_delete);
    spi_len = ntohs(hdr->isad_length) < len ? ntohs(hdr->isad_length) : len;
    spi_len -= sizeof(struct isakmp_delete);
 
-   hex_spi = hexstring(delete_spi, spi_len);
-   msg=make_message("Delete=(SPI_Size=%u, SPI_Count=%u, SPI_Data=%s)",
-                    hdr->isad_spisize, ntohs(hdr->isad_nospi), hex_spi);
-   free(hex_spi);
-
-   return msg;
+   out_printf(ob, "Delete=(SPI_Size=%u, SPI_Count=%u, SPI_Data=",
+              hdr->isad_spisize, ntohs(hdr->isad_nospi));
+   out_hex(ob, delete_spi, spi_len);
+   out_append(ob, ")");
 }
 
 /*
@@ -2448,31 +2318,560 @@ process_delete(unsigned char *cp, size_t len) {
  *
  *	cp	Pointer to start of Delete payload
  *	len	Packet length remaining
+ *	ob	Output buffer to append the payload description to
  *
  *	Returns:
  *
- *	Pointer to payload description string.
- *
- *	The description string pointer returned points to malloc'ed storage
- *	which should be free'ed by the caller when it's no longer needed.
+ *	None.
  */
-char *
-process_generic(unsigned char *cp, size_t len, unsigned next) {
+void
+process_generic(unsigned char *cp, size_t len, unsigned next, out_buf *ob) {
    struct isakmp_generic *hdr = (struct isakmp_generic *) cp;
-   char *msg;
 
    if (len < sizeof(struct isakmp_generic) ||
         ntohs(hdr->isag_length) < sizeof(struct isakmp_generic)) {
-      msg = make_message("%s (packet too short to decode)",
-                          id_to_name(next, payload_map));
-      return msg;
+      out_printf(ob, "%s (packet too short to decode)",
+                 id_to_name(next, payload_map));
+      return;
    }
 
-   msg=make_message("%s(%u bytes)", id_to_name(next, payload_map),
-                    ntohs(hdr->isag_length) -
-                    sizeof(struct isakmp_generic));
+   out_printf(ob, "%s(%u bytes)", id_to_name(next, payload_map),
+              ntohs(hdr->isag_length) - sizeof(struct isakmp_generic));
+}
 
-   return msg;
+/*
+ *	record_attr -- Add a transform attribute to an output record
+ *
+ *	Inputs:
+ *
+ *	r	The output record
+ *	cp	Pointer to start of attribute
+ *	len	Packet length remaining
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is the structured equivalent of process_attr(), and steps over
+ *	the attribute in the same way.
+ */
+static void
+record_attr(record *r, unsigned char **cp, size_t *len) {
+   struct isakmp_attribute *attr_hdr = (struct isakmp_attribute *) *cp;
+   unsigned attr_class;
+   unsigned attr_value;
+   const id_name_map *value_map = NULL;
+   size_t value_len;
+   size_t size;
+
+   record_object_begin(r, 0);
+   if (ntohs(attr_hdr->isaat_af_type) & 0x8000) {	/* Basic attribute */
+      attr_class = ntohs (attr_hdr->isaat_af_type) & 0x7fff;
+      attr_value = ntohs (attr_hdr->isaat_lv);
+      value_len = 0;	/* Value is in length field */
+      record_uint(r, REC_CLASS, attr_class);
+      record_str(r, REC_CLASS_NAME, id_to_name(attr_class, attr_map));
+      record_uint(r, REC_VALUE, attr_value);
+      switch (attr_class) {
+      case 1:		/* Encryption Algorithm */
+         value_map = enc_map;
+         break;
+      case 2:		/* Hash Algorithm */
+         value_map = hash_map;
+         break;
+      case 3:		/* Authentication Method */
+         value_map = auth_map;
+         break;
+      case 4:		/* Group Description */
+         value_map = dh_map;
+         break;
+      case 11:		/* Life Type */
+         value_map = life_map;
+         break;
+      }
+      if (value_map)
+         record_str(r, REC_VALUE_NAME, id_to_name(attr_value, value_map));
+   } else {					/* Variable attribute */
+      attr_class = ntohs (attr_hdr->isaat_af_type);
+      value_len = ntohs (attr_hdr->isaat_lv);
+      record_uint(r, REC_CLASS, attr_class);
+      record_str(r, REC_CLASS_NAME, id_to_name(attr_class, attr_map));
+      record_bytes(r, REC_DATA, (*cp) + sizeof (struct isakmp_attribute),
+                   value_len);
+   }
+   record_object_end(r);
+
+   size=sizeof (struct isakmp_attribute) + value_len;
+   if (size >= *len) {
+      *len=0;
+   } else {
+      *len -= size;
+      (*cp) += size;
+   }
+}
+
+/*
+ *	record_sa -- Add SA payload details to an output record
+ *
+ *	Inputs:
+ *
+ *	r	The output record
+ *	cp	Pointer to start of SA payload
+ *	len	Packet length remaining
+ *	quiet	Only add the basic info if nonzero
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+static void
+record_sa(record *r, unsigned char *cp, size_t len, int quiet) {
+   struct isakmp_sa *sa_hdr = (struct isakmp_sa *) cp;
+   struct isakmp_proposal *prop_hdr =
+      (struct isakmp_proposal *) (cp + sizeof(struct isakmp_sa));
+   unsigned char *attr_ptr;
+   size_t safelen;	/* Shorter of actual and claimed length */
+
+   safelen = (ntohs(sa_hdr->isasa_length)<len)?ntohs(sa_hdr->isasa_length):len;
+   if (safelen < sizeof(struct isakmp_sa) + sizeof(struct isakmp_proposal) +
+       sizeof(struct isakmp_transform)) {
+      record_str(r, REC_ERROR, "packet too short to decode");
+      return;
+   }
+   record_uint(r, REC_TRANSFORMS, prop_hdr->isap_notrans);
+   if (quiet || prop_hdr->isap_notrans != 1)
+      return;
+
+   if (prop_hdr->isap_spisize != 0)	/* Non-Zero SPI */
+      record_bytes(r, REC_SPI, cp + sizeof(struct isakmp_sa) +
+                   sizeof(struct isakmp_proposal), prop_hdr->isap_spisize);
+   attr_ptr = (cp + sizeof(struct isakmp_sa) +
+               sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize +
+               sizeof(struct isakmp_transform));
+   safelen -= sizeof(struct isakmp_sa) +
+              sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize +
+              sizeof(struct isakmp_transform);
+   record_list_begin(r, REC_ATTRIBUTES);
+   while (safelen)
+      record_attr(r, &attr_ptr, &safelen);
+   record_list_end(r);
+}
+
+/*
+ *	record_sa2 -- Add IKEv2 SA payload details to an output record
+ *
+ *	Inputs:
+ *
+ *	r	The output record
+ *	cp	Pointer to start of SA payload
+ *	len	Packet length remaining
+ *	quiet	Only add the basic info if nonzero
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+static void
+record_sa2(record *r, unsigned char *cp, size_t len, int quiet) {
+   struct isakmp_sa2 *sa_hdr = (struct isakmp_sa2 *) cp;
+   struct isakmp_proposal *prop_hdr =
+      (struct isakmp_proposal *) (cp + sizeof(struct isakmp_sa2));
+   struct isakmp_transform2 *trans_hdr;
+   unsigned char *trans_ptr;
+   size_t safelen;	/* Shorter of actual and claimed length */
+   size_t size;
+   unsigned trans_type;
+   unsigned trans_id;
+   const id_name_map *id_map2;
+
+   safelen = (ntohs(sa_hdr->isasa2_length)<len)?ntohs(sa_hdr->isasa2_length):len;
+   if (safelen < sizeof(struct isakmp_sa2) + sizeof(struct isakmp_proposal) +
+       sizeof(struct isakmp_transform2)) {
+      record_str(r, REC_ERROR, "packet too short to decode");
+      return;
+   }
+   if (prop_hdr->isap_np != ISAKMP_NEXT_NONE)
+      record_uint(r, REC_MULTIPLE_PROPOSALS, 1);
+   if (quiet || prop_hdr->isap_np != ISAKMP_NEXT_NONE)
+      return;
+
+   if (prop_hdr->isap_spisize != 0)	/* Non-Zero SPI */
+      record_bytes(r, REC_SPI, cp + sizeof(struct isakmp_sa2) +
+                   sizeof(struct isakmp_proposal), prop_hdr->isap_spisize);
+   trans_ptr = cp + sizeof(struct isakmp_sa2) +
+               sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize;
+   safelen -= sizeof(struct isakmp_sa2) +
+              sizeof(struct isakmp_proposal) + prop_hdr->isap_spisize;
+   record_list_begin(r, REC_IKEV2_TRANSFORMS);
+   while (safelen) {
+      trans_hdr = (struct isakmp_transform2 *) trans_ptr;
+      trans_type = trans_hdr->isat2_transtype;
+      trans_id = ntohs(trans_hdr->isat2_transid);
+      switch (trans_type) {
+      case 1:		/* Encryption Algorithm */
+         id_map2 = encr_map;
+         break;
+      case 2:		/* Pseudo-random Function */
+         id_map2 = prf_map;
+         break;
+      case 3:		/* Integrity Algorithm */
+         id_map2 = integ_map;
+         break;
+      case 4:		/* Diffie-Hellman Group */
+         id_map2 = dh_map;
+         break;
+      default:
+         id_map2 = NULL;
+         break;
+      }
+      record_object_begin(r, 0);
+      record_uint(r, REC_TYPE, trans_type);
+      record_str(r, REC_TYPE_NAME, id_to_name(trans_type, trans_type_map));
+      record_uint(r, REC_ID, trans_id);
+      if (id_map2)
+         record_str(r, REC_ID_NAME, id_to_name(trans_id, id_map2));
+      size=ntohs(trans_hdr->isat2_length);
+      if (size > sizeof(struct isakmp_transform2)) {	/* Attributes present */
+         struct isakmp_attribute *attr_hdr = (struct isakmp_attribute *)
+            (trans_ptr + sizeof(struct isakmp_transform2));
+
+         if (ntohs(attr_hdr->isaat_af_type) & 0x8000) {	/* Basic attribute */
+            unsigned attr_class = ntohs (attr_hdr->isaat_af_type) & 0x7fff;
+
+            record_uint(r, REC_CLASS, attr_class);
+            record_str(r, REC_CLASS_NAME, id_to_name(attr_class, attr_map));
+            record_uint(r, REC_VALUE, ntohs (attr_hdr->isaat_lv));
+         }
+      }
+      record_object_end(r);
+      if (size >= safelen) {
+         safelen=0;
+      } else {
+         safelen -= size;
+         trans_ptr += size;
+      }
+   }
+   record_list_end(r);
+}
+
+/*
+ *	record_notify -- Add notify payload details to an output record
+ *
+ *	Inputs:
+ *
+ *	r	The output record
+ *	cp	Pointer to start of notify payload
+ *	len	Packet length remaining
+ *	ikev2	Nonzero for an IKEv2 notify payload
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is used for the first payload of an informational exchange, like
+ *	process_notify() and process_notify2().
+ */
+static void
+record_notify(record *r, unsigned char *cp, size_t len, int ikev2) {
+   struct isakmp_notification *hdr = (struct isakmp_notification *) cp;
+   struct isakmp_notification2 *hdr2 = (struct isakmp_notification2 *) cp;
+   size_t hdr_len;
+   size_t payload_len;
+   unsigned msg_type;
+
+   if (ikev2) {
+      hdr_len = sizeof(struct isakmp_notification2);
+      payload_len = len < hdr_len ? 0 : ntohs(hdr2->isan2_length);
+      msg_type = len < hdr_len ? 0 : ntohs(hdr2->isan2_type);
+   } else {
+      hdr_len = sizeof(struct isakmp_notification);
+      payload_len = len < hdr_len ? 0 : ntohs(hdr->isan_length);
+      msg_type = len < hdr_len ? 0 : ntohs(hdr->isan_type);
+   }
+   if (len < hdr_len || payload_len < hdr_len) {
+      record_str(r, REC_ERROR, "packet too short to decode");
+      return;
+   }
+   if (payload_len > len)
+      payload_len = len;
+   record_uint(r, REC_NOTIFY_TYPE, msg_type);
+   if (msg_type == 9101 || msg_type == 9110) {	/* Firewall-1 message types */
+      record_str(r, REC_NOTIFY_NAME, "Firewall-1");
+      while (payload_len > hdr_len && cp[payload_len-1] == '\0')
+         payload_len--;	/* The message is NUL terminated */
+      record_strn(r, REC_MESSAGE, cp + hdr_len, payload_len - hdr_len);
+   } else {
+      record_str(r, REC_NOTIFY_NAME,
+                 id_to_name(msg_type,
+                            ikev2 ? notification_map2 : notification_map));
+   }
+}
+
+/*
+ *	record_payload -- Add the details of a later payload to an output record
+ *
+ *	Inputs:
+ *
+ *	r	The output record
+ *	cp	Pointer to start of payload, which must be suitably aligned
+ *	len	Packet length remaining
+ *	next	The payload type
+ *	vidmatch	Vendor ID pattern matcher.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is the structured equivalent of process_vid(), process_id(),
+ *	process_cert(), process_delete(), process_notification() and
+ *	process_generic().
+ */
+static void
+record_payload(record *r, unsigned char *cp, size_t len, unsigned next,
+               const vid_matcher *vidmatch) {
+   struct isakmp_generic *hdr = (struct isakmp_generic *) cp;
+   size_t hdr_len;
+   size_t data_len;
+   unsigned char *data;
+   const char *name;
+
+   switch (next) {
+      case ISAKMP_NEXT_VID:
+      case ISAKMP_NEXT_V2_VID:
+         hdr_len = sizeof(struct isakmp_vid);
+         break;
+      case ISAKMP_NEXT_ID:
+         hdr_len = sizeof(struct isakmp_id);
+         break;
+      case ISAKMP_NEXT_CERT:
+      case ISAKMP_NEXT_CR:
+         hdr_len = sizeof(struct isakmp_generic) + 1;
+         break;
+      case ISAKMP_NEXT_D:
+         hdr_len = sizeof(struct isakmp_delete);
+         break;
+      case ISAKMP_NEXT_N:
+         hdr_len = sizeof(struct isakmp_notification);
+         break;
+      default:
+         hdr_len = sizeof(struct isakmp_generic);
+         break;
+   }
+
+   record_object_begin(r, 0);
+   record_uint(r, REC_PAYLOAD, next);
+   record_str(r, REC_PAYLOAD_NAME, id_to_name(next, payload_map));
+   if (cp == NULL || len < hdr_len || ntohs(hdr->isag_length) < hdr_len) {
+      record_str(r, REC_ERROR, "packet too short to decode");
+      record_object_end(r);
+      return;
+   }
+   data = cp + hdr_len;
+   data_len = ntohs(hdr->isag_length) < len ? ntohs(hdr->isag_length) : len;
+   data_len -= hdr_len;
+
+   switch (next) {
+      case ISAKMP_NEXT_VID:	/* Vendor ID */
+      case ISAKMP_NEXT_V2_VID:	/* IKEv2 Vendor ID */
+         record_bytes(r, REC_DATA, data, data_len);
+         if ((name = vid_matcher_match(vidmatch, data, data_len,
+                                       NULL)) != NULL)
+            record_str(r, REC_VENDOR, name);
+         break;
+      case ISAKMP_NEXT_ID: {	/* ID */
+         struct isakmp_id *id_hdr = (struct isakmp_id *) cp;
+         char addr[16];
+         char value[64];
+         struct in_addr in;
+
+         record_uint(r, REC_ID_TYPE, id_hdr->isaid_idtype);
+         record_str(r, REC_ID_TYPE_NAME,
+                    id_to_name(id_hdr->isaid_idtype, id_map));
+         value[0] = '\0';
+         switch (id_hdr->isaid_idtype) {
+            case ID_IPV4_ADDR:
+               if (data_len >= 4) {
+                  memcpy(&in, data, sizeof(in));
+                  strlcpy(value, inet_ntoa(in), sizeof(value));
+               }
+               break;
+            case ID_IPV4_ADDR_SUBNET:
+               if (data_len >= 8) {
+                  memcpy(&in, data, sizeof(in));
+                  snprintf(value, sizeof(value), "%s/%u.%u.%u.%u",
+                           inet_ntoa(in), data[4], data[5], data[6], data[7]);
+               }
+               break;
+            case ID_IPV4_ADDR_RANGE:
+               if (data_len >= 8) {
+                  memcpy(&in, data, sizeof(in));
+                  strlcpy(addr, inet_ntoa(in), sizeof(addr));
+                  memcpy(&in, data + 4, sizeof(in));
+                  snprintf(value, sizeof(value), "%s-%s", addr, inet_ntoa(in));
+               }
+               break;
+            case ID_FQDN:
+            case ID_USER_FQDN:
+               record_strn(r, REC_ID_VALUE, data, data_len);
+               break;
+            default:
+               record_bytes(r, REC_DATA, data, data_len);
+               break;
+         }
+         if (value[0])
+            record_str(r, REC_ID_VALUE, value);
+         else if (id_hdr->isaid_idtype == ID_IPV4_ADDR ||
+                  id_hdr->isaid_idtype == ID_IPV4_ADDR_SUBNET ||
+                  id_hdr->isaid_idtype == ID_IPV4_ADDR_RANGE)
+            record_str(r, REC_ERROR, "value too short to decode");
+         break;
+      }
+      case ISAKMP_NEXT_CERT:	/* Certificate */
+      case ISAKMP_NEXT_CR:	/* Certificate Request */
+         record_uint(r, REC_CERT_TYPE, data[-1]);
+         record_str(r, REC_CERT_TYPE_NAME, id_to_name(data[-1], cert_map));
+         record_uint(r, REC_LENGTH, data_len);
+         break;
+      case ISAKMP_NEXT_D: {	/* Delete */
+         struct isakmp_delete *d_hdr = (struct isakmp_delete *) cp;
+
+         record_uint(r, REC_SPI_SIZE, d_hdr->isad_spisize);
+         record_uint(r, REC_SPI_COUNT, ntohs(d_hdr->isad_nospi));
+         record_bytes(r, REC_SPI, data, data_len);
+         break;
+      }
+      case ISAKMP_NEXT_N: {	/* Notification */
+         struct isakmp_notification *n_hdr =
+            (struct isakmp_notification *) cp;
+         size_t spi_len = n_hdr->isan_spisize;
+
+         if (spi_len > data_len)
+            spi_len = data_len;
+         record_uint(r, REC_DOI, ntohl(n_hdr->isan_doi));
+         record_uint(r, REC_PROTO_ID, n_hdr->isan_protoid);
+         record_uint(r, REC_NOTIFY_TYPE, ntohs(n_hdr->isan_type));
+         record_str(r, REC_NOTIFY_NAME,
+                    id_to_name(ntohs(n_hdr->isan_type), notification_map));
+         record_bytes(r, REC_SPI, data, spi_len);
+         record_bytes(r, REC_DATA, data + spi_len, data_len - spi_len);
+         break;
+      }
+      default:			/* Something else */
+         record_uint(r, REC_LENGTH, ntohs(hdr->isag_length) -
+                     sizeof(struct isakmp_generic));
+         break;
+   }
+   record_object_end(r);
+}
+
+/*
+ *	record_isakmp_packet -- Add the details of an IKE packet to a record
+ *
+ *	Inputs:
+ *
+ *	r		The output record
+ *	packet_in	The received packet
+ *	n		The length of the received packet in bytes
+ *	quiet		Only add the basic info if nonzero
+ *	vidmatch	Vendor ID pattern matcher.
+ *	save_psk	Nonzero to save the values for --pskcrack
+ *
+ *	Returns:
+ *
+ *	The type of the first payload, or ISAKMP_NEXT_NONE if the packet
+ *	is short or malformed.
+ *
+ *	This adds the same details as display_packet() displays, as separate
+ *	fields, for --format=jsonl and --format=binary.
+ */
+unsigned
+record_isakmp_packet(record *r, unsigned char *packet_in, size_t n, int quiet,
+                     const vid_matcher *vidmatch, int save_psk) {
+   struct isakmp_hdr *hdr = (struct isakmp_hdr *) packet_in;
+   size_t bytes_left;
+   unsigned char *pkt_ptr;
+   unsigned char *payload_ptr;
+   unsigned first;
+   unsigned next;
+   unsigned type;
+
+   if (save_psk)
+      add_psk_crack_payload(packet_in, 0, 'X');
+   if (n < sizeof(struct isakmp_hdr) ||
+       ntohl(hdr->isa_length) < sizeof(struct isakmp_hdr) ||
+       hdr->isa_np == ISAKMP_NEXT_NONE) {
+      record_str(r, REC_RESULT, "malformed");
+      record_uint(r, REC_LENGTH, n);
+      return ISAKMP_NEXT_NONE;
+   }
+   first = next = hdr->isa_np;
+   type = hdr->isa_xchg;
+   pkt_ptr = packet_in + sizeof(struct isakmp_hdr);
+   bytes_left = n - sizeof(struct isakmp_hdr);
+
+   switch (next) {
+      case ISAKMP_NEXT_SA:
+      case ISAKMP_NEXT_V2_SA:
+         record_str(r, REC_RESULT, "handshake");
+         if (type == ISAKMP_XCHG_IDPROT && next == ISAKMP_NEXT_SA)
+            record_str(r, REC_MODE, "Main Mode");
+         else if (type == ISAKMP_XCHG_AGGR && next == ISAKMP_NEXT_SA)
+            record_str(r, REC_MODE, "Aggressive Mode");
+         else if (type == ISAKMP_XCHG_IKE_SA_INIT && next == ISAKMP_NEXT_V2_SA)
+            record_str(r, REC_MODE, "IKEv2 SA_INIT");
+         else
+            record_str(r, REC_MODE, "UNKNOWN Mode");
+         break;
+      case ISAKMP_NEXT_N:
+      case ISAKMP_NEXT_V2_N:
+         record_str(r, REC_RESULT, "notify");
+         break;
+      default:
+         record_str(r, REC_RESULT, "unexpected");
+         record_uint(r, REC_PAYLOAD, next);
+         record_str(r, REC_PAYLOAD_NAME, id_to_name(next, payload_map));
+         break;
+   }
+   record_uint(r, REC_EXCHANGE, type);
+   if (!quiet) {
+      record_bytes(r, REC_RCOOKIE, (unsigned char *) hdr->isa_rcookie, 8);
+      record_uint(r, REC_VERSION, hdr->isa_version);
+      record_uint(r, REC_FLAGS, hdr->isa_flags);
+      record_uint(r, REC_MSGID, ntohl(hdr->isa_msgid));
+   }
+   switch (next) {
+      case ISAKMP_NEXT_SA:
+         if (save_psk)
+            add_psk_crack_payload(pkt_ptr, next, 'R');
+         record_sa(r, pkt_ptr, bytes_left, quiet);
+         break;
+      case ISAKMP_NEXT_V2_SA:
+         record_sa2(r, pkt_ptr, bytes_left, quiet);
+         break;
+      case ISAKMP_NEXT_N:
+         record_notify(r, pkt_ptr, bytes_left, 0);
+         break;
+      case ISAKMP_NEXT_V2_N:
+         record_notify(r, pkt_ptr, bytes_left, 1);
+         break;
+   }
+   pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
+   if (quiet || !bytes_left)
+      return first;
+
+   record_list_begin(r, REC_PAYLOADS);
+   while (bytes_left) {
+      payload_ptr = clone_payload(pkt_ptr, bytes_left);
+      if (save_psk && next != ISAKMP_NEXT_VID && next != ISAKMP_NEXT_V2_VID &&
+          next != ISAKMP_NEXT_CERT && next != ISAKMP_NEXT_CR &&
+          next != ISAKMP_NEXT_D && next != ISAKMP_NEXT_N)
+         add_psk_crack_payload(payload_ptr, next, 'R');
+      record_payload(r, payload_ptr, bytes_left, next, vidmatch);
+      pkt_ptr = skip_payload(pkt_ptr, &bytes_left, &next);
+   }
+   record_list_end(r);
+
+   return first;
 }
 
 /*
@@ -2740,17 +3139,19 @@ print_psk_crack_values(const char *psk_crack_file) {
  *	Pointer to the cloned payload or NULL if no payload.
  *
  *	This function clones the ISAKMP payload starting at pkt_ptr, with
- *	a maximum size of bytes_left.  It copies the payload to a newly
- *	allocated memory block to ensure that it is suitably aligned for
- *	those CPUs that have alignment restrictions.
+ *	a maximum size of bytes_left.  It copies the payload to a malloc'ed
+ *	memory block to ensure that it is suitably aligned for those CPUs
+ *	that have alignment restrictions.
  *
- *	The return value points to Malloc'ed memory, which should be
- *	free'ed when it is no longer required.
+ *	The return value points to a static buffer which is reused by the
+ *	next call, so it must not be free'ed.  The buffer only grows, so
+ *	cloning the payloads of each packet does not normally allocate.
  */
 unsigned char *
 clone_payload(const unsigned char *pkt_ptr, size_t bytes_left) {
+   static unsigned char *clone_ptr = NULL;
+   static size_t clone_size = 0;
    struct isakmp_generic hdr;
-   unsigned char *clone_ptr;
    size_t payload_len;
 /*
  *	Ensure that there is sufficient data to fill the generic
@@ -2772,9 +3173,12 @@ clone_payload(const unsigned char *pkt_ptr, size_t bytes_left) {
    if (payload_len > bytes_left)
       payload_len = bytes_left;
 /*
- *	Allocate memory and copy payload.
+ *	Grow the buffer if required and copy payload.
  */
-   clone_ptr = Malloc(payload_len);
+   if (payload_len > clone_size) {
+      clone_ptr = Realloc(clone_ptr, payload_len);
+      clone_size = payload_len;
+   }
    memcpy(clone_ptr, pkt_ptr, payload_len);
 
    return clone_ptr;
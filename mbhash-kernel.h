@@ -0,0 +1,254 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * mbhash-kernel.h -- Multi-buffer MD5 and SHA1 compression functions
+ *
+ * Date:	16 October 2026
+ *
+ *	This file is included by mbhash.c once for each vector width.
+ *	Before including it, mbhash.c defines MB_VEC as a vector of
+ *	MB_LANES 32-bit words, MB_TARGET as the function attributes that
+ *	enable the instruction set, and MB_FUNC(name) to give the functions
+ *	a unique name for that width.  Each lane of the vector holds the
+ *	same word from a different message, so the MD5 and SHA1 steps are
+ *	written exactly as they would be for one message.
+ */
+
+/*
+ *	md5 -- MD5 compression function for MB_LANES messages
+ *
+ *	Inputs:
+ *
+ *	state	The hash state, state[word * MB_LANES + lane]
+ *	block	The message block, block[word * MB_LANES + lane], or
+ *		block[word] if shared is set
+ *	shared	Is the message block the same for every lane?
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+static MB_TARGET void
+MB_FUNC(md5)(uint32_t *state, const uint32_t *block, int shared) {
+   MB_VEC a, b, c, d;
+   MB_VEC t;
+   MB_VEC zero;
+   MB_VEC X[16];
+   unsigned i;
+
+   memcpy(&a, state, sizeof(MB_VEC));
+   memcpy(&b, state + MB_LANES, sizeof(MB_VEC));
+   memcpy(&c, state + 2*MB_LANES, sizeof(MB_VEC));
+   memcpy(&d, state + 3*MB_LANES, sizeof(MB_VEC));
+   memset(&zero, 0, sizeof(MB_VEC));
+   for (i=0; i<16; i++) {
+      if (shared)
+         X[i] = zero + block[i];
+      else
+         memcpy(&X[i], block + i*MB_LANES, sizeof(MB_VEC));
+   }
+
+   /* Round 1 */
+   MD5_STEP(MD5_F, a, b, c, d,  0,  7, 0xd76aa478);
+   MD5_STEP(MD5_F, d, a, b, c,  1, 12, 0xe8c7b756);
+   MD5_STEP(MD5_F, c, d, a, b,  2, 17, 0x242070db);
+   MD5_STEP(MD5_F, b, c, d, a,  3, 22, 0xc1bdceee);
+   MD5_STEP(MD5_F, a, b, c, d,  4,  7, 0xf57c0faf);
+   MD5_STEP(MD5_F, d, a, b, c,  5, 12, 0x4787c62a);
+   MD5_STEP(MD5_F, c, d, a, b,  6, 17, 0xa8304613);
+   MD5_STEP(MD5_F, b, c, d, a,  7, 22, 0xfd469501);
+   MD5_STEP(MD5_F, a, b, c, d,  8,  7, 0x698098d8);
+   MD5_STEP(MD5_F, d, a, b, c,  9, 12, 0x8b44f7af);
+   MD5_STEP(MD5_F, c, d, a, b, 10, 17, 0xffff5bb1);
+   MD5_STEP(MD5_F, b, c, d, a, 11, 22, 0x895cd7be);
+   MD5_STEP(MD5_F, a, b, c, d, 12,  7, 0x6b901122);
+   MD5_STEP(MD5_F, d, a, b, c, 13, 12, 0xfd987193);
+   MD5_STEP(MD5_F, c, d, a, b, 14, 17, 0xa679438e);
+   MD5_STEP(MD5_F, b, c, d, a, 15, 22, 0x49b40821);
+   /* Round 2 */
+   MD5_STEP(MD5_G, a, b, c, d,  1,  5, 0xf61e2562);
+   MD5_STEP(MD5_G, d, a, b, c,  6,  9, 0xc040b340);
+   MD5_STEP(MD5_G, c, d, a, b, 11, 14, 0x265e5a51);
+   MD5_STEP(MD5_G, b, c, d, a,  0, 20, 0xe9b6c7aa);
+   MD5_STEP(MD5_G, a, b, c, d,  5,  5, 0xd62f105d);
+   MD5_STEP(MD5_G, d, a, b, c, 10,  9, 0x02441453);
+   MD5_STEP(MD5_G, c, d, a, b, 15, 14, 0xd8a1e681);
+   MD5_STEP(MD5_G, b, c, d, a,  4, 20, 0xe7d3fbc8);
+   MD5_STEP(MD5_G, a, b, c, d,  9,  5, 0x21e1cde6);
+   MD5_STEP(MD5_G, d, a, b, c, 14,  9, 0xc33707d6);
+   MD5_STEP(MD5_G, c, d, a, b,  3, 14, 0xf4d50d87);
+   MD5_STEP(MD5_G, b, c, d, a,  8, 20, 0x455a14ed);
+   MD5_STEP(MD5_G, a, b, c, d, 13,  5, 0xa9e3e905);
+   MD5_STEP(MD5_G, d, a, b, c,  2,  9, 0xfcefa3f8);
+   MD5_STEP(MD5_G, c, d, a, b,  7, 14, 0x676f02d9);
+   MD5_STEP(MD5_G, b, c, d, a, 12, 20, 0x8d2a4c8a);
+   /* Round 3 */
+   MD5_STEP(MD5_H, a, b, c, d,  5,  4, 0xfffa3942);
+   MD5_STEP(MD5_H, d, a, b, c,  8, 11, 0x8771f681);
+   MD5_STEP(MD5_H, c, d, a, b, 11, 16, 0x6d9d6122);
+   MD5_STEP(MD5_H, b, c, d, a, 14, 23, 0xfde5380c);
+   MD5_STEP(MD5_H, a, b, c, d,  1,  4, 0xa4beea44);
+   MD5_STEP(MD5_H, d, a, b, c,  4, 11, 0x4bdecfa9);
+   MD5_STEP(MD5_H, c, d, a, b,  7, 16, 0xf6bb4b60);
+   MD5_STEP(MD5_H, b, c, d, a, 10, 23, 0xbebfbc70);
+   MD5_STEP(MD5_H, a, b, c, d, 13,  4, 0x289b7ec6);
+   MD5_STEP(MD5_H, d, a, b, c,  0, 11, 0xeaa127fa);
+   MD5_STEP(MD5_H, c, d, a, b,  3, 16, 0xd4ef3085);
+   MD5_STEP(MD5_H, b, c, d, a,  6, 23, 0x04881d05);
+   MD5_STEP(MD5_H, a, b, c, d,  9,  4, 0xd9d4d039);
+   MD5_STEP(MD5_H, d, a, b, c, 12, 11, 0xe6db99e5);
+   MD5_STEP(MD5_H, c, d, a, b, 15, 16, 0x1fa27cf8);
+   MD5_STEP(MD5_H, b, c, d, a,  2, 23, 0xc4ac5665);
+   /* Round 4 */
+   MD5_STEP(MD5_I, a, b, c, d,  0,  6, 0xf4292244);
+   MD5_STEP(MD5_I, d, a, b, c,  7, 10, 0x432aff97);
+   MD5_STEP(MD5_I, c, d, a, b, 14, 15, 0xab9423a7);
+   MD5_STEP(MD5_I, b, c, d, a,  5, 21, 0xfc93a039);
+   MD5_STEP(MD5_I, a, b, c, d, 12,  6, 0x655b59c3);
+   MD5_STEP(MD5_I, d, a, b, c,  3, 10, 0x8f0ccc92);
+   MD5_STEP(MD5_I, c, d, a, b, 10, 15, 0xffeff47d);
+   MD5_STEP(MD5_I, b, c, d, a,  1, 21, 0x85845dd1);
+   MD5_STEP(MD5_I, a, b, c, d,  8,  6, 0x6fa87e4f);
+   MD5_STEP(MD5_I, d, a, b, c, 15, 10, 0xfe2ce6e0);
+   MD5_STEP(MD5_I, c, d, a, b,  6, 15, 0xa3014314);
+   MD5_STEP(MD5_I, b, c, d, a, 13, 21, 0x4e0811a1);
+   MD5_STEP(MD5_I, a, b, c, d,  4,  6, 0xf7537e82);
+   MD5_STEP(MD5_I, d, a, b, c, 11, 10, 0xbd3af235);
+   MD5_STEP(MD5_I, c, d, a, b,  2, 15, 0x2ad7d2bb);
+   MD5_STEP(MD5_I, b, c, d, a,  9, 21, 0xeb86d391);
+
+   memcpy(&t, state, sizeof(MB_VEC));
+   a += t;
+   memcpy(state, &a, sizeof(MB_VEC));
+   memcpy(&t, state + MB_LANES, sizeof(MB_VEC));
+   b += t;
+   memcpy(state + MB_LANES, &b, sizeof(MB_VEC));
+   memcpy(&t, state + 2*MB_LANES, sizeof(MB_VEC));
+   c += t;
+   memcpy(state + 2*MB_LANES, &c, sizeof(MB_VEC));
+   memcpy(&t, state + 3*MB_LANES, sizeof(MB_VEC));
+   d += t;
+   memcpy(state + 3*MB_LANES, &d, sizeof(MB_VEC));
+}
+
+/*
+ *	sha1 -- SHA1 compression function for MB_LANES messages
+ *
+ *	Inputs:
+ *
+ *	state	The hash state, state[word * MB_LANES + lane]
+ *	block	The message block, block[word * MB_LANES + lane], or
+ *		block[word] if shared is set
+ *	shared	Is the message block the same for every lane?
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The steps are unrolled five at a time so that the working variables
+ *	change roles instead of being copied.
+ */
+static MB_TARGET void
+MB_FUNC(sha1)(uint32_t *state, const uint32_t *block, int shared) {
+   MB_VEC a, b, c, d, e;
+   MB_VEC t;
+   MB_VEC zero;
+   MB_VEC W[16];
+   unsigned i;
+
+   memcpy(&a, state, sizeof(MB_VEC));
+   memcpy(&b, state + MB_LANES, sizeof(MB_VEC));
+   memcpy(&c, state + 2*MB_LANES, sizeof(MB_VEC));
+   memcpy(&d, state + 3*MB_LANES, sizeof(MB_VEC));
+   memcpy(&e, state + 4*MB_LANES, sizeof(MB_VEC));
+   memset(&zero, 0, sizeof(MB_VEC));
+   for (i=0; i<16; i++) {
+      if (shared)
+         W[i] = zero + block[i];
+      else
+         memcpy(&W[i], block + i*MB_LANES, sizeof(MB_VEC));
+   }
+
+   for (i=0; i<15; i+=5) {
+      SHA1_STEP(SHA1_F1, 0x5a827999, a, b, c, d, e, W[i]);
+      SHA1_STEP(SHA1_F1, 0x5a827999, e, a, b, c, d, W[i+1]);
+      SHA1_STEP(SHA1_F1, 0x5a827999, d, e, a, b, c, W[i+2]);
+      SHA1_STEP(SHA1_F1, 0x5a827999, c, d, e, a, b, W[i+3]);
+      SHA1_STEP(SHA1_F1, 0x5a827999, b, c, d, e, a, W[i+4]);
+   }
+   SHA1_STEP(SHA1_F1, 0x5a827999, a, b, c, d, e, W[15]);
+   SHA1_STEP(SHA1_F1, 0x5a827999, e, a, b, c, d, SHA1_W(W, 16));
+   SHA1_STEP(SHA1_F1, 0x5a827999, d, e, a, b, c, SHA1_W(W, 17));
+   SHA1_STEP(SHA1_F1, 0x5a827999, c, d, e, a, b, SHA1_W(W, 18));
+   SHA1_STEP(SHA1_F1, 0x5a827999, b, c, d, e, a, SHA1_W(W, 19));
+   for (i=20; i<40; i+=5) {
+      SHA1_STEP(SHA1_F2, 0x6ed9eba1, a, b, c, d, e, SHA1_W(W, i));
+      SHA1_STEP(SHA1_F2, 0x6ed9eba1, e, a, b, c, d, SHA1_W(W, i+1));
+      SHA1_STEP(SHA1_F2, 0x6ed9eba1, d, e, a, b, c, SHA1_W(W, i+2));
+      SHA1_STEP(SHA1_F2, 0x6ed9eba1, c, d, e, a, b, SHA1_W(W, i+3));
+      SHA1_STEP(SHA1_F2, 0x6ed9eba1, b, c, d, e, a, SHA1_W(W, i+4));
+   }
+   for (i=40; i<60; i+=5) {
+      SHA1_STEP(SHA1_F3, 0x8f1bbcdc, a, b, c, d, e, SHA1_W(W, i));
+      SHA1_STEP(SHA1_F3, 0x8f1bbcdc, e, a, b, c, d, SHA1_W(W, i+1));
+      SHA1_STEP(SHA1_F3, 0x8f1bbcdc, d, e, a, b, c, SHA1_W(W, i+2));
+      SHA1_STEP(SHA1_F3, 0x8f1bbcdc, c, d, e, a, b, SHA1_W(W, i+3));
+      SHA1_STEP(SHA1_F3, 0x8f1bbcdc, b, c, d, e, a, SHA1_W(W, i+4));
+   }
+   for (i=60; i<80; i+=5) {
+      SHA1_STEP(SHA1_F2, 0xca62c1d6, a, b, c, d, e, SHA1_W(W, i));
+      SHA1_STEP(SHA1_F2, 0xca62c1d6, e, a, b, c, d, SHA1_W(W, i+1));
+      SHA1_STEP(SHA1_F2, 0xca62c1d6, d, e, a, b, c, SHA1_W(W, i+2));
+      SHA1_STEP(SHA1_F2, 0xca62c1d6, c, d, e, a, b, SHA1_W(W, i+3));
+      SHA1_STEP(SHA1_F2, 0xca62c1d6, b, c, d, e, a, SHA1_W(W, i+4));
+   }
+
+   memcpy(&t, state, sizeof(MB_VEC));
+   a += t;
+   memcpy(state, &a, sizeof(MB_VEC));
+   memcpy(&t, state + MB_LANES, sizeof(MB_VEC));
+   b += t;
+   memcpy(state + MB_LANES, &b, sizeof(MB_VEC));
+   memcpy(&t, state + 2*MB_LANES, sizeof(MB_VEC));
+   c += t;
+   memcpy(state + 2*MB_LANES, &c, sizeof(MB_VEC));
+   memcpy(&t, state + 3*MB_LANES, sizeof(MB_VEC));
+   d += t;
+   memcpy(state + 3*MB_LANES, &d, sizeof(MB_VEC));
+   memcpy(&t, state + 4*MB_LANES, sizeof(MB_VEC));
+   e += t;
+   memcpy(state + 4*MB_LANES, &e, sizeof(MB_VEC));
+}
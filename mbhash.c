@@ -0,0 +1,527 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * mbhash.c -- Multi-buffer MD5 and SHA1 functions for psk-crack
+ *
+ * Date:	16 October 2026
+ *
+ *	These functions hash several messages at once by holding the same
+ *	word of each message in a different lane of a SIMD vector.  MD5 and
+ *	SHA1 have no data-dependent branches, so every lane runs the same
+ *	instructions and a vector of N lanes does the work of N scalar
+ *	compressions.
+ *
+ *	The compression kernels are in mbhash-kernel.h, which is included
+ *	once for each vector width.  With GCC compatible compilers, the
+ *	4-lane kernel uses the generic vector extensions, which become SSE2
+ *	on x86-64 and NEON on ARM.  If configure finds x86 SIMD run-time
+ *	dispatch, AVX2 (8 lanes) and AVX-512 (16 lanes) kernels are also
+ *	built, and mb_kernels() chooses the widest one that the CPU supports.
+ *	Other compilers get a 1-lane kernel built from the same code.
+ *
+ *	psk-crack uses the HMAC functions to try a group of candidate keys
+ *	against the same PSK entry in one pass.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h>
+#else
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#endif
+
+#include "mbhash.h"
+
+/*
+ *	Step functions shared by all of the kernels.  They work on vectors
+ *	and on plain 32-bit words alike.
+ */
+#define MB_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define MD5_F(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define MD5_G(b, c, d) ((c) ^ ((d) & ((b) ^ (c))))
+#define MD5_H(b, c, d) ((b) ^ (c) ^ (d))
+#define MD5_I(b, c, d) ((c) ^ ((b) | ~(d)))
+#define MD5_STEP(f, a, b, c, d, k, s, T) \
+   a += f(b, c, d) + X[k] + (uint32_t) (T); \
+   a = MB_ROTL(a, s) + b
+
+#define SHA1_F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_F2(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define SHA1_W(W, i) \
+   (W[(i) & 15] = MB_ROTL(W[((i) + 13) & 15] ^ W[((i) + 8) & 15] ^ \
+                          W[((i) + 2) & 15] ^ W[(i) & 15], 1))
+#define SHA1_STEP(f, K, a, b, c, d, e, w) \
+   e += MB_ROTL(a, 5) + f(b, c, d) + (uint32_t) (K) + (w); \
+   b = MB_ROTL(b, 30)
+
+#ifdef __GNUC__
+typedef uint32_t mb_vec4 __attribute__((vector_size(16)));
+#define MB_VEC mb_vec4
+#define MB_LANES 4
+#define MB_TARGET
+#define MB_FUNC(name) name ## _x4
+#include "mbhash-kernel.h"
+#undef MB_VEC
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_FUNC
+#define GENERIC_LANES 4
+#define generic_md5 md5_x4
+#define generic_sha1 sha1_x4
+#if defined(__SSE2__)
+#define GENERIC_NAME "SSE2"
+#elif defined(__ARM_NEON)
+#define GENERIC_NAME "NEON"
+#else
+#define GENERIC_NAME "generic"
+#endif
+#else	/* Not __GNUC__ */
+#define MB_VEC uint32_t
+#define MB_LANES 1
+#define MB_TARGET
+#define MB_FUNC(name) name ## _x1
+#include "mbhash-kernel.h"
+#undef MB_VEC
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_FUNC
+#define GENERIC_LANES 1
+#define generic_md5 md5_x1
+#define generic_sha1 sha1_x1
+#define GENERIC_NAME "scalar"
+#endif
+
+#ifdef HAVE_SIMD_DISPATCH
+typedef uint32_t mb_vec8 __attribute__((vector_size(32)));
+#define MB_VEC mb_vec8
+#define MB_LANES 8
+#define MB_TARGET __attribute__((target("avx2")))
+#define MB_FUNC(name) name ## _x8
+#include "mbhash-kernel.h"
+#undef MB_VEC
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_FUNC
+
+typedef uint32_t mb_vec16 __attribute__((vector_size(64)));
+#define MB_VEC mb_vec16
+#define MB_LANES 16
+#define MB_TARGET __attribute__((target("avx512f")))
+#define MB_FUNC(name) name ## _x16
+#include "mbhash-kernel.h"
+#undef MB_VEC
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_FUNC
+#endif
+
+/* Kernels, widest first */
+static const mb_kernel kernel_table[] = {
+#ifdef HAVE_SIMD_DISPATCH
+   {16, "AVX-512", md5_x16, sha1_x16},
+   {8, "AVX2", md5_x8, sha1_x8},
+#endif
+   {GENERIC_LANES, GENERIC_NAME, generic_md5, generic_sha1}
+};
+
+/* Hash algorithm parameters, indexed by MB_MD5 or MB_SHA1 */
+static const struct {
+   unsigned words;		/* Words of hash state */
+   int big_endian;		/* Are message words big endian? */
+   uint32_t iv[MB_MAX_WORDS];	/* Initial hash state */
+} mb_alg[] = {
+   {4, 0, {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0}},
+   {5, 1, {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0}}
+};
+
+/*
+ *	mb_kernels -- Return the kernels that this CPU supports
+ *
+ *	Inputs:
+ *
+ *	count	Set to the number of kernels, or NULL
+ *
+ *	Returns:
+ *
+ *	Pointer to an array of the supported kernels, widest first.
+ *
+ *	The first kernel is the one to use.  The others are returned so
+ *	that they can be checked against each other.  The CPU is checked on
+ *	the first call, so this must be called before starting any threads.
+ */
+const mb_kernel *
+mb_kernels(unsigned *count) {
+   static unsigned first = (unsigned) -1;
+
+   if (first == (unsigned) -1) {
+      first = 0;
+#ifdef HAVE_SIMD_DISPATCH
+      __builtin_cpu_init();
+      if (!__builtin_cpu_supports("avx512f") ||
+          !__builtin_cpu_supports("avx2"))
+         first++;
+      if (!__builtin_cpu_supports("avx2"))
+         first++;
+#endif
+   }
+   if (count)
+      *count = sizeof(kernel_table) / sizeof(kernel_table[0]) - first;
+
+   return &kernel_table[first];
+}
+
+/*
+ *	get_word -- Read a message word in the byte order of the hash
+ */
+static inline uint32_t
+get_word(const unsigned char *p, int big_endian) {
+   if (big_endian)
+      return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+             (uint32_t) p[2] << 8 | p[3];
+   else
+      return (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 |
+             (uint32_t) p[1] << 8 | p[0];
+}
+
+/*
+ *	put_digest -- Write the hash value for one lane
+ *
+ *	Inputs:
+ *
+ *	alg	MB_MD5 or MB_SHA1
+ *	state	The hash state
+ *	lanes	The number of lanes in the state
+ *	lane	The lane to write
+ *	md	The output buffer, 16 bytes for MD5 or 20 for SHA1
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+static void
+put_digest(int alg, const uint32_t *state, unsigned lanes, unsigned lane,
+           unsigned char *md) {
+   unsigned i;
+   uint32_t v;
+
+   for (i=0; i<mb_alg[alg].words; i++) {
+      v = state[i * lanes + lane];
+      if (mb_alg[alg].big_endian) {
+         md[0] = v >> 24;
+         md[1] = v >> 16;
+         md[2] = v >> 8;
+         md[3] = v;
+      } else {
+         md[0] = v;
+         md[1] = v >> 8;
+         md[2] = v >> 16;
+         md[3] = v >> 24;
+      }
+      md += 4;
+   }
+}
+
+/*
+ *	put_length -- Write the message length in bits at the end of a block
+ */
+static void
+put_length(int alg, unsigned char *end, IKE_UINT64 len) {
+   unsigned char *p = end - 8;
+   unsigned i;
+
+   len <<= 3;
+   for (i=0; i<8; i++) {
+      if (mb_alg[alg].big_endian)
+         p[7-i] = (unsigned char) (len >> (8*i));
+      else
+         p[i] = (unsigned char) (len >> (8*i));
+   }
+}
+
+/*
+ *	init_state -- Set the hash state of every lane to the initial value
+ */
+static void
+init_state(int alg, uint32_t *state, unsigned lanes) {
+   unsigned i;
+   unsigned j;
+
+   for (i=0; i<mb_alg[alg].words; i++)
+      for (j=0; j<lanes; j++)
+         state[i * lanes + j] = mb_alg[alg].iv[i];
+}
+
+/*
+ *	compress -- Run the kernel's compression function for a hash type
+ */
+static inline void
+compress(const mb_kernel *k, int alg, uint32_t *state, const uint32_t *block,
+         int shared) {
+   if (alg == MB_MD5)
+      k->md5(state, block, shared);
+   else
+      k->sha1(state, block, shared);
+}
+
+/*
+ *	hash_shared -- Finish hashing the same message in every lane
+ *
+ *	Inputs:
+ *
+ *	k	The kernel
+ *	alg	MB_MD5 or MB_SHA1
+ *	state	The hash state
+ *	text	The message
+ *	len	The length of the message
+ *	prefix	The number of bytes already hashed, a multiple of 64
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Each word of the message is converted once, and the kernel copies
+ *	it to every lane.  The final blocks include the padding and length.
+ */
+static void
+hash_shared(const mb_kernel *k, int alg, uint32_t *state,
+            const unsigned char *text, size_t len, IKE_UINT64 prefix) {
+   uint32_t block[16];
+   unsigned char tail[128];
+   size_t tail_len;
+   size_t full_len;
+   size_t done;
+   unsigned num_blocks;
+   unsigned i;
+
+   tail_len = len % 64;
+   full_len = len - tail_len;
+   memcpy(tail, text + full_len, tail_len);
+   tail[tail_len] = 0x80;
+   if (tail_len < 56) {
+      memset(tail + tail_len + 1, 0, 63 - tail_len);
+      num_blocks = 1;
+   } else {
+      memset(tail + tail_len + 1, 0, 127 - tail_len);
+      num_blocks = 2;
+   }
+   put_length(alg, tail + 64*num_blocks, prefix + len);
+
+   for (done=0; done<full_len+64*num_blocks; done+=64) {
+      const unsigned char *p = done < full_len ? text + done :
+                                                 tail + (done - full_len);
+
+      for (i=0; i<16; i++)
+         block[i] = get_word(p + 4*i, mb_alg[alg].big_endian);
+      compress(k, alg, state, block, 1);
+   }
+}
+
+/*
+ *	mb_hash -- Calculate the hash of a different message in each lane
+ *
+ *	Inputs:
+ *
+ *	k	The kernel
+ *	alg	MB_MD5 or MB_SHA1
+ *	msg	The message for each lane
+ *	len	The length of each message
+ *	md	The output buffer for each message
+ *	n	The number of messages, up to k->lanes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is meant for short messages such as passwords, which fit in
+ *	one block with their padding and are hashed together.  A message of
+ *	more than 55 bytes is hashed on its own.
+ */
+void
+mb_hash(const mb_kernel *k, int alg, const unsigned char *const *msg,
+        const size_t *len, unsigned char *const *md, unsigned n) {
+   unsigned char buf[64];
+   uint32_t block[16 * MB_MAX_LANES];
+   uint32_t state[MB_MAX_WORDS * MB_MAX_LANES];
+   unsigned i;
+   unsigned j;
+
+   for (j=0; j<k->lanes; j++) {
+      size_t l = j < n && len[j] < 56 ? len[j] : 0;
+
+      if (l)
+         memcpy(buf, msg[j], l);
+      buf[l] = 0x80;
+      memset(buf + l + 1, 0, 63 - l);
+      put_length(alg, buf + 64, l);
+      for (i=0; i<16; i++)
+         block[i * k->lanes + j] = get_word(buf + 4*i,
+                                            mb_alg[alg].big_endian);
+   }
+   init_state(alg, state, k->lanes);
+   compress(k, alg, state, block, 0);
+   for (j=0; j<n; j++)
+      put_digest(alg, state, k->lanes, j, md[j]);
+
+   for (j=0; j<n; j++) {
+      if (len[j] >= 56) {
+         init_state(alg, state, k->lanes);
+         hash_shared(k, alg, state, msg[j], len[j], 0);
+         put_digest(alg, state, k->lanes, 0, md[j]);
+      }
+   }
+}
+
+/*
+ *	mb_hmac_init -- Set up the HMAC key state for a group of keys
+ *
+ *	Inputs:
+ *
+ *	k	The kernel
+ *	alg	MB_MD5 or MB_SHA1
+ *	hc	The key state to set up
+ *	key	The key for each lane
+ *	key_len	The length of each key
+ *	n	The number of keys, up to k->lanes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The padded key blocks for all of the lanes are hashed together.
+ *	Keys longer than 64 bytes are hashed first, as RFC 2104 requires.
+ *	Lanes without a key get an empty one.
+ */
+void
+mb_hmac_init(const mb_kernel *k, int alg, mb_hmac_ctx *hc,
+             const unsigned char *const *key, const size_t *key_len,
+             unsigned n) {
+   uint32_t ipad[16 * MB_MAX_LANES];
+   uint32_t opad[16 * MB_MAX_LANES];
+   unsigned char kb[64];
+   uint32_t state[MB_MAX_WORDS * MB_MAX_LANES];
+   size_t kl;
+   unsigned i;
+   unsigned j;
+   uint32_t v;
+
+   for (j=0; j<k->lanes; j++) {
+      kl = j < n ? key_len[j] : 0;
+      if (kl > 64) {
+         init_state(alg, state, k->lanes);
+         hash_shared(k, alg, state, key[j], kl, 0);
+         put_digest(alg, state, k->lanes, 0, kb);
+         kl = 4 * mb_alg[alg].words;
+      } else if (kl) {
+         memcpy(kb, key[j], kl);
+      }
+      memset(kb + kl, 0, 64 - kl);
+      for (i=0; i<16; i++) {
+         v = get_word(kb + 4*i, mb_alg[alg].big_endian);
+         ipad[i * k->lanes + j] = v ^ 0x36363636;
+         opad[i * k->lanes + j] = v ^ 0x5c5c5c5c;
+      }
+   }
+   init_state(alg, hc->inner, k->lanes);
+   compress(k, alg, hc->inner, ipad, 0);
+   init_state(alg, hc->outer, k->lanes);
+   compress(k, alg, hc->outer, opad, 0);
+}
+
+/*
+ *	mb_hmac_final -- Calculate the HMAC of a message for a group of keys
+ *
+ *	Inputs:
+ *
+ *	k	The kernel
+ *	alg	MB_MD5 or MB_SHA1
+ *	hc	The key state from mb_hmac_init()
+ *	text	The message, which is the same for every key
+ *	len	The length of the message
+ *	md	The output buffer for each key, 16 bytes for MD5 or 20 for SHA1
+ *	n	The number of keys, up to k->lanes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The key state is not changed, so it can be used for other messages.
+ */
+void
+mb_hmac_final(const mb_kernel *k, int alg, const mb_hmac_ctx *hc,
+              const unsigned char *text, size_t len,
+              unsigned char *const *md, unsigned n) {
+   uint32_t block[16 * MB_MAX_LANES];
+   uint32_t state[MB_MAX_WORDS * MB_MAX_LANES];
+   unsigned words = mb_alg[alg].words;
+   size_t state_len = words * k->lanes * sizeof(uint32_t);
+   uint32_t bits = (64 + 4*words) * 8;
+   unsigned j;
+/*
+ *	Inner hash of the message.
+ */
+   memcpy(state, hc->inner, state_len);
+   hash_shared(k, alg, state, text, len, 64);
+/*
+ *	The outer hash of each inner hash fits in one block.  The digest
+ *	bytes are in the same byte order as the message words, so the
+ *	inner hash state is the start of the block as it is.
+ */
+   memcpy(block, state, state_len);
+   memset(block + words * k->lanes, 0, (16 - words) * k->lanes *
+          sizeof(uint32_t));
+   for (j=0; j<k->lanes; j++) {
+      if (mb_alg[alg].big_endian) {
+         block[words * k->lanes + j] = 0x80000000;
+         block[15 * k->lanes + j] = bits;
+      } else {
+         block[words * k->lanes + j] = 0x80;
+         block[14 * k->lanes + j] = bits;
+      }
+   }
+   memcpy(state, hc->outer, state_len);
+   compress(k, alg, state, block, 0);
+   for (j=0; j<n; j++)
+      put_digest(alg, state, k->lanes, j, md[j]);
+}
@@ -0,0 +1,86 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * mbhash.h -- Header file for the multi-buffer MD5 and SHA1 functions
+ *
+ * Date:	16 October 2026
+ */
+
+#ifndef IKE_SCAN_MBHASH_H
+#define IKE_SCAN_MBHASH_H 1
+
+/* Defines */
+
+#define MB_MAX_LANES 16		/* Most messages hashed by one kernel call */
+#define MB_MD5 0		/* Hash type for the mb_hmac functions */
+#define MB_SHA1 1
+#define MB_MAX_WORDS 5		/* Words of hash state, 4 for MD5, 5 for SHA1 */
+
+/* Structures */
+
+/*
+ *	A set of compression functions that each hash one 64-byte block
+ *	for "lanes" messages at once.  The hash state is held as
+ *	state[word * lanes + lane], and the message block as
+ *	block[word * lanes + lane] with each word in host byte order.  If the
+ *	last argument is non-zero, the block is the same for every lane and
+ *	is held as block[word].
+ */
+typedef struct {
+   unsigned lanes;		/* Number of messages hashed at once */
+   const char *name;		/* Instruction set name for display */
+   void (*md5)(uint32_t *, const uint32_t *, int);	/* MD5 compression */
+   void (*sha1)(uint32_t *, const uint32_t *, int);	/* SHA1 compression */
+} mb_kernel;
+
+/* HMAC key state for up to MB_MAX_LANES keys */
+typedef struct {
+   uint32_t inner[MB_MAX_WORDS * MB_MAX_LANES];	/* State after key ^ ipad */
+   uint32_t outer[MB_MAX_WORDS * MB_MAX_LANES];	/* State after key ^ opad */
+} mb_hmac_ctx;
+
+/* Functions */
+
+const mb_kernel *mb_kernels(unsigned *);
+void mb_hash(const mb_kernel *, int, const unsigned char *const *,
+             const size_t *, unsigned char *const *, unsigned);
+void mb_hmac_init(const mb_kernel *, int, mb_hmac_ctx *,
+                  const unsigned char *const *, const size_t *, unsigned);
+void mb_hmac_final(const mb_kernel *, int, const mb_hmac_ctx *,
+                   const unsigned char *, size_t, unsigned char *const *,
+                   unsigned);
+
+#endif	/* IKE_SCAN_MBHASH_H */
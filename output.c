@@ -0,0 +1,351 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * output.c -- Result output stage for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * Results are passed from the receive loop to a writer thread through a
+ * lock-free ring buffer, so that a slow reader on standard output, for
+ * example a pipe to another program, does not stall packet reception or
+ * delay the receive times that backoff fingerprinting depends on.
+ *
+ * The ring has a single producer, the receive loop, and a single
+ * consumer, the writer thread.  Each side only updates its own position,
+ * so no lock is needed to add or remove data.  The writer writes all of
+ * the data that is waiting, up to the end of the ring, with one write()
+ * call, so results that arrive close together are written in batches.
+ * The writer sleeps on a condition variable when the ring is empty, and
+ * the lock is only taken to wake it.
+ *
+ * If the ring is full, output_write() keeps the data in an overflow
+ * buffer and moves it into the ring on later calls, rather than waiting
+ * for the writer.  output_finish() waits for everything to be written.
+ *
+ * Systems without threads or the __atomic builtins write the results
+ * directly with stdio.
+ */
+
+#include "ike-scan.h"
+
+#if defined(HAVE_THREADS) && defined(HAVE_ATOMIC_BUILTINS)
+#define USE_OUTPUT_THREAD 1
+#endif
+
+#ifdef USE_OUTPUT_THREAD
+static int output_fd = -1;		/* File descriptor to write to */
+static int output_running = 0;		/* Writer thread has been started */
+static int output_registered = 0;	/* output_finish() passed to atexit() */
+static pthread_t output_thread;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t output_wakeup = PTHREAD_COND_INITIALIZER;
+static char *ring;			/* OUTPUT_RING_SIZE bytes */
+static size_t ring_head;		/* Bytes added, set by producer */
+static size_t ring_tail;		/* Bytes written, set by consumer */
+static int writer_idle;			/* Writer is waiting for data */
+static int writer_stop;			/* Writer should exit when empty */
+static out_buf overflow;		/* Data waiting for space in ring */
+static size_t overflow_pos;		/* Start of the data in overflow */
+
+/*
+ *	ring_push -- Add as much data to the ring as will fit
+ *
+ *	Inputs:
+ *
+ *	data	The data to add
+ *	len	The length of the data in bytes
+ *
+ *	Returns:
+ *
+ *	The number of bytes added, which may be less than len.
+ *
+ *	This is only called by the producer.  The new head is stored after the
+ *	data is copied, so the writer never sees a partly copied result.
+ */
+static size_t
+ring_push(const char *data, size_t len) {
+   size_t head = ring_head;
+   size_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+   size_t space = OUTPUT_RING_SIZE - (head - tail);
+   size_t pos = head & (OUTPUT_RING_SIZE - 1);
+   size_t first;
+
+   if (len > space)
+      len = space;
+   if (!len)
+      return 0;
+   first = OUTPUT_RING_SIZE - pos;
+   if (first > len)
+      first = len;
+   memcpy(ring + pos, data, first);
+   memcpy(ring, data + first, len - first);
+   __atomic_store_n(&ring_head, head + len, __ATOMIC_SEQ_CST);
+/*
+ *	Wake the writer if it is waiting.  The sequentially consistent store
+ *	above and load below pair with those in output_writer(), so either
+ *	the writer sees the new head before it waits, or we see that it is
+ *	idle and signal it.
+ */
+   if (__atomic_load_n(&writer_idle, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&output_lock);
+      pthread_cond_signal(&output_wakeup);
+      pthread_mutex_unlock(&output_lock);
+   }
+   return len;
+}
+
+/*
+ *	overflow_push -- Move data from the overflow buffer into the ring
+ *
+ *	Inputs:
+ *
+ *	None.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Data is taken from the front of the overflow buffer.  The buffer is
+ *	emptied once all of its data is in the ring, or compacted once more
+ *	than half of it has been moved, so that it does not keep growing
+ *	while the writer is falling behind.
+ */
+static void
+overflow_push(void) {
+   overflow_pos += ring_push(overflow.buf + overflow_pos,
+                             overflow.len - overflow_pos);
+   if (overflow_pos == overflow.len) {
+      out_reset(&overflow);
+      overflow_pos = 0;
+   } else if (overflow_pos > overflow.len / 2) {
+      memmove(overflow.buf, overflow.buf + overflow_pos,
+              overflow.len - overflow_pos + 1);
+      overflow.len -= overflow_pos;
+      overflow_pos = 0;
+   }
+}
+
+/*
+ *	output_writer -- Writer thread
+ *
+ *	Inputs:
+ *
+ *	arg	Not used
+ *
+ *	Returns:
+ *
+ *	NULL
+ *
+ *	This writes data from the ring until it is empty and writer_stop is
+ *	set.
+ */
+static void *
+output_writer(void *arg) {
+   size_t head;
+   size_t tail = ring_tail;
+   size_t pos;
+   size_t len;
+   ssize_t n;
+
+   while (1) {
+      head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+      if (head == tail) {
+         if (__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE))
+            break;
+         pthread_mutex_lock(&output_lock);
+         __atomic_store_n(&writer_idle, 1, __ATOMIC_SEQ_CST);
+         if (__atomic_load_n(&ring_head, __ATOMIC_SEQ_CST) == tail &&
+             !__atomic_load_n(&writer_stop, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&output_wakeup, &output_lock);
+         __atomic_store_n(&writer_idle, 0, __ATOMIC_SEQ_CST);
+         pthread_mutex_unlock(&output_lock);
+         continue;
+      }
+      pos = tail & (OUTPUT_RING_SIZE - 1);
+      len = head - tail;
+      if (len > OUTPUT_RING_SIZE - pos)
+         len = OUTPUT_RING_SIZE - pos;
+      if ((n = write(output_fd, ring + pos, len)) < 0) {
+         if (errno == EINTR)
+            continue;
+         err_sys("ERROR: write");
+      }
+      tail += n;
+      __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+   }
+   return arg;
+}
+#endif
+
+/*
+ *	output_init -- Start the output stage
+ *
+ *	Inputs:
+ *
+ *	fd	The file descriptor to write results to.  This should be
+ *		the file descriptor for stdout unless testing.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Anything already written to stdout with stdio is flushed first, so
+ *	that it appears before the results.  output_finish() is registered
+ *	with atexit() so that queued results are not lost if we exit with
+ *	an error during the scan.
+ */
+void
+output_init(int fd) {
+   fflush(stdout);
+#ifdef USE_OUTPUT_THREAD
+   output_fd = fd;
+   if (ring == NULL)
+      ring = Malloc(OUTPUT_RING_SIZE);
+   ring_head = ring_tail = 0;
+   writer_idle = writer_stop = 0;
+   out_reset(&overflow);
+   overflow_pos = 0;
+   if ((pthread_create(&output_thread, NULL, output_writer, NULL)) != 0)
+      err_msg("ERROR: pthread_create failed");
+   if (!output_registered) {
+      atexit(output_finish);
+      output_registered = 1;
+   }
+   output_running = 1;
+#else
+   (void) fd;
+#endif
+}
+
+/*
+ *	output_write -- Queue data to be written
+ *
+ *	Inputs:
+ *
+ *	data	The data to write
+ *	len	The length of the data in bytes
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This never waits for the writer thread.  It must only be called from
+ *	one thread.
+ */
+void
+output_write(const char *data, size_t len) {
+#ifdef USE_OUTPUT_THREAD
+   size_t n = 0;
+
+   if (!output_running) {
+      fwrite(data, 1, len, stdout);
+      return;
+   }
+   if (overflow.len)
+      overflow_push();
+   if (!overflow.len)
+      n = ring_push(data, len);
+   if (n < len)
+      out_append_len(&overflow, data + n, len - n);
+#else
+   fwrite(data, 1, len, stdout);
+#endif
+}
+
+/*
+ *	output_poll -- Move any overflow data into the ring
+ *
+ *	Inputs:
+ *
+ *	None.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This should be called regularly from the receive loop, so that results
+ *	held in the overflow buffer are written without waiting for the next
+ *	result.
+ */
+void
+output_poll(void) {
+#ifdef USE_OUTPUT_THREAD
+   if (overflow.len)
+      overflow_push();
+#endif
+}
+
+/*
+ *	output_finish -- Write all queued data and stop the output stage
+ *
+ *	Inputs:
+ *
+ *	None.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This waits until the writer thread has written everything in the ring,
+ *	and then writes the overflow buffer directly.  It does nothing if
+ *	called from the writer thread, which happens when the writer exits
+ *	on a write error.
+ */
+void
+output_finish(void) {
+#ifdef USE_OUTPUT_THREAD
+   size_t done;
+   ssize_t n;
+
+   if (!output_running || pthread_equal(pthread_self(), output_thread))
+      return;
+   output_running = 0;
+   pthread_mutex_lock(&output_lock);
+   __atomic_store_n(&writer_stop, 1, __ATOMIC_SEQ_CST);
+   pthread_cond_signal(&output_wakeup);
+   pthread_mutex_unlock(&output_lock);
+   pthread_join(output_thread, NULL);
+   for (done=overflow_pos; done<overflow.len; done+=n) {
+      if ((n = write(output_fd, overflow.buf + done, overflow.len - done)) < 0) {
+         if (errno != EINTR)
+            err_sys("ERROR: write");
+         n = 0;
+      }
+   }
+   out_reset(&overflow);
+   overflow_pos = 0;
+#endif
+}
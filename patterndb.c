@@ -0,0 +1,512 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * patterndb.c -- Compiled pattern database for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * Loading the Vendor ID patterns file means compiling hundreds of regular
+ * expressions, which takes much longer than a scan of a single host.
+ * ike-scan --compiledb reads the Vendor ID and backoff patterns files and
+ * saves them in a compiled pattern database, which later runs map with a
+ * single mmap() call and use in place.
+ *
+ * The database holds the Vendor ID matcher image from vid_matcher_image()
+ * and a table of backoff patterns.  It also records the name, size and
+ * modification time of each patterns file that it was compiled from.  If
+ * ike-scan is using different patterns files, or the files have changed
+ * since the database was compiled, the database is not used and the
+ * patterns files are read as before.  The same happens if the database
+ * is missing, was written by a different version or on a system with a
+ * different byte order, or is damaged.
+ *
+ * The database is written to a temporary file which is then renamed, so
+ * that a scan that starts while the database is being compiled sees
+ * either the old database or the new one.
+ */
+
+#include "ike-scan.h"
+
+#define PATTERN_DB_MAGIC "IKEPATDB"
+#define PATTERN_DB_VERSION 1
+#define PATTERN_DB_BYTE_ORDER 0x01020304
+#define PATTERN_DB_NAME_LEN 1024
+
+typedef struct {
+   char file[PATTERN_DB_NAME_LEN];	/* Patterns file name */
+   IKE_UINT64 size;			/* Size when compiled */
+   IKE_UINT64 mtime;			/* Modification time when compiled */
+} pattern_db_source;
+
+typedef struct {
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+   uint32_t size;		/* Size of the whole database */
+   uint32_t vid_offset;		/* Vendor ID matcher image */
+   uint32_t vid_size;
+   uint32_t backoff_offset;	/* Backoff pattern table */
+   uint32_t num_backoff;	/* Number of backoff patterns */
+   uint32_t num_times;		/* Total number of backoff times */
+   pattern_db_source vid_source;
+   pattern_db_source backoff_source;
+} pattern_db_header;
+
+/*
+ *	The backoff table is an array of num_backoff patterns, then an array
+ *	of num_times times, then the pattern names.
+ */
+typedef struct {
+   uint32_t name;		/* Offset of name from start of names */
+   uint32_t first_time;		/* Index of first time */
+   uint32_t num_times;
+} pattern_db_backoff_entry;
+
+typedef struct {
+   uint32_t sec;
+   uint32_t usec;
+   uint32_t fuzz;		/* Fuzz in ms, or PATTERN_FUZZ_UNSET */
+} pattern_db_time;
+
+/*
+ *	source_info -- Get the size and modification time of a patterns file
+ *
+ *	Inputs:
+ *
+ *	fn	The patterns file name
+ *	src	The source information to fill in
+ *
+ *	Returns:
+ *
+ *	Zero on success, or -1 if the file does not exist.
+ */
+static int
+source_info(const char *fn, pattern_db_source *src) {
+   struct stat st;
+
+   memset(src, '\0', sizeof(pattern_db_source));
+   strlcpy(src->file, fn, sizeof(src->file));
+   if (stat(fn, &st) != 0)
+      return -1;
+   src->size = st.st_size;
+   src->mtime = st.st_mtime;
+   return 0;
+}
+
+/*
+ *	pad8 -- Pad an output buffer to a multiple of 8 bytes
+ */
+static void
+pad8(out_buf *ob) {
+   static const char zero[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+   if (ob->len % 8)
+      out_append_len(ob, zero, 8 - ob->len % 8);
+}
+
+/*
+ *	pattern_db_write -- Write a compiled pattern database
+ *
+ *	Inputs:
+ *
+ *	dbfile		The database file name
+ *	vidlist		The Vendor ID patterns
+ *	vid_fn		The Vendor ID patterns file that vidlist was read from
+ *	patlist		The backoff patterns
+ *	backoff_fn	The backoff patterns file that patlist was read from
+ *
+ *	Returns:
+ *
+ *	Zero on success, or -1 with errno set if the database could not be
+ *	written.
+ *
+ *	The backoff patterns must have been loaded with PATTERN_FUZZ_UNSET
+ *	as the default fuzz, so that the default given when the database is
+ *	used applies to the times that don't give a fuzz value.
+ */
+int
+pattern_db_write(const char *dbfile, vid_pattern_list *vidlist,
+                 const char *vid_fn, pattern_list *patlist,
+                 const char *backoff_fn) {
+   pattern_db_header hdr;
+   out_buf ob = {NULL, 0, 0};
+   out_buf vid = {NULL, 0, 0};
+   out_buf names = {NULL, 0, 0};
+   pattern_db_backoff_entry be;
+   pattern_db_time t;
+   pattern_list *pl;
+   pattern_entry_list *te;
+   char *tmpfile;
+   unsigned i;
+   int fd;
+   int saved_errno;
+
+   memset(&hdr, '\0', sizeof(hdr));
+   memcpy(hdr.magic, PATTERN_DB_MAGIC, sizeof(hdr.magic));
+   hdr.version = PATTERN_DB_VERSION;
+   hdr.byte_order = PATTERN_DB_BYTE_ORDER;
+   source_info(vid_fn, &hdr.vid_source);
+   source_info(backoff_fn, &hdr.backoff_source);
+   out_append_len(&ob, (const char *) &hdr, sizeof(hdr));
+/*
+ *	Add the Vendor ID matcher image.
+ */
+   pad8(&ob);
+   vid_matcher_image(vidlist, &vid);
+   hdr.vid_offset = ob.len;
+   hdr.vid_size = vid.len;
+   out_append_len(&ob, vid.buf, vid.len);
+/*
+ *	Add the backoff pattern table.  The entries are written first with
+ *	the number of times filled in, and the times follow them.
+ */
+   pad8(&ob);
+   hdr.backoff_offset = ob.len;
+   for (pl=patlist; pl != NULL; pl=pl->next)
+      hdr.num_backoff++;
+   for (pl=patlist; pl != NULL; pl=pl->next) {
+      be.name = names.len;
+      be.first_time = hdr.num_times;
+      be.num_times = 0;
+      for (te=pl->recv_times; te != NULL; te=te->next)
+         be.num_times++;
+      hdr.num_times += be.num_times;
+      out_append_len(&names, pl->name, strlen(pl->name) + 1);
+      out_append_len(&ob, (const char *) &be, sizeof(be));
+   }
+   for (pl=patlist; pl != NULL; pl=pl->next) {
+      for (te=pl->recv_times; te != NULL; te=te->next) {
+         t.sec = te->time.tv_sec;
+         t.usec = te->time.tv_usec;
+         t.fuzz = te->fuzz;
+         out_append_len(&ob, (const char *) &t, sizeof(t));
+      }
+   }
+   out_append_len(&ob, names.buf ? names.buf : "", names.len);
+   pad8(&ob);
+   hdr.size = ob.len;
+   memcpy(ob.buf, &hdr, sizeof(hdr));
+/*
+ *	Write to a temporary file, and rename it when it is complete.
+ */
+   tmpfile = make_message("%s.%u", dbfile, (unsigned) getpid());
+   if ((fd = open(tmpfile, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+      goto error;
+   for (i=0; i<ob.len; ) {
+      ssize_t n;
+
+      if ((n = write(fd, ob.buf + i, ob.len - i)) < 0) {
+         if (errno == EINTR)
+            continue;
+         saved_errno = errno;
+         close(fd);
+         unlink(tmpfile);
+         errno = saved_errno;
+         goto error;
+      }
+      i += n;
+   }
+   if (close(fd) != 0 || rename(tmpfile, dbfile) != 0) {
+      saved_errno = errno;
+      unlink(tmpfile);
+      errno = saved_errno;
+      goto error;
+   }
+   free(tmpfile);
+   free(ob.buf);
+   free(vid.buf);
+   free(names.buf);
+   return 0;
+
+error:
+   saved_errno = errno;
+   free(tmpfile);
+   free(ob.buf);
+   free(vid.buf);
+   free(names.buf);
+   errno = saved_errno;
+   return -1;
+}
+
+/*
+ *	source_current -- Check if a database source is current
+ *
+ *	Inputs:
+ *
+ *	src	The source information from the database
+ *	fn	The patterns file name that ike-scan is using
+ *
+ *	Returns:
+ *
+ *	Nonzero if the database was compiled from this file, and the file
+ *	has not changed since.  A file that no longer exists is taken to be
+ *	unchanged.
+ */
+static int
+source_current(const pattern_db_source *src, const char *fn) {
+   pattern_db_source now;
+
+   if (memchr(src->file, '\0', sizeof(src->file)) == NULL ||
+       strcmp(src->file, fn) != 0)
+      return 0;
+   if (source_info(fn, &now) != 0)
+      return 1;
+   return now.size == src->size && now.mtime == src->mtime;
+}
+
+/*
+ *	backoff_table_ok -- Check the backoff table in a database
+ *
+ *	Inputs:
+ *
+ *	db	The database
+ *	hdr	The database header
+ *
+ *	Returns:
+ *
+ *	Nonzero if every pattern name and time is within the database.  The
+ *	caller must already have checked that the entries and times are.
+ */
+static int
+backoff_table_ok(const pattern_db *db, const pattern_db_header *hdr) {
+   const pattern_db_backoff_entry *be;
+   const char *names;
+   size_t names_len;
+   unsigned i;
+
+   be = (const pattern_db_backoff_entry *) (db->data + hdr->backoff_offset);
+   names = (const char *) ((const pattern_db_time *) (be + hdr->num_backoff) +
+                           hdr->num_times);
+   names_len = db->data + db->len - (const unsigned char *) names;
+   for (i=0; i<hdr->num_backoff; i++) {
+      if (be[i].name >= names_len ||
+          memchr(names + be[i].name, '\0', names_len - be[i].name) == NULL ||
+          be[i].first_time > hdr->num_times ||
+          be[i].num_times > hdr->num_times - be[i].first_time)
+         return 0;
+   }
+   return 1;
+}
+
+/*
+ *	pattern_db_open -- Open a compiled pattern database
+ *
+ *	Inputs:
+ *
+ *	dbfile		The database file name
+ *	vid_fn		The Vendor ID patterns file that ike-scan is using
+ *	backoff_fn	The backoff patterns file that ike-scan is using
+ *
+ *	Returns:
+ *
+ *	A pointer to the database, or NULL if it is missing, out of date or
+ *	not valid.
+ *
+ *	The database is mapped into memory if mmap() is available, or read
+ *	into memory otherwise.
+ */
+pattern_db *
+pattern_db_open(const char *dbfile, const char *vid_fn,
+                const char *backoff_fn) {
+   pattern_db *db;
+   pattern_db_header hdr;
+   struct stat st;
+   void *data;
+   size_t len;
+   size_t table_len;
+   int mapped;
+   int fd;
+
+   if ((fd = open(dbfile, O_RDONLY)) < 0)
+      return NULL;
+   if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(hdr) ||
+       st.st_size > (off_t) UINT32_MAX) {
+      close(fd);
+      return NULL;
+   }
+   len = st.st_size;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+   data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (data == MAP_FAILED) {
+      close(fd);
+      return NULL;
+   }
+   mapped = 1;
+#else
+   {
+      ssize_t n;
+      size_t got;
+
+      data = Malloc(len);
+      for (got=0; got<len; got+=n) {
+         if ((n = read(fd, (char *) data + got, len - got)) <= 0) {
+            free(data);
+            close(fd);
+            return NULL;
+         }
+      }
+      mapped = 0;
+   }
+#endif
+   close(fd);
+
+   db = Malloc(sizeof(pattern_db));
+   db->data = data;
+   db->len = len;
+   db->mapped = mapped;
+/*
+ *	Check the header and the backoff table.  The Vendor ID image is
+ *	checked by vid_matcher_attach().
+ */
+   memcpy(&hdr, data, sizeof(hdr));
+   table_len = (size_t) hdr.num_backoff * sizeof(pattern_db_backoff_entry) +
+               (size_t) hdr.num_times * sizeof(pattern_db_time);
+   if (memcmp(hdr.magic, PATTERN_DB_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != PATTERN_DB_VERSION ||
+       hdr.byte_order != PATTERN_DB_BYTE_ORDER || hdr.size != len ||
+       hdr.vid_offset % 8 || hdr.vid_offset > len ||
+       hdr.vid_size > len - hdr.vid_offset ||
+       hdr.backoff_offset % 8 || hdr.backoff_offset > len ||
+       hdr.num_backoff > len || hdr.num_times > len ||
+       table_len > len - hdr.backoff_offset || !backoff_table_ok(db, &hdr) ||
+       !source_current(&hdr.vid_source, vid_fn) ||
+       !source_current(&hdr.backoff_source, backoff_fn)) {
+      pattern_db_close(db);
+      return NULL;
+   }
+
+   return db;
+}
+
+/*
+ *	pattern_db_vid_matcher -- Get the Vendor ID matcher from a database
+ *
+ *	Inputs:
+ *
+ *	db	The database
+ *
+ *	Returns:
+ *
+ *	A pointer to the matcher, or NULL if the image is not valid.
+ *
+ *	The matcher uses the database in place, so the database must not be
+ *	closed while the matcher is in use.
+ */
+vid_matcher *
+pattern_db_vid_matcher(const pattern_db *db) {
+   pattern_db_header hdr;
+
+   memcpy(&hdr, db->data, sizeof(hdr));
+   return vid_matcher_attach(db->data + hdr.vid_offset, hdr.vid_size, NULL);
+}
+
+/*
+ *	pattern_db_backoff -- Get the backoff patterns from a database
+ *
+ *	Inputs:
+ *
+ *	db		The database
+ *	pattern_fuzz	Default fuzz value in ms
+ *
+ *	Returns:
+ *
+ *	The backoff pattern list, in the same order as the patterns file.
+ */
+pattern_list *
+pattern_db_backoff(const pattern_db *db, unsigned pattern_fuzz) {
+   pattern_db_header hdr;
+   const pattern_db_backoff_entry *be;
+   const pattern_db_time *t;
+   const char *names;
+   pattern_list *head = NULL;
+   pattern_list **tail = &head;
+   pattern_list *pe;
+   pattern_entry_list **te_tail;
+   pattern_entry_list *te;
+   unsigned i;
+   unsigned j;
+
+   memcpy(&hdr, db->data, sizeof(hdr));
+   be = (const pattern_db_backoff_entry *) (db->data + hdr.backoff_offset);
+   t = (const pattern_db_time *) (be + hdr.num_backoff);
+   names = (const char *) (t + hdr.num_times);
+
+   for (i=0; i<hdr.num_backoff; i++) {
+      pe = Malloc(sizeof(pattern_list));
+      pe->name = dupstr(names + be[i].name);
+      pe->num_times = be[i].num_times;
+      pe->recv_times = NULL;
+      pe->next = NULL;
+      te_tail = &pe->recv_times;
+      for (j=be[i].first_time; j<be[i].first_time+be[i].num_times; j++) {
+         te = Malloc(sizeof(pattern_entry_list));
+         te->time.tv_sec = t[j].sec;
+         te->time.tv_usec = t[j].usec;
+         te->fuzz = t[j].fuzz == PATTERN_FUZZ_UNSET ? pattern_fuzz : t[j].fuzz;
+         te->next = NULL;
+         *te_tail = te;
+         te_tail = &te->next;
+      }
+      *tail = pe;
+      tail = &pe->next;
+   }
+
+   return head;
+}
+
+/*
+ *	pattern_db_close -- Close a compiled pattern database
+ *
+ *	Inputs:
+ *
+ *	db	The database
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+pattern_db_close(pattern_db *db) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+   if (db->mapped)
+      munmap((void *) db->data, db->len);
+   else
+      free((void *) db->data);
+#else
+   free((void *) db->data);
+#endif
+   free(db);
+}
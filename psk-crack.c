@@ -44,13 +44,41 @@
  *
  */
 #include "psk-crack.h"
-#include "hash_functions.h"
 
 static const char *default_charset =
    "0123456789abcdefghijklmnopqrstuvwxyz"; /* default bruteforce charset */
 
 static psk_entry *psk_list;	/* List of PSK parameters */
 
+/*
+ *	With --threads, the live flag of each PSK entry, the number of
+ *	uncracked entries and the next brute force key are shared between
+ *	the threads, so they are accessed with atomic operations.
+ */
+#ifdef HAVE_THREADS
+#define shared_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define shared_exchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_RELAXED)
+#define shared_fetch_add(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#define shared_sub(p, n) __atomic_sub_fetch((p), (n), __ATOMIC_RELAXED)
+#else
+#define shared_load(p) (*(p))
+#define shared_sub(p, n) (*(p) -= (n))
+static inline int
+shared_exchange(int *p, int v) {
+   int old = *p;
+
+   *p = v;
+   return old;
+}
+static inline IKE_UINT64
+shared_fetch_add(IKE_UINT64 *p, IKE_UINT64 n) {
+   IKE_UINT64 old = *p;
+
+   *p += n;
+   return old;
+}
+#endif
+
 int
 main (int argc, char *argv[]) {
    const struct option long_options[] = {
@@ -61,9 +89,10 @@ main (int argc, char *argv[]) {
       {"charset", required_argument, 0, 'c'},
       {"dictionary", required_argument, 0, 'd'},
       {"norteluser", required_argument, 0, 'u'},
+      {"threads", required_argument, 0, 't'},
       {0, 0, 0, 0}
    };
-   const char *short_options = "hvVB:c:d:u:";
+   const char *short_options = "hvVB:c:d:u:t:";
    int arg;
    int options_index=0;
    int verbose=0;
@@ -71,17 +100,16 @@ main (int argc, char *argv[]) {
    const char *charset = NULL;
    char dict_file_name[MAXLINE];	/* Dictionary file name */
    char *nortel_user = NULL; /* For cracking Nortel Contivity passwords only */
-   FILE *dictionary_file=NULL;	/* Dictionary file */
    IKE_UINT64 iterations=0;
    struct timeval start_time;	/* Program start time */
    struct timeval end_time;	/* Program end time */
    struct timeval elapsed_time; /* Elapsed time as timeval */
    double elapsed_seconds;	/* Elapsed time in seconds */
    unsigned psk_idx;		/* Index into psk list */
-   unsigned psk_count;		/* Number of PSK entries in the list */
-   unsigned psk_uncracked;	/* Number of uncracked PSK entries */
-   unsigned char *hash_r;
-   char line[MAXLINE];
+   unsigned num_threads=1;	/* Number of cracking threads */
+   unsigned thread_no;
+   crack_state cs;		/* State shared by the cracking threads */
+   crack_worker *workers;
 
    dict_file_name[0] = '\0';	/* Initialise to empty string */
 /*
@@ -118,6 +146,16 @@ main (int argc, char *argv[]) {
          case 'u':      /* --norteluser */
             nortel_user = make_message("%s", optarg);
             break;
+         case 't':      /* --threads */
+            num_threads=Strtoul(optarg, 10);
+            if (num_threads < 1 || num_threads > MAX_THREADS)
+               err_msg("ERROR: The --threads value must be between 1 and %d",
+                       MAX_THREADS);
+#ifndef HAVE_THREADS
+            if (num_threads > 1)
+               err_msg("ERROR: This build of psk-crack does not support --threads");
+#endif
+            break;
          default:       /* Unknown option */
             psk_crack_usage(EXIT_FAILURE);
             break;	/* NOTREACHED */
@@ -143,16 +181,23 @@ main (int argc, char *argv[]) {
 /*
  *	Load the PSK entries from the data file.
  */
-   psk_count = load_psk_params(argv[optind], nortel_user);
+   memset(&cs, '\0', sizeof(cs));
+   cs.verbose = verbose;
+   cs.nortel_user = nortel_user;
+   cs.kernel = mb_kernels(NULL);
+   cs.psk_count = load_psk_params(argv[optind], nortel_user);
    if (verbose)
-      printf("Loaded %u PSK entries from %s\n", psk_count, argv[optind]);
-   if (psk_count < 1)
+      printf("Loaded %u PSK entries from %s\n", cs.psk_count, argv[optind]);
+   if (cs.psk_count < 1)
       err_msg("ERROR: No pre-shared keys to crack");
+   if (verbose)
+      printf("Using %s hash kernel with %u lanes\n", cs.kernel->name,
+             cs.kernel->lanes);
 /*
  *	Open dictionary file if required.
  */
    if (!brute_len)	/* If not bruteforcing */
-      dictionary_file = open_dict_file(dict_file_name);
+      open_dict_file(&cs, dict_file_name);
 /*
  *	Get program start time for statistics displayed on completion.
  */
@@ -163,81 +208,57 @@ main (int argc, char *argv[]) {
    }
    Gettimeofday(&start_time);
 /*
- *	Cracking loop.
+ *	Cracking loop.  The keys are shared out between the threads: brute
+ *	force keys in chunks of BRUTE_CHUNK consecutive indexes, and
+ *	dictionary words in chunks of about DICT_CHUNK bytes.  With one thread,
+ *	the cracking is done by the main thread.
  */
-   psk_uncracked = psk_count;
+   cs.psk_uncracked = cs.psk_count;
    if (brute_len) {	/* Brute force cracking */
-      IKE_UINT64 max;
-      unsigned base;
       unsigned i;
-      IKE_UINT64 loop;
-      IKE_UINT64 val;
-      unsigned digit;
 
-      base = strlen(charset);
-      max = base;
+      cs.charset = charset;
+      cs.base = strlen(charset);
+      cs.max = cs.base;
       for (i=1; i<brute_len; i++)
-         max *= base;	/* max = base^brute_len without using pow() */
+         cs.max *= cs.base;	/* max = base^brute_len without using pow() */
       printf("Brute force with %u chars up to length %u will take up to "
-             IKE_UINT64_FORMAT " iterations\n", base, brute_len, max);
-
-      for (loop=0; psk_uncracked && loop<max; loop++) {
-         char *line_p;
-
-         val = loop;
-         line_p = line;
-         do {
-            digit = val % base;
-            val /= base;
-            *line_p++ = charset[digit];
-         } while (val);
-         *line_p = '\0';
-         if (verbose > 1)
-            printf("Trying key \"%s\"\n", line);
-         iterations++;
-         for (psk_idx=0; psk_idx<psk_count; psk_idx++) {
-            if (psk_list[psk_idx].live) {
-               hash_r = compute_hash(&psk_list[psk_idx], line);
-               if (!memcmp(hash_r, psk_list[psk_idx].hash_r,
-                   psk_list[psk_idx].hash_r_len)) {
-                  printf("key \"%s\" matches %s hash %s\n", line,
-                         psk_list[psk_idx].hash_name,
-                         psk_list[psk_idx].hash_r_hex);
-                  psk_uncracked--;
-                  psk_list[psk_idx].live=0;
-               }
-            }
-         }
-      }
-   } else {	/* Dictionary cracking */
-      while (psk_uncracked && fgets(line, MAXLINE, dictionary_file)) {
-         char *line_p;
-         for (line_p = line; !isspace((unsigned char)*line_p) &&
-              *line_p != '\0'; line_p++)
-            ;
-         *line_p = '\0';
-         if (verbose > 1)
-            printf("Trying key \"%s\"\n", line);
-         iterations++;
-         for (psk_idx=0; psk_idx<psk_count; psk_idx++) {
-            if (psk_list[psk_idx].live) {
-               hash_r = compute_hash(&psk_list[psk_idx], line);
-               if (!memcmp(hash_r, psk_list[psk_idx].hash_r,
-                           psk_list[psk_idx].hash_r_len)) {
-                  printf("key \"%s\" matches %s hash %s\n", line,
-                         psk_list[psk_idx].hash_name,
-                         psk_list[psk_idx].hash_r_hex);
-                  psk_uncracked--;
-                  psk_list[psk_idx].live=0;
-               }
-            }
-         }
+             IKE_UINT64_FORMAT " iterations\n", cs.base, brute_len, cs.max);
+   }
+   workers = Malloc(num_threads * sizeof(crack_worker));
+   for (thread_no=0; thread_no<num_threads; thread_no++) {
+      workers[thread_no].cs = &cs;
+      workers[thread_no].iterations = 0;
+   }
+#ifdef HAVE_THREADS
+   if (num_threads > 1) {
+      int status;
+
+      if ((status = pthread_mutex_init(&cs.dict_lock, NULL)) != 0)
+         err_msg("ERROR: pthread_mutex_init failed: %s", strerror(status));
+      if (verbose)
+         printf("Cracking with %u threads\n", num_threads);
+      for (thread_no=0; thread_no<num_threads; thread_no++) {
+         if ((status = pthread_create(&workers[thread_no].thread, NULL,
+                                      crack_thread, &workers[thread_no])) != 0)
+            err_msg("ERROR: pthread_create failed: %s", strerror(status));
       }
+      for (thread_no=0; thread_no<num_threads; thread_no++)
+         pthread_join(workers[thread_no].thread, NULL);
+      pthread_mutex_destroy(&cs.dict_lock);
+   } else {
+      crack_thread(&workers[0]);
    }
+#else
+   crack_thread(&workers[0]);
+#endif
+   for (thread_no=0; thread_no<num_threads; thread_no++)
+      iterations += workers[thread_no].iterations;
+   free(workers);
 /*
  *	Display any hashes that we've not cracked.
  */
-   for (psk_idx=0; psk_idx<psk_count; psk_idx++) {
+   for (psk_idx=0; psk_idx<cs.psk_count; psk_idx++) {
       if (psk_list[psk_idx].live)
          printf("no match found for %s hash %s\n",
                 psk_list[psk_idx].hash_name,
@@ -257,7 +278,7 @@ main (int argc, char *argv[]) {
           iterations, elapsed_seconds, iterations/elapsed_seconds);
   
    if (!brute_len)
-      fclose(dictionary_file);
+      close_dict_file(&cs);
 
    return 0;
 }
@@ -439,16 +460,112 @@ load_psk_params(const char *filename, const char *nortel_user) {
 }
 
 /*
- *	compute_hash	-- Compute the hash given a candidate password
+ *	psk_keys_init -- Set up the SKEYID keys for a group of candidates
+ *
+ *	Inputs:
+ *
+ *	pk		The key state to set up
+ *	kernel		The multi-buffer hash kernel
+ *	cand		The candidate passwords
+ *	count		The number of candidates, up to the kernel lanes
+ *	nortel_user	The username for Nortel PSK cracking, or NULL
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The SKEYID key depends only on the candidate password, so it is the
+ *	same for all of the PSK entries.  For Nortel entries, the key is
+ *	derived from the password and username here once per group, using
+ *	the multi-buffer kernel for both the hash and the HMAC.
+ *	The HMAC key state is set up by hash_group() when the first entry
+ *	with each hash type needs it.
+ */
+static void
+psk_keys_init(psk_keys *pk, const mb_kernel *kernel,
+              const psk_candidate *cand, unsigned count,
+              const char *nortel_user) {
+   unsigned i;
+
+   pk->kernel = kernel;
+   pk->count = count;
+   for (i=0; i<MB_MAX_LANES; i++) {	/* Unused lanes get empty keys */
+      pk->key[i] = (const unsigned char *) (i < count ? cand[i].key : "");
+      pk->key_len[i] = i < count ? cand[i].len : 0;
+   }
+   if (nortel_user != NULL) {	/* Nortel proprietary SKEYID calculation */
+      unsigned char nortel_pwd_hash[MB_MAX_LANES][SHA1_HASH_LEN];
+      unsigned char *md[MB_MAX_LANES];
+      mb_hmac_ctx user_key;
+
+      for (i=0; i<MB_MAX_LANES; i++)
+         md[i] = nortel_pwd_hash[i];
+      mb_hash(kernel, MB_SHA1, pk->key, pk->key_len, md, count);
+      for (i=0; i<count; i++) {
+         pk->key[i] = nortel_pwd_hash[i];
+         pk->key_len[i] = SHA1_HASH_LEN;
+      }
+      mb_hmac_init(kernel, MB_SHA1, &user_key, pk->key, pk->key_len, count);
+      for (i=0; i<count; i++) {
+         md[i] = pk->nortel_psk[i];
+         pk->key[i] = pk->nortel_psk[i];
+      }
+      mb_hmac_final(kernel, MB_SHA1, &user_key,
+                    (const unsigned char *) nortel_user, strlen(nortel_user),
+                    md, count);
+   }
+   pk->have_md5 = 0;
+   pk->have_sha1 = 0;
+}
+
+/*
+ *	psk_batch_alloc -- Allocate the scratch space for a batch of keys
+ *
+ *	Inputs:
+ *
+ *	kernel	The multi-buffer hash kernel
+ *
+ *	Returns:
+ *
+ *	Pointer to the new batch, which is empty.
+ *
+ *	Each thread has its own batch, so nothing in it is shared.
+ */
+static psk_batch *
+psk_batch_alloc(const mb_kernel *kernel) {
+   psk_batch *batch;
+   unsigned num_groups;
+
+   num_groups = (CRACK_BATCH + kernel->lanes - 1) / kernel->lanes;
+   batch = Malloc(sizeof(psk_batch));
+   batch->kernel = kernel;
+   batch->count = 0;
+   batch->group = Malloc(num_groups * sizeof(psk_keys));
+
+   return batch;
+}
+
+/*
+ *	psk_batch_free -- Free a batch allocated by psk_batch_alloc()
+ */
+static void
+psk_batch_free(psk_batch *batch) {
+   free(batch->group);
+   free(batch);
+}
+
+/*
+ *	hash_group	-- Compute the hashes for a group of candidate passwords
  *
  *	Inputs:
  *
  *	psk_params	Pointer to PSK params structure
- *	password	The candidate password
+ *	pk		The candidate key state from psk_keys_init()
+ *	hash_r		Buffers for the computed hashes, one per candidate
  *
  *	Returns:
  *
- *	Pointer to the computed hash.
+ *	None.
  *
  *	This function calculates a hash given the PSK parameters and
  *	a candidate password.
@@ -462,50 +579,226 @@ load_psk_params(const char *filename, const char *nortel_user) {
  *	a) Calculate SKEYID using some of the PSK parameters and the password;
  *	b) Calculate HASH_R using SKEYID and the other PSK parameters.
  *
+ *	Both stages are done for all of the candidates in the group at once
+ *	by the multi-buffer kernel.  The padded key blocks for (a) are hashed
+ *	once per group and kept in pk, so each further PSK entry only hashes
+ *	its own data.
  */
-static inline unsigned char *
-compute_hash (const psk_entry *psk_params, const char *password) {
-   size_t password_len = strlen(password);
-   unsigned char skeyid[SHA1_HASH_LEN];
-   static unsigned char hash_r[SHA1_HASH_LEN];
+static inline void
+hash_group(const psk_entry *psk_params, psk_keys *pk,
+           unsigned char (*hash_r)[SHA1_HASH_LEN]) {
+   unsigned char skeyid[MB_MAX_LANES][SHA1_HASH_LEN];
+   unsigned char *md[MB_MAX_LANES];
+   const unsigned char *skeyid_key[MB_MAX_LANES];
+   size_t skeyid_len[MB_MAX_LANES];
+   mb_hmac_ctx hash_r_key;
+   mb_hmac_ctx *ctx;
+   int alg;
+   unsigned i;
 /*
  *	Calculate SKEYID
  */
-   if (psk_params->nortel_user == NULL) {   /* RFC 2409 SKEYID calculation */
-      if (psk_params->hash_type == HASH_TYPE_MD5) {
-         hmac_md5(psk_params->skeyid_data, psk_params->skeyid_data_len,
-                  (const unsigned char *) password, password_len, skeyid);
-      } else {	/* SHA1 */
-         hmac_sha1(psk_params->skeyid_data, psk_params->skeyid_data_len,
-                   (const unsigned char *) password, password_len, skeyid);
+   if (psk_params->hash_type == HASH_TYPE_MD5) {
+      alg = MB_MD5;
+      ctx = &pk->md5;
+      if (!pk->have_md5) {
+         mb_hmac_init(pk->kernel, alg, ctx, pk->key, pk->key_len, pk->count);
+         pk->have_md5 = 1;
       }
-   } else {	/* Nortel proprietary SKEYID calculation */
-      unsigned char nortel_psk[SHA1_HASH_LEN];
-      unsigned char nortel_pwd_hash[SHA1_HASH_LEN];
-
-      SHA1((const unsigned char *) password, password_len, nortel_pwd_hash);
-      hmac_sha1((const unsigned char *)psk_params->nortel_user,
-                strlen(psk_params->nortel_user), nortel_pwd_hash,
-                SHA1_HASH_LEN, nortel_psk);
-      if (psk_params->hash_type == HASH_TYPE_MD5) {
-         hmac_md5(psk_params->skeyid_data, psk_params->skeyid_data_len,
-                  nortel_psk, SHA1_HASH_LEN, skeyid);
-      } else {	/* SHA1 */
-         hmac_sha1(psk_params->skeyid_data, psk_params->skeyid_data_len,
-                   nortel_psk, SHA1_HASH_LEN, skeyid);
+   } else {	/* SHA1 */
+      alg = MB_SHA1;
+      ctx = &pk->sha1;
+      if (!pk->have_sha1) {
+         mb_hmac_init(pk->kernel, alg, ctx, pk->key, pk->key_len, pk->count);
+         pk->have_sha1 = 1;
       }
    }
+   for (i=0; i<pk->count; i++) {
+      md[i] = skeyid[i];
+      skeyid_key[i] = skeyid[i];
+      skeyid_len[i] = psk_params->hash_r_len;
+   }
+   mb_hmac_final(pk->kernel, alg, ctx, psk_params->skeyid_data,
+                 psk_params->skeyid_data_len, md, pk->count);
 /*
  *	Calculate HASH_R
  */
-   if (psk_params->hash_type == HASH_TYPE_MD5) {
-      hmac_md5(psk_params->hash_r_data, psk_params->hash_r_data_len, skeyid,
-               psk_params->hash_r_len, hash_r);
-   } else {	/* SHA1 */
-      hmac_sha1(psk_params->hash_r_data, psk_params->hash_r_data_len, skeyid,
-                psk_params->hash_r_len, hash_r);
+   mb_hmac_init(pk->kernel, alg, &hash_r_key, skeyid_key, skeyid_len,
+                pk->count);
+   for (i=0; i<pk->count; i++)
+      md[i] = hash_r[i];
+   mb_hmac_final(pk->kernel, alg, &hash_r_key, psk_params->hash_r_data,
+                 psk_params->hash_r_data_len, md, pk->count);
+}
+
+/*
+ *	compute_hash	-- Compute the hashes for a batch of candidate passwords
+ *
+ *	Inputs:
+ *
+ *	psk_params	Pointer to PSK params structure
+ *	batch		The batch, with key state set up by try_batch()
+ *	hash_r		Output array with one hash for each candidate
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The batch is hashed in groups of as many candidates as the kernel
+ *	has lanes.  All of the working storage is in the batch or on the
+ *	stack, so threads with their own batches can call this at once.
+ */
+static void
+compute_hash(const psk_entry *psk_params, psk_batch *batch,
+             unsigned char (*hash_r)[SHA1_HASH_LEN]) {
+   unsigned lanes = batch->kernel->lanes;
+   unsigned first;
+   unsigned g;
+
+   for (g=0, first=0; first<batch->count; g++, first+=lanes)
+      hash_group(psk_params, &batch->group[g], hash_r + first);
+}
+
+/*
+ *	try_batch -- Try a batch of candidate keys against the uncracked entries
+ *
+ *	Inputs:
+ *
+ *	cs	The shared cracking state
+ *	batch	The batch of candidate keys, which is emptied
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	If another thread cracks an entry at the same time, only the thread
+ *	that clears the live flag reports it.
+ */
+static void
+try_batch(crack_state *cs, psk_batch *batch) {
+   unsigned lanes = batch->kernel->lanes;
+   unsigned psk_idx;
+   unsigned first;
+   unsigned g;
+   unsigned i;
+
+   if (cs->verbose > 1) {
+      for (i=0; i<batch->count; i++)
+         printf("Trying key \"%.*s\"\n", (int) batch->cand[i].len,
+                batch->cand[i].key);
+   }
+   for (g=0, first=0; first<batch->count; g++, first+=lanes)
+      psk_keys_init(&batch->group[g], batch->kernel, &batch->cand[first],
+                    batch->count - first < lanes ? batch->count - first :
+                                                   lanes,
+                    cs->nortel_user);
+   for (psk_idx=0; psk_idx<cs->psk_count; psk_idx++) {
+      psk_entry *pe = &psk_list[psk_idx];
+
+      if (!shared_load(&pe->live))
+         continue;
+      compute_hash(pe, batch, batch->hash_r);
+      for (i=0; i<batch->count; i++) {
+         if (!memcmp(batch->hash_r[i], pe->hash_r, pe->hash_r_len)) {
+            if (shared_exchange(&pe->live, 0)) {
+               printf("key \"%.*s\" matches %s hash %s\n",
+                      (int) batch->cand[i].len, batch->cand[i].key,
+                      pe->hash_name, pe->hash_r_hex);
+               shared_sub(&cs->psk_uncracked, 1);
+            }
+            break;
+         }
+      }
+   }
+   batch->count = 0;
+}
+
+/*
+ *	crack_thread -- Try keys until they run out or all entries are cracked
+ *
+ *	Inputs:
+ *
+ *	arg	Pointer to the crack_worker structure for this thread
+ *
+ *	Returns:
+ *
+ *	NULL.
+ *
+ *	In brute force mode, the thread takes the next BRUTE_CHUNK key
+ *	indexes from the shared counter and builds each key from its index.
+ *	In dictionary mode, it takes the next DICT_CHUNK bytes of the mapped
+ *	dictionary from the shared offset, or reads the next block of a
+ *	dictionary stream under the dictionary lock.  The keys are collected
+ *	into batches of CRACK_BATCH candidates in the thread's own scratch
+ *	space.  It stops as soon as all of the PSK entries have been cracked
+ *	by any thread.
+ */
+static void *
+crack_thread(void *arg) {
+   crack_worker *w = arg;
+   crack_state *cs = w->cs;
+   psk_batch *batch;
+
+   batch = psk_batch_alloc(cs->kernel);
+   if (cs->max) {	/* Brute force cracking */
+      char (*line)[MAXLINE];
+      IKE_UINT64 first;
+      IKE_UINT64 last;
+      IKE_UINT64 loop;
+      IKE_UINT64 val;
+      unsigned digit;
+      char *line_p;
+
+      line = Malloc(CRACK_BATCH * sizeof(*line));
+      while (shared_load(&cs->psk_uncracked) &&
+             (first = shared_fetch_add(&cs->next, BRUTE_CHUNK)) < cs->max) {
+         last = first + BRUTE_CHUNK;
+         if (last > cs->max)
+            last = cs->max;
+         for (loop=first; loop<last && shared_load(&cs->psk_uncracked);
+              loop++) {
+            val = loop;
+            line_p = line[batch->count];
+            do {
+               digit = val % cs->base;
+               val /= cs->base;
+               *line_p++ = cs->charset[digit];
+            } while (val);
+            w->iterations++;
+            batch->cand[batch->count].key = line[batch->count];
+            batch->cand[batch->count].len = line_p - line[batch->count];
+            if (++batch->count == CRACK_BATCH)
+               try_batch(cs, batch);
+         }
+         if (batch->count)
+            try_batch(cs, batch);
+      }
+      free(line);
+   } else if (cs->dict_data) {	/* Dictionary cracking, mapped file */
+      IKE_UINT64 start;
+      size_t stop;
+
+      while (shared_load(&cs->psk_uncracked) &&
+             (start = shared_fetch_add(&cs->next, DICT_CHUNK)) <
+             cs->dict_len) {
+         stop = start + DICT_CHUNK;
+         if (stop > cs->dict_len)
+            stop = cs->dict_len;
+         dict_words(cs, w, batch, cs->dict_data, start, stop, cs->dict_len);
+      }
+   } else {	/* Dictionary cracking, stream */
+      char *buf = NULL;
+      size_t size = 0;
+      size_t n;
+
+      while (shared_load(&cs->psk_uncracked) &&
+             (n = read_dict_block(cs, &buf, &size)) > 0)
+         dict_words(cs, w, batch, buf, 0, n, n);
+      free(buf);
    }
-   return hash_r;
+   psk_batch_free(batch);
+
+   return NULL;
 }
 
 /*
@@ -513,16 +806,21 @@ compute_hash (const psk_entry *psk_params, const char *password) {
  *
  *	Inputs:
  *
- *	dict_file_name	The dictionary file name, or NULL for default.
+ *	cs		The cracking state to set up
+ *	dict_file_name	The dictionary file name, or empty for default.
  *
  *	Returns:
  *
- *	The file descriptor of the dictionary file.
+ *	None.
+ *
+ *	A regular file is mapped into memory with mmap() if it is
+ *	available, so the words can be used where they are without copying.
+ *	Otherwise, including when the filename is "-" for stdin, the
+ *	dictionary is read as a stream.
  */
-static FILE *
-open_dict_file(const char *dict_file_name) {
+static void
+open_dict_file(crack_state *cs, const char *dict_file_name) {
    char *fn;
-   FILE *fp;
 #ifdef __CYGWIN__
    char fnbuf[MAXLINE];
    int fnbuf_siz;
@@ -548,16 +846,161 @@ open_dict_file(const char *dict_file_name) {
       fn = make_message("%s", dict_file_name);
    }
 
+   cs->dict_data = NULL;
+   cs->dict_len = 0;
    if ((strcmp(fn, "-")) == 0) {       /* Filename "-" means stdin */
-      fp = stdin;
+      cs->dictionary_file = stdin;
    } else {
-      if ((fp = fopen(fn, "r")) == NULL) {
+      if ((cs->dictionary_file = fopen(fn, "r")) == NULL) {
          err_sys("error opening dictionary file %s", fn);
       }
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+      {
+         struct stat st;
+         void *data;
+
+         if (fstat(fileno(cs->dictionary_file), &st) == 0 &&
+             S_ISREG(st.st_mode) && st.st_size > 0 &&
+             (off_t) (size_t) st.st_size == st.st_size) {
+            data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                        fileno(cs->dictionary_file), 0);
+            if (data != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+               madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
+               cs->dict_data = data;
+               cs->dict_len = st.st_size;
+               fclose(cs->dictionary_file);
+               cs->dictionary_file = NULL;
+            }
+         }
+      }
+#endif
+   }
+   if (cs->verbose) {
+      if (cs->dict_data)
+         printf("Mapped %lu bytes of dictionary file %s\n",
+                (unsigned long) cs->dict_len, fn);
+      else
+         printf("Reading dictionary file %s as a stream\n", fn);
    }
    free(fn);
+}
+
+/*
+ *	close_dict_file	-- Close the dictionary file opened by open_dict_file()
+ */
+static void
+close_dict_file(crack_state *cs) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+   if (cs->dict_data)
+      munmap((void *) cs->dict_data, cs->dict_len);
+#endif
+   if (cs->dictionary_file)
+      fclose(cs->dictionary_file);
+}
+
+/*
+ *	read_dict_block	-- Read the next block of a dictionary stream
+ *
+ *	Inputs:
+ *
+ *	cs	The cracking state
+ *	buf	The thread's buffer, which is enlarged if needed
+ *	size	The size of buf
+ *
+ *	Returns:
+ *
+ *	The number of bytes read, or 0 at the end of the dictionary.
+ *
+ *	About DICT_CHUNK bytes are read under the dictionary lock.  If the
+ *	block ends part way through a line, the rest of the line is read too,
+ *	so that every line is in one block however long it is.
+ */
+static size_t
+read_dict_block(crack_state *cs, char **buf, size_t *size) {
+   size_t n;
+   int c;
 
-   return fp;
+   if (*size < DICT_CHUNK) {
+      *buf = Realloc(*buf, DICT_CHUNK);
+      *size = DICT_CHUNK;
+   }
+#ifdef HAVE_THREADS
+   pthread_mutex_lock(&cs->dict_lock);
+#endif
+   n = fread(*buf, 1, DICT_CHUNK, cs->dictionary_file);
+   if (n == DICT_CHUNK && (*buf)[n-1] != '\n') {
+      while ((c = getc(cs->dictionary_file)) != EOF) {
+         if (n == *size) {
+            *size *= 2;
+            *buf = Realloc(*buf, *size);
+         }
+         (*buf)[n++] = c;
+         if (c == '\n')
+            break;
+      }
+   }
+#ifdef HAVE_THREADS
+   pthread_mutex_unlock(&cs->dict_lock);
+#endif
+
+   return n;
+}
+
+/*
+ *	dict_words	-- Try the dictionary words in part of a buffer
+ *
+ *	Inputs:
+ *
+ *	cs	The shared cracking state
+ *	w	The crack_worker structure for this thread
+ *	batch	The thread's batch
+ *	data	The dictionary data
+ *	start	Offset of the first byte of this thread's part
+ *	stop	Offset of the byte after this thread's part
+ *	len	The length of data
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Each line that starts in [start, stop) gives one candidate: the
+ *	text up to the first whitespace character.  A line that starts
+ *	before start belongs to the previous part, and the last line may
+ *	run past stop.  The candidates point into data, so the batch is
+ *	tried before returning.
+ */
+static void
+dict_words(crack_state *cs, crack_worker *w, psk_batch *batch,
+           const char *data, size_t start, size_t stop, size_t len) {
+   const char *p = data + start;
+   const char *end = data + len;
+   const char *line_end;
+   const char *word_end;
+
+   if (start > 0 && data[start-1] != '\n') {
+      if ((p = memchr(p, '\n', end - p)) == NULL)
+         return;
+      p++;
+   }
+   while (p < data + stop && shared_load(&cs->psk_uncracked)) {
+      if ((line_end = memchr(p, '\n', end - p)) == NULL)
+         line_end = end;
+      for (word_end = p; word_end < line_end &&
+           !isspace((unsigned char)*word_end); word_end++)
+         ;
+      w->iterations++;
+      batch->cand[batch->count].key = p;
+      batch->cand[batch->count].len = word_end - p;
+      if (++batch->count == CRACK_BATCH)
+         try_batch(cs, batch);
+      if (line_end == end)
+         break;
+      p = line_end + 1;
+   }
+   if (batch->count)
+      try_batch(cs, batch);
 }
 
 /*
@@ -623,6 +1066,13 @@ psk_crack_usage(int status) {
    fprintf(stderr, "\n--bruteforce=<n> or -B <n> Select bruteforce cracking up to <n> characters.\n");
    fprintf(stderr, "\n--charset=<s> or -c <s>\tSet bruteforce character set to <s>\n");
    fprintf(stderr, "\t\t\tDefault is \"%s\"\n", default_charset);
+   fprintf(stderr, "\n--threads=<n> or -t <n> Crack using <n> threads, default=1.\n");
+   fprintf(stderr, "\t\t\tThe candidate keys are shared out between the threads\n");
+   fprintf(stderr, "\t\t\tin blocks, so up to <n> processor cores can be used.\n");
+   fprintf(stderr, "\t\t\tEach PSK entry stops being cracked as soon as any\n");
+   fprintf(stderr, "\t\t\tthread finds its key. With more than one thread, the\n");
+   fprintf(stderr, "\t\t\tkeys are not tried in order, so when several entries\n");
+   fprintf(stderr, "\t\t\tare cracked they may be displayed in a different order.\n");
    fprintf(stderr, "\n");
    fprintf(stderr, "Report bugs or send suggestions at %s\n", PACKAGE_BUGREPORT);
    fprintf(stderr, "See the ike-scan homepage at http://www.nta-monitor.com/tools/ike-scan/\n");
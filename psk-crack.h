@@ -93,6 +93,32 @@
 # endif
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/*
+ *	The --threads option needs POSIX threads, and the __atomic builtins
+ *	for the state that the threads share.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && \
+    defined(HAVE_ATOMIC_BUILTINS)
+#include <pthread.h>
+#define HAVE_THREADS 1
+#endif
+
 #ifdef HAVE_OPENSSL
 #include <openssl/md5.h>
 #include <openssl/sha.h>
@@ -100,6 +126,8 @@
 #include "md5.h"
 #include "sha1.h"
 #endif
+#include "hash_functions.h"
+#include "mbhash.h"
 
 /* Defines */
 
@@ -111,6 +139,10 @@
 #define MD5_HASH_LEN 16
 #define SHA1_HASH_LEN 20
 #define PSK_REALLOC_COUNT 10		/* Number of PSK entries to allocate */
+#define MAX_THREADS 256			/* Max value for --threads */
+#define BRUTE_CHUNK 4096		/* Brute force keys taken at a time */
+#define DICT_CHUNK 65536		/* Dictionary bytes taken at a time */
+#define CRACK_BATCH 256			/* Candidate keys tried at a time */
 
 /* Structures */
 
@@ -129,6 +161,62 @@ typedef struct {
    int live;			/* Are we still cracking this entry? */
 } psk_entry;
 
+/* A candidate key, which need not be NUL terminated */
+typedef struct {
+   const char *key;
+   size_t len;
+} psk_candidate;
+
+/* HMAC key state for a group of candidate keys, shared by all PSK entries */
+typedef struct {
+   const mb_kernel *kernel;	/* Kernel that hashes the group */
+   unsigned count;		/* Number of candidates, up to kernel lanes */
+   const unsigned char *key[MB_MAX_LANES];	/* SKEYID key for each */
+   size_t key_len[MB_MAX_LANES];
+   unsigned char nortel_psk[MB_MAX_LANES][SHA1_HASH_LEN]; /* Nortel keys */
+   mb_hmac_ctx md5;		/* Key state for HMAC-MD5 */
+   mb_hmac_ctx sha1;		/* Key state for HMAC-SHA1 */
+   int have_md5;		/* Is md5 set up? */
+   int have_sha1;		/* Is sha1 set up? */
+} psk_keys;
+
+/* Scratch space for a batch of candidate keys, one for each thread */
+typedef struct {
+   const mb_kernel *kernel;	/* Kernel that hashes the batch */
+   unsigned count;		/* Number of candidates in the batch */
+   psk_candidate cand[CRACK_BATCH];	/* The candidates */
+   unsigned char hash_r[CRACK_BATCH][SHA1_HASH_LEN]; /* Computed hashes */
+   psk_keys *group;		/* Key state for each group of lanes */
+} psk_batch;
+
+/* State shared by the cracking threads */
+typedef struct {
+   const char *charset;		/* Brute force character set */
+   unsigned base;		/* Number of characters in charset */
+   IKE_UINT64 max;		/* Number of brute force keys, 0=dictionary */
+   IKE_UINT64 next;		/* Next brute force key or dictionary offset */
+   const char *dict_data;	/* Mapped dictionary file, or NULL */
+   size_t dict_len;		/* Length of dict_data */
+   FILE *dictionary_file;	/* Dictionary stream if not mapped */
+   const char *nortel_user;	/* User for nortel cracking, or NULL */
+   const mb_kernel *kernel;	/* Multi-buffer hash kernel */
+   unsigned psk_count;		/* Number of PSK entries in the list */
+   unsigned psk_uncracked;	/* Number of uncracked PSK entries */
+   int verbose;
+#ifdef HAVE_THREADS
+   pthread_mutex_t dict_lock;	/* Protects dictionary_file */
+#endif
+} crack_state;
+
+/* A cracking thread */
+typedef struct {
+   crack_state *cs;
+   IKE_UINT64 iterations;	/* Number of keys tried by this thread */
+#ifdef HAVE_THREADS
+   pthread_t thread;
+#endif
+} crack_worker;
+
 
 /* Functions */
 
@@ -140,8 +228,21 @@ size_t strlcpy(char *dst, const char *src, size_t siz);
 #endif
 
 static unsigned load_psk_params(const char *, const char *);
-static inline unsigned char *compute_hash(const psk_entry *, const char *);
-static FILE *open_dict_file(const char *);
+static void psk_keys_init(psk_keys *, const mb_kernel *,
+                          const psk_candidate *, unsigned, const char *);
+static psk_batch *psk_batch_alloc(const mb_kernel *);
+static void psk_batch_free(psk_batch *);
+static inline void hash_group(const psk_entry *, psk_keys *,
+                              unsigned char (*)[SHA1_HASH_LEN]);
+static void compute_hash(const psk_entry *, psk_batch *,
+                         unsigned char (*)[SHA1_HASH_LEN]);
+static void try_batch(crack_state *, psk_batch *);
+static void *crack_thread(void *);
+static void open_dict_file(crack_state *, const char *);
+static void close_dict_file(crack_state *);
+static size_t read_dict_block(crack_state *, char **, size_t *);
+static void dict_words(crack_state *, crack_worker *, psk_batch *,
+                       const char *, size_t, size_t, size_t);
 void err_sys(const char *, ...);
 void warn_sys(const char *, ...);
 void err_msg(const char *, ...);
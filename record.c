@@ -0,0 +1,580 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * record.c -- Structured record output for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * These functions write the results for --format=jsonl and
+ * --format=binary.  A record is written as a sequence of fields, each
+ * identified by one of the REC_* tags, and is rendered directly into an
+ * output buffer in the chosen format as the fields are added.
+ *
+ * In JSON Lines format each record is one JSON object on a line.  The
+ * object keys are the tag names in rec_tag_names[] below.  Byte strings
+ * are written as lower case hex, and any characters in text strings that
+ * are not printable ASCII are written with \u escapes.
+ *
+ * The binary format is a sequence of records, each of which is a 32-bit
+ * length in network byte order followed by that many bytes of fields.
+ * Each field is a one byte tag and a one byte type, followed by:
+ *
+ *	REC_T_UINT	A one byte count n, then an n byte big endian integer.
+ *	REC_T_STR	A 16-bit length in network byte order, then the string.
+ *	REC_T_BYTES	A 16-bit length in network byte order, then the bytes.
+ *	REC_T_LIST	A 32-bit length in network byte order, then the
+ *			elements, which are fields with tag zero.
+ *	REC_T_OBJECT	A 32-bit length in network byte order, then the fields
+ *			of the object.
+ *
+ * The first field of every record is REC_RECORD, a string giving the kind
+ * of record.  record_read() converts a binary record back to JSON.
+ */
+
+#include "ike-scan.h"
+
+static const char *const rec_tag_names[REC_TAG_MAX] = {
+   NULL,		/* Tag 0 is for list elements */
+   "record",
+   "addr",
+   "recv_addr",
+   "num",
+   "time",
+   "result",
+   "length",
+   "exchange",
+   "mode",
+   "rcookie",
+   "version",
+   "flags",
+   "msgid",
+   "transforms",
+   "multiple_proposals",
+   "spi",
+   "attributes",
+   "class",
+   "class_name",
+   "value",
+   "value_name",
+   "data",
+   "ikev2_transforms",
+   "type",
+   "type_name",
+   "id",
+   "id_name",
+   "notify_type",
+   "notify_name",
+   "message",
+   "payloads",
+   "payload",
+   "payload_name",
+   "vendor",
+   "id_type",
+   "id_type_name",
+   "id_value",
+   "cert_type",
+   "cert_type_name",
+   "spi_size",
+   "spi_count",
+   "doi",
+   "proto_id",
+   "error",
+   "times",
+   "guess",
+   "hosts",
+   "elapsed_us",
+   "packets",
+   "handshakes",
+   "notifies",
+};
+
+/*
+ *	rec_key -- Start a field in JSON format
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This writes the separator from the previous field, and the key unless
+ *	we are in a list.
+ */
+static void
+rec_key(record *r, unsigned tag) {
+   if (r->first[r->depth])
+      r->first[r->depth] = 0;
+   else
+      out_append_len(r->ob, ",", 1);
+   if (!r->in_list[r->depth]) {
+      out_append_len(r->ob, "\"", 1);
+      out_append(r->ob, rec_tag_names[tag]);
+      out_append_len(r->ob, "\":", 2);
+   }
+}
+
+/*
+ *	rec_header -- Write a field header in binary format
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag
+ *	type	The field type
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+static void
+rec_header(record *r, unsigned tag, unsigned type) {
+   char hdr[2];
+
+   hdr[0] = tag;
+   hdr[1] = type;
+   out_append_len(r->ob, hdr, 2);
+}
+
+/*
+ *	rec_put32 -- Write a 32-bit length in network byte order
+ */
+static void
+rec_put32(char *p, size_t value) {
+   p[0] = (value >> 24) & 0xff;
+   p[1] = (value >> 16) & 0xff;
+   p[2] = (value >> 8) & 0xff;
+   p[3] = value & 0xff;
+}
+
+/*
+ *	rec_get16, rec_get32 -- Read a length in network byte order
+ */
+static size_t
+rec_get16(const unsigned char *p) {
+   return ((size_t)p[0] << 8) | p[1];
+}
+
+static size_t
+rec_get32(const unsigned char *p) {
+   return ((size_t)p[0] << 24) | ((size_t)p[1] << 16) |
+          ((size_t)p[2] << 8) | p[3];
+}
+
+/*
+ *	rec_open -- Start a record, list or object in binary format
+ *
+ *	Leaves space for the 32-bit length, which rec_close() fills in.
+ */
+static void
+rec_open(record *r) {
+   char len[4] = {0, 0, 0, 0};
+
+   r->start[r->depth] = r->ob->len;
+   out_append_len(r->ob, len, 4);
+}
+
+static void
+rec_close(record *r) {
+   size_t start = r->start[r->depth];
+
+   rec_put32(r->ob->buf + start, r->ob->len - start - 4);
+}
+
+/*
+ *	record_begin -- Start a new record
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	ob	The output buffer to append the record to
+ *	format	FORMAT_JSONL or FORMAT_BINARY
+ *	kind	The kind of record, which is written as the REC_RECORD field
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+record_begin(record *r, out_buf *ob, int format, const char *kind) {
+   r->ob = ob;
+   r->format = format;
+   r->depth = 0;
+   r->first[0] = 1;
+   r->in_list[0] = 0;
+   if (format == FORMAT_JSONL)
+      out_append_len(ob, "{", 1);
+   else
+      rec_open(r);
+   record_str(r, REC_RECORD, kind);
+}
+
+/*
+ *	record_end -- Finish a record
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+record_end(record *r) {
+   if (r->format == FORMAT_JSONL)
+      out_append_len(r->ob, "}\n", 2);
+   else
+      rec_close(r);
+}
+
+/*
+ *	record_uint -- Add an unsigned integer field
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag, or zero in a list
+ *	value	The value
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+record_uint(record *r, unsigned tag, IKE_UINT64 value) {
+   char buf[9];
+   unsigned n;
+
+   if (r->format == FORMAT_JSONL) {
+      rec_key(r, tag);
+      out_printf(r->ob, IKE_UINT64_FORMAT, value);
+   } else {
+      rec_header(r, tag, REC_T_UINT);
+      for (n=1; n<8 && (value >> (8*n)); n++)
+         ;
+      buf[0] = n;
+      for (; n; n--, value >>= 8)
+         buf[n] = value & 0xff;
+      out_append_len(r->ob, buf, buf[0] + 1);
+   }
+}
+
+/*
+ *	record_strn -- Add a text string field
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag, or zero in a list
+ *	str	The string, which need not be null-terminated
+ *	len	The length of the string, at most 65535 bytes
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+record_strn(record *r, unsigned tag, const unsigned char *str, size_t len) {
+   static const char hex_digits[] = "0123456789abcdef";
+   char buf[6];
+   size_t i;
+   size_t start;
+
+   if (len > 0xffff)
+      len = 0xffff;
+   if (r->format == FORMAT_JSONL) {
+      rec_key(r, tag);
+      out_append_len(r->ob, "\"", 1);
+      for (i=0; i<len; i=start) {
+/*
+ *	Copy runs of characters that don't need escaping in one go.
+ */
+         for (start=i; start<len && str[start] >= 0x20 && str[start] < 0x7f &&
+              str[start] != '"' && str[start] != '\\'; start++)
+            ;
+         out_append_len(r->ob, (const char *) str + i, start - i);
+         if (start < len) {
+            if (str[start] == '"' || str[start] == '\\') {
+               buf[0] = '\\';
+               buf[1] = str[start];
+               out_append_len(r->ob, buf, 2);
+            } else {
+               memcpy(buf, "\\u00", 4);
+               buf[4] = hex_digits[str[start] >> 4];
+               buf[5] = hex_digits[str[start] & 0x0f];
+               out_append_len(r->ob, buf, 6);
+            }
+            start++;
+         }
+      }
+      out_append_len(r->ob, "\"", 1);
+   } else {
+      rec_header(r, tag, REC_T_STR);
+      buf[0] = (len >> 8) & 0xff;
+      buf[1] = len & 0xff;
+      out_append_len(r->ob, buf, 2);
+      out_append_len(r->ob, (const char *) str, len);
+   }
+}
+
+/*
+ *	record_str -- Add a null-terminated text string field
+ */
+void
+record_str(record *r, unsigned tag, const char *str) {
+   record_strn(r, tag, (const unsigned char *) str, strlen(str));
+}
+
+/*
+ *	record_bytes -- Add a byte string field
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag, or zero in a list
+ *	data	The bytes
+ *	len	The number of bytes, at most 65535
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+record_bytes(record *r, unsigned tag, const unsigned char *data, size_t len) {
+   char buf[2];
+
+   if (len > 0xffff)
+      len = 0xffff;
+   if (r->format == FORMAT_JSONL) {
+      rec_key(r, tag);
+      out_append_len(r->ob, "\"", 1);
+      out_hex(r->ob, data, len);
+      out_append_len(r->ob, "\"", 1);
+   } else {
+      rec_header(r, tag, REC_T_BYTES);
+      buf[0] = (len >> 8) & 0xff;
+      buf[1] = len & 0xff;
+      out_append_len(r->ob, buf, 2);
+      out_append_len(r->ob, (const char *) data, len);
+   }
+}
+
+/*
+ *	record_nest -- Start a list or object field
+ *
+ *	Inputs:
+ *
+ *	r	The record
+ *	tag	The field tag, or zero in a list
+ *	list	Nonzero for a list, zero for an object
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Lists and objects may be nested up to REC_MAX_DEPTH deep.  Each must be
+ *	finished with record_unnest().
+ */
+static void
+record_nest(record *r, unsigned tag, int list) {
+   if (r->depth + 1 >= REC_MAX_DEPTH)
+      err_msg("ERROR: Output records nested too deeply");
+   if (r->format == FORMAT_JSONL) {
+      rec_key(r, tag);
+      out_append_len(r->ob, list ? "[" : "{", 1);
+      r->depth++;
+   } else {
+      rec_header(r, tag, list ? REC_T_LIST : REC_T_OBJECT);
+      r->depth++;
+      rec_open(r);
+   }
+   r->first[r->depth] = 1;
+   r->in_list[r->depth] = list;
+}
+
+static void
+record_unnest(record *r) {
+   if (r->format == FORMAT_JSONL)
+      out_append_len(r->ob, r->in_list[r->depth] ? "]" : "}", 1);
+   else
+      rec_close(r);
+   r->depth--;
+}
+
+void
+record_list_begin(record *r, unsigned tag) {
+   record_nest(r, tag, 1);
+}
+
+void
+record_list_end(record *r) {
+   record_unnest(r);
+}
+
+void
+record_object_begin(record *r, unsigned tag) {
+   record_nest(r, tag, 0);
+}
+
+void
+record_object_end(record *r) {
+   record_unnest(r);
+}
+
+/*
+ *	record_read_fields -- Convert binary fields to another format
+ *
+ *	Inputs:
+ *
+ *	r	The record to add the fields to
+ *	cp	The binary fields
+ *	len	The length of the binary fields
+ *	list	Nonzero if the fields are list elements
+ *
+ *	Returns:
+ *
+ *	Zero on success, or -1 if the fields are not valid.
+ */
+static int
+record_read_fields(record *r, const unsigned char *cp, size_t len, int list) {
+   const unsigned char *end = cp + len;
+   unsigned tag;
+   unsigned type;
+   size_t n;
+   IKE_UINT64 value;
+
+   while (cp < end) {
+      if (end - cp < 2)
+         return -1;
+      tag = cp[0];
+      type = cp[1];
+      cp += 2;
+      if (tag >= REC_TAG_MAX || (tag == 0) != (list != 0))
+         return -1;
+      switch (type) {
+         case REC_T_UINT:
+            if (cp >= end || cp[0] < 1 || cp[0] > 8 || end - cp < cp[0] + 1)
+               return -1;
+            value = 0;
+            for (n=1; n<=cp[0]; n++)
+               value = (value << 8) | cp[n];
+            cp += cp[0] + 1;
+            record_uint(r, tag, value);
+            break;
+         case REC_T_STR:
+         case REC_T_BYTES:
+            if (end - cp < 2 || (size_t)(end - cp - 2) < rec_get16(cp))
+               return -1;
+            n = rec_get16(cp);
+            if (type == REC_T_STR)
+               record_strn(r, tag, cp + 2, n);
+            else
+               record_bytes(r, tag, cp + 2, n);
+            cp += n + 2;
+            break;
+         case REC_T_LIST:
+         case REC_T_OBJECT:
+            if (end - cp < 4 || (size_t)(end - cp - 4) < rec_get32(cp) ||
+                r->depth + 1 >= REC_MAX_DEPTH)
+               return -1;
+            n = rec_get32(cp);
+            record_nest(r, tag, type == REC_T_LIST);
+            if (record_read_fields(r, cp + 4, n, type == REC_T_LIST) != 0)
+               return -1;
+            record_unnest(r);
+            cp += n + 4;
+            break;
+         default:
+            return -1;
+      }
+   }
+   return 0;
+}
+
+/*
+ *	record_read -- Convert a binary record to another format
+ *
+ *	Inputs:
+ *
+ *	cp	The binary record
+ *	len	The number of bytes available at cp
+ *	ob	The output buffer to append the converted record to
+ *	format	The format to convert to
+ *
+ *	Returns:
+ *
+ *	The length of the binary record, or zero if there is not a complete
+ *	valid record at cp.
+ *
+ *	This reads binary records that were written with --format=binary,
+ *	and can convert them to FORMAT_JSONL, or to FORMAT_BINARY to check
+ *	that they are valid.
+ */
+size_t
+record_read(const unsigned char *cp, size_t len, out_buf *ob, int format) {
+   record r;
+   size_t rec_len;
+   size_t kind_len;
+   size_t start = ob->len;
+   char kind[MAXLINE];
+/*
+ *	The first field must be the REC_RECORD string.
+ */
+   if (len < 8)
+      return 0;
+   rec_len = rec_get32(cp);
+   if (rec_len > len - 4 || rec_len < 4 || cp[4] != REC_RECORD ||
+       cp[5] != REC_T_STR)
+      return 0;
+   kind_len = rec_get16(cp + 6);
+   if (kind_len > rec_len - 4 || kind_len >= sizeof(kind))
+      return 0;
+   memcpy(kind, cp + 8, kind_len);
+   kind[kind_len] = '\0';
+
+   record_begin(&r, ob, format, kind);
+   if (record_read_fields(&r, cp + 8 + kind_len, rec_len - 4 - kind_len,
+                          0) != 0 || r.depth != 0) {
+      ob->len = start;
+      ob->buf[start] = '\0';
+      return 0;
+   }
+   record_end(&r);
+   return rec_len + 4;
+}
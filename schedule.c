@@ -0,0 +1,196 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * schedule.c -- Host send schedule functions for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * Hosts that have been sent at least one packet and are still awaiting a
+ * response are kept in a binary min-heap ordered by the time when they
+ * are next due, which is the time of the last send plus the current
+ * timeout for the host.  Because each host has its own timeout, which
+ * grows by the backoff factor on every retry, the due times are not in
+ * host list order, and the heap lets the main loop find the hosts that
+ * are due without walking over the ones that are not.
+ *
+ * Hosts with the same due time are returned in the order that they were
+ * added, so that hosts sent in one batch are retried in the same order.
+ * Each host entry records its position in the heap so that it can be
+ * removed in O(log n) time when a response arrives.  A host can only be
+ * in one schedule at a time.
+ */
+
+#include "ike-scan.h"
+
+#define SCHED_MIN_SIZE 1024	/* Initial number of heap entries */
+
+/*
+ *	sched_before -- Return true if node a is due before node b
+ */
+static int
+sched_before(const sched_node *a, const sched_node *b) {
+   if (a->due != b->due)
+      return a->due < b->due;
+   return (int)(a->seq - b->seq) < 0;
+}
+
+/*
+ *	sched_set -- Store a node in the heap and update its host entry
+ */
+static void
+sched_set(host_schedule *hs, unsigned pos, const sched_node *node) {
+   hs->heap[pos] = *node;
+   hs->heap[pos].he->sched_pos = pos + 1;
+}
+
+/*
+ *	sched_sift_up -- Move a node up the heap to its correct position
+ */
+static void
+sched_sift_up(host_schedule *hs, unsigned pos, sched_node node) {
+   unsigned parent;
+
+   while (pos > 0) {
+      parent = (pos - 1) / 2;
+      if (!sched_before(&node, &hs->heap[parent]))
+         break;
+      sched_set(hs, pos, &hs->heap[parent]);
+      pos = parent;
+   }
+   sched_set(hs, pos, &node);
+}
+
+/*
+ *	sched_sift_down -- Move a node down the heap to its correct position
+ */
+static void
+sched_sift_down(host_schedule *hs, unsigned pos, sched_node node) {
+   unsigned child;
+
+   while ((child = 2 * pos + 1) < hs->count) {
+      if (child + 1 < hs->count &&
+          sched_before(&hs->heap[child+1], &hs->heap[child]))
+         child++;
+      if (!sched_before(&hs->heap[child], &node))
+         break;
+      sched_set(hs, pos, &hs->heap[child]);
+      pos = child;
+   }
+   sched_set(hs, pos, &node);
+}
+
+/*
+ *	sched_add -- Add a host to the send schedule
+ *
+ *	Inputs:
+ *
+ *	hs	The send schedule
+ *	he	The host entry, which must not already be in a schedule
+ *	due	The time when the host is next due in microseconds
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The heap is allocated on first use, and is doubled in size whenever
+ *	it becomes full.
+ */
+void
+sched_add(host_schedule *hs, host_entry *he, IKE_UINT64 due) {
+   sched_node node;
+
+   if (hs->count >= hs->size) {
+      hs->size = hs->size ? 2 * hs->size : SCHED_MIN_SIZE;
+      hs->heap = Realloc(hs->heap, hs->size * sizeof(sched_node));
+   }
+   node.due = due;
+   node.seq = hs->seq++;
+   node.he = he;
+   sched_sift_up(hs, hs->count++, node);
+}
+
+/*
+ *	sched_remove -- Remove a host from the send schedule
+ *
+ *	Inputs:
+ *
+ *	hs	The send schedule
+ *	he	The host entry
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Does nothing if the host is not in the schedule.
+ */
+void
+sched_remove(host_schedule *hs, host_entry *he) {
+   unsigned pos;
+   sched_node last;
+
+   if (he->sched_pos == 0)
+      return;
+   pos = he->sched_pos - 1;
+   he->sched_pos = 0;
+   last = hs->heap[--hs->count];
+   if (pos == hs->count)
+      return;
+   if (pos > 0 && sched_before(&last, &hs->heap[(pos - 1) / 2]))
+      sched_sift_up(hs, pos, last);
+   else
+      sched_sift_down(hs, pos, last);
+}
+
+/*
+ *	sched_first -- Return the host that is due first
+ *
+ *	Inputs:
+ *
+ *	hs	The send schedule
+ *	due	Set to the time when the host is due in microseconds
+ *
+ *	Returns:
+ *
+ *	The host entry that is due first, or NULL if the schedule is empty.
+ *	The host remains in the schedule.
+ */
+host_entry *
+sched_first(const host_schedule *hs, IKE_UINT64 *due) {
+   if (hs->count == 0)
+      return NULL;
+   *due = hs->heap[0].due;
+   return hs->heap[0].he;
+}
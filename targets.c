@@ -0,0 +1,1073 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * targets.c -- Target list and host entry pool functions for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * The targets are not expanded into host entries when they are loaded.
+ * Instead, each host pattern is stored as a range of addresses, so that a
+ * large network takes the same space as a single host.  The send loop
+ * takes one target at a time from the target list with target_next(), and
+ * only then creates a host entry for it.  The host entry is returned to
+ * its pool as soon as the host has responded or timed out, so the number
+ * of host entries in use is bounded by the number of hosts awaiting a
+ * response rather than by the number of targets.
+ *
+ * When the targets are read from a file with --file, the file is first
+ * read once to count the targets, and then read again one pattern at a
+ * time as the targets are needed.  This is not possible if the file is
+ * standard input, or if the targets are to be sent in random order, in
+ * which case all of the patterns are loaded as ranges before the scan.
+ *
+ * Random order uses the multiplicative group of integers modulo a prime p
+ * that is larger than the number of targets, as used by ZMap.  If g is a
+ * primitive root modulo p, then the sequence x, x*g, x*g^2, ... mod p
+ * visits every value from 1 to p-1 exactly once before it repeats.  We
+ * use x-1 as the target index and skip values beyond the last target.
+ * Choosing p as the smallest prime above the number of targets means that
+ * few values are skipped.  The state is just p, g and the current value,
+ * and a random g and starting value give a different order for each seed.
+ *
+ * Host names are looked up by a pool of up to dns_threads threads, which
+ * are started when names are queued and exit when the queue is empty.
+ * Each address is added to the list as a new range as soon as it has been
+ * looked up, so the scan starts on the addresses that are already known
+ * while the names are still being looked up.  The targets are counted
+ * when the names are queued, and the count is reduced for each name that
+ * can't be looked up.  When reading a file on demand, no more patterns
+ * are read while DNS_BACKLOG names are waiting to be looked up.
+ *
+ * The host entries are allocated in blocks of REALLOC_COUNT entries which
+ * are never moved or freed, so pointers to them remain valid for the
+ * whole scan.  Unused entries are kept on a free list.  Each block of
+ * host entries has a matching block of host_info structures, and each
+ * entry points to its own host_info for the whole scan.
+ */
+
+#include "ike-scan.h"
+
+#if defined(HAVE_THREADS) && defined(HAVE_GETADDRINFO)
+#define USE_DNS_THREADS 1
+#endif
+
+/*
+ *	mul_mod -- Return (a * b) mod m
+ *
+ *	a and b must be less than m.  The product is calculated directly if
+ *	it can't overflow, and otherwise by shifting and adding.
+ */
+static IKE_UINT64
+mul_mod(IKE_UINT64 a, IKE_UINT64 b, IKE_UINT64 m) {
+   IKE_UINT64 result = 0;
+
+   if (m <= 0x100000000ULL)
+      return (a * b) % m;
+   while (b) {
+      if (b & 1)
+         result = (result + a) % m;
+      a = (a + a) % m;
+      b >>= 1;
+   }
+   return result;
+}
+
+/*
+ *	pow_mod -- Return (base ^ exp) mod m
+ */
+static IKE_UINT64
+pow_mod(IKE_UINT64 base, IKE_UINT64 exp, IKE_UINT64 m) {
+   IKE_UINT64 result = 1 % m;
+
+   base %= m;
+   while (exp) {
+      if (exp & 1)
+         result = mul_mod(result, base, m);
+      base = mul_mod(base, base, m);
+      exp >>= 1;
+   }
+   return result;
+}
+
+/*
+ *	is_prime -- Return 1 if n is prime, or 0 if not
+ *
+ *	Uses trial division, which is fast enough because n is less than 2^33.
+ */
+static int
+is_prime(IKE_UINT64 n) {
+   IKE_UINT64 d;
+
+   if (n < 2)
+      return 0;
+   if (n % 2 == 0)
+      return n == 2;
+   for (d=3; d*d<=n; d+=2) {
+      if (n % d == 0)
+         return 0;
+   }
+   return 1;
+}
+
+/*
+ *	is_primitive_root -- Return 1 if g is a primitive root modulo prime p
+ *
+ *	g is a primitive root if g^((p-1)/q) is not 1 for every prime factor
+ *	q of p-1.
+ */
+static int
+is_primitive_root(IKE_UINT64 g, IKE_UINT64 p) {
+   IKE_UINT64 n = p - 1;
+   IKE_UINT64 q;
+
+   for (q=2; q*q<=n; q++) {
+      if (n % q == 0) {
+         if (pow_mod(g, (p - 1) / q, p) == 1)
+            return 0;
+         while (n % q == 0)
+            n /= q;
+      }
+   }
+   if (n > 1 && pow_mod(g, (p - 1) / n, p) == 1)
+      return 0;
+   return 1;
+}
+
+/*
+ *	target_lock -- Lock the target list
+ */
+static void
+target_lock(target_list *tl) {
+#ifdef HAVE_THREADS
+   pthread_mutex_lock(&tl->lock);
+#endif
+}
+
+/*
+ *	target_unlock -- Unlock the target list
+ */
+static void
+target_unlock(target_list *tl) {
+#ifdef HAVE_THREADS
+   pthread_mutex_unlock(&tl->lock);
+#endif
+}
+
+/*
+ *	target_read_line -- Read the next host pattern from a file
+ *
+ *	Inputs:
+ *
+ *	fp	The file to read from
+ *	line	Buffer of MAXLINE bytes for the pattern
+ *
+ *	Returns:
+ *
+ *	1 if a pattern was read, or 0 at end of file.
+ *
+ *	The pattern ends at the first whitespace character on the line.
+ */
+static int
+target_read_line(FILE *fp, char *line) {
+   char *cp;
+
+   if (!fgets(line, MAXLINE, fp))
+      return 0;
+   for (cp = line; !isspace((unsigned char)*cp) && *cp != '\0'; cp++)
+      ;
+   *cp = '\0';
+
+   return 1;
+}
+
+/*
+ *	parse_host_pattern -- Parse a host pattern that gives a range
+ *
+ *	Inputs:
+ *
+ *	pattern	= The host pattern to parse.
+ *	first	= Set to the first address in host byte order.
+ *	last	= Set to the last address in host byte order.
+ *	warn	= Issue warnings about the pattern if nonzero.
+ *
+ *	Returns:
+ *
+ *	1 if the pattern gives a range of addresses, or 0 if it is a single
+ *	host name or IP address.
+ *
+ *	The pattern can specify a number of hosts with the IPnet/bits,
+ *	IPnet:mask or IPstart-IPend formats.  The range is empty if first is
+ *	greater than last, which can happen with the IPstart-IPend format.
+ */
+int
+parse_host_pattern(const char *pattern, uint32_t *first, uint32_t *last,
+                   int warn) {
+   char *patcopy;
+   struct in_addr in_val;
+   struct in_addr mask_val;
+   unsigned numbits;
+   char *cp;
+   uint32_t ipnet_val;
+   uint32_t network;
+   uint32_t mask;
+   unsigned i;
+   uint32_t x;
+   int is_range = 1;
+   static int first_call=1;
+   static regex_t iprange_pat;
+   static regex_t ipslash_pat;
+   static regex_t ipmask_pat;
+   static const char *iprange_pat_str =
+      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+-[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+";
+   static const char *ipslash_pat_str =
+      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+/[0-9]+";
+   static const char *ipmask_pat_str =
+      "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+:[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+";
+/*
+ *	Compile regex patterns if this is the first time we've been called.
+ */
+   if (first_call) {
+      int result;
+
+      first_call = 0;
+      if ((result=regcomp(&iprange_pat, iprange_pat_str,
+                          REG_EXTENDED|REG_NOSUB))) {
+         char errbuf[MAXLINE];
+         regerror(result, &iprange_pat, errbuf, MAXLINE);
+         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
+                 iprange_pat_str, errbuf);
+      }
+      if ((result=regcomp(&ipslash_pat, ipslash_pat_str,
+                          REG_EXTENDED|REG_NOSUB))) {
+         char errbuf[MAXLINE];
+         regerror(result, &ipslash_pat, errbuf, MAXLINE);
+         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
+                 ipslash_pat_str, errbuf);
+      }
+      if ((result=regcomp(&ipmask_pat, ipmask_pat_str,
+                          REG_EXTENDED|REG_NOSUB))) {
+         char errbuf[MAXLINE];
+         regerror(result, &ipmask_pat, errbuf, MAXLINE);
+         err_msg("ERROR: cannot compile regex pattern \"%s\": %s",
+                 ipmask_pat_str, errbuf);
+      }
+   }
+/*
+ *	Make a copy of pattern because we don't want to modify our argument.
+ */
+   patcopy = dupstr(pattern);
+
+   if (!(regexec(&ipslash_pat, patcopy, 0, NULL, 0))) { /* IPnet/bits */
+/*
+ *	Get IPnet and bits as integers. Perform basic error checking.
+ */
+      cp=strchr(patcopy, '/');
+      *(cp++)='\0';	/* patcopy points to IPnet, cp points to bits */
+      if (!(inet_aton(patcopy, &in_val)))
+         err_msg("ERROR: %s is not a valid IP address", patcopy);
+      ipnet_val=ntohl(in_val.s_addr);	/* We need host byte order */
+      numbits=Strtoul(cp, 10);
+      if (numbits<3 || numbits>32)
+         err_msg("ERROR: Number of bits in %s must be between 3 and 32",
+                 pattern);
+/*
+ *	Construct 32-bit network bitmask from number of bits.
+ */
+      mask=0;
+      for (i=0; i<numbits; i++)
+         mask += 1 << i;
+      mask = mask << (32-i);
+/*
+ *	Mask off the network. Warn if the host bits were non-zero.
+ */
+      network=ipnet_val & mask;
+      if (warn && network != ipnet_val)
+         warn_msg("WARNING: host part of %s is non-zero", pattern);
+/*
+ *	Determine the first and last addresses.  We include the host
+ *	and broadcast.
+ */
+      *first = network;
+      *last = network + (uint32_t)(((IKE_UINT64)1 << (32-numbits)) - 1);
+   } else if (!(regexec(&ipmask_pat, patcopy, 0, NULL, 0))) {
+      /* IPnet:netmask */
+/*
+ *	Get IPnet and bits as integers. Perform basic error checking.
+ */
+      cp=strchr(patcopy, ':');
+      *(cp++)='\0';	/* patcopy points to IPnet, cp points to netmask */
+      if (!(inet_aton(patcopy, &in_val)))
+         err_msg("ERROR: %s is not a valid IP address", patcopy);
+      ipnet_val=ntohl(in_val.s_addr);	/* We need host byte order */
+      if (!(inet_aton(cp, &mask_val)))
+         err_msg("ERROR: %s is not a valid netmask", patcopy);
+      mask=ntohl(mask_val.s_addr);	/* We need host byte order */
+/*
+ *	Calculate the number of bits in the network.
+ */
+      x = mask;
+      for (numbits=0; x != 0; x>>=1) {
+         if (x & 0x01) {
+            numbits++;
+         }
+      }
+/*
+ *	Mask off the network. Warn if the host bits were non-zero.
+ */
+      network=ipnet_val & mask;
+      if (warn && network != ipnet_val)
+         warn_msg("WARNING: host part of %s is non-zero", pattern);
+/*
+ *	Determine the first and last addresses.  We include the host
+ *	and broadcast.
+ */
+      *first = network;
+      *last = network + (uint32_t)(((IKE_UINT64)1 << (32-numbits)) - 1);
+   } else if (!(regexec(&iprange_pat, patcopy, 0, NULL, 0))) {
+      /* IPstart-IPend */
+/*
+ *	Get IPstart and IPend as integers.
+ */
+      cp=strchr(patcopy, '-');
+      *(cp++)='\0';	/* patcopy points to IPstart, cp points to IPend */
+      if (!(inet_aton(patcopy, &in_val)))
+         err_msg("ERROR: %s is not a valid IP address", patcopy);
+      *first=ntohl(in_val.s_addr);	/* We need host byte order */
+      if (!(inet_aton(cp, &in_val)))
+         err_msg("ERROR: %s is not a valid IP address", cp);
+      *last=ntohl(in_val.s_addr);	/* We need host byte order */
+   } else {	/* Single host or IP address */
+      is_range = 0;
+   }
+   free(patcopy);
+
+   return is_range;
+}
+
+/*
+ *	target_count_add -- Add to the number of targets in a list
+ */
+static void
+target_count_add(target_list *tl, IKE_UINT64 num) {
+   if (tl->count + num > UINT_MAX)
+      err_msg("ERROR: Too many target hosts");
+   tl->count += num;
+}
+
+/*
+ *	target_append_range -- Add a range to a target list without counting it
+ *
+ *	The caller must hold the target list lock.
+ */
+static void
+target_append_range(target_list *tl, uint32_t first, uint32_t last) {
+   target_range *r;
+
+   if (tl->num_ranges >= tl->max_ranges) {
+      tl->max_ranges += REALLOC_COUNT;
+      tl->range = Realloc(tl->range, tl->max_ranges * sizeof(target_range));
+   }
+   r = &tl->range[tl->num_ranges];
+   r->first = first;
+   r->last = last;
+   if (tl->num_ranges)
+      r->start = r[-1].start + (r[-1].last - r[-1].first + 1);
+   else
+      r->start = 0;
+   tl->num_ranges++;
+}
+
+#ifdef USE_DNS_THREADS
+/*
+ *	target_resolver -- Look up the host names in the queue
+ *
+ *	Inputs:
+ *
+ *	arg	The target list.
+ *
+ *	Returns:
+ *
+ *	NULL.
+ *
+ *	This is the start routine for the lookup threads.  It takes names
+ *	from the queue until the queue is empty, and then exits.
+ *	getaddrinfo() is used because gethostbyname() is not thread safe.
+ */
+static void *
+target_resolver(void *arg) {
+   target_list *tl = arg;
+   struct addrinfo hints;
+   struct addrinfo *res;
+   struct sockaddr_in *sa;
+   uint32_t addr = 0;
+   char *name;
+   int result;
+
+   memset(&hints, '\0', sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+   target_lock(tl);
+   while (tl->next_name < tl->num_names) {
+      name = tl->name[tl->next_name++];
+      if (tl->next_name == tl->num_names)
+         tl->next_name = tl->num_names = 0;
+      target_unlock(tl);
+      if ((result = getaddrinfo(name, NULL, &hints, &res)) == 0) {
+         sa = (struct sockaddr_in *) res->ai_addr;
+         addr = ntohl(sa->sin_addr.s_addr);
+         freeaddrinfo(res);
+      } else {
+         warn_msg("WARNING: getaddrinfo failed for \"%s\": %s - target ignored",
+                  name, gai_strerror(result));
+      }
+      free(name);
+      target_lock(tl);
+      if (result == 0)
+         target_append_range(tl, addr, addr);
+      else
+         tl->count--;
+      tl->resolving--;
+      pthread_cond_broadcast(&tl->resolved);
+   }
+   tl->dns_running--;
+   target_unlock(tl);
+
+   return NULL;
+}
+
+/*
+ *	target_queue_name -- Queue a host name to be looked up
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *	name	The host name
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Starts another lookup thread if there are more names waiting than
+ *	threads running, up to the dns_threads limit.  The caller must hold
+ *	the target list lock.
+ */
+static void
+target_queue_name(target_list *tl, const char *name) {
+   pthread_t thread;
+
+   if (tl->num_names >= tl->max_names) {
+      tl->max_names += REALLOC_COUNT;
+      tl->name = Realloc(tl->name, tl->max_names * sizeof(char *));
+   }
+   tl->name[tl->num_names++] = dupstr(name);
+   tl->resolving++;
+   if (tl->dns_running < tl->dns_threads &&
+       tl->dns_running < tl->num_names - tl->next_name) {
+      if ((pthread_create(&thread, NULL, target_resolver, tl)) != 0)
+         err_msg("ERROR: pthread_create failed");
+      pthread_detach(thread);
+      tl->dns_running++;
+   }
+}
+#endif
+
+/*
+ *	target_add_pattern -- Add a host pattern to the target list
+ *
+ *	This is add_host_pattern() for callers that hold the target list lock.
+ */
+static void
+target_add_pattern(target_list *tl, const char *pattern) {
+   struct hostent *hp;
+   struct in_addr inp;
+   uint32_t first;
+   uint32_t last;
+
+   if (parse_host_pattern(pattern, &first, &last, 1)) {
+      if (first <= last) {
+         if (tl->fp == NULL)
+            target_count_add(tl, (IKE_UINT64)last - first + 1);
+         target_append_range(tl, first, last);
+      }
+      return;
+   }
+
+   if (!(inet_aton(pattern, &inp))) {
+      if (tl->no_dns) {
+         warn_msg("WARNING: inet_aton failed for \"%s\" - target ignored",
+                  pattern);
+         if (tl->fp != NULL)
+            tl->count--;	/* It was counted by target_count_file() */
+         return;
+      }
+#ifdef USE_DNS_THREADS
+      if (tl->dns_threads) {
+         if (tl->fp == NULL)
+            target_count_add(tl, 1);
+         target_queue_name(tl, pattern);
+         return;
+      }
+#endif
+      if ((hp = gethostbyname(pattern)) == NULL) {
+         warn_sys("WARNING: gethostbyname failed for \"%s\" - target ignored",
+                  pattern);
+         if (tl->fp != NULL)
+            tl->count--;	/* It was counted by target_count_file() */
+         return;
+      }
+      memcpy(&inp, hp->h_addr_list[0], sizeof(struct in_addr));
+   }
+   if (tl->fp == NULL)
+      target_count_add(tl, 1);
+   target_append_range(tl, ntohl(inp.s_addr), ntohl(inp.s_addr));
+}
+
+/*
+ *	add_host_pattern -- Add one or more new hosts to the target list.
+ *
+ *	Inputs:
+ *
+ *	tl	= The target list.
+ *	pattern	= The host pattern to add.
+ *
+ *	Returns: None
+ *
+ *	This adds one or more new hosts to the target list.  The pattern
+ *	argument can either be a single host or IP address, in which case one
+ *	host will be added to the list, or it can specify a number of hosts
+ *	with the IPnet/bits, IPnet:mask or IPstart-IPend formats.  Either way,
+ *	the pattern is stored as a single range of addresses.
+ *
+ *	Host names are queued to be looked up by the lookup threads if
+ *	dns_threads is nonzero, and otherwise are looked up before returning.
+ */
+void
+add_host_pattern(target_list *tl, const char *pattern) {
+   target_lock(tl);
+   target_add_pattern(tl, pattern);
+   target_unlock(tl);
+}
+
+/*
+ *	target_init -- Initialise a target list
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+target_init(target_list *tl) {
+   memset(tl, '\0', sizeof(*tl));
+#ifdef HAVE_THREADS
+   pthread_mutex_init(&tl->lock, NULL);
+   pthread_cond_init(&tl->resolved, NULL);
+#endif
+}
+
+/*
+ *	target_add_range -- Add a range of addresses to a target list
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *	first	The first address in host byte order
+ *	last	The last address in host byte order
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	If the list is being read from a file on demand, then the targets in
+ *	the file were counted when it was opened, so the count is not changed.
+ */
+void
+target_add_range(target_list *tl, uint32_t first, uint32_t last) {
+   target_lock(tl);
+   if (tl->fp == NULL)
+      target_count_add(tl, (IKE_UINT64)last - first + 1);
+   target_append_range(tl, first, last);
+   target_unlock(tl);
+}
+
+/*
+ *	target_count_file -- Count the targets in a file of host patterns
+ *
+ *	Inputs:
+ *
+ *	fp	The file, which is left at the position where it started
+ *
+ *	Returns:
+ *
+ *	The number of target addresses in the file.
+ *
+ *	Host names are not looked up, and are counted as one target each,
+ *	and empty lines are not counted.
+ */
+unsigned
+target_count_file(FILE *fp) {
+   char line[MAXLINE];
+   uint32_t first;
+   uint32_t last;
+   IKE_UINT64 count = 0;
+   long start;
+
+   if ((start = ftell(fp)) < 0)
+      err_sys("ERROR: ftell");
+   while (target_read_line(fp, line)) {
+      if (line[0] == '\0')
+         continue;
+      if (parse_host_pattern(line, &first, &last, 0))
+         count += (IKE_UINT64)last - first + 1;
+      else
+         count++;
+      if (count > UINT_MAX)
+         err_msg("ERROR: Too many target hosts");
+   }
+   if ((fseek(fp, start, SEEK_SET)) != 0)
+      err_sys("ERROR: fseek");
+
+   return count;
+}
+
+/*
+ *	target_read_more -- Replace the ranges with the next ones in the file
+ *
+ *	Inputs:
+ *
+ *	tl	The target list, which must be reading from a file
+ *
+ *	Returns:
+ *
+ *	1 if more ranges were read, or 0 at end of file.
+ *
+ *	Reads patterns until one gives at least one range, so that patterns
+ *	with host names that can't be resolved are skipped.  Also stops if
+ *	there are DNS_BACKLOG names waiting to be looked up, and returns 0
+ *	even though the file is still open.  The file is closed at the end.
+ *	The caller must hold the target list lock.
+ */
+static int
+target_read_more(target_list *tl) {
+   char line[MAXLINE];
+
+   tl->num_ranges = 0;
+   tl->cur_range = 0;
+   tl->cur_offset = 0;
+   while (tl->num_ranges == 0) {
+      if (tl->resolving >= DNS_BACKLOG)
+         return 0;
+      if (!target_read_line(tl->fp, line)) {
+         fclose(tl->fp);
+         tl->fp = NULL;
+         return 0;
+      }
+      target_add_pattern(tl, line);
+   }
+
+   return 1;
+}
+
+/*
+ *	target_open_file -- Read targets from a file on demand
+ *
+ *	Inputs:
+ *
+ *	tl	The target list, which must be empty
+ *	fp	The file, which must be seekable
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The targets in the file are counted, and the first pattern that
+ *	gives at least one target is loaded.  The file is closed when the
+ *	last pattern has been read.
+ */
+void
+target_open_file(target_list *tl, FILE *fp) {
+   tl->count = target_count_file(fp);
+   target_lock(tl);
+   tl->fp = fp;
+   target_read_more(tl);
+   target_unlock(tl);
+}
+
+/*
+ *	target_load_file -- Load all of the targets in a file
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *	fp	The file
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+target_load_file(target_list *tl, FILE *fp) {
+   char line[MAXLINE];
+
+   while (target_read_line(fp, line))
+      add_host_pattern(tl, line);
+}
+
+/*
+ *	target_resolve_wait -- Wait until all queued host names are looked up
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This is needed before the targets can be put in random order, because
+ *	that needs the final list of ranges.
+ */
+void
+target_resolve_wait(target_list *tl) {
+#ifdef USE_DNS_THREADS
+   target_lock(tl);
+   while (tl->resolving)
+      pthread_cond_wait(&tl->resolved, &tl->lock);
+   target_unlock(tl);
+#endif
+}
+
+/*
+ *	target_randomise -- Put the targets in random order
+ *
+ *	Inputs:
+ *
+ *	tl	The target list, which must have all of its ranges loaded
+ *		and no names waiting to be looked up
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Chooses the prime modulus, a random primitive root and a random
+ *	starting value for the cyclic group.  The random number generator
+ *	must have been seeded.
+ */
+void
+target_randomise(target_list *tl) {
+   IKE_UINT64 p;
+   IKE_UINT64 g;
+
+   for (p=(IKE_UINT64)tl->count+1; !is_prime(p); p++)
+      ;
+   if (p == 2) {
+      g = 1;
+   } else {
+      do {
+         g = 2 + genrand_int32() % (p - 2);	/* 2 <= g < p */
+      } while (!is_primitive_root(g, p));
+   }
+   tl->prime = p;
+   tl->root = g;
+   tl->elem = 1 + (((IKE_UINT64)genrand_int32() << 32) | genrand_int32()) %
+                  (p - 1);
+}
+
+/*
+ *	target_next -- Return the next target
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *	addr	Set to the target address
+ *	n	Set to the position of the target in the list, starting from 1
+ *
+ *	Returns:
+ *
+ *	1 if a target was returned, or 0 if there are no targets left.
+ *
+ *	This may be called from several threads at once.
+ */
+int
+target_next(target_list *tl, struct in_addr *addr, unsigned *n) {
+   target_range *r;
+   IKE_UINT64 index;
+   unsigned lo;
+   unsigned hi;
+   unsigned mid;
+
+   target_lock(tl);
+   if (tl->prime) {
+/*
+ *	Random order: take the next group element that gives a valid target
+ *	index, and find the range that contains it with a binary search on
+ *	the range start indexes.
+ */
+      if (tl->next >= tl->count) {
+         target_unlock(tl);
+         return 0;
+      }
+      do {
+         index = tl->elem - 1;
+         tl->elem = mul_mod(tl->elem, tl->root, tl->prime);
+      } while (index >= tl->count);
+      tl->next++;
+      lo = 0;
+      hi = tl->num_ranges - 1;
+      while (lo < hi) {
+         mid = lo + (hi - lo + 1) / 2;
+         if (tl->range[mid].start <= index)
+            lo = mid;
+         else
+            hi = mid - 1;
+      }
+      r = &tl->range[lo];
+      addr->s_addr = htonl(r->first + (uint32_t)(index - r->start));
+      *n = index + 1;
+   } else {
+/*
+ *	List order: return the next address in the current range.
+ */
+      while (tl->cur_range >= tl->num_ranges) {
+         if (tl->fp == NULL || !target_read_more(tl)) {
+            target_unlock(tl);
+            return 0;
+         }
+      }
+      r = &tl->range[tl->cur_range];
+      addr->s_addr = htonl(r->first + tl->cur_offset);
+      *n = ++tl->next;
+      if (r->first + tl->cur_offset == r->last) {
+         tl->cur_range++;
+         tl->cur_offset = 0;
+      } else {
+         tl->cur_offset++;
+      }
+   }
+   target_unlock(tl);
+
+   return 1;
+}
+
+/*
+ *	target_pending -- Check if there are any targets left
+ *
+ *	Inputs:
+ *
+ *	tl	The target list
+ *
+ *	Returns:
+ *
+ *	1 if target_next() may return another target, or 0 if not.
+ *
+ *	When reading from a file or looking up host names, the remaining
+ *	patterns may not give any targets, so target_next() can still return
+ *	0 after this returns 1.
+ */
+int
+target_pending(target_list *tl) {
+   int pending;
+
+   target_lock(tl);
+   if (tl->prime)
+      pending = tl->next < tl->count;
+   else
+      pending = tl->cur_range < tl->num_ranges || tl->fp != NULL ||
+                tl->resolving;
+   target_unlock(tl);
+
+   return pending;
+}
+
+/*
+ *	host_alloc -- Allocate a host entry from a pool
+ *
+ *	Inputs:
+ *
+ *	hp	The host entry pool
+ *
+ *	Returns:
+ *
+ *	Pointer to an unused host entry.  The contents are undefined except
+ *	that info points to the entry's host_info, in which num_recv is zero
+ *	and recv_more is NULL.
+ *
+ *	If there are no unused entries, another block of REALLOC_COUNT entries
+ *	is allocated, together with a block of REALLOC_COUNT host_info
+ *	structures for them.
+ */
+host_entry *
+host_alloc(host_pool *hp) {
+   host_entry *block;
+   host_info *info;
+   unsigned i;
+
+   if (!hp->num_free) {
+      block = Malloc(REALLOC_COUNT * sizeof(host_entry));
+      memset(block, '\0', REALLOC_COUNT * sizeof(host_entry));
+      info = Malloc(REALLOC_COUNT * sizeof(host_info));
+      memset(info, '\0', REALLOC_COUNT * sizeof(host_info));
+      hp->chunk = Realloc(hp->chunk,
+                          (hp->num_chunks + 1) * sizeof(host_entry *));
+      hp->info_chunk = Realloc(hp->info_chunk,
+                               (hp->num_chunks + 1) * sizeof(host_info *));
+      hp->chunk[hp->num_chunks] = block;
+      hp->info_chunk[hp->num_chunks++] = info;
+      hp->free_list = Realloc(hp->free_list, hp->num_chunks *
+                              REALLOC_COUNT * sizeof(host_entry *));
+      for (i=REALLOC_COUNT; i>0; i--) {
+         block[i-1].info = &info[i-1];
+         hp->free_list[hp->num_free++] = &block[i-1];
+      }
+   }
+
+   return hp->free_list[--hp->num_free];
+}
+
+/*
+ *	host_free -- Return a host entry to its pool
+ *
+ *	Inputs:
+ *
+ *	hp	The host entry pool that the entry was allocated from
+ *	he	The host entry
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Any blocks of receive times are returned to the pool.  The entry must
+ *	not be in a schedule or a cookie index.
+ */
+void
+host_free(host_pool *hp, host_entry *he) {
+   host_info *info = he->info;
+
+   if (info->recv_more != NULL) {
+      info->recv_last->next = hp->free_times;
+      hp->free_times = info->recv_more;
+      info->recv_more = NULL;
+      info->recv_last = NULL;
+   }
+   info->num_recv = 0;
+   hp->free_list[hp->num_free++] = he;
+}
+
+/*
+ *	host_add_recv_time -- Record the time that a packet was received
+ *
+ *	Inputs:
+ *
+ *	hp	The host entry pool that the entry was allocated from
+ *	he	The host entry
+ *	us	The time that the packet was received in microseconds
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The first RECV_TIMES_INLINE times are held in the host_info.  Later
+ *	times go in blocks of RECV_TIMES_BLOCK times which are taken from the
+ *	pool, and the host_info points to the last block so that a time can
+ *	be added without walking the times already recorded.  The blocks are
+ *	allocated TIME_BLOCK_SLAB at a time, and are reused once the host
+ *	entry is freed.
+ */
+void
+host_add_recv_time(host_pool *hp, host_entry *he, IKE_UINT64 us) {
+   host_info *info = he->info;
+   time_block *tb;
+   unsigned i;
+
+   if (info->num_recv == USHRT_MAX)	/* Counter is full */
+      return;
+   if (info->num_recv < RECV_TIMES_INLINE) {
+      info->recv_time[info->num_recv++] = us;
+      return;
+   }
+   i = (info->num_recv - RECV_TIMES_INLINE) % RECV_TIMES_BLOCK;
+   if (i == 0) {
+      if (hp->free_times == NULL) {
+         tb = Malloc(TIME_BLOCK_SLAB * sizeof(time_block));
+         for (i=0; i<TIME_BLOCK_SLAB; i++) {
+            tb[i].next = hp->free_times;
+            hp->free_times = &tb[i];
+         }
+         i = 0;
+      }
+      tb = hp->free_times;
+      hp->free_times = tb->next;
+      tb->next = NULL;
+      if (info->recv_more == NULL)
+         info->recv_more = tb;
+      else
+         info->recv_last->next = tb;
+      info->recv_last = tb;
+   }
+   info->recv_last->time[i] = us;
+   info->num_recv++;
+}
+
+/*
+ *	host_recv_times -- Copy the receive times for a host entry
+ *
+ *	Inputs:
+ *
+ *	he	The host entry
+ *	times	Array of at least he->info->num_recv elements to copy the
+ *		receive times into, in the order that they were added
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+host_recv_times(const host_entry *he, IKE_UINT64 *times) {
+   const host_info *info = he->info;
+   const time_block *tb;
+   unsigned i;
+   unsigned j;
+
+   for (i=0; i<info->num_recv && i<RECV_TIMES_INLINE; i++)
+      times[i] = info->recv_time[i];
+   for (tb=info->recv_more; tb != NULL; tb=tb->next) {
+      for (j=0; j<RECV_TIMES_BLOCK && i<info->num_recv; j++)
+         times[i++] = tb->time[j];
+   }
+}
@@ -339,74 +339,167 @@ numstr(unsigned num) {
 }
 
 /*
- *	printable -- Convert string to printable form using C-style escapes
+ *	out_reserve -- Make room for more characters in an output buffer
  *
  *	Inputs:
  *
- *	string	Pointer to input string.
- *	size	Size of input string.  0 means that string is null-terminated.
+ *	ob	The output buffer
+ *	n	Number of characters to make room for
  *
  *	Returns:
  *
- *	Pointer to the printable string.
+ *	None.
  *
- *	Any non-printable characters are replaced by C-Style escapes, e.g.
- *	"\n" for newline.  As a result, the returned string may be longer than
- *	the one supplied.
+ *	This ensures that there is room for n more characters plus the
+ *	trailing NULL.  The buffer at least doubles each time it grows, so
+ *	building a string costs a small number of allocations however many
+ *	pieces it is built from.
+ */
+static void
+out_reserve(out_buf *ob, size_t n) {
+   size_t size;
+
+   if (ob->len + n < ob->size)
+      return;
+   size = ob->size ? 2 * ob->size : OUT_BUF_SIZE;
+   while (size <= ob->len + n)
+      size *= 2;
+   ob->buf = Realloc(ob->buf, size);
+   ob->size = size;
+}
+
+/*
+ *	out_reset -- Empty an output buffer
  *
- *	This function makes two passes through the input string: one to
- *	determine the required output length, then a second to perform the
- *	conversion.
+ *	Inputs:
  *
- *	The pointer returned points to malloc'ed storage which should be
- *	free'ed by the caller when it's no longer needed.
+ *	ob	The output buffer
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The storage is kept, so a buffer that is reset for each result only
+ *	needs to allocate until it reaches the size of the longest result.
+ *	An out_buf initialised to all zero is an empty buffer with no storage.
  */
-char *
-printable(const unsigned char *string, size_t size) {
-   char *result;
-   char *r;
-   const unsigned char *cp;
-   size_t outlen;
-   unsigned i;
+void
+out_reset(out_buf *ob) {
+   out_reserve(ob, 0);
+   ob->len = 0;
+   ob->buf[0] = '\0';
+}
+
 /*
- *	If the input string is NULL, return an empty string.
+ *	out_append -- Append a string to an output buffer
+ *
+ *	Inputs:
+ *
+ *	ob	The output buffer
+ *	str	The null-terminated string to append
+ *
+ *	Returns:
+ *
+ *	None.
  */
-   if (string == NULL) {
-      result = Malloc(1);
-      result[0] = '\0';
-      return result;
-   }
+void
+out_append(out_buf *ob, const char *str) {
+   out_append_len(ob, str, strlen(str));
+}
+
 /*
- *	Determine required size of output string.
+ *	out_append_len -- Append characters to an output buffer
+ *
+ *	Inputs:
+ *
+ *	ob	The output buffer
+ *	data	The characters to append
+ *	n	Number of characters to append
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	data does not need to be null-terminated.
  */
-   if (!size)
-      size = strlen((const char *) string);
+void
+out_append_len(out_buf *ob, const char *data, size_t n) {
+   out_reserve(ob, n);
+   memcpy(ob->buf + ob->len, data, n);
+   ob->len += n;
+   ob->buf[ob->len] = '\0';
+}
 
-   outlen = size;
-   cp = string;
-   for (i=0; i<size; i++) {
-      switch (*cp) {
-         case '\\':
-         case '\b':
-         case '\f':
-         case '\n':
-         case '\r':
-         case '\t':
-         case '\v':
-            outlen++;
-            break;
-         default:
-            if(!isprint(*cp))
-               outlen += 3;
-      }
-      cp++;
+/*
+ *	out_printf -- Append formatted output to an output buffer
+ *
+ *	Inputs:
+ *
+ *	ob	The output buffer
+ *	fmt	printf() format string
+ *	...	Arguments for the format
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	This formats directly into the free space at the end of the buffer,
+ *	and only formats a second time if the output did not fit.
+ */
+void
+out_printf(out_buf *ob, const char *fmt, ...) {
+   va_list ap;
+   int n;
+
+   out_reserve(ob, 0);
+   va_start(ap, fmt);
+   n = vsnprintf(ob->buf + ob->len, ob->size - ob->len, fmt, ap);
+   va_end(ap);
+   if (n < 0)
+      err_sys("vsnprintf");
+   if ((size_t) n >= ob->size - ob->len) {
+      out_reserve(ob, n);
+      va_start(ap, fmt);
+      vsnprintf(ob->buf + ob->len, ob->size - ob->len, fmt, ap);
+      va_end(ap);
    }
-   outlen++;	/* One more for the ending NULL */
+   ob->len += n;
+}
 
-   result = Malloc(outlen);
+/*
+ *	out_printable -- Append a string to an output buffer in printable form
+ *
+ *	Inputs:
+ *
+ *	ob	The output buffer
+ *	string	Pointer to input string, or NULL for none.
+ *	size	Size of input string.  0 means that string is null-terminated.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Any non-printable characters are replaced by C-Style escapes, e.g.
+ *	"\n" for newline.  See printable().
+ */
+void
+out_printable(out_buf *ob, const unsigned char *string, size_t size) {
+   const unsigned char *cp;
+   char *r;
+   unsigned i;
 
+   if (string == NULL) {
+      out_reserve(ob, 0);
+      return;
+   }
+   if (!size)
+      size = strlen((const char *) string);
+/*
+ *	Each input character needs at most four output characters.
+ */
+   out_reserve(ob, 4 * size);
    cp = string;
-   r = result;
+   r = ob->buf + ob->len;
    for (i=0; i<size; i++) {
       switch (*cp) {
          case '\\':
@@ -450,8 +543,70 @@ printable(const unsigned char *string, size_t size) {
       cp++;
    }
    *r = '\0';
+   ob->len = r - ob->buf;
+}
 
-   return result;
+/*
+ *	out_hex -- Append data to an output buffer as a hex string
+ *
+ *	Inputs:
+ *
+ *	ob	The output buffer
+ *	data	Pointer to input data, or NULL for none.
+ *	size	Size of input data.
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	Each byte in the input data is represented by two lower case hex
+ *	digits.  See hexstring().
+ */
+void
+out_hex(out_buf *ob, const unsigned char *data, size_t size) {
+   static const char hex_digits[] = "0123456789abcdef";
+   char *r;
+   size_t i;
+
+   out_reserve(ob, 2 * size);
+   if (data == NULL)
+      return;
+   r = ob->buf + ob->len;
+   for (i=0; i<size; i++) {
+      *r++ = hex_digits[data[i] >> 4];
+      *r++ = hex_digits[data[i] & 0x0f];
+   }
+   *r = '\0';
+   ob->len += 2 * size;
+}
+
+/*
+ *	printable -- Convert string to printable form using C-style escapes
+ *
+ *	Inputs:
+ *
+ *	string	Pointer to input string.
+ *	size	Size of input string.  0 means that string is null-terminated.
+ *
+ *	Returns:
+ *
+ *	Pointer to the printable string.
+ *
+ *	Any non-printable characters are replaced by C-Style escapes, e.g.
+ *	"\n" for newline.  As a result, the returned string may be longer than
+ *	the one supplied.
+ *
+ *	The pointer returned points to malloc'ed storage which should be
+ *	free'ed by the caller when it's no longer needed.
+ */
+char *
+printable(const unsigned char *string, size_t size) {
+   out_buf ob = {NULL, 0, 0};
+
+   out_reset(&ob);
+   out_printable(&ob, string, size);
+
+   return ob.buf;
 }
 
 /*
@@ -475,31 +630,12 @@ printable(const unsigned char *string, size_t size) {
  */
 char *
 hexstring(const unsigned char *data, size_t size) {
-   char *result;
-   char *r;
-   const unsigned char *cp;
-   unsigned i;
-/*
- *	If the input data is NULL, return an empty string.
- */
-   if (data == NULL) {
-      result = Malloc(1);
-      result[0] = '\0';
-      return result;
-   }
-/*
- *	Create and return hex string.
- */
-   result = Malloc(2*size + 1);
-   cp = data;
-   r = result;
-   for (i=0; i<size; i++) {
-      snprintf(r, 3, "%.2x", *cp++);
-      r += 2;
-   }
-   *r = '\0';
+   out_buf ob = {NULL, 0, 0};
 
-   return result;
+   out_reset(&ob);
+   out_hex(&ob, data, size);
+
+   return ob.buf;
 }
 
 /*
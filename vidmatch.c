@@ -0,0 +1,747 @@
+/*
+ * The IKE Scanner (ike-scan) is Copyright (C) 2003-2013 Roy Hills,
+ * NTA Monitor Ltd.
+ *
+ * This file is part of ike-scan.
+ *
+ * ike-scan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ike-scan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ike-scan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library, and distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.
+ *
+ * If this license is unacceptable to you, I may be willing to negotiate
+ * alternative licenses (contact ike-scan@nta-monitor.com).
+ *
+ * You are encouraged to submit comments, improvements or suggestions
+ * at the github repository https://github.com/royhills/ike-scan
+ *
+ * vidmatch.c -- Vendor ID pattern matching for ike-scan
+ *
+ * Date: 16 October 2026
+ *
+ * The Vendor ID patterns are Posix extended regular expressions that are
+ * matched against the Vendor ID in hex, and the name of the first pattern
+ * in the file that matches is displayed.  Nearly all of the patterns are
+ * a "^" followed by a fixed hex prefix, which may be followed by some "."
+ * characters and a "$" to set the length.  Trying each pattern in turn
+ * with regexec() is slow when there are hundreds of patterns.
+ *
+ * vid_matcher_build() compiles these prefix patterns into a trie on the
+ * raw Vendor ID bytes, so the Vendor ID can be matched without converting
+ * it to hex, in time that depends on the Vendor ID length rather than the
+ * number of patterns.  A prefix with an odd number of hex digits ends at
+ * the node for the whole bytes, and the final digit is checked against
+ * the high nibble of the next byte.  Any other patterns are kept in a
+ * fallback list and are matched with regexec() as before, but only if the
+ * Vendor ID starts with the fixed hex prefix of the pattern, if it has one.
+ *
+ * Several patterns can match the same Vendor ID, so the pattern number in
+ * file order is stored with each pattern, and the lowest numbered match is
+ * returned.  The fallback patterns are only tried if their number is lower
+ * than the best trie match, so the result is always the same as trying
+ * every pattern in file order.
+ *
+ * The matcher is built as a single image, with arrays that refer to each
+ * other by index and strings that are referred to by offset, so that it
+ * can be saved in the compiled pattern database and used directly from
+ * the mapped file.  vid_matcher_attach() checks that an image is
+ * consistent before it is used, because the database may be damaged.
+ */
+
+#include "ike-scan.h"
+
+#define VID_IMAGE_MAGIC 0x56494431	/* "VID1" */
+
+/*
+ *	The image starts with this header.  The offsets are from the start of
+ *	the image, and each array starts on an 8 byte boundary.
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t size;		/* Size of the whole image */
+   uint32_t num_nodes;
+   uint32_t num_edges;
+   uint32_t num_terms;
+   uint32_t num_patterns;
+   uint32_t num_fallback;
+   uint32_t strings_len;
+   uint32_t off_node;
+   uint32_t off_keys;
+   uint32_t off_child;
+   uint32_t off_term;
+   uint32_t off_name;
+   uint32_t off_pattern;
+   uint32_t off_fallback;
+   uint32_t off_strings;
+} vid_image_header;
+
+/*
+ *	Trie node used while building, before the nodes are laid out in
+ *	breadth first order.
+ */
+typedef struct {
+   unsigned char *keys;		/* Next Vendor ID byte for each child, sorted */
+   unsigned *child;		/* Node number of each child */
+   unsigned num_child;
+   vid_trie_term *term;		/* Patterns that end at this node */
+   unsigned num_term;
+} build_node;
+
+typedef struct {
+   build_node *node;
+   unsigned num_nodes;
+   vid_fallback *fallback;
+   unsigned num_fallback;
+   out_buf strings;
+} build_state;
+
+/*
+ *	hex_value -- Return the value of a hex digit
+ *
+ *	Inputs:
+ *
+ *	c	The character
+ *
+ *	Returns:
+ *
+ *	The value of the hex digit, or -1 if c is not a hex digit.
+ */
+static int
+hex_value(int c) {
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
+}
+
+/*
+ *	add_string -- Add a string to the string table
+ *
+ *	Inputs:
+ *
+ *	b	The build state
+ *	str	The string
+ *	len	The length of the string
+ *
+ *	Returns:
+ *
+ *	The offset of the string in the table.
+ */
+static uint32_t
+add_string(build_state *b, const char *str, size_t len) {
+   uint32_t offset = b->strings.len;
+
+   out_append_len(&b->strings, str, len);
+   out_append_len(&b->strings, "", 1);	/* Keep the terminating null */
+
+   return offset;
+}
+
+/*
+ *	trie_child -- Find or add the child of a trie node
+ *
+ *	Inputs:
+ *
+ *	b	The build state
+ *	n	The node number
+ *	key	The Vendor ID byte for the child
+ *
+ *	Returns:
+ *
+ *	The node number of the child.
+ *
+ *	The children of each node are kept sorted by key, so that they can
+ *	be found with a binary search.
+ */
+static unsigned
+trie_child(build_state *b, unsigned n, unsigned char key) {
+   build_node *node = &b->node[n];
+   unsigned i;
+   unsigned child;
+
+   for (i=0; i<node->num_child && node->keys[i] < key; i++)
+      ;
+   if (i < node->num_child && node->keys[i] == key)
+      return node->child[i];
+
+   child = b->num_nodes++;
+   b->node = Realloc(b->node, b->num_nodes * sizeof(build_node));
+   memset(&b->node[child], '\0', sizeof(build_node));
+   node = &b->node[n];
+   node->keys = Realloc(node->keys, node->num_child + 1);
+   node->child = Realloc(node->child, (node->num_child + 1) * sizeof(unsigned));
+   memmove(node->keys + i + 1, node->keys + i, node->num_child - i);
+   memmove(node->child + i + 1, node->child + i,
+           (node->num_child - i) * sizeof(unsigned));
+   node->keys[i] = key;
+   node->child[i] = child;
+   node->num_child++;
+
+   return child;
+}
+
+/*
+ *	trie_add -- Add a Vendor ID pattern to the trie if possible
+ *
+ *	Inputs:
+ *
+ *	b	The build state
+ *	pattern	The text regular expression
+ *	num	The pattern number
+ *
+ *	Returns:
+ *
+ *	1 if the pattern was added, or 0 if it needs regexec().
+ *
+ *	The pattern must be "^", then any number of hex digits, then any
+ *	number of ".", then an optional "$".
+ */
+static int
+trie_add(build_state *b, const char *pattern, unsigned num) {
+   const char *p;
+   size_t digits;
+   size_t dots;
+   int exact;
+   unsigned n;
+   build_node *node;
+   vid_trie_term *term;
+
+   if (*pattern != '^')
+      return 0;
+   for (p=pattern+1; hex_value(*p) >= 0; p++)
+      ;
+   digits = p - (pattern+1);
+   for (dots=0; *p == '.'; p++)
+      dots++;
+   exact = (*p == '$');
+   if (exact)
+      p++;
+   if (*p != '\0')
+      return 0;
+
+   n = 0;
+   for (p=pattern+1; p+1 < pattern+1+digits; p+=2)
+      n = trie_child(b, n, (hex_value(p[0]) << 4) | hex_value(p[1]));
+   node = &b->node[n];
+   node->term = Realloc(node->term,
+                        (node->num_term + 1) * sizeof(vid_trie_term));
+   term = &node->term[node->num_term++];
+   term->pattern = num;
+   term->nibble = (digits % 2) ? hex_value(pattern[digits]) : -1;
+   term->hex_len = digits + dots;
+   term->exact = exact;
+
+   return 1;
+}
+
+/*
+ *	fallback_add -- Add a pattern to the fallback list
+ *
+ *	Inputs:
+ *
+ *	b	The build state
+ *	pattern	The text regular expression
+ *	num	The pattern number
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	If the pattern starts with "^" and some hex digits, these digits are
+ *	saved as a prefix that the hex Vendor ID must start with.  The last
+ *	digit is not included if it is followed by a repeat, and there is no
+ *	prefix if the pattern contains alternatives.
+ */
+static void
+fallback_add(build_state *b, const char *pattern, unsigned num) {
+   vid_fallback *fb;
+   char prefix[MAXLINE];
+   size_t len;
+   size_t i;
+
+   len = 0;
+   if (*pattern == '^' && strchr(pattern, '|') == NULL) {
+      while (len < sizeof(prefix) - 1 && hex_value(pattern[1+len]) >= 0)
+         len++;
+      if (len && strchr("*+?{", pattern[1+len]) != NULL)
+         len--;
+   }
+   for (i=0; i<len; i++)
+      prefix[i] = tolower((unsigned char) pattern[1+i]);
+
+   b->fallback = Realloc(b->fallback,
+                         (b->num_fallback + 1) * sizeof(vid_fallback));
+   fb = &b->fallback[b->num_fallback++];
+   fb->pattern = num;
+   fb->prefix = add_string(b, prefix, len);
+   fb->prefix_len = len;
+}
+
+/*
+ *	image_array -- Add an array to a matcher image
+ *
+ *	Inputs:
+ *
+ *	ob	The image
+ *	data	The array
+ *	len	The size of the array in bytes
+ *
+ *	Returns:
+ *
+ *	The offset of the array in the image.
+ */
+static uint32_t
+image_array(out_buf *ob, const void *data, size_t len) {
+   static const char zero[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+   uint32_t offset;
+
+   if (ob->len % 8)
+      out_append_len(ob, zero, 8 - ob->len % 8);
+   offset = ob->len;
+   if (len)
+      out_append_len(ob, data, len);
+
+   return offset;
+}
+
+/*
+ *	vid_matcher_image -- Compile a Vendor ID pattern list into an image
+ *
+ *	Inputs:
+ *
+ *	vidlist	The list of Vendor ID patterns
+ *	ob	The output buffer to put the image in
+ *
+ *	Returns:
+ *
+ *	None.
+ *
+ *	The image can be passed to vid_matcher_attach(), or saved in the
+ *	compiled pattern database.  It does not refer to vidlist.
+ */
+void
+vid_matcher_image(vid_pattern_list *vidlist, out_buf *ob) {
+   build_state b;
+   vid_image_header hdr;
+   vid_pattern_list *pe;
+   vid_trie_node *node;
+   unsigned char *keys;
+   uint32_t *child;
+   vid_trie_term *term;
+   uint32_t *name;
+   uint32_t *pattern;
+   unsigned *order;	/* Old node number of each new node */
+   unsigned num_order;
+   unsigned num_edges;
+   unsigned num_terms;
+   unsigned num_patterns;
+   unsigned i;
+   unsigned j;
+   const build_node *bn;
+/*
+ *	Build the trie, and the list of patterns that need regexec().
+ */
+   memset(&b, '\0', sizeof(b));
+   b.num_nodes = 1;
+   b.node = Malloc(sizeof(build_node));
+   memset(b.node, '\0', sizeof(build_node));
+   add_string(&b, "", 0);	/* The string table is never empty */
+   num_patterns = 0;
+   for (pe=vidlist; pe != NULL; pe=pe->next)
+      num_patterns++;
+   name = Malloc((num_patterns + 1) * sizeof(uint32_t));
+   pattern = Malloc((num_patterns + 1) * sizeof(uint32_t));
+   for (pe=vidlist, i=0; pe != NULL; pe=pe->next, i++) {
+      name[i] = add_string(&b, pe->name, strlen(pe->name));
+      pattern[i] = add_string(&b, pe->pattern, strlen(pe->pattern));
+      if (!trie_add(&b, pe->pattern, i))
+         fallback_add(&b, pe->pattern, i);
+   }
+/*
+ *	Lay out the nodes in breadth first order, so that the children of
+ *	each node are next to each other in the keys and child arrays.
+ */
+   node = Malloc(b.num_nodes * sizeof(vid_trie_node));
+   keys = Malloc(b.num_nodes);
+   child = Malloc(b.num_nodes * sizeof(uint32_t));
+   term = Malloc((num_patterns + 1) * sizeof(vid_trie_term));
+   order = Malloc(b.num_nodes * sizeof(unsigned));
+   order[0] = 0;
+   num_order = 1;
+   num_edges = 0;
+   num_terms = 0;
+   for (i=0; i<num_order; i++) {
+      bn = &b.node[order[i]];
+      node[i].first_child = num_edges;
+      node[i].num_child = bn->num_child;
+      for (j=0; j<bn->num_child; j++) {
+         keys[num_edges] = bn->keys[j];
+         child[num_edges++] = num_order;
+         order[num_order++] = bn->child[j];
+      }
+      node[i].first_term = num_terms;
+      node[i].num_term = bn->num_term;
+      if (bn->num_term) {
+         memcpy(term + num_terms, bn->term,
+                bn->num_term * sizeof(vid_trie_term));
+         num_terms += bn->num_term;
+      }
+   }
+/*
+ *	Write the image.
+ */
+   memset(&hdr, '\0', sizeof(hdr));
+   out_reset(ob);
+   image_array(ob, &hdr, sizeof(hdr));
+   hdr.magic = VID_IMAGE_MAGIC;
+   hdr.num_nodes = b.num_nodes;
+   hdr.num_edges = num_edges;
+   hdr.num_terms = num_terms;
+   hdr.num_patterns = num_patterns;
+   hdr.num_fallback = b.num_fallback;
+   hdr.strings_len = b.strings.len;
+   hdr.off_node = image_array(ob, node, num_order * sizeof(vid_trie_node));
+   hdr.off_keys = image_array(ob, keys, num_edges);
+   hdr.off_child = image_array(ob, child, num_edges * sizeof(uint32_t));
+   hdr.off_term = image_array(ob, term, num_terms * sizeof(vid_trie_term));
+   hdr.off_name = image_array(ob, name, num_patterns * sizeof(uint32_t));
+   hdr.off_pattern = image_array(ob, pattern, num_patterns * sizeof(uint32_t));
+   hdr.off_fallback = image_array(ob, b.fallback,
+                                  b.num_fallback * sizeof(vid_fallback));
+   hdr.off_strings = image_array(ob, b.strings.buf, b.strings.len);
+   image_array(ob, NULL, 0);	/* Pad to a multiple of 8 bytes */
+   hdr.size = ob->len;
+   memcpy(ob->buf, &hdr, sizeof(hdr));
+
+   for (i=0; i<b.num_nodes; i++) {
+      free(b.node[i].keys);
+      free(b.node[i].child);
+      free(b.node[i].term);
+   }
+   free(b.node);
+   free(b.fallback);
+   free(b.strings.buf);
+   free(node);
+   free(keys);
+   free(child);
+   free(term);
+   free(name);
+   free(pattern);
+   free(order);
+}
+
+/*
+ *	image_ok -- Check that an array is within an image
+ *
+ *	Inputs:
+ *
+ *	offset	The offset of the array
+ *	count	The number of elements
+ *	size	The size of each element
+ *	len	The size of the image
+ *
+ *	Returns:
+ *
+ *	Nonzero if the array is aligned and within the image.
+ */
+static int
+image_ok(uint32_t offset, uint32_t count, size_t size, size_t len) {
+   return offset % 8 == 0 && offset <= len &&
+          (IKE_UINT64) count * size <= len - offset;
+}
+
+/*
+ *	vid_matcher_attach -- Make a Vendor ID matcher from an image
+ *
+ *	Inputs:
+ *
+ *	image	The image from vid_matcher_image(), aligned to 8 bytes
+ *	len	The number of bytes available at image
+ *	mem	Memory to free with the matcher, or NULL
+ *
+ *	Returns:
+ *
+ *	A pointer to the new matcher, or NULL if the image is not valid.
+ *
+ *	The matcher uses the image in place, so it must not be changed or
+ *	freed while the matcher is in use.  Only the fallback patterns are
+ *	compiled with regcomp().
+ */
+vid_matcher *
+vid_matcher_attach(const void *image, size_t len, void *mem) {
+   const char *base = image;
+   vid_image_header hdr;
+   vid_matcher *m;
+   unsigned i;
+
+   if (len < sizeof(hdr))
+      return NULL;
+   memcpy(&hdr, image, sizeof(hdr));
+   if (hdr.magic != VID_IMAGE_MAGIC || hdr.size > len || hdr.num_nodes < 1 ||
+       hdr.strings_len < 1 ||
+       !image_ok(hdr.off_node, hdr.num_nodes, sizeof(vid_trie_node), len) ||
+       !image_ok(hdr.off_keys, hdr.num_edges, 1, len) ||
+       !image_ok(hdr.off_child, hdr.num_edges, sizeof(uint32_t), len) ||
+       !image_ok(hdr.off_term, hdr.num_terms, sizeof(vid_trie_term), len) ||
+       !image_ok(hdr.off_name, hdr.num_patterns, sizeof(uint32_t), len) ||
+       !image_ok(hdr.off_pattern, hdr.num_patterns, sizeof(uint32_t), len) ||
+       !image_ok(hdr.off_fallback, hdr.num_fallback, sizeof(vid_fallback),
+                 len) ||
+       !image_ok(hdr.off_strings, hdr.strings_len, 1, len))
+      return NULL;
+
+   m = Malloc(sizeof(vid_matcher));
+   m->node = (const vid_trie_node *) (base + hdr.off_node);
+   m->num_nodes = hdr.num_nodes;
+   m->keys = (const unsigned char *) (base + hdr.off_keys);
+   m->child = (const uint32_t *) (base + hdr.off_child);
+   m->num_edges = hdr.num_edges;
+   m->term = (const vid_trie_term *) (base + hdr.off_term);
+   m->num_terms = hdr.num_terms;
+   m->name = (const uint32_t *) (base + hdr.off_name);
+   m->pattern = (const uint32_t *) (base + hdr.off_pattern);
+   m->num_patterns = hdr.num_patterns;
+   m->fallback = (const vid_fallback *) (base + hdr.off_fallback);
+   m->num_fallback = hdr.num_fallback;
+   m->strings = base + hdr.off_strings;
+   m->strings_len = hdr.strings_len;
+   m->regex = NULL;
+   m->mem = NULL;
+/*
+ *	Check that all of the indexes and offsets are in range, so that
+ *	matching can't go outside the image.
+ */
+   if (m->strings[m->strings_len - 1] != '\0')
+      goto invalid;
+   for (i=0; i<m->num_nodes; i++) {
+      if (m->node[i].first_child > m->num_edges ||
+          m->node[i].num_child > m->num_edges - m->node[i].first_child ||
+          m->node[i].first_term > m->num_terms ||
+          m->node[i].num_term > m->num_terms - m->node[i].first_term)
+         goto invalid;
+   }
+   for (i=0; i<m->num_edges; i++) {
+      if (m->child[i] >= m->num_nodes)
+         goto invalid;
+   }
+   for (i=0; i<m->num_terms; i++) {
+      if (m->term[i].pattern >= m->num_patterns || m->term[i].nibble > 15)
+         goto invalid;
+   }
+   for (i=0; i<m->num_patterns; i++) {
+      if (m->name[i] >= m->strings_len || m->pattern[i] >= m->strings_len)
+         goto invalid;
+   }
+   for (i=0; i<m->num_fallback; i++) {
+      if (m->fallback[i].pattern >= m->num_patterns ||
+          m->fallback[i].prefix >= m->strings_len ||
+          m->fallback[i].prefix_len > m->strings_len - 1 -
+                                      m->fallback[i].prefix)
+         goto invalid;
+   }
+/*
+ *	Compile the patterns that need regexec().
+ */
+   m->regex = Malloc((m->num_fallback + 1) * sizeof(regex_t));
+   for (i=0; i<m->num_fallback; i++) {
+      if (regcomp(&m->regex[i], m->strings + m->pattern[m->fallback[i].pattern],
+                  REG_EXTENDED|REG_ICASE|REG_NOSUB) != 0) {
+         while (i > 0)
+            regfree(&m->regex[--i]);
+         goto invalid;
+      }
+   }
+   m->mem = mem;
+
+   return m;
+
+invalid:
+   free(m->regex);
+   free(m);
+   return NULL;
+}
+
+/*
+ *	vid_matcher_build -- Compile a Vendor ID pattern list
+ *
+ *	Inputs:
+ *
+ *	vidlist	The list of Vendor ID patterns
+ *
+ *	Returns:
+ *
+ *	A pointer to the new matcher.
+ */
+vid_matcher *
+vid_matcher_build(vid_pattern_list *vidlist) {
+   out_buf ob = {NULL, 0, 0};
+   vid_matcher *m;
+
+   vid_matcher_image(vidlist, &ob);
+   if ((m = vid_matcher_attach(ob.buf, ob.len, ob.buf)) == NULL)
+      err_msg("ERROR: Could not build the Vendor ID matcher");
+
+   return m;
+}
+
+/*
+ *	prefix_match -- Check if a Vendor ID starts with a hex prefix
+ *
+ *	Inputs:
+ *
+ *	vid		The Vendor ID
+ *	len		The length of the Vendor ID in bytes
+ *	prefix		The lower case hex prefix
+ *	prefix_len	The number of hex digits in the prefix
+ *
+ *	Returns:
+ *
+ *	Nonzero if the Vendor ID starts with the prefix.
+ */
+static int
+prefix_match(const unsigned char *vid, size_t len, const char *prefix,
+             size_t prefix_len) {
+   size_t i;
+   unsigned digit;
+
+   if (prefix_len > 2*len)
+      return 0;
+   for (i=0; i<prefix_len; i++) {
+      digit = (i % 2) ? vid[i/2] & 0x0f : vid[i/2] >> 4;
+      if ((int) digit != hex_value(prefix[i]))
+         return 0;
+   }
+   return 1;
+}
+
+/*
+ *	vid_matcher_match -- Find the first pattern that matches a Vendor ID
+ *
+ *	Inputs:
+ *
+ *	m	The Vendor ID matcher, or NULL for no patterns
+ *	vid	The Vendor ID
+ *	len	The length of the Vendor ID in bytes
+ *	hexvid	The Vendor ID in hex, or NULL if the caller doesn't have it
+ *
+ *	Returns:
+ *
+ *	The name of the first pattern that matches, or NULL if none match.
+ *
+ *	The hex Vendor ID is only needed for the fallback patterns, and is
+ *	built here if it is needed and was not given.
+ */
+const char *
+vid_matcher_match(const vid_matcher *m, const unsigned char *vid, size_t len,
+                  const char *hexvid) {
+   static out_buf hexbuf;
+   const vid_trie_node *node;
+   const vid_trie_term *term;
+   const unsigned char *keys;
+   uint32_t best = UINT32_MAX;
+   size_t depth;
+   unsigned lo;
+   unsigned hi;
+   unsigned mid;
+   unsigned i;
+/*
+ *	Follow the Vendor ID bytes down the trie, checking the patterns that
+ *	end at each node on the way.
+ */
+   if (m == NULL)
+      return NULL;
+   node = &m->node[0];
+   depth = 0;
+   while (1) {
+      term = m->term + node->first_term;
+      for (i=0; i<node->num_term; i++) {
+         if (term[i].pattern < best &&
+             (term[i].exact ? 2*len == term[i].hex_len :
+                              2*len >= term[i].hex_len) &&
+             (term[i].nibble < 0 ||
+              (depth < len && (vid[depth] >> 4) == term[i].nibble)))
+            best = term[i].pattern;
+      }
+      if (depth == len)
+         break;
+      keys = m->keys + node->first_child;
+      lo = 0;
+      hi = node->num_child;
+      while (lo < hi) {
+         mid = (lo + hi) / 2;
+         if (keys[mid] < vid[depth])
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      if (lo == node->num_child || keys[lo] != vid[depth])
+         break;
+      node = &m->node[m->child[node->first_child + lo]];
+      depth++;
+   }
+/*
+ *	Try any fallback patterns that come before the best match so far.
+ */
+   for (i=0; i<m->num_fallback && m->fallback[i].pattern < best; i++) {
+      if (!prefix_match(vid, len, m->strings + m->fallback[i].prefix,
+                        m->fallback[i].prefix_len))
+         continue;
+      if (hexvid == NULL) {
+         out_reset(&hexbuf);
+         out_hex(&hexbuf, vid, len);
+         hexvid = hexbuf.buf;
+      }
+      if (!(regexec(&m->regex[i], hexvid, 0, NULL, 0))) {
+         best = m->fallback[i].pattern;
+         break;
+      }
+   }
+
+   return best == UINT32_MAX ? NULL : m->strings + m->name[best];
+}
+
+/*
+ *	vid_matcher_free -- Free a Vendor ID matcher
+ *
+ *	Inputs:
+ *
+ *	m	The Vendor ID matcher
+ *
+ *	Returns:
+ *
+ *	None.
+ */
+void
+vid_matcher_free(vid_matcher *m) {
+   unsigned i;
+
+   if (m == NULL)
+      return;
+   for (i=0; i<m->num_fallback; i++)
+      regfree(&m->regex[i]);
+   free(m->regex);
+   free(m->mem);
+   free(m);
+}